@@ -0,0 +1,19 @@
+// World space irradiance cache, see src/rendering/IrradianceCache.h. Keep
+// both in sync. Expects the irradianceEntries buffer, mapSize and
+// brickGridSize.
+
+#define FACES_PER_BRICK 6u
+
+// The cached light of the face a hit is in front of
+vec3 irradianceLookup(vec3 position, vec3 normal) {
+    ivec3 voxel = ivec3(floor(position - 0.5 * normal));
+    if (any(lessThan(voxel, ivec3(0))) || any(greaterThanEqual(voxel, ivec3(mapSize)))) {
+        return vec3(0);
+    }
+
+    int axis = normal.x != 0 ? 0 : normal.y != 0 ? 1 : 2;
+    uint face = uint(axis) * 2u + (normal[axis] > 0 ? 1u : 0u);
+    uvec3 brick = uvec3(voxel) / BRICK_SIZE;
+    uint brickIndex = (brick.z * brickGridSize.y + brick.y) * brickGridSize.x + brick.x;
+    return irradianceEntries[brickIndex * FACES_PER_BRICK + face].rgb;
+}
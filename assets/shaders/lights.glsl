@@ -0,0 +1,60 @@
+// Emissive voxel sampling, see src/rendering/Lights.h. Keep both in sync.
+// Expects the lights buffer and numLights.
+
+struct LightSample {
+    vec3 position;
+    vec3 normal;
+    uvec3 voxel;
+    uint paletteIndex;
+    // Per area, including picking the light. 0 if there was nothing to sample.
+    float pdf;
+};
+
+LightSample sampleLight(vec3 point, vec2 u, vec2 v) {
+    LightSample lightSample;
+    lightSample.pdf = 0;
+    if (numLights == 0u) {
+        return lightSample;
+    }
+
+    // The fraction of u.x left after picking an entry decides about the alias
+    float scaled = u.x * float(numLights);
+    uint index = min(uint(scaled), numLights - 1u);
+    if (scaled - float(index) >= lights[index].probability) {
+        index = lights[index].alias;
+    }
+    EmissiveLight light = lights[index];
+
+    // At most one face per axis faces the point
+    vec3 voxelMin = vec3(light.x, light.y, light.z);
+    vec3 normals[3];
+    int numFaces = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        vec3 normal = vec3(0);
+        if (point[axis] > voxelMin[axis] + 1) {
+            normal[axis] = 1;
+            normals[numFaces++] = normal;
+        } else if (point[axis] < voxelMin[axis]) {
+            normal[axis] = -1;
+            normals[numFaces++] = normal;
+        }
+    }
+    if (numFaces == 0) {
+        return lightSample;
+    }
+
+    vec3 normal = normals[min(int(u.y * float(numFaces)), numFaces - 1)];
+    int axis = normal.x != 0 ? 0 : normal.y != 0 ? 1 : 2;
+    vec3 position = voxelMin;
+    position[axis] += normal[axis] > 0 ? 1.0 : 0.0;
+    position[(axis + 1) % 3] += v.x;
+    position[(axis + 2) % 3] += v.y;
+
+    lightSample.position = position;
+    lightSample.normal = normal;
+    lightSample.voxel = uvec3(light.x, light.y, light.z);
+    lightSample.paletteIndex = light.paletteIndex;
+    // Faces have an area of 1
+    lightSample.pdf = light.pdf / float(numFaces);
+    return lightSample;
+}
@@ -0,0 +1,62 @@
+// Two level occupancy pyramid, see src/rendering/Occupancy.h
+#define BRICK_SIZE 4
+#define COARSE_CELL_SIZE 16
+
+bool brickOccupied(uvec3 cell) {
+    uint index = (cell.z * brickGridSize.y + cell.y) * brickGridSize.x + cell.x;
+    return ((brickBits[index >> 5] >> (index & 31u)) & 1u) != 0u;
+}
+
+bool coarseCellOccupied(uvec3 cell) {
+    uint index = (cell.z * coarseGridSize.y + cell.y) * coarseGridSize.x + cell.x;
+    return ((coarseBits[index >> 5] >> (index & 31u)) & 1u) != 0u;
+}
+
+// Moves dda to the last voxel of the cell it is in before the ray leaves it
+void advanceThroughCell(inout DDA dda, float cellSize) {
+    vec3 cellMin = floor(dda.pos / cellSize) * cellSize;
+
+    vec3 inside;
+    float exitDist = uintBitsToFloat(0x7f800000u);
+    for (int axis = 0; axis < 3; ++axis) {
+        inside[axis] = dda.rayStep[axis] > 0
+            ? cellMin[axis] + cellSize - 1 - dda.pos[axis]
+            : dda.pos[axis] - cellMin[axis];
+
+        float axisExit = inside[axis] > 0
+            ? dda.sideDist[axis] + inside[axis] * dda.deltaDist[axis]
+            : dda.sideDist[axis];
+        if (axisExit < exitDist) {
+            exitDist = axisExit;
+        }
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+        if (dda.sideDist[axis] < exitDist) {
+            float crossings = min(ceil((exitDist - dda.sideDist[axis]) / dda.deltaDist[axis]), inside[axis]);
+            dda.sideDist[axis] += crossings * dda.deltaDist[axis];
+            dda.pos[axis] += crossings * dda.rayStep[axis];
+        }
+    }
+}
+
+// Skips the empty coarse cell or brick dda.pos lies in, if any
+bool skipEmptyCell(inout DDA dda) {
+    if (!enableEmptySpaceSkipping) {
+        return false;
+    }
+
+    uvec3 voxel = uvec3(dda.pos);
+
+    if (!coarseCellOccupied(voxel / uint(COARSE_CELL_SIZE))) {
+        advanceThroughCell(dda, COARSE_CELL_SIZE);
+        return true;
+    }
+
+    if (!brickOccupied(voxel / uint(BRICK_SIZE))) {
+        advanceThroughCell(dda, BRICK_SIZE);
+        return true;
+    }
+
+    return false;
+}
@@ -1,12 +1,19 @@
 #version 440 core
 
 uniform sampler2D renderTexture;
+// Part of renderTexture the voxel shader rendered, from its origin. It is
+// stretched over the window, the bilinear filter does the upscaling.
+uniform vec2 renderSize;
 
 out vec4 color;
 in vec2 textureCoord;
 
 void main() {
-    color = vec4(texture(renderTexture, textureCoord).xyz, 1);
-    //color.xyz = vec3(texture(renderTexture, textureCoord).w / 150);
+    // Half a texel inside the rendered part, so the edges do not blend in
+    // stale texels from beyond it
+    vec2 texel = clamp(textureCoord * renderSize, vec2(0.5), renderSize - 0.5);
+    vec2 uv = texel / vec2(textureSize(renderTexture, 0));
+    color = vec4(texture(renderTexture, uv).xyz, 1);
+    //color.xyz = vec3(texture(renderTexture, uv).w / 150);
     //color.w = 1;
-}
\ No newline at end of file
+}
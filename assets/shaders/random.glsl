@@ -15,27 +15,21 @@ float randomFloat(inout uint state) {
     return float(wangHash(state)) / 4294967296.0;
 }
 
-vec3 randomUnitVector(ivec2 outputCoords, int offset) {
-    ivec3 noiseSize = imageSize(noiseArray);
-    vec2 noiseSample = imageLoad(noiseArray, ivec3(ivec3(outputCoords, offset) + randomness) % noiseSize).rg;
-
-    float z = noiseSample.r * 2.0f - 1.0f;
-    float a = noiseSample.g * twoPi;
+// Uniform directions from a 2D sample in [0, 1)^2, see sampler.glsl
+vec3 randomUnitVector(vec2 u) {
+    float z = u.x * 2.0f - 1.0f;
+    float a = u.y * twoPi;
     float r = sqrt(1.0f - z * z);
     float x = r * cos(a);
     float y = r * sin(a);
     return vec3(x, y, z);
 }
 
-vec3 randomInHemisphere(ivec2 outputCoords, int offset, vec3 normal) {
-    vec3 inUnitSphere = randomUnitVector(outputCoords, offset);
+vec3 randomInHemisphere(vec2 u, vec3 normal) {
+    vec3 inUnitSphere = randomUnitVector(u);
     if (dot(inUnitSphere, normal) > 0) {
         return inUnitSphere;
     } else {
         return -inUnitSphere;
     }
 }
-
-uint randomSeed(vec2 outputCoords, uint frame) {
-    return uint(outputCoords.x) * 1973 + uint(outputCoords.y) * 9277 + frameCount * 26699 | 1;
-}
\ No newline at end of file
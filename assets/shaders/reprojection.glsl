@@ -0,0 +1,45 @@
+// Temporal reprojection: carries accumulated samples over camera moves by
+// looking up where the surface seen by a pixel was in the previous frame.
+#define LOCAL_SIZE 10
+
+// New samples of the work group, for clamping history to their neighborhood
+shared vec3 groupSamples[LOCAL_SIZE][LOCAL_SIZE];
+
+// Pixel of the previous frame that saw samplePos, a world position for hits
+// (w = 1) or a direction for sky (w = 0). Negative when off screen.
+ivec2 previousPixel(vec4 samplePos, ivec2 screenSize) {
+    vec4 clip = prevProjection * prevView * samplePos;
+    if (clip.w <= 0) {
+        return ivec2(-1);
+    }
+    vec2 ndc = clip.xy / clip.w;
+    ivec2 pixel = ivec2(floor((ndc * 0.5 + 0.5) * vec2(screenSize)));
+    if (any(lessThan(pixel, ivec2(0))) || any(greaterThanEqual(pixel, screenSize))) {
+        return ivec2(-1);
+    }
+    return pixel;
+}
+
+// Whether the history pixel saw the same surface, from its stored depth
+bool historyMatches(vec4 samplePos, float historyDepth) {
+    if (samplePos.w == 0) {
+        return historyDepth == 0;
+    }
+    float expectedDepth = length(samplePos.xyz - prevCameraPos);
+    return historyDepth > 0 && abs(historyDepth - expectedDepth) < 0.02 * expectedDepth + 0.5;
+}
+
+// Range of the new samples around this invocation's pixel, within the work
+// group and the rendered pixels
+void neighborhoodRange(out vec3 minColor, out vec3 maxColor) {
+    ivec2 local = ivec2(gl_LocalInvocationID.xy);
+    ivec2 last = min(ivec2(LOCAL_SIZE), renderSize - ivec2(gl_WorkGroupID.xy) * LOCAL_SIZE) - 1;
+    minColor = vec3(1);
+    maxColor = vec3(0);
+    for (int y = max(local.y - 1, 0); y <= min(local.y + 1, last.y); ++y) {
+        for (int x = max(local.x - 1, 0); x <= min(local.x + 1, last.x); ++x) {
+            minColor = min(minColor, groupSamples[y][x]);
+            maxColor = max(maxColor, groupSamples[y][x]);
+        }
+    }
+}
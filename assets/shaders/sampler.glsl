@@ -0,0 +1,90 @@
+// Low discrepancy samples, see src/rendering/Sampler.h. Keep both in sync.
+// Expects samplerType and, for SAMPLER_BLUE_NOISE, the blueNoise image.
+
+// SamplerType
+#define SAMPLER_RANDOM 0
+#define SAMPLER_SOBOL 1
+#define SAMPLER_R2 2
+#define SAMPLER_BLUE_NOISE 3
+
+// Dimension pairs, path vertex n takes three from vertexDimension(n) on
+#define SAMPLE_JITTER 0u
+#define SAMPLE_LIGHT_CHOICE 0u
+#define SAMPLE_LIGHT_POINT 1u
+#define SAMPLE_BOUNCE 2u
+
+uint vertexDimension(uint vertex) {
+    return 1u + 3u * vertex;
+}
+
+float toUnitFloat(uint bits) {
+    return float(bits >> 8) * (1.0 / 16777216.0);
+}
+
+uint hashUint(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+uint hashCombine(uint seed, uint value) {
+    return hashUint(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+uint nestedUniformScramble(uint x, uint seed) {
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return bitfieldReverse(x);
+}
+
+uint sobolSecond(uint index) {
+    uint result = 0u;
+    for (uint direction = 1u << 31; index != 0u; index >>= 1, direction ^= direction >> 1) {
+        if ((index & 1u) != 0u) {
+            result ^= direction;
+        }
+    }
+    return result;
+}
+
+vec2 sobol2D(uint index, uint seed) {
+    uint shuffled = nestedUniformScramble(index, hashCombine(seed, 0u));
+    uint x = nestedUniformScramble(bitfieldReverse(shuffled), hashCombine(seed, 1u));
+    uint y = nestedUniformScramble(sobolSecond(shuffled), hashCombine(seed, 2u));
+    return vec2(toUnitFloat(x), toUnitFloat(y));
+}
+
+vec2 r2(uint index, uint seed) {
+    uint x = hashCombine(seed, 0u) + index * 0xc13fa9a9u;
+    uint y = hashCombine(seed, 1u) + index * 0x91e10da5u;
+    return vec2(toUnitFloat(x), toUnitFloat(y));
+}
+
+uint pixelSeed(uvec2 pixel, uint dimension) {
+    return hashCombine(hashCombine(hashUint(pixel.x), pixel.y), dimension);
+}
+
+vec2 sample2D(uvec2 pixel, uint sampleIndex, uint dimension) {
+    if (samplerType == SAMPLER_RANDOM) {
+        uint x = hashCombine(pixelSeed(pixel, dimension), sampleIndex);
+        return vec2(toUnitFloat(x), toUnitFloat(hashUint(x)));
+    }
+    if (samplerType == SAMPLER_R2) {
+        return r2(sampleIndex, pixelSeed(pixel, dimension));
+    }
+    if (samplerType == SAMPLER_BLUE_NOISE) {
+        uvec3 noiseSize = uvec3(imageSize(blueNoise));
+        uint offset = hashUint(dimension / noiseSize.z);
+        uvec2 texel = (pixel + uvec2(offset, offset >> 16)) % noiseSize.xy;
+        uint rank = uint(imageLoad(blueNoise, ivec3(texel, dimension % noiseSize.z)).r * 255.0 + 0.5);
+        return sobol2D(sampleIndex ^ rank, hashUint(dimension));
+    }
+    return sobol2D(sampleIndex, pixelSeed(pixel, dimension));
+}
@@ -0,0 +1,20 @@
+// Baked sun shadows, see src/rendering/SunVisibility.h. Keep both in sync.
+// Expects the sunVisibilityBits buffer, baked for sunDir, and mapSize.
+
+// Whether the sun reaches a hit, from its position a little in front of the
+// face it hit and its normal
+bool hitLit(vec3 position, vec3 normal) {
+    int axis = normal.x != 0 ? 0 : normal.y != 0 ? 1 : 2;
+    // Faces turned away from the sun are in their own shadow
+    if (normal[axis] * sunDir[axis] <= 0) {
+        return false;
+    }
+
+    ivec3 voxel = ivec3(floor(position - 0.5 * normal));
+    if (any(lessThan(voxel, ivec3(0))) || any(greaterThanEqual(voxel, ivec3(mapSize)))) {
+        return false;
+    }
+    uint index = (uint(voxel.z) * mapSize.y + uint(voxel.y)) * mapSize.x + uint(voxel.x);
+    uint bit = index * 4u + uint(axis);
+    return ((sunVisibilityBits[bit >> 5] >> (bit & 31u)) & 1u) != 0u;
+}
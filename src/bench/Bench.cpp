@@ -0,0 +1,514 @@
+// draft_bench: headless benchmarks of scene loading, CPU traversal and
+// acceleration structure builds for every scene in a directory. Results go to
+// stdout (or --out) as JSON, progress to stderr.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "../commands/Arguments.h"
+#include "../rendering/Camera.h"
+#include "../rendering/CpuTracer.h"
+#include "../rendering/Denoiser.h"
+#include "../rendering/IrradianceCache.h"
+#include "../rendering/Model.h"
+#include "../rendering/Occupancy.h"
+#include "../rendering/PacketTracer.h"
+#include "../rendering/RayQuery.h"
+#include "../rendering/SunVisibility.h"
+#include "../rendering/VoxelDag.h"
+#include "../rendering/VoxelEdit.h"
+#include "../util/ThreadPool.h"
+
+namespace {
+    // Bump when metrics are renamed or change meaning, so comparisons
+    // against older result files can tell
+    constexpr int benchFormatVersion = 1;
+
+    struct BenchOptions {
+        std::filesystem::path assetDir = "assets/vox";
+        std::string filter;
+        int repeats = 5;
+        int warmups = 1;
+        int raysPerAxis = 256;
+        unsigned numThreads = std::thread::hardware_concurrency();
+        VoxelLayout layout = VoxelLayout::Linear;
+        std::string outputPath;
+    };
+
+    // Summary of the repeats of one metric
+    struct Stats {
+        explicit Stats(std::vector<double> values) : samples(std::move(values)) {
+            std::vector<double> sorted = samples;
+            std::sort(sorted.begin(), sorted.end());
+
+            size_t n = sorted.size();
+            min = sorted.front();
+            max = sorted.back();
+            median = n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+
+            for (double value : sorted) {
+                mean += value;
+            }
+            mean /= double(n);
+
+            double sumSquares = 0;
+            for (double value : sorted) {
+                sumSquares += (value - mean) * (value - mean);
+            }
+            stddev = n > 1 ? std::sqrt(sumSquares / double(n - 1)) : 0.0;
+        }
+
+        std::vector<double> samples;
+        double mean = 0;
+        double stddev = 0;
+        double min = 0;
+        double median = 0;
+        double max = 0;
+    };
+
+    struct Metric {
+        std::string name;
+        std::string unit;
+        // Whether a larger value is an improvement, for regression checks
+        bool higherIsBetter;
+        Stats stats;
+    };
+
+    struct SceneResult {
+        std::string name;
+        glm::uvec3 size{0};
+        size_t fileBytes = 0;
+        size_t solidVoxels = 0;
+        std::vector<Metric> metrics;
+    };
+
+    double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Runs f warmups + repeats times and returns the durations of the repeats in ms
+    template<typename F>
+    std::vector<double> timeRepeats(BenchOptions const& options, F&& f) {
+        std::vector<double> times;
+        for (int i = 0; i < options.warmups + options.repeats; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            f();
+            double ms = elapsedMs(start);
+            if (i >= options.warmups) {
+                times.push_back(ms);
+            }
+        }
+        return times;
+    }
+
+    std::vector<double> perSecond(std::vector<double> const& timesMs, double count) {
+        std::vector<double> rates;
+        for (double ms : timesMs) {
+            rates.push_back(ms > 0 ? count / (ms / 1000.0) : 0.0);
+        }
+        return rates;
+    }
+
+    // Fixed views around the scene, so runs are comparable: the default view
+    // of the interactive mode, one from the opposite side and one from above
+    std::vector<Camera> benchCameras(Model const& model, int raysPerAxis) {
+        glm::vec3 size{model.size};
+        glm::vec3 center = size / 2.0f;
+        return {
+                Camera{glm::vec3{-1, 0.5f, -1} * size, center, raysPerAxis, raysPerAxis},
+                Camera{glm::vec3{2, 0.75f, 1.5f} * size, center, raysPerAxis, raysPerAxis},
+                Camera{center + glm::vec3{0.1f, 1.5f, 0.2f} * size, center, raysPerAxis, raysPerAxis},
+        };
+    }
+
+    // The first hit of every camera ray, the starting points of the shadow
+    // and bounce rays
+    struct PrimaryHits {
+        std::vector<VoxelHit> hits;
+        size_t numHits = 0;
+    };
+
+    PrimaryHits tracePrimary(CpuTracer const& tracer, std::vector<Camera> const& cameras, int raysPerAxis,
+                             ThreadPool& pool) {
+        PrimaryHits primary;
+        primary.hits.resize(cameras.size() * raysPerAxis * raysPerAxis);
+        glm::ivec2 screenSize{raysPerAxis};
+
+        pool.parallelFor(cameras.size() * raysPerAxis, [&](size_t row) {
+            Camera const& camera = cameras[row / raysPerAxis];
+            int y = int(row % raysPerAxis);
+            for (int x = 0; x < raysPerAxis; ++x) {
+                glm::vec3 rayPos;
+                glm::vec3 rayDir;
+                tracer.cameraRay(camera, {x, y}, screenSize, tracer.pixelSampler({x, y}, 0), rayPos, rayDir);
+
+                VoxelHit& hit = primary.hits[row * raysPerAxis + x];
+                if (tracer.enterVoxelBox(rayPos, rayDir)) {
+                    hit = tracer.traceVoxel(rayPos, rayDir);
+                }
+            }
+        });
+
+        for (VoxelHit const& hit : primary.hits) {
+            primary.numHits += hit.hit;
+        }
+        return primary;
+    }
+
+    size_t traceShadows(CpuTracer const& tracer, PrimaryHits const& primary, ThreadPool& pool) {
+        std::atomic<size_t> shadowed{0};
+        size_t chunk = 4096;
+        pool.parallelFor((primary.hits.size() + chunk - 1) / chunk, [&](size_t index) {
+            size_t end = std::min(primary.hits.size(), (index + 1) * chunk);
+            size_t count = 0;
+            for (size_t i = index * chunk; i < end; ++i) {
+                if (primary.hits[i].hit) {
+                    count += tracer.hitIsShadowed(primary.hits[i]);
+                }
+            }
+            shadowed += count;
+        });
+        return shadowed;
+    }
+
+    // One diffuse bounce per primary hit, the rays the GI loop of
+    // shadePrimaryHit traces
+    size_t traceBounces(CpuTracer const& tracer, PrimaryHits const& primary, ThreadPool& pool) {
+        std::atomic<size_t> bounceHits{0};
+        size_t chunk = 4096;
+        pool.parallelFor((primary.hits.size() + chunk - 1) / chunk, [&](size_t index) {
+            size_t end = std::min(primary.hits.size(), (index + 1) * chunk);
+            size_t count = 0;
+            for (size_t i = index * chunk; i < end; ++i) {
+                VoxelHit const& hit = primary.hits[i];
+                if (hit.hit) {
+                    glm::vec2 u = sobol2D(uint32_t(i), vertexDimension(0) + bounceDimension);
+                    glm::vec3 rayDir = hit.normal + randomInHemisphere(u, hit.normal);
+                    count += tracer.traceVoxel(hit.position, rayDir).hit;
+                }
+            }
+            bounceHits += count;
+        });
+        return bounceHits;
+    }
+
+    SceneResult benchScene(std::filesystem::path const& path, BenchOptions const& options, ThreadPool& pool) {
+        SceneResult result;
+        result.name = path.filename().string();
+        result.fileBytes = std::filesystem::file_size(path);
+
+        Model model;
+        std::vector<double> loadTimes = timeRepeats(options, [&] {
+            model = loadVoxModel(path.string(), options.layout);
+        });
+        result.size = model.size;
+        for (uint32_t z = 0; z < model.size.z; ++z) {
+            for (uint32_t y = 0; y < model.size.y; ++y) {
+                for (uint32_t x = 0; x < model.size.x; ++x) {
+                    result.solidVoxels += model.isSolid({x, y, z});
+                }
+            }
+        }
+
+        double voxels = double(model.size.x) * model.size.y * model.size.z;
+        result.metrics.push_back({"load_ms", "ms", false, Stats(loadTimes)});
+        result.metrics.push_back({"load_mb_per_s", "MB/s", true, Stats(perSecond(loadTimes, double(result.fileBytes) / 1e6))});
+        result.metrics.push_back({"load_mvoxels_per_s", "Mvoxels/s", true, Stats(perSecond(loadTimes, voxels / 1e6))});
+
+        result.metrics.push_back({"build_occupancy_ms", "ms", false, Stats(timeRepeats(options, [&] {
+            model.occupancy = buildOccupancyPyramid(model);
+        }))});
+
+        VoxelDag dag;
+        result.metrics.push_back({"build_dag_ms", "ms", false, Stats(timeRepeats(options, [&] {
+            dag = buildVoxelDag(model);
+        }))});
+
+        VoxelLayout otherLayout = model.layout == VoxelLayout::Linear ? VoxelLayout::Bricked : VoxelLayout::Linear;
+        result.metrics.push_back({"convert_layout_ms", "ms", false, Stats(timeRepeats(options, [&] {
+            Model converted = convertLayout(model, otherLayout);
+        }))});
+
+        // Fills a 16^3 box in the middle of a copy of the map and clears it
+        // again, which should cost the same whatever the size of the map
+        Model edited = model;
+        VoxelEditor editor(edited);
+        glm::uvec3 boxMin = model.size / 2u - glm::min(model.size / 2u, glm::uvec3(8));
+        glm::uvec3 boxMax = boxMin + 16u;
+        size_t editBytes = 0;
+        result.metrics.push_back({"edit_box_ms", "ms", false, Stats(timeRepeats(options, [&] {
+            editor.fillBox(boxMin, boxMax, 1);
+            editor.clearBox(boxMin, boxMax);
+            ModelEdits const& edits = editor.edits();
+            editBytes = edits.indices.bytes() + edits.solid.bytes() +
+                        edits.brickOccupancy.bytes() + edits.coarseOccupancy.bytes();
+            editor.edits().clear();
+        }))});
+        result.metrics.push_back({"edit_box_upload_kb", "KB", false, Stats({editBytes / 1024.0})});
+
+        RenderSettings settings;
+        settings.enableRayRandomization = false;
+        std::vector<Camera> cameras = benchCameras(model, options.raysPerAxis);
+        double numRays = double(cameras.size()) * options.raysPerAxis * options.raysPerAxis;
+
+        auto benchTraversal = [&](std::string const& prefix, CpuTracer const& tracer) {
+            PrimaryHits primary;
+            std::vector<double> primaryTimes = timeRepeats(options, [&] {
+                primary = tracePrimary(tracer, cameras, options.raysPerAxis, pool);
+            });
+            std::vector<double> shadowTimes = timeRepeats(options, [&] { traceShadows(tracer, primary, pool); });
+            std::vector<double> bounceTimes = timeRepeats(options, [&] { traceBounces(tracer, primary, pool); });
+
+            // Shadow and bounce rays only start from primary hits
+            double numSecondary = double(primary.numHits);
+            result.metrics.push_back({prefix + "primary_mrays_per_s", "Mrays/s", true, Stats(perSecond(primaryTimes, numRays / 1e6))});
+            result.metrics.push_back({prefix + "shadow_mrays_per_s", "Mrays/s", true, Stats(perSecond(shadowTimes, numSecondary / 1e6))});
+            result.metrics.push_back({prefix + "bounce_mrays_per_s", "Mrays/s", true, Stats(perSecond(bounceTimes, numSecondary / 1e6))});
+            result.metrics.push_back({prefix + "primary_hit_rate", "ratio", true, Stats({numRays > 0 ? numSecondary / numRays : 0.0})});
+        };
+
+        CpuTracer tracer(model, settings);
+        benchTraversal("", tracer);
+
+        CpuTracer dagTracer(model, settings);
+        dagTracer.m_dag = &dag;
+        benchTraversal("dag_", dagTracer);
+
+        // Sun shadows baked per exposed face and looked up per hit, and the
+        // re-bake after the edit above
+        SunVisibility sunVisibility;
+        result.metrics.push_back({"bake_sun_visibility_ms", "ms", false, Stats(timeRepeats(options, [&] {
+            sunVisibility = bakeSunVisibility(tracer, pool);
+        }))});
+        CpuTracer cachedTracer(model, settings);
+        cachedTracer.m_sunVisibility = &sunVisibility;
+        PrimaryHits cachedPrimary = tracePrimary(cachedTracer, cameras, options.raysPerAxis, pool);
+        std::vector<double> cachedShadowTimes = timeRepeats(options, [&] {
+            traceShadows(cachedTracer, cachedPrimary, pool);
+        });
+        result.metrics.push_back({"sun_cache_shadow_mlookups_per_s", "Mlookups/s", true,
+                                  Stats(perSecond(cachedShadowTimes, double(cachedPrimary.numHits) / 1e6))});
+
+        // One update of every entry of the irradiance cache, with baked sun
+        // shadows
+        IrradianceCache irradianceCache(model);
+        result.metrics.push_back({"irradiance_cache_pass_ms", "ms", false, Stats(timeRepeats(options, [&] {
+            irradianceCache.update(cachedTracer, irradianceCache.entries().size(), pool);
+        }))});
+
+        // The denoiser over a one sample render from the first camera, the
+        // copy of the image it filters in place is timed along
+        int imageSize = options.raysPerAxis;
+        GBuffer gbuffer;
+        Image noisy = cachedTracer.render(cameras.front(), imageSize, imageSize, pool, 32, nullptr, &gbuffer);
+        std::vector<double> denoiseTimes = timeRepeats(options, [&] {
+            Image denoised = noisy;
+            denoise(denoised, gbuffer, DenoiseSettings{}, pool);
+        });
+        result.metrics.push_back({"denoise_mpixels_per_s", "Mpixels/s", true,
+                                  Stats(perSecond(denoiseTimes, double(imageSize) * imageSize / 1e6))});
+
+        CpuTracer editedTracer(edited, settings);
+        SunVisibility editedVisibility = bakeSunVisibility(editedTracer, pool);
+        result.metrics.push_back({"edit_box_sun_rebake_ms", "ms", false, Stats(timeRepeats(options, [&] {
+            editor.fillBox(boxMin, boxMax, 1);
+            rebakeSunVisibility(editedVisibility, editedTracer, boxMin, boxMax, pool);
+            editor.clearBox(boxMin, boxMax);
+            rebakeSunVisibility(editedVisibility, editedTracer, boxMin, boxMax, pool);
+            editor.edits().clear();
+        }))});
+
+        // Line of sight between random points of the map, as game logic asks
+        size_t numQueries = size_t(options.raysPerAxis) * options.raysPerAxis;
+        std::vector<glm::vec3> origins(numQueries);
+        std::vector<glm::vec3> directions(numQueries);
+        std::vector<float> distances(numQueries);
+        uint32_t rngState = 1;
+        auto randomPoint = [&] {
+            glm::vec3 unit{randomFloat(rngState), randomFloat(rngState), randomFloat(rngState)};
+            return unit * glm::vec3(model.size);
+        };
+        for (size_t i = 0; i < numQueries; ++i) {
+            origins[i] = randomPoint();
+            directions[i] = randomPoint() - origins[i];
+            distances[i] = glm::length(directions[i]);
+        }
+
+        RayQuery query(model);
+        RayBatch batch{origins, directions, distances};
+        std::vector<RayQueryHit> queryHits(numQueries);
+        std::vector<uint8_t> occluded(numQueries);
+        std::vector<double> closestTimes = timeRepeats(options, [&] { query.closestHit(batch, queryHits, &pool); });
+        std::vector<double> anyTimes = timeRepeats(options, [&] { query.anyHit(batch, occluded, &pool); });
+        result.metrics.push_back({"query_closest_mrays_per_s", "Mrays/s", true, Stats(perSecond(closestTimes, numQueries / 1e6))});
+        result.metrics.push_back({"query_any_mrays_per_s", "Mrays/s", true, Stats(perSecond(anyTimes, numQueries / 1e6))});
+
+        return result;
+    }
+
+    std::string jsonString(std::string const& value) {
+        std::ostringstream out;
+        out << '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (uint8_t(c) < 0x20) {
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+        return out.str();
+    }
+
+    void writeJson(std::ostream& out, BenchOptions const& options, unsigned numThreads,
+                   std::vector<SceneResult> const& results) {
+        out << std::setprecision(6);
+        out << "{\n";
+        out << "  \"version\": " << benchFormatVersion << ",\n";
+        out << "  \"config\": {\"repeats\": " << options.repeats << ", \"warmups\": " << options.warmups
+            << ", \"rays_per_view\": " << options.raysPerAxis * options.raysPerAxis
+            << ", \"threads\": " << numThreads
+            << ", \"layout\": " << jsonString(options.layout == VoxelLayout::Linear ? "linear" : "bricked")
+            << ", \"simd\": " << jsonString(simdLevelName(activeSimdLevel())) << "},\n";
+        out << "  \"scenes\": [";
+
+        for (size_t i = 0; i < results.size(); ++i) {
+            SceneResult const& scene = results[i];
+            out << (i ? ",\n" : "\n");
+            out << "    {\n";
+            out << "      \"name\": " << jsonString(scene.name) << ",\n";
+            out << "      \"size\": [" << scene.size.x << ", " << scene.size.y << ", " << scene.size.z << "],\n";
+            out << "      \"file_bytes\": " << scene.fileBytes << ",\n";
+            out << "      \"solid_voxels\": " << scene.solidVoxels << ",\n";
+            out << "      \"metrics\": {";
+
+            for (size_t j = 0; j < scene.metrics.size(); ++j) {
+                Metric const& metric = scene.metrics[j];
+                Stats const& stats = metric.stats;
+                out << (j ? ",\n" : "\n");
+                out << "        " << jsonString(metric.name) << ": {"
+                    << "\"unit\": " << jsonString(metric.unit)
+                    << ", \"higher_is_better\": " << (metric.higherIsBetter ? "true" : "false")
+                    << ", \"mean\": " << stats.mean
+                    << ", \"stddev\": " << stats.stddev
+                    << ", \"cv\": " << (stats.mean != 0 ? stats.stddev / std::abs(stats.mean) : 0.0)
+                    << ", \"min\": " << stats.min
+                    << ", \"median\": " << stats.median
+                    << ", \"max\": " << stats.max
+                    << ", \"samples\": [";
+                for (size_t k = 0; k < stats.samples.size(); ++k) {
+                    out << (k ? ", " : "") << stats.samples[k];
+                }
+                out << "]}";
+            }
+            out << "\n      }\n";
+            out << "    }";
+        }
+
+        out << "\n  ]\n";
+        out << "}\n";
+    }
+
+    void printUsage() {
+        std::cerr << "Usage: draft_bench [options]\n"
+                     "  --assets <dir>       Directory of .vox scenes (default assets/vox)\n"
+                     "  --filter <text>      Only scenes whose file name contains text\n"
+                     "  --repeats <n>        Measured runs per metric (default 5)\n"
+                     "  --warmups <n>        Unmeasured runs before them (default 1)\n"
+                     "  --rays <n>           n x n rays per camera view (default 256)\n"
+                     "  --layout <name>      Voxel storage: linear (default) or bricked\n"
+                     "  --threads <n>        Worker threads (default: all cores)\n"
+                     "  --out <file.json>    Write the results there instead of stdout\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        Arguments args(argc - 1, argv + 1);
+        BenchOptions options;
+
+        while (!args.empty()) {
+            std::string option = args.next("option");
+
+            if (option == "--assets") {
+                options.assetDir = args.next(option);
+            } else if (option == "--filter") {
+                options.filter = args.next(option);
+            } else if (option == "--repeats") {
+                options.repeats = args.nextInt(option);
+            } else if (option == "--warmups") {
+                options.warmups = args.nextInt(option);
+            } else if (option == "--rays") {
+                options.raysPerAxis = args.nextInt(option);
+            } else if (option == "--layout") {
+                options.layout = parseVoxelLayout(args.next(option));
+            } else if (option == "--threads") {
+                options.numThreads = args.nextInt(option);
+            } else if (option == "--out") {
+                options.outputPath = args.next(option);
+            } else if (option == "--help") {
+                printUsage();
+                return 0;
+            } else {
+                printUsage();
+                throw std::runtime_error("Unknown option: " + option);
+            }
+        }
+
+        if (options.repeats <= 0 || options.warmups < 0 || options.raysPerAxis <= 0) {
+            throw std::runtime_error("Repeats and rays must be positive, warmups not negative");
+        }
+
+        std::vector<std::filesystem::path> scenes;
+        for (auto const& entry : std::filesystem::directory_iterator(options.assetDir)) {
+            std::string name = entry.path().filename().string();
+            if (entry.path().extension() == ".vox" && name.find(options.filter) != std::string::npos) {
+                scenes.push_back(entry.path());
+            }
+        }
+        std::sort(scenes.begin(), scenes.end());
+
+        if (scenes.empty()) {
+            throw std::runtime_error("No .vox scenes found in " + options.assetDir.string());
+        }
+
+        ThreadPool pool(options.numThreads);
+        std::vector<SceneResult> results;
+
+        for (auto const& scene : scenes) {
+            std::cerr << "Benchmarking " << scene.filename().string() << "..." << std::flush;
+            auto start = std::chrono::steady_clock::now();
+            results.push_back(benchScene(scene, options, pool));
+            std::cerr << " " << std::fixed << std::setprecision(0) << elapsedMs(start) << " ms" << std::endl;
+        }
+
+        if (options.outputPath.empty()) {
+            writeJson(std::cout, options, pool.size(), results);
+        } else {
+            std::ofstream out(options.outputPath);
+            if (!out.is_open()) {
+                throw std::runtime_error("Failed to open " + options.outputPath);
+            }
+            writeJson(out, options, pool.size(), results);
+        }
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../rendering/Model.h"
+#include "../rendering/Sampler.h"
+
+// Minimal "--name value" style argument reader for the headless commands.
+struct Arguments {
+    Arguments(int argc, char* argv[]) : args(argv, argv + argc) {}
+
+    bool empty() const { return index >= args.size(); }
+
+    std::string next(std::string const& what) {
+        if (empty()) {
+            throw std::runtime_error("Missing argument: " + what);
+        }
+        return args[index++];
+    }
+
+    int nextInt(std::string const& what) {
+        std::string value = next(what);
+        try {
+            return std::stoi(value);
+        } catch (std::exception const&) {
+            throw std::runtime_error("Expected integer for " + what + ", got: " + value);
+        }
+    }
+
+    float nextFloat(std::string const& what) {
+        std::string value = next(what);
+        try {
+            return std::stof(value);
+        } catch (std::exception const&) {
+            throw std::runtime_error("Expected number for " + what + ", got: " + value);
+        }
+    }
+
+    // Parses "x,y,z"
+    glm::vec3 nextVec3(std::string const& what) {
+        std::string value = next(what);
+        glm::vec3 result;
+        size_t start = 0;
+        for (int i = 0; i < 3; ++i) {
+            size_t end = value.find(',', start);
+            if ((end == std::string::npos) != (i == 2)) {
+                throw std::runtime_error("Expected x,y,z for " + what + ", got: " + value);
+            }
+            result[i] = std::stof(value.substr(start, end - start));
+            start = end + 1;
+        }
+        return result;
+    }
+
+    std::vector<std::string> args;
+    size_t index = 0;
+};
+
+inline VoxelLayout parseVoxelLayout(std::string const& name) {
+    if (name == "linear") {
+        return VoxelLayout::Linear;
+    }
+    if (name == "bricked") {
+        return VoxelLayout::Bricked;
+    }
+    throw std::runtime_error("Unknown voxel layout: " + name);
+}
+
+inline SamplerType parseSamplerType(std::string const& name) {
+    for (SamplerType type : {SamplerType::Random, SamplerType::Sobol, SamplerType::R2, SamplerType::BlueNoise}) {
+        if (name == samplerName(type)) {
+            return type;
+        }
+    }
+    throw std::runtime_error("Unknown sampler: " + name);
+}
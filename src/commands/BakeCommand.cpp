@@ -0,0 +1,61 @@
+#include "Commands.h"
+
+#include <chrono>
+#include <iostream>
+
+#include "Arguments.h"
+#include "../rendering/BakedScene.h"
+#include "../rendering/Model.h"
+#include "../rendering/VoxelDag.h"
+
+static void printUsage() {
+    std::cerr << "Usage: draft --bake <scene.vox> <out.vxc> [options]\n"
+                 "  --layout <name>      Voxel storage: linear (default) or bricked\n"
+                 "  --dag                Also store a sparse voxel DAG for --render --dag\n";
+}
+
+int runBakeCommand(int argc, char* argv[]) {
+    Arguments args(argc, argv);
+
+    if (args.args.size() < 2) {
+        printUsage();
+        return 1;
+    }
+
+    std::string scenePath = args.next("scene");
+    std::string outputPath = args.next("output");
+
+    VoxelLayout layout = VoxelLayout::Linear;
+    bool bakeDag = false;
+
+    while (!args.empty()) {
+        std::string option = args.next("option");
+
+        if (option == "--layout") {
+            layout = parseVoxelLayout(args.next(option));
+        } else if (option == "--dag") {
+            bakeDag = true;
+        } else {
+            printUsage();
+            throw std::runtime_error("Unknown option: " + option);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Model model = loadVoxModel(scenePath, layout);
+
+    VoxelDag dag;
+    if (bakeDag) {
+        dag = buildVoxelDag(model);
+    }
+
+    writeBakedScene(outputPath, model, bakeDag ? &dag : nullptr);
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "Baked " << scenePath << " (" << model.size.x << "x" << model.size.y << "x" << model.size.z
+              << (bakeDag ? ", with DAG" : "") << ") in "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms -> " << outputPath
+              << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// Headless command line modes of the draft executable. Each one receives the
+// arguments following its flag and returns the process exit code.
+
+// draft --render <scene.vox|scene.vxc> <out.png> [options]
+int runRenderCommand(int argc, char* argv[]);
+
+// draft --render-worker <address> [options], started by draft --render --workers
+int runRenderWorkerCommand(int argc, char* argv[]);
+
+// draft --serve <address> [options]
+int runServeCommand(int argc, char* argv[]);
+
+// draft --sequence <scene.vox|scene.vxc> <path.json> <out_####.png> [options]
+int runSequenceCommand(int argc, char* argv[]);
+
+// draft --dag-stats <scene.vox>...
+int runDagStatsCommand(int argc, char* argv[]);
+
+// draft --bake <scene.vox> <out.vxc> [options]
+int runBakeCommand(int argc, char* argv[]);
+
+// draft --stream <scene.vox|scene.vxc> <out.png> [options]
+int runStreamCommand(int argc, char* argv[]);
+
+// draft --preprocess <shader> [--hash]
+int runPreprocessCommand(int argc, char* argv[]);
@@ -0,0 +1,67 @@
+#include "Commands.h"
+
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+
+#include "Arguments.h"
+#include "../rendering/Model.h"
+#include "../rendering/VoxelDag.h"
+
+// Compares linear, bricked and DAG storage for every scene given on the command line
+int runDagStatsCommand(int argc, char* argv[]) {
+    Arguments args(argc, argv);
+
+    if (args.empty()) {
+        std::cerr << "Usage: draft --dag-stats <scene.vox>..." << std::endl;
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(28) << "asset"
+              << std::right << std::setw(16) << "size"
+              << std::setw(12) << "voxels"
+              << std::setw(12) << "dense KiB"
+              << std::setw(12) << "bricked KiB"
+              << std::setw(12) << "dag KiB"
+              << std::setw(8) << "ratio"
+              << std::setw(12) << "octree"
+              << std::setw(12) << "unique"
+              << std::setw(12) << "build ms" << std::endl;
+
+    while (!args.empty()) {
+        std::string scenePath = args.next("scene");
+        Model model = loadVoxModel(scenePath);
+
+        size_t solidVoxels = 0;
+        for (uint32_t z = 0; z < model.size.z; ++z) {
+            for (uint32_t y = 0; y < model.size.y; ++y) {
+                for (uint32_t x = 0; x < model.size.x; ++x) {
+                    solidVoxels += model.isSolid({x, y, z});
+                }
+            }
+        }
+
+        DagBuildStats stats;
+        VoxelDag dag = buildVoxelDag(model, &stats);
+
+        double denseKiB = double(denseModelBytes(model)) / 1024.0;
+        double brickedKiB = double(denseModelBytes(convertLayout(model, VoxelLayout::Bricked))) / 1024.0;
+        double dagKiB = double(dag.sizeBytes()) / 1024.0;
+        std::string size = std::to_string(model.size.x) + "x" + std::to_string(model.size.y) + "x" +
+                           std::to_string(model.size.z);
+
+        std::cout << std::left << std::setw(28) << std::filesystem::path(scenePath).filename().string()
+                  << std::right << std::setw(16) << size
+                  << std::setw(12) << solidVoxels
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(12) << denseKiB
+                  << std::setw(12) << brickedKiB
+                  << std::setw(12) << dagKiB
+                  << std::setw(8) << (dagKiB > 0 ? denseKiB / dagKiB : 0.0)
+                  << std::setw(12) << stats.octreeNodes
+                  << std::setw(12) << stats.uniqueNodes
+                  << std::setprecision(2) << std::setw(12) << stats.buildMs << std::endl;
+    }
+
+    return 0;
+}
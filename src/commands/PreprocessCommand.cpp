@@ -0,0 +1,49 @@
+#include "Commands.h"
+
+#include <iomanip>
+#include <iostream>
+
+#include "Arguments.h"
+#include "../rendering/ShaderPreprocessor.h"
+
+static void printUsage() {
+    std::cerr << "Usage: draft --preprocess <shader> [options]\n"
+                 "  --hash               Print the source hash and the included files instead of the source\n";
+}
+
+int runPreprocessCommand(int argc, char* argv[]) {
+    Arguments args(argc, argv);
+
+    if (args.args.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    std::string shaderPath = args.next("shader");
+    bool printHash = false;
+
+    while (!args.empty()) {
+        std::string option = args.next("option");
+
+        if (option == "--hash") {
+            printHash = true;
+        } else {
+            printUsage();
+            throw std::runtime_error("Unknown option: " + option);
+        }
+    }
+
+    ShaderPreprocessor preprocessor;
+    ShaderSource source = preprocessor.preprocess(shaderPath);
+
+    if (!printHash) {
+        std::cout << source.code;
+        return 0;
+    }
+
+    std::cout << std::hex << std::setw(16) << std::setfill('0') << source.hash << std::dec << "\n";
+    for (size_t i = 0; i < source.files.size(); ++i) {
+        std::cout << i << " " << source.files[i] << "\n";
+    }
+    return 0;
+}
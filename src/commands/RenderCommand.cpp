@@ -0,0 +1,158 @@
+#include "Commands.h"
+
+#include <chrono>
+#include <iostream>
+#include <optional>
+
+#include "Arguments.h"
+#include "RenderOptions.h"
+#include "../rendering/CpuTracer.h"
+#include "../rendering/Denoiser.h"
+#include "../rendering/DistributedRender.h"
+#include "../rendering/PacketTracer.h"
+#include "../rendering/RenderJob.h"
+#include "../util/ThreadPool.h"
+#include "../util/Trace.h"
+
+static void printUsage() {
+    std::cerr << "Usage: draft --render <scene.vox|scene.vxc> <out.png> [options]\n"
+              << renderJobUsage <<
+                 "  --threads <n>        Worker threads (default: all cores)\n"
+                 "  --workers <n>        Render the tiles in n worker processes on this machine\n"
+                 "  --listen <address>   Also take workers connecting to host:port or unix:path\n"
+                 "                       (started with draft --render-worker <address>)\n"
+                 "  --worker-threads <n> Threads of each local worker (default: cores / workers)\n"
+                 "  --crash-worker-after <n>\n"
+                 "                       Make the first local worker exit after n tiles, to test retries\n"
+                 "  --trace <file.json>  Write a Chrome trace of loading and rendering\n";
+}
+
+int runRenderCommand(int argc, char* argv[]) {
+    Arguments args(argc, argv);
+
+    if (args.args.size() < 2) {
+        printUsage();
+        return 1;
+    }
+
+    RenderJob job;
+    job.scenePath = args.next("scene");
+    std::string outputPath = args.next("output");
+
+    unsigned numThreads = std::thread::hardware_concurrency();
+    RenderSettings& settings = job.settings;
+    DistributedOptions distributed;
+    std::string tracePath;
+
+    while (!args.empty()) {
+        std::string option = args.next("option");
+
+        if (parseRenderJobOption(args, option, job)) {
+            continue;
+        }
+
+        if (option == "--threads") {
+            numThreads = args.nextInt(option);
+        } else if (option == "--workers") {
+            distributed.localWorkers = args.nextInt(option);
+        } else if (option == "--listen") {
+            distributed.listenAddress = args.next(option);
+        } else if (option == "--worker-threads") {
+            distributed.workerThreads = args.nextInt(option);
+        } else if (option == "--crash-worker-after") {
+            distributed.crashWorkerAfter = args.nextInt(option);
+        } else if (option == "--trace") {
+            tracePath = args.next(option);
+        } else {
+            printUsage();
+            throw std::runtime_error("Unknown option: " + option);
+        }
+    }
+
+    if (job.width <= 0 || job.height <= 0 || job.tileSize <= 0 || settings.numSamples <= 0) {
+        throw std::runtime_error("Width, height, tile size and samples must be positive");
+    }
+
+    if (!tracePath.empty()) {
+        setTracingEnabled(true);
+        setTraceThreadName("main");
+    }
+
+    ThreadPool pool(numThreads);
+    bool isDistributed = distributed.localWorkers > 0 || !distributed.listenAddress.empty();
+
+    // The workers load the scene, the coordinator only puts the tiles together
+    std::optional<PreparedRender> prepared;
+    if (!isDistributed) {
+        prepared.emplace(job, pool, &std::cout);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    RenderStats renderStats;
+    DistributedStats distributedStats;
+    GBuffer gbuffer;
+    Image image;
+    if (isDistributed) {
+        image = renderDistributed(job, distributed, &distributedStats, job.denoise ? &gbuffer : nullptr, &std::cout);
+        renderStats = distributedStats.render;
+    } else {
+        image = prepared->tracer->render(prepared->camera(), job.width, job.height, pool, job.tileSize, &renderStats,
+                                         job.denoise ? &gbuffer : nullptr);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double denoiseMs = 0;
+    if (job.denoise) {
+        auto denoiseStart = std::chrono::steady_clock::now();
+        denoise(image, gbuffer, job.denoiseSettings, pool);
+        denoiseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - denoiseStart).count();
+    }
+
+    {
+        TRACE_SCOPE("writePng");
+        writePng(image, outputPath);
+    }
+
+    std::cout << "Rendered " << job.width << "x" << job.height << " @ " << settings.numSamples << " spp ("
+              << samplerName(settings.sampler) << " sampler) ";
+    if (isDistributed) {
+        std::cout << "on " << distributedStats.workersConnected << " workers";
+    } else {
+        std::cout << "on " << pool.size() << " threads ("
+                  << (settings.enablePacketTracing && !job.useDag ? simdLevelName(activeSimdLevel()) : "scalar")
+                  << ")";
+    }
+    std::cout << " in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms -> "
+              << outputPath << std::endl;
+
+    if (isDistributed) {
+        std::cout << "Distributed: " << distributedStats.numTiles << " tiles, " << distributedStats.tilesRetried
+                  << " retried, " << distributedStats.tilesStolen << " stolen (" << distributedStats.duplicateResults
+                  << " finished twice), " << distributedStats.workersLost << " workers lost" << std::endl;
+    }
+
+    if (prepared && settings.enableGlobalIllumination && !prepared->model.lights.empty()) {
+        std::cout << "Emissive voxels: " << prepared->model.lights.lights.size()
+                  << (settings.enableLightSampling ? ", sampled directly" : ", found by bounces") << std::endl;
+    }
+
+    if (job.denoise) {
+        std::cout << "Denoised with " << job.denoiseSettings.iterations << " passes in " << denoiseMs << " ms ("
+                  << simdLevelName(activeSimdLevel()) << ")" << std::endl;
+    }
+
+    if (settings.enableAdaptiveSampling) {
+        std::cout << "Adaptive sampling: " << renderStats.convergedTiles << " of " << renderStats.numTiles
+                  << " tiles converged early, traced " << renderStats.samplesTraced << " of "
+                  << renderStats.samplesBudget << " samples ("
+                  << 100.0 * double(renderStats.samplesTraced) / double(renderStats.samplesBudget) << "%)"
+                  << std::endl;
+    }
+
+    if (!tracePath.empty()) {
+        writeChromeTrace(tracePath);
+        std::cout << "Wrote trace " << tracePath << std::endl;
+    }
+
+    return 0;
+}
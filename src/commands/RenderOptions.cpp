@@ -0,0 +1,94 @@
+#include "RenderOptions.h"
+
+char const* const renderJobUsage =
+        "  --width <n>          Image width (default 1920)\n"
+        "  --height <n>         Image height (default 1010)\n"
+        "  --samples <n>        Samples per pixel (default 1)\n"
+        "  --bounces <n>        Num ray bounces (default 3)\n"
+        "  --max-dda-depth <n>  Max DDA depth (default 300)\n"
+        "  --camera <x,y,z>     Camera position\n"
+        "  --target <x,y,z>     Camera target\n"
+        "  --sun <x,y,z>        Sun direction\n"
+        "  --shadow-multiplier <f>\n"
+        "  --gi                 Enable global illumination\n"
+        "  --sun-strength <f>   Sunlight with GI, relative to the sky (default 1)\n"
+        "  --no-light-sampling  Only find emissive voxels by bouncing into them\n"
+        "  --gi-cache <n>       End GI paths in an irradiance cache refined n times first\n"
+        "  --no-shadows         Disable shadows\n"
+        "  --no-sun-cache       Trace every sun shadow instead of baking them per voxel face\n"
+        "  --no-randomization   Disable ray randomization\n"
+        "  --sampler <name>     Sample sequence: random, sobol (default), r2 or blue-noise\n"
+        "  --no-skip            Disable empty space skipping\n"
+        "  --layout <name>      Voxel storage: linear (default, or as baked) or bricked\n"
+        "  --dag                Trace through a sparse voxel DAG (baked or built from the scene)\n"
+        "  --no-packets         Disable SIMD packet traversal of primary rays\n"
+        "  --denoise            Filter the image guided by the normals and albedo of the first hits\n"
+        "  --denoise-passes <n> Passes of the denoising filter, each twice as wide (default 4)\n"
+        "  --adaptive           Stop sampling tiles whose pixels converged\n"
+        "  --adaptive-threshold <f>\n"
+        "                       Max standard error of a converged pixel's luminance (default 0.01)\n"
+        "  --min-samples <n>    Samples before a tile may converge (default 8)\n"
+        "  --tile-size <n>      Tile edge length in pixels (default 32)\n";
+
+bool parseRenderJobOption(Arguments& args, std::string const& option, RenderJob& job) {
+    RenderSettings& settings = job.settings;
+
+    if (option == "--width") {
+        job.width = args.nextInt(option);
+    } else if (option == "--height") {
+        job.height = args.nextInt(option);
+    } else if (option == "--samples") {
+        settings.numSamples = args.nextInt(option);
+    } else if (option == "--bounces") {
+        settings.numRayBounces = args.nextInt(option);
+    } else if (option == "--max-dda-depth") {
+        settings.maxDDADepth = args.nextInt(option);
+    } else if (option == "--camera") {
+        job.cameraPosition = args.nextVec3(option);
+    } else if (option == "--target") {
+        job.cameraTarget = args.nextVec3(option);
+    } else if (option == "--sun") {
+        settings.sunDir = args.nextVec3(option);
+    } else if (option == "--shadow-multiplier") {
+        settings.shadowMultiplier = args.nextFloat(option);
+    } else if (option == "--gi") {
+        settings.enableGlobalIllumination = true;
+    } else if (option == "--sun-strength") {
+        settings.sunStrength = args.nextFloat(option);
+    } else if (option == "--no-light-sampling") {
+        settings.enableLightSampling = false;
+    } else if (option == "--gi-cache") {
+        job.irradiancePasses = args.nextInt(option);
+    } else if (option == "--no-shadows") {
+        settings.enableShadows = false;
+    } else if (option == "--no-sun-cache") {
+        job.useSunCache = false;
+    } else if (option == "--no-randomization") {
+        settings.enableRayRandomization = false;
+    } else if (option == "--sampler") {
+        settings.sampler = parseSamplerType(args.next(option));
+    } else if (option == "--no-skip") {
+        settings.enableEmptySpaceSkipping = false;
+    } else if (option == "--layout") {
+        job.layout = parseVoxelLayout(args.next(option));
+    } else if (option == "--dag") {
+        job.useDag = true;
+    } else if (option == "--no-packets") {
+        settings.enablePacketTracing = false;
+    } else if (option == "--denoise") {
+        job.denoise = true;
+    } else if (option == "--denoise-passes") {
+        job.denoiseSettings.iterations = args.nextInt(option);
+    } else if (option == "--adaptive") {
+        settings.enableAdaptiveSampling = true;
+    } else if (option == "--adaptive-threshold") {
+        settings.adaptiveThreshold = args.nextFloat(option);
+    } else if (option == "--min-samples") {
+        settings.adaptiveMinSamples = args.nextInt(option);
+    } else if (option == "--tile-size") {
+        job.tileSize = args.nextInt(option);
+    } else {
+        return false;
+    }
+    return true;
+}
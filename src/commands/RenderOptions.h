@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+#include "Arguments.h"
+#include "../rendering/RenderJob.h"
+
+// The options of draft --render that describe the image, shared with the
+// other commands that render one.
+
+// One line per option, for the commands' usage
+extern char const* const renderJobUsage;
+
+// Applies option, reading its value from args. Returns false for options
+// that are not about the job.
+bool parseRenderJobOption(Arguments& args, std::string const& option, RenderJob& job);
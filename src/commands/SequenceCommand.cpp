@@ -0,0 +1,169 @@
+#include "Commands.h"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+
+#include "Arguments.h"
+#include "RenderOptions.h"
+#include "../rendering/CameraPath.h"
+#include "../rendering/Denoiser.h"
+#include "../rendering/FrameWriter.h"
+#include "../rendering/RenderJob.h"
+#include "../util/ThreadPool.h"
+#include "../util/Trace.h"
+
+static void printUsage() {
+    std::cerr << "Usage: draft --sequence <scene.vox|scene.vxc> <path.json> <out_####.png> [options]\n"
+                 "  Renders every frame of a camera path, see rendering/CameraPath.h. The #s in the\n"
+                 "  output name are replaced by the frame number.\n"
+              << renderJobUsage <<
+                 "  --threads <n>        Render threads (default: all cores)\n"
+                 "  --io-threads <n>     Threads encoding and writing frames (default 2)\n"
+                 "  --queue <n>          Frames waiting to be written before rendering waits (default 4)\n"
+                 "  --overwrite          Render the frames that are already on disk again\n"
+                 "  --trace <file.json>  Write a Chrome trace of the run\n";
+}
+
+// outputPattern with its run of #s replaced by frame, zero padded to as many
+// digits
+static std::string framePath(std::string const& outputPattern, int frame) {
+    size_t first = outputPattern.find('#');
+    size_t last = outputPattern.find_last_of('#');
+    std::string number = std::to_string(frame);
+    if (number.size() < last - first + 1) {
+        number.insert(0, last - first + 1 - number.size(), '0');
+    }
+    return outputPattern.substr(0, first) + number + outputPattern.substr(last + 1);
+}
+
+int runSequenceCommand(int argc, char* argv[]) {
+    Arguments args(argc, argv);
+
+    if (args.args.size() < 3) {
+        printUsage();
+        return 1;
+    }
+
+    RenderJob job;
+    job.scenePath = args.next("scene");
+    std::string pathFile = args.next("camera path");
+    std::string outputPattern = args.next("output");
+
+    unsigned numThreads = std::thread::hardware_concurrency();
+    unsigned ioThreads = 2;
+    int queueSize = 4;
+    bool overwrite = false;
+    std::string tracePath;
+
+    while (!args.empty()) {
+        std::string option = args.next("option");
+
+        if (parseRenderJobOption(args, option, job)) {
+            continue;
+        }
+
+        if (option == "--threads") {
+            numThreads = args.nextInt(option);
+        } else if (option == "--io-threads") {
+            ioThreads = args.nextInt(option);
+        } else if (option == "--queue") {
+            queueSize = args.nextInt(option);
+        } else if (option == "--overwrite") {
+            overwrite = true;
+        } else if (option == "--trace") {
+            tracePath = args.next(option);
+        } else {
+            printUsage();
+            throw std::runtime_error("Unknown option: " + option);
+        }
+    }
+
+    if (job.width <= 0 || job.height <= 0 || job.tileSize <= 0 || job.settings.numSamples <= 0) {
+        throw std::runtime_error("Width, height, tile size and samples must be positive");
+    }
+    if (job.cameraPosition || job.cameraTarget) {
+        throw std::runtime_error("The camera of a sequence comes from its path, --camera and --target do not apply");
+    }
+    if (outputPattern.find('#') == std::string::npos) {
+        throw std::runtime_error("Expected #s for the frame number in the output name: " + outputPattern);
+    }
+    if (ioThreads == 0 || queueSize <= 0) {
+        throw std::runtime_error("I/O threads and queue size must be positive");
+    }
+
+    if (!tracePath.empty()) {
+        setTracingEnabled(true);
+        setTraceThreadName("main");
+    }
+
+    CameraPath path = loadCameraPath(pathFile);
+
+    // Frames a previous run got to are complete, files are only renamed into
+    // place once written
+    std::vector<int> frames;
+    for (int frame = 0; frame < path.numFrames(); ++frame) {
+        if (overwrite || !std::filesystem::exists(framePath(outputPattern, frame))) {
+            frames.push_back(frame);
+        }
+    }
+    size_t framesOnDisk = size_t(path.numFrames()) - frames.size();
+    if (frames.empty()) {
+        std::cout << "All " << path.numFrames() << " frames are already on disk" << std::endl;
+        return 0;
+    }
+
+    auto outputDirectory = std::filesystem::path(framePath(outputPattern, 0)).parent_path();
+    if (!outputDirectory.empty()) {
+        std::filesystem::create_directories(outputDirectory);
+    }
+
+    ThreadPool pool(numThreads);
+    PreparedRender prepared(job, pool, &std::cout);
+    FrameWriter writer(ioThreads, size_t(queueSize));
+
+    auto start = std::chrono::steady_clock::now();
+    double renderMs = 0;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        TRACE_SCOPE("frame");
+        int frame = frames[i];
+        glm::vec3 position;
+        glm::vec3 focusPoint;
+        path.evaluate(float(frame), position, focusPoint);
+        Camera camera{position, focusPoint, job.width, job.height};
+
+        auto frameStart = std::chrono::steady_clock::now();
+        GBuffer gbuffer;
+        Image image = prepared.tracer->render(camera, job.width, job.height, pool, job.tileSize, nullptr,
+                                              job.denoise ? &gbuffer : nullptr);
+        if (job.denoise) {
+            denoise(image, gbuffer, job.denoiseSettings, pool);
+        }
+        double frameMs =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        renderMs += frameMs;
+
+        std::string output = framePath(outputPattern, frame);
+        writer.write(std::move(image), output);
+        std::cout << "Frame " << frame << " (" << i + 1 << "/" << frames.size() << ") rendered in " << frameMs
+                  << " ms -> " << output << std::endl;
+    }
+    writer.finish();
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Rendered " << frames.size() << " frames";
+    if (framesOnDisk > 0) {
+        std::cout << " (" << framesOnDisk << " already on disk)";
+    }
+    std::cout << " at " << job.width << "x" << job.height << " @ " << job.settings.numSamples << " spp in "
+              << totalMs << " ms: " << renderMs / double(frames.size()) << " ms rendering per frame, "
+              << writer.waitedMs() << " ms waiting for the writer" << std::endl;
+
+    if (!tracePath.empty()) {
+        writeChromeTrace(tracePath);
+        std::cout << "Wrote trace " << tracePath << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include "Commands.h"
+
+#include <iostream>
+
+#include "Arguments.h"
+#include "../rendering/RenderServer.h"
+
+static void printUsage() {
+    std::cerr << "Usage: draft --serve <address> [options]\n"
+                 "  Renders JSON jobs sent to host:port or unix:path, see rendering/RenderServer.h\n"
+                 "  --threads <n>        Worker threads (default: all cores)\n"
+                 "  --cache-size <n>     Prepared scenes kept loaded (default 4)\n"
+                 "  --quiet              Do not log every job\n";
+}
+
+int runServeCommand(int argc, char* argv[]) {
+    Arguments args(argc, argv);
+
+    if (args.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    std::string address = args.next("address");
+    RenderServerOptions options;
+    bool quiet = false;
+
+    while (!args.empty()) {
+        std::string option = args.next("option");
+
+        if (option == "--threads") {
+            options.numThreads = args.nextInt(option);
+        } else if (option == "--cache-size") {
+            options.cacheSize = args.nextInt(option);
+        } else if (option == "--quiet") {
+            quiet = true;
+        } else {
+            printUsage();
+            throw std::runtime_error("Unknown option: " + option);
+        }
+    }
+
+    runRenderServer(address, options, quiet ? nullptr : &std::cout);
+    return 0;
+}
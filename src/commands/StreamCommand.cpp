@@ -0,0 +1,156 @@
+#include "Commands.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#include "Arguments.h"
+#include "../rendering/BakedScene.h"
+#include "../rendering/Camera.h"
+#include "../rendering/ChunkedWorld.h"
+#include "../rendering/CpuTracer.h"
+#include "../rendering/Model.h"
+#include "../util/ThreadPool.h"
+#include "../util/Trace.h"
+
+static void printUsage() {
+    std::cerr << "Usage: draft --stream <scene.vox|scene.vxc> <out.png> [options]\n"
+                 "  --tiles <x,y,z>      Times the scene is repeated per axis (default 16,1,16)\n"
+                 "  --budget-mb <n>      Chunk cache budget in MiB (default 64)\n"
+                 "  --radius <n>         Load chunks within this many voxels of the camera (default 256)\n"
+                 "  --frames <n>         Frames to fly over the world (default 32)\n"
+                 "  --no-wait            Render without waiting for the queued chunks\n"
+                 "  --width <n>          Image width (default 640)\n"
+                 "  --height <n>         Image height (default 360)\n"
+                 "  --threads <n>        Worker threads (default: all cores)\n"
+                 "  --trace <file.json>  Write a Chrome trace of the run\n";
+}
+
+// Flies the camera over a tiled copy of the scene, streaming chunks in and
+// out, and prints the cache counters per frame. The last frame is written.
+int runStreamCommand(int argc, char* argv[]) {
+    Arguments args(argc, argv);
+
+    if (args.args.size() < 2) {
+        printUsage();
+        return 1;
+    }
+
+    std::string scenePath = args.next("scene");
+    std::string outputPath = args.next("output");
+
+    glm::uvec3 tiles{16, 1, 16};
+    size_t budgetMiB = 64;
+    float radius = 256;
+    int numFrames = 32;
+    bool waitForLoads = true;
+    int width = 640;
+    int height = 360;
+    unsigned numThreads = std::thread::hardware_concurrency();
+    std::string tracePath;
+
+    while (!args.empty()) {
+        std::string option = args.next("option");
+
+        if (option == "--tiles") {
+            tiles = glm::uvec3(glm::max(args.nextVec3(option), glm::vec3(1)));
+        } else if (option == "--budget-mb") {
+            budgetMiB = size_t(args.nextInt(option));
+        } else if (option == "--radius") {
+            radius = args.nextFloat(option);
+        } else if (option == "--frames") {
+            numFrames = args.nextInt(option);
+        } else if (option == "--no-wait") {
+            waitForLoads = false;
+        } else if (option == "--width") {
+            width = args.nextInt(option);
+        } else if (option == "--height") {
+            height = args.nextInt(option);
+        } else if (option == "--threads") {
+            numThreads = args.nextInt(option);
+        } else if (option == "--trace") {
+            tracePath = args.next(option);
+        } else {
+            printUsage();
+            throw std::runtime_error("Unknown option: " + option);
+        }
+    }
+
+    if (width <= 0 || height <= 0 || numFrames <= 0) {
+        throw std::runtime_error("Width, height and frames must be positive");
+    }
+
+    if (!tracePath.empty()) {
+        setTracingEnabled(true);
+        setTraceThreadName("main");
+    }
+
+    Model model = isBakedSceneFile(scenePath) ? std::move(loadBakedScene(scenePath).model) : loadVoxModel(scenePath);
+
+    ChunkedWorld world(std::make_unique<TiledModelSource>(model, tiles), budgetMiB << 20);
+    glm::vec3 worldSize{world.size()};
+    std::cout << "World " << world.size().x << "x" << world.size().y << "x" << world.size().z << ", "
+              << std::fixed << std::setprecision(1)
+              << worldSize.x * worldSize.y * worldSize.z / double(1 << 20) << " MiB dense" << std::endl;
+
+    ThreadPool pool(numThreads);
+    RenderSettings settings;
+    settings.enableRayRandomization = false;
+    Image image;
+    ChunkCacheStats previous;
+
+    for (int frame = 0; frame < numFrames; ++frame) {
+        // Diagonal flight above the world, looking ahead and down
+        float t = numFrames > 1 ? float(frame) / float(numFrames - 1) : 0.0f;
+        glm::vec3 position = glm::vec3(0.1f + 0.8f * t, 1.5f, 0.1f + 0.8f * t) * worldSize;
+        Camera camera{position, position + glm::vec3(1, -1, 1) * float(model.size.y), width, height};
+        TRACE_SCOPE("frame");
+
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<ChunkResidency const> residency;
+        {
+            TRACE_SCOPE("stream");
+            world.update(position, radius);
+            if (waitForLoads) {
+                world.waitForLoads();
+            }
+            residency = world.beginFrame();
+        }
+        auto loaded = std::chrono::steady_clock::now();
+
+        CpuTracer tracer(model, settings);
+        tracer.m_world = residency.get();
+        image = tracer.render(camera, width, height, pool);
+        auto end = std::chrono::steady_clock::now();
+
+        ChunkCacheStats stats = world.stats();
+        ChunkCacheStats frameStats;
+        frameStats.hits = stats.hits - previous.hits;
+        frameStats.misses = stats.misses - previous.misses;
+        previous = stats;
+
+        std::cout << "frame " << std::setw(3) << frame
+                  << std::setprecision(1)
+                  << "  resident " << std::setw(5) << stats.residentChunks
+                  << " (" << std::setw(6) << double(stats.residentBytes) / double(1 << 20) << " / "
+                  << double(stats.budgetBytes) / double(1 << 20) << " MiB)"
+                  << "  queued " << std::setw(4) << stats.queuedLoads
+                  << "  loads " << std::setw(5) << stats.loads
+                  << "  evictions " << std::setw(5) << stats.evictions
+                  << std::setprecision(3) << "  hit rate " << frameStats.hitRate()
+                  << std::setprecision(2)
+                  << "  stream " << std::chrono::duration<double, std::milli>(loaded - start).count() << " ms"
+                  << "  render " << std::chrono::duration<double, std::milli>(end - loaded).count() << " ms"
+                  << std::endl;
+    }
+
+    writePng(image, outputPath);
+    std::cout << "Wrote " << outputPath << std::endl;
+
+    if (!tracePath.empty()) {
+        writeChromeTrace(tracePath);
+        std::cout << "Wrote trace " << tracePath << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,40 @@
+#include "Commands.h"
+
+#include <iostream>
+
+#include "Arguments.h"
+#include "../rendering/DistributedRender.h"
+
+static void printUsage() {
+    std::cerr << "Usage: draft --render-worker <address> [options]\n"
+                 "  --threads <n>        Worker threads (default: all cores)\n"
+                 "  --exit-after <n>     Exit after rendering n tiles, to test retries\n";
+}
+
+int runRenderWorkerCommand(int argc, char* argv[]) {
+    Arguments args(argc, argv);
+
+    if (args.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    std::string address = args.next("address");
+    WorkerOptions options;
+
+    while (!args.empty()) {
+        std::string option = args.next("option");
+
+        if (option == "--threads") {
+            options.numThreads = args.nextInt(option);
+        } else if (option == "--exit-after") {
+            options.exitAfterTiles = args.nextInt(option);
+        } else {
+            printUsage();
+            throw std::runtime_error("Unknown option: " + option);
+        }
+    }
+
+    runRenderWorker(address, options);
+    return 0;
+}
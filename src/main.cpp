@@ -1,21 +1,42 @@
+#include <algorithm>
 #include <array>
+#include <cstdio>
 #include <iostream>
-#include <random>
+#include <optional>
+#include <string_view>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <backends/imgui_impl_glfw.h>
 #include <backends/imgui_impl_opengl3.h>
+#include <glm/common.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <imgui.h>
 
+#include "commands/Commands.h"
 #include "rendering/Camera.h"
+#include "rendering/CpuTracer.h"
+#include "rendering/Denoiser.h"
 #include "rendering/Model.h"
+#include "rendering/GpuTimer.h"
+#include "rendering/IrradianceCache.h"
 #include "rendering/Noise.h"
+#include "rendering/ResolutionController.h"
+#include "rendering/Sampler.h"
 #include "rendering/Shader.h"
+#include "rendering/SunVisibility.h"
+#include "rendering/VoxelEdit.h"
+#include "util/AssetPipeline.h"
+#include "util/BackgroundTask.h"
+#include "util/Trace.h"
 
-const int screenWidth = 1920;
-const int screenHeight = 1010;
+// The window is maximized right away and can be resized, the render targets
+// follow its framebuffer size
+const int initialWindowWidth = 1920;
+const int initialWindowHeight = 1010;
+
+// Edge length of the voxel shader's work groups
+const int workGroupSize = 10;
 
 const std::array<GLfloat, 18> quadVertices{
     -1.0f, 1.0f, 0.0f, 1.0f, 1.0f,  0.0f, 1.0f,  -1.0f, 0.0f,
@@ -33,10 +54,34 @@ static double lastCursorY = 0;
 Camera camera{
     {0, 0, 0},
     {0, 0, 0},
-    screenWidth,
-    screenHeight,
+    initialWindowWidth,
+    initialWindowHeight,
 };
 
+// Uploads the changed bytes of data into buffer, one glBufferSubData per range
+static void uploadDirtyRanges(GLuint buffer, DirtyRanges const &dirty,
+                              void const *data) {
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  for (ByteRange range : dirty.ranges()) {
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, range.begin,
+                    range.end - range.begin,
+                    static_cast<uint8_t const *>(data) + range.begin);
+  }
+}
+
+// Model::materials followed by Model::lights, as voxel.comp reads them
+static void uploadLights(GLuint buffer, Model const &model) {
+  size_t materialBytes = sizeof(model.materials);
+  size_t lightBytes = model.lights.lights.size() * sizeof(EmissiveLight);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, materialBytes + lightBytes, nullptr,
+               GL_DYNAMIC_DRAW);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, materialBytes,
+                  model.materials.data());
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, materialBytes, lightBytes,
+                  model.lights.lights.data());
+}
+
 static void mouseHandler(GLFWwindow *window, int button, int action, int code) {
   ImGui_ImplGlfw_MouseButtonCallback(window, button, action, code);
   if (ImGui::GetIO().WantCaptureMouse) {
@@ -74,6 +119,31 @@ static void errorCallback(int error, const char *description) {
 
 int main(int argc, char *argv[]) {
   try {
+    if (argc > 1 && std::string_view(argv[1]) == "--render") {
+      return runRenderCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string_view(argv[1]) == "--render-worker") {
+      return runRenderWorkerCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string_view(argv[1]) == "--serve") {
+      return runServeCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string_view(argv[1]) == "--sequence") {
+      return runSequenceCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string_view(argv[1]) == "--dag-stats") {
+      return runDagStatsCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string_view(argv[1]) == "--bake") {
+      return runBakeCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string_view(argv[1]) == "--stream") {
+      return runStreamCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string_view(argv[1]) == "--preprocess") {
+      return runPreprocessCommand(argc - 2, argv + 2);
+    }
+
     if (!glfwInit()) {
       throw std::runtime_error("Failed to initialize Glfw");
     }
@@ -84,7 +154,8 @@ int main(int argc, char *argv[]) {
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     GLFWwindow *window =
-        glfwCreateWindow(screenWidth, screenHeight, "draft", nullptr, nullptr);
+        glfwCreateWindow(initialWindowWidth, initialWindowHeight, "draft",
+                         nullptr, nullptr);
 
     if (!window) {
       throw std::runtime_error("Failed to open window");
@@ -113,18 +184,139 @@ int main(int argc, char *argv[]) {
     ImGui_ImplGlfw_InitForOpenGL(window, false);
     ImGui_ImplOpenGL3_Init("#version 440");
 
-    ShaderProgram quadProgram({
-        {"assets/shaders/quad.vert", GL_VERTEX_SHADER},
-        {"assets/shaders/quad.frag", GL_FRAGMENT_SHADER},
-    });
-    ShaderProgram voxelProgram(
-        {{"assets/shaders/voxel.comp", GL_COMPUTE_SHADER}});
+    glClearColor(0, 1, 1, 1);
+
+    // File reads and decoding run on the pool, the GL side of every asset is
+    // done here once its CPU buffers are ready
+    ThreadPool loaderPool;
+    AssetPipeline assets(loaderPool);
+
+    // Includes are read once and shared by all shaders, the linked programs
+    // are cached as driver binaries so later starts skip compiling
+    ShaderPreprocessor shaderPreprocessor;
+    std::string const shaderCacheDir = ".shader_cache";
+
+    using ShaderStages = std::vector<ShaderStage>;
+    auto readShaders = [&](std::vector<std::pair<std::string, GLenum>> files) {
+      return [&shaderPreprocessor, files] {
+        ShaderStages stages;
+        for (auto const &[filename, type] : files) {
+          stages.push_back({shaderPreprocessor.preprocess(filename), type});
+        }
+        return stages;
+      };
+    };
+
+    std::optional<ShaderProgram> quadProgram;
+    assets.load<ShaderStages>(
+        "quad shaders",
+        readShaders({{"assets/shaders/quad.vert", GL_VERTEX_SHADER},
+                     {"assets/shaders/quad.frag", GL_FRAGMENT_SHADER}}),
+        [&](ShaderStages &stages) { quadProgram.emplace(stages, shaderCacheDir); });
+
+    std::optional<ShaderProgram> voxelProgram;
+    assets.load<ShaderStages>(
+        "voxel shader",
+        readShaders({{"assets/shaders/voxel.comp", GL_COMPUTE_SHADER}}),
+        [&](ShaderStages &stages) {
+          voxelProgram.emplace(stages, shaderCacheDir);
+        });
+
+    std::optional<ShaderProgram> denoiseProgram;
+    assets.load<ShaderStages>(
+        "denoise shader",
+        readShaders({{"assets/shaders/denoise.comp", GL_COMPUTE_SHADER}}),
+        [&](ShaderStages &stages) {
+          denoiseProgram.emplace(stages, shaderCacheDir);
+        });
+
+    std::optional<Noise> blueNoise;
+    assets.load<NoiseImages>(
+        "blue noise",
+        [&] { return loadNoiseImages("assets/noise/256_256", loaderPool); },
+        [&](NoiseImages &images) {
+          glActiveTexture(GL_TEXTURE1);
+          blueNoise = Noise::FromImages(images);
+        });
+
+    GLuint voxelIndexBufferId;
+    GLuint voxelPaletteBufferId;
+    GLuint voxelSolidBufferId;
+    GLuint brickOccupancyBufferId;
+    GLuint coarseOccupancyBufferId;
+    GLuint voxelLightBufferId;
+
+    std::optional<Model> model;
+    assets.load<Model>(
+        "assets/vox/menger.vox",
+        [] {
+          return loadVoxModel("assets/vox/menger.vox", VoxelLayout::Bricked);
+        },
+        [&](Model &loaded) {
+          model = std::move(loaded);
+
+          glGenBuffers(1, &voxelIndexBufferId);
+          glBindBuffer(GL_SHADER_STORAGE_BUFFER, voxelIndexBufferId);
+          glBufferData(GL_SHADER_STORAGE_BUFFER,
+                       model->indices.size() * sizeof(uint8_t),
+                       model->indices.data(), GL_DYNAMIC_DRAW);
+
+          glGenBuffers(1, &voxelPaletteBufferId);
+          glBindBuffer(GL_SHADER_STORAGE_BUFFER, voxelPaletteBufferId);
+          glBufferData(GL_SHADER_STORAGE_BUFFER,
+                       model->palette.size() * sizeof(uint32_t),
+                       model->palette.data(), GL_DYNAMIC_DRAW);
+
+          glGenBuffers(1, &voxelSolidBufferId);
+          glBindBuffer(GL_SHADER_STORAGE_BUFFER, voxelSolidBufferId);
+          glBufferData(GL_SHADER_STORAGE_BUFFER,
+                       model->solid.size() * sizeof(uint8_t),
+                       model->solid.data(), GL_DYNAMIC_DRAW);
+
+          glGenBuffers(1, &brickOccupancyBufferId);
+          glBindBuffer(GL_SHADER_STORAGE_BUFFER, brickOccupancyBufferId);
+          glBufferData(GL_SHADER_STORAGE_BUFFER,
+                       model->occupancy.bricks.bits.size() * sizeof(uint32_t),
+                       model->occupancy.bricks.bits.data(),
+                       GL_DYNAMIC_DRAW);
+
+          glGenBuffers(1, &coarseOccupancyBufferId);
+          glBindBuffer(GL_SHADER_STORAGE_BUFFER, coarseOccupancyBufferId);
+          glBufferData(GL_SHADER_STORAGE_BUFFER,
+                       model->occupancy.coarse.bits.size() * sizeof(uint32_t),
+                       model->occupancy.coarse.bits.data(),
+                       GL_DYNAMIC_DRAW);
+
+          glGenBuffers(1, &voxelLightBufferId);
+          uploadLights(voxelLightBufferId, *model);
+        });
+
+    while (!assets.processUploads()) {
+      // Leave the cores to the loader while waiting
+      glfwWaitEventsTimeout(0.01);
+
+      ImGui_ImplOpenGL3_NewFrame();
+      ImGui_ImplGlfw_NewFrame();
+      ImGui::NewFrame();
 
-    Model model = loadVoxModel("assets/vox/menger.vox");
+      ImGui::Begin("Loading");
+      ImGui::ProgressBar(assets.progress());
+      for (auto const &name : assets.pendingNames()) {
+        ImGui::BulletText("%s", name.c_str());
+      }
+      ImGui::End();
+      ImGui::Render();
 
-    camera.m_position = glm::vec3{-1, 0.5f, -1} * glm::vec3{model.size};
-    camera.m_focusPoint = {model.size.x / 2, model.size.y / 2,
-                           model.size.z / 2};
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+      glfwSwapBuffers(window);
+    }
+
+    VoxelEditor editor{*model};
+
+    camera.m_position = glm::vec3{-1, 0.5f, -1} * glm::vec3{model->size};
+    camera.m_focusPoint = {model->size.x / 2, model->size.y / 2,
+                           model->size.z / 2};
     camera.updateView();
 
     GLuint vertexArrayId;
@@ -151,66 +343,139 @@ int main(int argc, char *argv[]) {
     glBindBuffer(GL_ARRAY_BUFFER, uvBufferId);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
 
-    glActiveTexture(GL_TEXTURE0);
+    GLuint momentsTextureId;
+    GLuint historyColorTextureId;
+    GLuint historyMomentsTextureId;
+    GLuint normalTextureId;
+    GLuint albedoTextureId;
     GLuint renderTextureId;
+    // The denoiser's passes alternate between these
+    std::array<GLuint, 2> denoiseTextureIds;
+    // One convergence flag per work group of the voxel shader
+    GLuint tileConvergenceBufferId;
+    glGenTextures(1, &momentsTextureId);
+    glGenTextures(1, &historyColorTextureId);
+    glGenTextures(1, &historyMomentsTextureId);
+    glGenTextures(1, &normalTextureId);
+    glGenTextures(1, &albedoTextureId);
     glGenTextures(1, &renderTextureId);
-    glBindTexture(GL_TEXTURE_2D, renderTextureId);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, screenWidth, screenHeight, 0,
-                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glGenTextures(denoiseTextureIds.size(), denoiseTextureIds.data());
+    glGenBuffers(1, &tileConvergenceBufferId);
 
-    glActiveTexture(GL_TEXTURE1);
-    Noise blueNoise{Noise::LoadBlueNoise("assets/noise/256_256")};
-    Noise whiteNoise{Noise::LoadWhiteNoise(1, 512)};
+    // Sized for rendering at full window resolution, lower render scales use
+    // the lower left part of them
+    auto allocateRenderTargets = [&](glm::ivec2 size) {
+      // The quad blit binds the texture it shows to unit 0 every frame
+      glActiveTexture(GL_TEXTURE0);
+      for (GLuint textureId :
+           {momentsTextureId, historyColorTextureId, historyMomentsTextureId,
+            normalTextureId, albedoTextureId}) {
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size.x, size.y, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, nullptr);
+      }
 
-    Noise *activeNoise = &whiteNoise;
+      // Filtered for the quad shader, the denoiser's output is shown
+      // instead of the render texture
+      for (GLuint textureId :
+           {denoiseTextureIds[0], denoiseTextureIds[1], renderTextureId}) {
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size.x, size.y, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      }
 
-    GLuint voxelIndexBufferId;
-    glGenBuffers(1, &voxelIndexBufferId);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, voxelIndexBufferId);
-    glBufferData(GL_SHADER_STORAGE_BUFFER,
-                 model.indices.size() * sizeof(uint8_t), model.indices.data(),
-                 GL_STATIC_DRAW);
+      glm::ivec2 numWorkGroups = workGroupCount(size, workGroupSize);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileConvergenceBufferId);
+      glBufferData(GL_SHADER_STORAGE_BUFFER,
+                   numWorkGroups.x * numWorkGroups.y * sizeof(uint32_t),
+                   nullptr, GL_DYNAMIC_DRAW);
+    };
 
-    GLuint voxelPaletteBufferId;
-    glGenBuffers(1, &voxelPaletteBufferId);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, voxelPaletteBufferId);
-    glBufferData(GL_SHADER_STORAGE_BUFFER,
-                 model.palette.size() * sizeof(uint32_t), model.palette.data(),
-                 GL_STATIC_DRAW);
+    glm::ivec2 windowSize;
+    glfwGetFramebufferSize(window, &windowSize.x, &windowSize.y);
+    windowSize = glm::max(windowSize, glm::ivec2(1));
+    allocateRenderTargets(windowSize);
+    glViewport(0, 0, windowSize.x, windowSize.y);
+    camera.updateProjection(windowSize.x, windowSize.y);
 
-    GLuint voxelSolidBufferId;
-    glGenBuffers(1, &voxelSolidBufferId);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, voxelSolidBufferId);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, model.solid.size() * sizeof(uint8_t),
-                 model.solid.data(), GL_STATIC_DRAW);
-
-    glViewport(0, 0, screenWidth, screenHeight);
-    glClearColor(0, 1, 1, 1);
+    // The converged tile count is read back a few frames late from a ring
+    // of counters, so the readout does not wait for the current dispatch
+    std::array<GLuint, 3> convergenceCounterBufferIds;
+    glGenBuffers(convergenceCounterBufferIds.size(),
+                 convergenceCounterBufferIds.data());
+    for (GLuint bufferId : convergenceCounterBufferIds) {
+      uint32_t zero = 0;
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferId);
+      glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t), &zero,
+                   GL_DYNAMIC_READ);
+    }
+    uint32_t convergedTiles = 0;
 
-    int invViewId = glGetUniformLocation(voxelProgram.id, "invView");
+    int invViewId = glGetUniformLocation(voxelProgram->id, "invView");
     int invCenteredViewId =
-        glGetUniformLocation(voxelProgram.id, "invCenteredView");
+        glGetUniformLocation(voxelProgram->id, "invCenteredView");
     int invProjectionId =
-        glGetUniformLocation(voxelProgram.id, "invProjection");
-    int mapSizeId = glGetUniformLocation(voxelProgram.id, "mapSize");
-    int frameCountId = glGetUniformLocation(voxelProgram.id, "frameCount");
-    int numSamplesId = glGetUniformLocation(voxelProgram.id, "numSamples");
+        glGetUniformLocation(voxelProgram->id, "invProjection");
+    int mapSizeId = glGetUniformLocation(voxelProgram->id, "mapSize");
+    int brickGridSizeId =
+        glGetUniformLocation(voxelProgram->id, "brickGridSize");
+    int coarseGridSizeId =
+        glGetUniformLocation(voxelProgram->id, "coarseGridSize");
+    int enableEmptySpaceSkippingId =
+        glGetUniformLocation(voxelProgram->id, "enableEmptySpaceSkipping");
+    int brickedVoxelsId = glGetUniformLocation(voxelProgram->id, "brickedVoxels");
+    int samplerTypeId = glGetUniformLocation(voxelProgram->id, "samplerType");
+    int sampleIndexId = glGetUniformLocation(voxelProgram->id, "sampleIndex");
+    int numSamplesId = glGetUniformLocation(voxelProgram->id, "numSamples");
     int numRayBouncesId =
-        glGetUniformLocation(voxelProgram.id, "numRayBounces");
-    int maxDDADepthId = glGetUniformLocation(voxelProgram.id, "maxDDADepth");
-    int sunDirId = glGetUniformLocation(voxelProgram.id, "sunDir");
+        glGetUniformLocation(voxelProgram->id, "numRayBounces");
+    int maxDDADepthId = glGetUniformLocation(voxelProgram->id, "maxDDADepth");
+    int sunDirId = glGetUniformLocation(voxelProgram->id, "sunDir");
     int enableShadowsId =
-        glGetUniformLocation(voxelProgram.id, "enableShadows");
+        glGetUniformLocation(voxelProgram->id, "enableShadows");
+    int enableSunVisibilityId =
+        glGetUniformLocation(voxelProgram->id, "enableSunVisibility");
     int enableGlobalIlluminationId =
-        glGetUniformLocation(voxelProgram.id, "enableGlobalIllumination");
+        glGetUniformLocation(voxelProgram->id, "enableGlobalIllumination");
+    int enableIrradianceCacheId =
+        glGetUniformLocation(voxelProgram->id, "enableIrradianceCache");
     int enableRayRandomizationId =
-        glGetUniformLocation(voxelProgram.id, "enableRayRandomization");
+        glGetUniformLocation(voxelProgram->id, "enableRayRandomization");
     int shadowMultiplierId =
-        glGetUniformLocation(voxelProgram.id, "shadowMultiplier");
-    int randomnessId = glGetUniformLocation(voxelProgram.id, "randomness");
-    int noiseSizeId = glGetUniformLocation(voxelProgram.id, "noiseSize");
+        glGetUniformLocation(voxelProgram->id, "shadowMultiplier");
+    int sunStrengthId = glGetUniformLocation(voxelProgram->id, "sunStrength");
+    int enableLightSamplingId =
+        glGetUniformLocation(voxelProgram->id, "enableLightSampling");
+    int numLightsId = glGetUniformLocation(voxelProgram->id, "numLights");
+    int enableAdaptiveSamplingId =
+        glGetUniformLocation(voxelProgram->id, "enableAdaptiveSampling");
+    int adaptiveThresholdId =
+        glGetUniformLocation(voxelProgram->id, "adaptiveThreshold");
+    int adaptiveMinSamplesId =
+        glGetUniformLocation(voxelProgram->id, "adaptiveMinSamples");
+    int reprojectHistoryId =
+        glGetUniformLocation(voxelProgram->id, "reprojectHistory");
+    int prevViewId = glGetUniformLocation(voxelProgram->id, "prevView");
+    int prevProjectionId =
+        glGetUniformLocation(voxelProgram->id, "prevProjection");
+    int prevCameraPosId = glGetUniformLocation(voxelProgram->id, "prevCameraPos");
+    int maxHistorySamplesId =
+        glGetUniformLocation(voxelProgram->id, "maxHistorySamples");
+    int renderSizeId = glGetUniformLocation(voxelProgram->id, "renderSize");
+    int prevRenderSizeId =
+        glGetUniformLocation(voxelProgram->id, "prevRenderSize");
+    int quadRenderSizeId =
+        glGetUniformLocation(quadProgram->id, "renderSize");
+    int denoiseRenderSizeId =
+        glGetUniformLocation(denoiseProgram->id, "renderSize");
+    int denoiseStepSizeId =
+        glGetUniformLocation(denoiseProgram->id, "stepSize");
+    int denoiseSigmaLuminanceId =
+        glGetUniformLocation(denoiseProgram->id, "sigmaLuminance");
+    int denoiseSigmaDepthId =
+        glGetUniformLocation(denoiseProgram->id, "sigmaDepth");
 
     unsigned int globalFrameCounter = 0;
     unsigned int numSamples = 1;
@@ -219,35 +484,193 @@ int main(int argc, char *argv[]) {
     bool sample = true;
     glm::vec3 sunDir{-100, 200, -100};
     bool enableShadows = true;
+    bool enableSunVisibility = true;
     bool enableGlobalIllumination = false;
+    bool enableIrradianceCache = true;
+    int irradianceUpdatesPerBatch = 2048;
     bool enableRayRandomization = true;
+    SamplerType samplerType = SamplerType::Sobol;
+    bool enableEmptySpaceSkipping = true;
     float shadowMultiplier = 0.5;
-    std::independent_bits_engine<std::default_random_engine, 32, unsigned int>
-        randomEngine{};
-
-    glUseProgram(voxelProgram.id);
-    glUniform3i(randomnessId, 0, 0, 0);
-    glUniform3i(noiseSizeId, activeNoise->textureWidth,
-                activeNoise->textureHeight, activeNoise->textureLayerCount);
-    glUniform3uiv(mapSizeId, 1, &model.size[0]);
+    float sunStrength = 1.0f;
+    bool enableLightSampling = true;
+    bool enableAdaptiveSampling = false;
+    float adaptiveThreshold = 0.01f;
+    int adaptiveMinSamples = 8;
+    bool enableReprojection = true;
+    int maxHistorySamples = 32;
+    bool enableDenoiser = false;
+    DenoiseSettings denoiseSettings;
+    bool enableDynamicResolution = false;
+    float renderScale = 1.0f;
+    ResolutionController resolutionController;
+    ResolutionControllerSettings resolutionSettings =
+        resolutionController.settings();
+    glm::ivec2 renderSize = windowSize;
+    glm::ivec3 editMin{0};
+    glm::ivec3 editMax{4};
+    int editPaletteIndex = 1;
+    // Camera the accumulated image was last rendered with
+    glm::mat4 renderedViewMat = camera.m_viewMat;
+    glm::mat4 renderedProjectionMat = camera.m_projectionMat;
+    glm::vec3 renderedCameraPos = camera.m_position;
+    glm::ivec2 renderedSize = renderSize;
+
+    // A new sun direction or depth is baked into bakedSunVisibility on the
+    // loader pool, and swapped in when it is done. A request during a bake
+    // starts another one after it, the result of the first is dropped.
+    SunVisibility sunVisibility;
+    SunVisibility bakedSunVisibility;
+    BackgroundTask sunVisibilityBake(loaderPool);
+    bool sunVisibilityRequested = false;
+    auto sunVisibilityPending = [&] {
+      return sunVisibilityRequested || sunVisibilityBake.running();
+    };
+
+    // The voxel shader's settings on the CPU, for the caches it reads. The
+    // bits of a pending bake are for another sun, shadows are traced then.
+    auto cpuTracer = [&] {
+      RenderSettings settings;
+      settings.maxDDADepth = maxDDADepth;
+      settings.sunDir = sunDir;
+      settings.enableShadows = enableShadows;
+      settings.enableEmptySpaceSkipping = enableEmptySpaceSkipping;
+      settings.sunStrength = sunStrength;
+      settings.enableLightSampling = enableLightSampling;
+      CpuTracer tracer(*model, settings);
+      if (enableSunVisibility && !sunVisibilityPending()) {
+        tracer.m_sunVisibility = &sunVisibility;
+      }
+      return tracer;
+    };
+
+    // Sun shadows are traced once per exposed face on the loader pool, and
+    // again for the faces an edit or a new sun direction may have changed
+    sunVisibility = bakeSunVisibility(cpuTracer(), loaderPool);
+    GLuint sunVisibilityBufferId;
+    glGenBuffers(1, &sunVisibilityBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sunVisibilityBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 sunVisibility.bits.size() * sizeof(uint32_t),
+                 sunVisibility.bits.data(), GL_DYNAMIC_DRAW);
+
+    // Global illumination reads the light of the faces its paths end on
+    // from a cache that the loader pool refines in the background, a batch
+    // of entries at a time. Entries near an edit, and all of them when the
+    // sun changes, start over.
+    IrradianceCache irradianceCache(*model);
+    GLuint irradianceBufferId;
+    glGenBuffers(1, &irradianceBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, irradianceBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 irradianceCache.entries().size() * sizeof(glm::vec4),
+                 irradianceCache.entries().data(), GL_DYNAMIC_DRAW);
+
+    // While a batch runs it owns the cache, and reads the model and the sun
+    // visibility. The render loop uploads, invalidates and counts between
+    // batches only, and waits for the running one before changing what it
+    // reads. The GPU keeps its copy of the entries meanwhile, so the cache
+    // needs no second buffer.
+    DirtyRanges irradianceEdits(256);
+    BackgroundTask irradianceUpdate(loaderPool);
+    bool irradianceInvalidated = false;
+    size_t irradiancePending = irradianceCache.numPending();
+    auto collectIrradianceUpdate = [&](bool wait) {
+      if (wait ? irradianceUpdate.wait() : irradianceUpdate.poll()) {
+        uploadDirtyRanges(irradianceBufferId, irradianceEdits,
+                          irradianceCache.entries().data());
+        irradianceEdits.clear();
+      }
+    };
+
+    // The shader traces sun shadows itself until the bake is swapped in
+    auto rebakeSunVisibilityCache = [&] {
+      sunVisibilityRequested = true;
+      glUniform1i(enableSunVisibilityId, false);
+    };
+    // Swaps in a finished bake that no later request replaced. Irradiance
+    // batches do not start while a bake is pending, one from before it may
+    // still read the old bits.
+    auto collectSunVisibilityBake = [&](bool wait) {
+      if ((wait ? sunVisibilityBake.wait() : sunVisibilityBake.poll()) &&
+          !sunVisibilityRequested) {
+        collectIrradianceUpdate(true);
+        std::swap(sunVisibility, bakedSunVisibility);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sunVisibilityBufferId);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                        sunVisibility.bits.size() * sizeof(uint32_t),
+                        sunVisibility.bits.data());
+        glUniform1i(enableSunVisibilityId, enableSunVisibility);
+        irradianceInvalidated = true;
+        numSamples = 1;
+      }
+    };
+
+    glUseProgram(voxelProgram->id);
+    glUniform1i(samplerTypeId, int(samplerType));
+    glUniform3uiv(mapSizeId, 1, &model->size[0]);
+    glUniform3uiv(brickGridSizeId, 1, &model->occupancy.bricks.size[0]);
+    glUniform3uiv(coarseGridSizeId, 1, &model->occupancy.coarse.size[0]);
+    glUniform1i(enableEmptySpaceSkippingId, enableEmptySpaceSkipping);
+    glUniform1i(brickedVoxelsId, model->layout == VoxelLayout::Bricked);
     glUniform1i(maxDDADepthId, maxDDADepth);
     glUniform1i(numRayBouncesId, numRayBounces);
     glUniform3fv(sunDirId, 1, &sunDir[0]);
     glUniform1i(enableShadowsId, enableShadows);
+    glUniform1i(enableSunVisibilityId, enableSunVisibility);
     glUniform1i(enableGlobalIlluminationId, enableGlobalIllumination);
+    glUniform1i(enableIrradianceCacheId, enableIrradianceCache);
     glUniform1i(enableRayRandomizationId, enableRayRandomization);
     glUniform1f(shadowMultiplierId, shadowMultiplier);
+    glUniform1f(sunStrengthId, sunStrength);
+    glUniform1i(enableLightSamplingId, enableLightSampling);
+    glUniform1ui(numLightsId, GLuint(model->lights.lights.size()));
+    glUniform1i(enableAdaptiveSamplingId, enableAdaptiveSampling);
+    glUniform1f(adaptiveThresholdId, adaptiveThreshold);
+    glUniform1ui(adaptiveMinSamplesId, adaptiveMinSamples);
+    glUniform1ui(maxHistorySamplesId, maxHistorySamples);
+
+    // Stage timings, recorded while enabled in the Profiler section
+    setTraceThreadName("main");
+    GpuTimer gpuTimer;
+    TraceHistograms traceHistograms;
+    bool enableTracing = tracingEnabled();
 
     while (!glfwWindowShouldClose(window)) {
-      glfwPollEvents();
+      TRACE_SCOPE("frame");
+      {
+        TRACE_SCOPE("poll events");
+        glfwPollEvents();
+      }
+
+      glm::ivec2 framebufferSize;
+      glfwGetFramebufferSize(window, &framebufferSize.x, &framebufferSize.y);
+      if (framebufferSize.x == 0 || framebufferSize.y == 0) {
+        // Minimized, nothing to draw into
+        glfwWaitEventsTimeout(0.1);
+        continue;
+      }
+      if (framebufferSize != windowSize) {
+        // Whatever was accumulated is lost with the old render targets
+        windowSize = framebufferSize;
+        allocateRenderTargets(windowSize);
+        glViewport(0, 0, windowSize.x, windowSize.y);
+        camera.updateProjection(windowSize.x, windowSize.y);
+        numSamples = 1;
+      }
+
+      gpuTimer.collect();
+      traceHistograms.update();
 
       // Start the Dear ImGui frame
+      ScopedTrace imguiTrace("imgui");
       ImGui_ImplOpenGL3_NewFrame();
       ImGui_ImplGlfw_NewFrame();
       ImGui::NewFrame();
 
       ++globalFrameCounter;
 
+      bool cameraMoved = false;
       if (dragging) {
         double cursorX;
         double cursorY;
@@ -257,10 +680,10 @@ int main(int argc, char *argv[]) {
         double deltaY = lastCursorY - cursorY;
 
         if (deltaX != 0.0 || deltaY != 0.0) {
-          camera.arcBallRotate(deltaX, deltaY, screenWidth, screenHeight);
+          camera.arcBallRotate(deltaX, deltaY, windowSize.x, windowSize.y);
           lastCursorX = cursorX;
           lastCursorY = cursorY;
-          numSamples = 1;
+          cameraMoved = true;
         }
       }
 
@@ -269,13 +692,54 @@ int main(int argc, char *argv[]) {
       }
 
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-      glUseProgram(voxelProgram.id);
+      glUseProgram(voxelProgram->id);
 
       ImGui::Begin("Settings");
       ImGui::Text("Ms/Frame: %.2f", 1000.0f / io.Framerate);
       ImGui::Text("FPS: %.2f", ImGui::GetIO().Framerate);
       ImGui::Text("Samples: %d", numSamples - 1);
       ImGui::Checkbox("Accumulate Samples", &sample);
+      if (ImGui::Checkbox("Adaptive Sampling", &enableAdaptiveSampling)) {
+        glUniform1i(enableAdaptiveSamplingId, enableAdaptiveSampling);
+        numSamples = 1;
+      }
+      if (enableAdaptiveSampling) {
+        ImGui::SameLine();
+        glm::ivec2 numWorkGroups = workGroupCount(renderSize, workGroupSize);
+        ImGui::Text("Converged: %.1f%%",
+                    100.0f * float(convergedTiles) /
+                        float(numWorkGroups.x * numWorkGroups.y));
+      }
+      if (ImGui::InputFloat("Adaptive Threshold", &adaptiveThreshold, 0.001f,
+                            0.01f, "%.4f",
+                            ImGuiInputTextFlags_EnterReturnsTrue)) {
+        glUniform1f(adaptiveThresholdId, adaptiveThreshold);
+        numSamples = 1;
+      }
+      if (ImGui::InputInt("Adaptive Min Samples", &adaptiveMinSamples, 1, 10,
+                          ImGuiInputTextFlags_EnterReturnsTrue)) {
+        glUniform1ui(adaptiveMinSamplesId, adaptiveMinSamples);
+        numSamples = 1;
+      }
+      if (ImGui::Checkbox("Dynamic Resolution", &enableDynamicResolution)) {
+        resolutionController.reset();
+      }
+      ImGui::SameLine();
+      ImGui::Text("%dx%d (%.0f%%)", renderSize.x, renderSize.y,
+                  100.0f * renderScale);
+      if (enableDynamicResolution) {
+        if (ImGui::InputFloat("Target Ms/Frame", &resolutionSettings.targetMs,
+                              1.0f, 5.0f, "%.1f",
+                              ImGuiInputTextFlags_EnterReturnsTrue)) {
+          resolutionSettings.targetMs =
+              std::max(resolutionSettings.targetMs, 1.0f);
+          resolutionController.setSettings(resolutionSettings);
+        }
+      } else {
+        ImGui::SliderFloat("Render Scale", &renderScale,
+                           resolutionSettings.minScale,
+                           resolutionSettings.maxScale, "%.2f");
+      }
       if (ImGui::Checkbox("Enable Ray Randomization",
                           &enableRayRandomization)) {
         glUniform1i(enableRayRandomizationId, enableRayRandomization);
@@ -286,6 +750,15 @@ int main(int argc, char *argv[]) {
         glUniform1i(enableGlobalIlluminationId, enableGlobalIllumination);
         numSamples = 1;
       }
+      if (ImGui::Checkbox("Irradiance Cache", &enableIrradianceCache)) {
+        glUniform1i(enableIrradianceCacheId, enableIrradianceCache);
+        numSamples = 1;
+      }
+      ImGui::SameLine();
+      ImGui::Text("(%zu bricks pending)", irradiancePending);
+      ImGui::InputInt("Cache Updates / Batch", &irradianceUpdatesPerBatch, 256,
+                      1024);
+      irradianceUpdatesPerBatch = std::max(irradianceUpdatesPerBatch, 0);
       if (ImGui::InputInt("Num Ray Bounces", &numRayBounces, 1, 100,
                           ImGuiInputTextFlags_EnterReturnsTrue)) {
         glUniform1i(numRayBouncesId, numRayBounces);
@@ -294,25 +767,58 @@ int main(int argc, char *argv[]) {
       if (ImGui::InputInt("Max DDA Depth", &maxDDADepth, 1, 100,
                           ImGuiInputTextFlags_EnterReturnsTrue)) {
         glUniform1i(maxDDADepthId, maxDDADepth);
+        rebakeSunVisibilityCache();
+        numSamples = 1;
+      }
+      if (ImGui::Checkbox("Enable Empty Space Skipping",
+                          &enableEmptySpaceSkipping)) {
+        glUniform1i(enableEmptySpaceSkippingId, enableEmptySpaceSkipping);
+        // Shadow rays skip too, which changes how far they reach
+        rebakeSunVisibilityCache();
         numSamples = 1;
       }
       if (ImGui::InputFloat3("Camera Position", &camera.m_position[0], "%.2f",
                              ImGuiInputTextFlags_EnterReturnsTrue)) {
         camera.updateView();
-        numSamples = 1;
+        cameraMoved = true;
       }
       if (ImGui::InputFloat3("Camera Target", &camera.m_focusPoint[0], "%.2f",
                              ImGuiInputTextFlags_EnterReturnsTrue)) {
         camera.updateView();
+        cameraMoved = true;
+      }
+      if (ImGui::Checkbox("Temporal Reprojection", &enableReprojection)) {
         numSamples = 1;
       }
+      if (ImGui::InputInt("Max History Samples", &maxHistorySamples, 1, 10,
+                          ImGuiInputTextFlags_EnterReturnsTrue)) {
+        glUniform1ui(maxHistorySamplesId, maxHistorySamples);
+      }
+      // Filters the accumulated image for display only, accumulation goes on
+      // from the unfiltered one
+      ImGui::Checkbox("Denoise", &enableDenoiser);
+      if (enableDenoiser) {
+        ImGui::SliderInt("Denoise Passes", &denoiseSettings.iterations, 1, 6);
+        ImGui::SliderFloat("Denoise Luminance Sigma",
+                           &denoiseSettings.sigmaLuminance, 0.05f, 4.0f,
+                           "%.2f");
+        ImGui::SliderFloat("Denoise Depth Sigma", &denoiseSettings.sigmaDepth,
+                           0.001f, 0.1f, "%.3f");
+      }
       if (ImGui::InputFloat3("Sun Direction", &sunDir[0], "%.2f",
                              ImGuiInputTextFlags_EnterReturnsTrue)) {
         glUniform3fv(sunDirId, 1, &sunDir[0]);
+        rebakeSunVisibilityCache();
         numSamples = 1;
       }
       if (ImGui::Checkbox("Enable Shadows", &enableShadows)) {
         glUniform1i(enableShadowsId, enableShadows);
+        irradianceInvalidated = true;
+        numSamples = 1;
+      }
+      if (ImGui::Checkbox("Baked Sun Shadows", &enableSunVisibility)) {
+        glUniform1i(enableSunVisibilityId,
+                    enableSunVisibility && !sunVisibilityPending());
         numSamples = 1;
       }
       if (ImGui::InputFloat("Shadow Multiplier", &shadowMultiplier, 0.1f, 0.2f,
@@ -320,47 +826,284 @@ int main(int argc, char *argv[]) {
         glUniform1f(shadowMultiplierId, shadowMultiplier);
         numSamples = 1;
       }
-      if (ImGui::RadioButton("White Noise", activeNoise == &whiteNoise)) {
-        activeNoise = &whiteNoise;
+      if (ImGui::InputFloat("Sun Strength", &sunStrength, 0.1f, 0.5f, "%.2f",
+                            ImGuiInputTextFlags_EnterReturnsTrue)) {
+        glUniform1f(sunStrengthId, sunStrength);
+        irradianceInvalidated = true;
+        numSamples = 1;
+      }
+      if (ImGui::Checkbox("Light Sampling", &enableLightSampling)) {
+        glUniform1i(enableLightSamplingId, enableLightSampling);
         numSamples = 1;
       }
       ImGui::SameLine();
-      if (ImGui::RadioButton("Blue Noise", activeNoise == &blueNoise)) {
-        activeNoise = &blueNoise;
+      ImGui::Text("(%zu emissive voxels)", model->lights.lights.size());
+      ImGui::Text("Sampler");
+      for (SamplerType type : {SamplerType::Random, SamplerType::Sobol,
+                               SamplerType::R2, SamplerType::BlueNoise}) {
+        ImGui::SameLine();
+        if (ImGui::RadioButton(samplerName(type), samplerType == type)) {
+          samplerType = type;
+          glUniform1i(samplerTypeId, int(samplerType));
+          numSamples = 1;
+        }
+      }
+
+      if (ImGui::CollapsingHeader("Edit")) {
+        ImGui::InputInt3("Box Min", &editMin[0]);
+        ImGui::InputInt3("Box Max", &editMax[0]);
+        ImGui::InputInt("Palette Index", &editPaletteIndex);
+        editMin = glm::max(editMin, 0);
+        editMax = glm::max(editMax, 0);
+        editPaletteIndex = glm::clamp(editPaletteIndex, 0, 255);
+        // Edits write the model running bakes and batches read, and rebake
+        // the sun visibility of the region on top of the current bits
+        if (ImGui::Button("Fill Box")) {
+          collectSunVisibilityBake(true);
+          collectIrradianceUpdate(true);
+          editor.fillBox(glm::uvec3(editMin), glm::uvec3(editMax),
+                         uint8_t(editPaletteIndex));
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Clear Box")) {
+          collectSunVisibilityBake(true);
+          collectIrradianceUpdate(true);
+          editor.clearBox(glm::uvec3(editMin), glm::uvec3(editMax));
+        }
+      }
+
+      // Only the parts of the buffers an edit touched are uploaded
+      if (!editor.edits().empty()) {
+        TRACE_SCOPE("upload edits");
+        ModelEdits const &edits = editor.edits();
+        uploadDirtyRanges(voxelIndexBufferId, edits.indices,
+                          model->indices.data());
+        uploadDirtyRanges(voxelSolidBufferId, edits.solid,
+                          model->solid.data());
+        uploadDirtyRanges(voxelPaletteBufferId, edits.palette,
+                          model->palette.data());
+        uploadDirtyRanges(brickOccupancyBufferId, edits.brickOccupancy,
+                          model->occupancy.bricks.bits.data());
+        uploadDirtyRanges(coarseOccupancyBufferId, edits.coarseOccupancy,
+                          model->occupancy.coarse.bits.data());
+        if (edits.lights) {
+          uploadLights(voxelLightBufferId, *model);
+          glUniform1ui(numLightsId, GLuint(model->lights.lights.size()));
+        }
+        DirtyRanges sunVisibilityEdits(256);
+        rebakeSunVisibility(sunVisibility, cpuTracer(), edits.voxelsMin,
+                            edits.voxelsMax, loaderPool, &sunVisibilityEdits);
+        uploadDirtyRanges(sunVisibilityBufferId, sunVisibilityEdits,
+                          sunVisibility.bits.data());
+        irradianceCache.invalidate(edits.voxelsMin, edits.voxelsMax);
+        irradianceCache.invalidateSunVisibility(sunVisibility,
+                                                sunVisibilityEdits);
+        editor.edits().clear();
         numSamples = 1;
       }
-      glm::uvec3 randomness{randomEngine(), randomEngine(), randomEngine()};
+
+      collectSunVisibilityBake(false);
+      if (sunVisibilityRequested && !sunVisibilityBake.running()) {
+        CpuTracer tracer = cpuTracer();
+        sunVisibilityRequested = false;
+        sunVisibilityBake.start([&bakedSunVisibility, &loaderPool, tracer] {
+          TRACE_SCOPE("sun visibility bake");
+          bakedSunVisibility = bakeSunVisibility(tracer, loaderPool);
+        });
+      }
+
+      // Uploads a finished batch and starts the next one, with the settings
+      // of this frame
+      collectIrradianceUpdate(false);
+      if (!irradianceUpdate.running() && !sunVisibilityPending()) {
+        if (irradianceInvalidated) {
+          irradianceCache.invalidateAll();
+          irradianceInvalidated = false;
+        }
+        irradiancePending = irradianceCache.numPending();
+        if (enableGlobalIllumination && enableIrradianceCache &&
+            irradianceUpdatesPerBatch > 0) {
+          irradianceUpdate.start(
+              [&irradianceCache, &irradianceEdits, &loaderPool,
+               tracer = cpuTracer(),
+               budget = size_t(irradianceUpdatesPerBatch)] {
+                TRACE_SCOPE("irradiance update");
+                irradianceCache.update(tracer, budget, loaderPool,
+                                       &irradianceEdits);
+              });
+        }
+      }
+
+      if (ImGui::CollapsingHeader("Profiler")) {
+        if (ImGui::Checkbox("Record Trace", &enableTracing)) {
+          setTracingEnabled(enableTracing);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Save Trace")) {
+          try {
+            writeChromeTrace("draft-trace.json");
+          } catch (std::exception const &e) {
+            std::cerr << e.what() << std::endl;
+          }
+        }
+        // Per frame totals of each stage, GPU stages lag a few frames
+        for (auto const &stage : traceHistograms.stages()) {
+          char overlay[64];
+          std::snprintf(overlay, sizeof(overlay), "%.2f ms, mean %.2f, p95 %.2f",
+                        stage.latestMs, stage.meanMs, stage.p95Ms);
+          ImGui::PlotHistogram(stage.name.c_str(), stage.history.data(),
+                               int(stage.history.size()), 0, overlay, 0.0f,
+                               stage.p95Ms * 1.5f, ImVec2(0, 40));
+        }
+      }
 
       ImGui::End();
       ImGui::Render();
+      imguiTrace.end();
 
-      glUniform3ui(randomnessId, randomEngine(), randomEngine(),
-                   randomEngine());
-      glUniform1ui(frameCountId, globalFrameCounter);
+      // The render scale follows the time of the previous frame
+      if (enableDynamicResolution) {
+        renderScale = resolutionController.update(io.DeltaTime * 1000.0f);
+      }
+      renderSize = scaledResolution(windowSize, renderScale);
+      bool rescaled = renderSize != renderedSize;
+
+      // Camera moves and render scale changes keep the accumulated image by
+      // reprojecting it, unless there is nothing accumulated to keep
+      bool reproject = (cameraMoved || rescaled) && enableReprojection &&
+                       sample && numSamples > 1;
+      if ((cameraMoved || rescaled) && !reproject) {
+        numSamples = 1;
+      }
+
+      ScopedTrace uniformTrace("uniforms");
+      // Accumulated samples walk along the pixels' sequences, single
+      // samples take a new point every frame
+      glUniform1ui(sampleIndexId,
+                   sample ? numSamples - 1 : globalFrameCounter);
       glUniform1ui(numSamplesId, numSamples);
       glUniformMatrix4fv(invViewId, 1, false, &camera.m_invViewMat[0][0]);
       glUniformMatrix4fv(invCenteredViewId, 1, false,
                          &camera.m_invCenteredMat[0][0]);
       glUniformMatrix4fv(invProjectionId, 1, false,
                          &camera.m_invProjectionMat[0][0]);
+      glUniform2i(renderSizeId, renderSize.x, renderSize.y);
 
       glBindImageTexture(0, renderTextureId, 0, false, 0, GL_READ_WRITE,
                          GL_RGBA32F);
-      glBindImageTexture(1, activeNoise->textureId, 0, false, 0, GL_READ_ONLY,
-                         GL_RGBA32F);
+      glBindImageTexture(1, blueNoise->textureId, 0, true, 0, GL_READ_ONLY,
+                         GL_RG8);
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, voxelIndexBufferId);
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, voxelPaletteBufferId);
       glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, voxelSolidBufferId);
-      glDispatchCompute(screenWidth / 10, screenHeight / 10, 1);
-      glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
-                      GL_SHADER_STORAGE_BARRIER_BIT);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, brickOccupancyBufferId);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, coarseOccupancyBufferId);
+      glBindImageTexture(2, momentsTextureId, 0, false, 0, GL_READ_WRITE,
+                         GL_RGBA32F);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, tileConvergenceBufferId);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, voxelLightBufferId);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, sunVisibilityBufferId);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, irradianceBufferId);
+
+      glUniform1i(reprojectHistoryId, reproject);
+      if (reproject) {
+        // The shader writes the images it reprojects from, so it reads copies
+        glCopyImageSubData(renderTextureId, GL_TEXTURE_2D, 0, 0, 0, 0,
+                           historyColorTextureId, GL_TEXTURE_2D, 0, 0, 0, 0,
+                           renderedSize.x, renderedSize.y, 1);
+        glCopyImageSubData(momentsTextureId, GL_TEXTURE_2D, 0, 0, 0, 0,
+                           historyMomentsTextureId, GL_TEXTURE_2D, 0, 0, 0, 0,
+                           renderedSize.x, renderedSize.y, 1);
+        glUniform2i(prevRenderSizeId, renderedSize.x, renderedSize.y);
+        glUniformMatrix4fv(prevViewId, 1, false, &renderedViewMat[0][0]);
+        glUniformMatrix4fv(prevProjectionId, 1, false,
+                           &renderedProjectionMat[0][0]);
+        glUniform3fv(prevCameraPosId, 1, &renderedCameraPos[0]);
+      }
+      glBindImageTexture(3, historyColorTextureId, 0, false, 0, GL_READ_ONLY,
+                         GL_RGBA32F);
+      glBindImageTexture(4, historyMomentsTextureId, 0, false, 0,
+                         GL_READ_ONLY, GL_RGBA32F);
+      glBindImageTexture(5, normalTextureId, 0, false, 0, GL_READ_WRITE,
+                         GL_RGBA32F);
+      glBindImageTexture(6, albedoTextureId, 0, false, 0, GL_READ_WRITE,
+                         GL_RGBA32F);
+      renderedViewMat = camera.m_viewMat;
+      renderedProjectionMat = camera.m_projectionMat;
+      renderedCameraPos = camera.m_position;
+      renderedSize = renderSize;
+
+      // Written by the dispatch three frames ago, then reused for this one
+      GLuint counterBufferId =
+          convergenceCounterBufferIds[globalFrameCounter %
+                                      convergenceCounterBufferIds.size()];
+      uint32_t zero = 0;
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBufferId);
+      glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t),
+                         &convergedTiles);
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t), &zero);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, counterBufferId);
+      uniformTrace.end();
+
+      {
+        TRACE_SCOPE("dispatch");
+        ScopedGpuTimer gpuTrace(gpuTimer, "gpu voxel dispatch");
+        // Rounded up, the shader leaves out the pixels past renderSize
+        glm::ivec2 numWorkGroups = workGroupCount(renderSize, workGroupSize);
+        glDispatchCompute(numWorkGroups.x, numWorkGroups.y, 1);
+        // The buffer update bit covers reading the convergence counter back
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                        GL_SHADER_STORAGE_BARRIER_BIT |
+                        GL_BUFFER_UPDATE_BARRIER_BIT);
+      }
       ++numSamples;
 
-      glUseProgram(quadProgram.id);
-      glBindVertexArray(vertexArrayId);
-      glDrawArrays(GL_TRIANGLES, 0, quadVertices.size() / 3);
+      GLuint displayTextureId = renderTextureId;
+      if (enableDenoiser) {
+        TRACE_SCOPE("denoise");
+        ScopedGpuTimer gpuTrace(gpuTimer, "gpu denoise");
+        glUseProgram(denoiseProgram->id);
+        glUniform2i(denoiseRenderSizeId, renderSize.x, renderSize.y);
+        glUniform1f(denoiseSigmaDepthId, denoiseSettings.sigmaDepth);
+        glBindImageTexture(1, normalTextureId, 0, false, 0, GL_READ_ONLY,
+                           GL_RGBA32F);
+        glBindImageTexture(2, albedoTextureId, 0, false, 0, GL_READ_ONLY,
+                           GL_RGBA32F);
+        glm::ivec2 numWorkGroups = workGroupCount(renderSize, workGroupSize);
+        for (int pass = 0; pass < denoiseSettings.iterations; ++pass) {
+          GLuint outputTextureId = denoiseTextureIds[pass % 2];
+          glBindImageTexture(0, displayTextureId, 0, false, 0, GL_READ_ONLY,
+                             GL_RGBA32F);
+          glBindImageTexture(3, outputTextureId, 0, false, 0, GL_WRITE_ONLY,
+                             GL_RGBA32F);
+          glUniform1i(denoiseStepSizeId, 1 << pass);
+          glUniform1f(denoiseSigmaLuminanceId,
+                      denoiseSettings.sigmaLuminance / float(1 << pass));
+          glDispatchCompute(numWorkGroups.x, numWorkGroups.y, 1);
+          glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                          GL_TEXTURE_FETCH_BARRIER_BIT);
+          displayTextureId = outputTextureId;
+        }
+      }
 
-      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+      {
+        TRACE_SCOPE("quad blit");
+        ScopedGpuTimer gpuTrace(gpuTimer, "gpu quad blit");
+        glUseProgram(quadProgram->id);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, displayTextureId);
+        glUniform2f(quadRenderSizeId, float(renderSize.x), float(renderSize.y));
+        glBindVertexArray(vertexArrayId);
+        glDrawArrays(GL_TRIANGLES, 0, quadVertices.size() / 3);
+      }
+
+      {
+        TRACE_SCOPE("imgui draw");
+        ScopedGpuTimer gpuTrace(gpuTimer, "gpu imgui draw");
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+      }
+
+      TRACE_SCOPE("swap buffers");
       glfwSwapBuffers(window);
     }
 
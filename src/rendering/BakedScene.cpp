@@ -0,0 +1,270 @@
+#include "BakedScene.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+#include "../util/MappedFile.h"
+#include "../util/Trace.h"
+
+namespace {
+    enum Section : uint32_t {
+        PaletteSection,
+        MaterialsSection,
+        IndicesSection,
+        SolidSection,
+        BrickBitsSection,
+        CoarseBitsSection,
+        DagNodesSection,
+        NumSections,
+    };
+
+    constexpr uint64_t sectionAlignment = 64;
+
+    // Whether the subtree of node, a node of the given level, stays inside
+    // the node words. A DAG is written children first, so every child offset
+    // must be below its parent's, which also rules out cycles. checkedLevels
+    // holds the level each node was already checked at, 0 if none.
+    bool validDagNode(std::vector<uint32_t> const& nodes, uint32_t node, uint32_t level,
+                      std::vector<uint8_t>& checkedLevels) {
+        if (node >= nodes.size() || level == 0) {
+            return false;
+        }
+        if (checkedLevels[node] != 0) {
+            return checkedLevels[node] == level;
+        }
+
+        uint32_t mask = nodes[node];
+        if (mask == 0 || mask > 0xff) {
+            return false;
+        }
+        if (level == 1) {
+            if (nodes.size() - node < 3) {
+                return false;
+            }
+        } else {
+            uint32_t numChildren = uint32_t(std::popcount(mask));
+            if (nodes.size() - node - 1 < numChildren) {
+                return false;
+            }
+            for (uint32_t i = 0; i < numChildren; ++i) {
+                uint32_t child = nodes[node + 1 + i];
+                if (child >= node || !validDagNode(nodes, child, level - 1, checkedLevels)) {
+                    return false;
+                }
+            }
+        }
+
+        checkedLevels[node] = uint8_t(level);
+        return true;
+    }
+
+    struct SectionRange {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct BakedSceneHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t layout;
+        uint32_t hasDag;
+        uint32_t size[3];
+        uint32_t dagLevels;
+        uint32_t dagRoot;
+        uint32_t reserved;
+        SectionRange sections[NumSections];
+        uint64_t checksum;
+    };
+
+    static_assert(std::is_trivially_copyable_v<BakedSceneHeader>);
+
+    constexpr char bakedSceneMagic[4] = {'V', 'X', 'C', ' '};
+
+    // 64 bit FNV-1a over whole words, tail bytes zero padded
+    uint64_t computeChecksum(std::span<uint8_t const> bytes) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        size_t i = 0;
+        for (; i + 8 <= bytes.size(); i += 8) {
+            uint64_t word;
+            std::memcpy(&word, bytes.data() + i, 8);
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+        if (i < bytes.size()) {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes.data() + i, bytes.size() - i);
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    template<typename T>
+    std::span<uint8_t const> asBytes(std::vector<T> const& values) {
+        return {reinterpret_cast<uint8_t const*>(values.data()), values.size() * sizeof(T)};
+    }
+
+    template<typename T>
+    void copySection(std::vector<T>& values, std::span<uint8_t const> bytes) {
+        values.resize(bytes.size() / sizeof(T));
+        std::memcpy(values.data(), bytes.data(), bytes.size());
+    }
+}
+
+void writeBakedScene(std::string const& filename, Model const& model, VoxelDag const* dag) {
+    TRACE_SCOPE("writeBakedScene");
+    std::span<uint8_t const> payloads[NumSections] = {
+            {reinterpret_cast<uint8_t const*>(model.palette.data()), sizeof(model.palette)},
+            {reinterpret_cast<uint8_t const*>(model.materials.data()), sizeof(model.materials)},
+            asBytes(model.indices),
+            asBytes(model.solid),
+            asBytes(model.occupancy.bricks.bits),
+            asBytes(model.occupancy.coarse.bits),
+            dag ? asBytes(dag->nodes) : std::span<uint8_t const>(),
+    };
+
+    BakedSceneHeader header{};
+    std::memcpy(header.magic, bakedSceneMagic, sizeof(header.magic));
+    header.version = bakedSceneVersion;
+    header.layout = uint32_t(model.layout);
+    header.hasDag = dag != nullptr;
+    header.size[0] = model.size.x;
+    header.size[1] = model.size.y;
+    header.size[2] = model.size.z;
+    header.dagLevels = dag ? dag->levels : 0;
+    header.dagRoot = dag ? dag->root : VoxelDag::emptyNode;
+
+    std::vector<uint8_t> body;
+    for (uint32_t section = 0; section < NumSections; ++section) {
+        uint64_t offset = (sizeof(BakedSceneHeader) + body.size() + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+        body.resize(offset - sizeof(BakedSceneHeader));
+        body.insert(body.end(), payloads[section].begin(), payloads[section].end());
+        header.sections[section] = {offset, payloads[section].size()};
+    }
+    header.checksum = computeChecksum(body);
+
+    std::ofstream ofs(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<char const*>(body.data()), std::streamsize(body.size()));
+    if (!ofs) {
+        throw std::runtime_error("Failed to write baked scene: " + filename);
+    }
+}
+
+BakedScene loadBakedScene(std::string const& filename) {
+    TRACE_SCOPE("loadBakedScene");
+    MappedFile file(filename);
+
+    auto fail = [&](std::string const& what) {
+        return std::runtime_error("Invalid baked scene " + filename + ": " + what);
+    };
+
+    BakedSceneHeader header;
+    if (file.size() < sizeof(header)) {
+        throw fail("truncated header");
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, bakedSceneMagic, sizeof(header.magic)) != 0) {
+        throw fail("not a baked scene");
+    }
+    if (header.version != bakedSceneVersion) {
+        throw fail("version " + std::to_string(header.version) + ", expected " + std::to_string(bakedSceneVersion) +
+                   ", bake it again");
+    }
+    if (header.layout > uint32_t(VoxelLayout::Bricked) || header.hasDag > 1) {
+        throw fail("bad header");
+    }
+
+    std::span<uint8_t const> body = file.bytes().subspan(sizeof(header));
+    if (computeChecksum(body) != header.checksum) {
+        throw fail("checksum mismatch");
+    }
+
+    BakedScene scene;
+    Model& model = scene.model;
+    glm::uvec3 size{header.size[0], header.size[1], header.size[2]};
+    if (size.x == 0 || size.y == 0 || size.z == 0 || size.x > 4096 || size.y > 4096 || size.z > 4096) {
+        throw fail("bad size");
+    }
+
+    // Derive every array size from the header instead of trusting the sections
+    model.allocate(size, VoxelLayout(header.layout));
+    OccupancyPyramid& occupancy = model.occupancy;
+    occupancy.bricks.cellSize = brickSize;
+    occupancy.bricks.size = (size + brickSize - 1u) / brickSize;
+    occupancy.coarse.cellSize = coarseCellSize;
+    occupancy.coarse.size = (size + coarseCellSize - 1u) / coarseCellSize;
+
+    auto levelBytes = [](OccupancyLevel const& level) {
+        return (size_t(level.size.x) * level.size.y * level.size.z + 31) / 32 * sizeof(uint32_t);
+    };
+
+    size_t expectedSizes[NumSections] = {
+            sizeof(model.palette),
+            sizeof(model.materials),
+            model.indices.size(),
+            model.solid.size(),
+            levelBytes(occupancy.bricks),
+            levelBytes(occupancy.coarse),
+            0,
+    };
+
+    std::span<uint8_t const> sections[NumSections];
+    for (uint32_t section = 0; section < NumSections; ++section) {
+        SectionRange range = header.sections[section];
+        if (range.offset % sectionAlignment != 0 || range.offset < sizeof(header) ||
+            range.offset > file.size() || range.size > file.size() - range.offset) {
+            throw fail("section out of bounds");
+        }
+        if (section != DagNodesSection && range.size != expectedSizes[section]) {
+            throw fail("section size does not match the scene size");
+        }
+        sections[section] = file.bytes().subspan(range.offset, range.size);
+    }
+
+    std::memcpy(model.palette.data(), sections[PaletteSection].data(), sizeof(model.palette));
+    std::memcpy(model.materials.data(), sections[MaterialsSection].data(), sizeof(model.materials));
+    for (PaletteMaterial const& material : model.materials) {
+        if (!(material.emission >= 0 && std::isfinite(material.emission)) || material.metal > 1) {
+            throw fail("bad materials");
+        }
+    }
+    copySection(model.indices, sections[IndicesSection]);
+    copySection(model.solid, sections[SolidSection]);
+    copySection(occupancy.bricks.bits, sections[BrickBitsSection]);
+    copySection(occupancy.coarse.bits, sections[CoarseBitsSection]);
+
+    if (header.hasDag) {
+        if (sections[DagNodesSection].size() % sizeof(uint32_t) != 0 ||
+            (header.dagRoot != VoxelDag::emptyNode && header.dagRoot >= sections[DagNodesSection].size() / sizeof(uint32_t)) ||
+            header.dagLevels > 16 || (1u << header.dagLevels) < std::max({size.x, size.y, size.z})) {
+            throw fail("bad DAG");
+        }
+        scene.hasDag = true;
+        scene.dag.levels = header.dagLevels;
+        scene.dag.size = size;
+        scene.dag.root = header.dagRoot;
+        copySection(scene.dag.nodes, sections[DagNodesSection]);
+
+        // traceDag follows child offsets without checking them
+        std::vector<uint8_t> checkedLevels(scene.dag.nodes.size(), 0);
+        if (scene.dag.root != VoxelDag::emptyNode &&
+            !validDagNode(scene.dag.nodes, scene.dag.root, scene.dag.levels, checkedLevels)) {
+            throw fail("bad DAG nodes");
+        }
+    }
+
+    model.lights = buildLightList(model);
+
+    return scene;
+}
+
+bool isBakedSceneFile(std::string const& filename) {
+    return std::filesystem::path(filename).extension() == ".vxc";
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+#include "Model.h"
+#include "VoxelDag.h"
+
+// Native scene file (.vxc) written by `draft --bake`. It stores a Model with
+// its materials, its occupancy pyramid and optionally a voxel DAG in the
+// exact layout the tracer and the SSBO uploads consume, so loading is a map,
+// a validation pass and one copy per array instead of parsing and
+// rebuilding. Only the light list is rebuilt, from the materials.
+//
+// Layout (little endian): a BakedSceneHeader followed by 64 byte aligned
+// sections. The checksum covers every byte after the header.
+
+constexpr uint32_t bakedSceneVersion = 2;
+
+struct BakedScene {
+    Model model;
+    bool hasDag = false;
+    VoxelDag dag;
+};
+
+// Throws std::runtime_error if the file cannot be written
+void writeBakedScene(std::string const& filename, Model const& model, VoxelDag const* dag = nullptr);
+
+// Throws std::runtime_error if the file is missing, from another version,
+// truncated, inconsistent or fails the checksum
+BakedScene loadBakedScene(std::string const& filename);
+
+bool isBakedSceneFile(std::string const& filename);
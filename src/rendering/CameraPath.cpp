@@ -0,0 +1,126 @@
+#include "CameraPath.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "../util/Json.h"
+
+namespace {
+    glm::vec3 parseVec3(JsonValue const& value) {
+        if (value.type != JsonType::Array || value.array.size() != 3) {
+            throw std::runtime_error("Expected [x, y, z], got " + formatJson(value));
+        }
+        return {float(value.array[0].asNumber()), float(value.array[1].asNumber()), float(value.array[2].asNumber())};
+    }
+
+    // Cubic Hermite spline from p1 at s = 0 to p2 at s = 1, with the
+    // tangents of a Catmull-Rom spline through keyframes that are not evenly
+    // spaced. t are the keyframes' frames.
+    glm::vec3 catmullRom(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, float t0, float t1, float t2,
+                         float t3, float s) {
+        float duration = t2 - t1;
+        glm::vec3 m1 = (p2 - p0) / (t2 - t0) * duration;
+        glm::vec3 m2 = (p3 - p1) / (t3 - t1) * duration;
+        float s2 = s * s;
+        float s3 = s2 * s;
+        return (2 * s3 - 3 * s2 + 1) * p1 + (s3 - 2 * s2 + s) * m1 + (-2 * s3 + 3 * s2) * p2 + (s3 - s2) * m2;
+    }
+}
+
+int CameraPath::numFrames() const {
+    return keyframes.empty() ? 0 : keyframes.back().frame + 1;
+}
+
+void CameraPath::evaluate(float frame, glm::vec3& position, glm::vec3& focusPoint) const {
+    if (keyframes.empty()) {
+        throw std::runtime_error("Camera path has no keyframes");
+    }
+    if (frame <= float(keyframes.front().frame)) {
+        position = keyframes.front().position;
+        focusPoint = keyframes.front().focusPoint;
+        return;
+    }
+    if (frame >= float(keyframes.back().frame)) {
+        position = keyframes.back().position;
+        focusPoint = keyframes.back().focusPoint;
+        return;
+    }
+
+    // The segment from keyframe i to i + 1 holds frame
+    auto next = std::upper_bound(keyframes.begin(), keyframes.end(), frame,
+                                 [](float f, CameraKeyframe const& keyframe) { return f < float(keyframe.frame); });
+    int i = int(next - keyframes.begin()) - 1;
+    CameraKeyframe const& k1 = keyframes[i];
+    CameraKeyframe const& k2 = keyframes[i + 1];
+    float s = (frame - float(k1.frame)) / float(k2.frame - k1.frame);
+
+    if (interpolation == PathInterpolation::Linear) {
+        position = k1.position + (k2.position - k1.position) * s;
+        focusPoint = k1.focusPoint + (k2.focusPoint - k1.focusPoint) * s;
+        return;
+    }
+
+    // The ends repeat the first and last keyframe
+    CameraKeyframe const& k0 = keyframes[std::max(i - 1, 0)];
+    CameraKeyframe const& k3 = keyframes[std::min(i + 2, int(keyframes.size()) - 1)];
+    float t0 = float(k0.frame);
+    float t1 = float(k1.frame);
+    float t2 = float(k2.frame);
+    float t3 = float(k3.frame);
+    position = catmullRom(k0.position, k1.position, k2.position, k3.position, t0, t1, t2, t3, s);
+    focusPoint = catmullRom(k0.focusPoint, k1.focusPoint, k2.focusPoint, k3.focusPoint, t0, t1, t2, t3, s);
+}
+
+CameraPath loadCameraPath(std::string const& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+
+    CameraPath path;
+    try {
+        JsonValue document = parseJson(text.str());
+        JsonValue const& interpolation = document["interpolation"];
+        if (!interpolation.isNull()) {
+            if (interpolation.asString() == "linear") {
+                path.interpolation = PathInterpolation::Linear;
+            } else if (interpolation.asString() == "catmull-rom") {
+                path.interpolation = PathInterpolation::CatmullRom;
+            } else {
+                throw std::runtime_error("Unknown interpolation: " + interpolation.asString());
+            }
+        }
+
+        JsonValue const& keyframes = document["keyframes"];
+        if (keyframes.type != JsonType::Array || keyframes.array.empty()) {
+            throw std::runtime_error("Expected an array of keyframes");
+        }
+        for (size_t i = 0; i < keyframes.array.size(); ++i) {
+            JsonValue const& keyframe = keyframes.array[i];
+            try {
+                path.keyframes.push_back({
+                        keyframe["frame"].asInt(),
+                        parseVec3(keyframe["position"]),
+                        parseVec3(keyframe["focusPoint"]),
+                });
+            } catch (std::runtime_error const& e) {
+                throw std::runtime_error("keyframe " + std::to_string(i) + ": " + e.what());
+            }
+        }
+    } catch (std::runtime_error const& e) {
+        throw std::runtime_error("Invalid camera path " + filename + ": " + e.what());
+    }
+
+    std::ranges::sort(path.keyframes, {}, &CameraKeyframe::frame);
+    for (size_t i = 0; i < path.keyframes.size(); ++i) {
+        if (path.keyframes[i].frame < 0 || (i > 0 && path.keyframes[i].frame == path.keyframes[i - 1].frame)) {
+            throw std::runtime_error("Invalid camera path " + filename + ": frame " +
+                                     std::to_string(path.keyframes[i].frame) + " is negative or used twice");
+        }
+    }
+    return path;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+// Camera::m_position and m_focusPoint at a frame of an animation
+struct CameraKeyframe {
+    int frame = 0;
+    glm::vec3 position{0};
+    glm::vec3 focusPoint{0};
+};
+
+enum class PathInterpolation {
+    Linear,
+    // Passes through every keyframe with a continuous velocity
+    CatmullRom,
+};
+
+// A camera flight through keyframes, as draft --sequence renders it. Frames
+// before the first and after the last keyframe hold still.
+struct CameraPath {
+    // Frames 0 to the last keyframe's
+    int numFrames() const;
+    void evaluate(float frame, glm::vec3& position, glm::vec3& focusPoint) const;
+
+    // Ordered by frame, no two on the same one
+    std::vector<CameraKeyframe> keyframes;
+    PathInterpolation interpolation = PathInterpolation::CatmullRom;
+};
+
+// Reads a JSON file of the form
+//
+//   {"interpolation": "catmull-rom",
+//    "keyframes": [{"frame": 0, "position": [x, y, z], "focusPoint": [x, y, z]},
+//                  {"frame": 120, ...}]}
+//
+// "interpolation" is "linear" or "catmull-rom" (default). Keyframes may come
+// in any order.
+CameraPath loadCameraPath(std::string const& filename);
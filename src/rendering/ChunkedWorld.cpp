@@ -0,0 +1,353 @@
+#include "ChunkedWorld.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <glm/common.hpp>
+#include <glm/vector_relational.hpp>
+
+#include "Dda.h"
+#include "Model.h"
+#include "../util/Trace.h"
+
+static_assert(chunkSize % coarseCellSize == 0, "Chunks must be aligned to the occupancy cells");
+
+TiledModelSource::TiledModelSource(Model const& model, glm::uvec3 tiles)
+        : m_model(model), m_tiles(tiles) {
+}
+
+glm::uvec3 TiledModelSource::worldSize() const {
+    return m_model.size * m_tiles;
+}
+
+std::array<uint32_t, 256> const& TiledModelSource::palette() const {
+    return m_model.palette;
+}
+
+void TiledModelSource::loadChunk(glm::ivec3 coord, Chunk& chunk) const {
+    glm::uvec3 origin = glm::uvec3(coord) * chunkSize;
+    glm::uvec3 end = glm::min(origin + chunkSize, worldSize());
+
+    for (uint32_t z = origin.z; z < end.z; ++z) {
+        for (uint32_t y = origin.y; y < end.y; ++y) {
+            for (uint32_t x = origin.x; x < end.x; ++x) {
+                glm::uvec3 voxel = glm::uvec3(x, y, z) % m_model.size;
+                if (m_model.isSolid(voxel)) {
+                    glm::uvec3 local = glm::uvec3(x, y, z) - origin;
+                    // 0 marks empty voxels in a chunk, keep solid ones visible
+                    uint8_t index = std::max<uint8_t>(m_model.paletteIndex(voxel), 1);
+                    chunk.indices[(size_t(local.z) * chunkSize + local.y) * chunkSize + local.x] = index;
+                }
+            }
+        }
+    }
+}
+
+static OccupancyLevel makeChunkLevel(uint32_t cellSize) {
+    OccupancyLevel level;
+    level.cellSize = cellSize;
+    level.size = glm::uvec3(chunkSize / cellSize);
+    level.bits.assign((size_t(level.size.x) * level.size.y * level.size.z + 31) / 32, 0);
+    return level;
+}
+
+// Size of a chunk with solid voxels, what a chunk that is not loaded yet
+// may take
+static size_t fullChunkBytes() {
+    static size_t const bytes = sizeof(Chunk) + size_t(chunkSize) * chunkSize * chunkSize +
+                                (makeChunkLevel(brickSize).bits.size() + makeChunkLevel(coarseCellSize).bits.size()) *
+                                        sizeof(uint32_t);
+    return bytes;
+}
+
+static void finishChunk(Chunk& chunk) {
+    chunk.bricks = makeChunkLevel(brickSize);
+    chunk.coarse = makeChunkLevel(coarseCellSize);
+
+    chunk.empty = true;
+    for (uint32_t z = 0; z < chunkSize; ++z) {
+        for (uint32_t y = 0; y < chunkSize; ++y) {
+            for (uint32_t x = 0; x < chunkSize; ++x) {
+                if (chunk.indices[(size_t(z) * chunkSize + y) * chunkSize + x] != 0) {
+                    chunk.bricks.set(glm::uvec3(x, y, z) / brickSize);
+                    chunk.coarse.set(glm::uvec3(x, y, z) / coarseCellSize);
+                    chunk.empty = false;
+                }
+            }
+        }
+    }
+
+    if (chunk.empty) {
+        chunk.indices = {};
+        chunk.bricks = {};
+        chunk.coarse = {};
+    }
+}
+
+ChunkedWorld::ChunkedWorld(std::unique_ptr<ChunkSource> source, size_t budgetBytes)
+        : m_source(std::move(source)),
+          m_size(m_source->worldSize()),
+          m_numChunks((m_size + chunkSize - 1u) / chunkSize),
+          m_budgetBytes(budgetBytes),
+          m_loader([this] { loaderLoop(); }) {
+}
+
+ChunkedWorld::~ChunkedWorld() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_loadQueued.notify_all();
+    m_loader.join();
+}
+
+void ChunkedWorld::update(glm::vec3 position, float radius) {
+    glm::ivec3 minChunk = glm::max(glm::ivec3(glm::floor((position - radius) / float(chunkSize))), glm::ivec3(0));
+    glm::ivec3 maxChunk = glm::min(glm::ivec3(glm::floor((position + radius) / float(chunkSize))), m_numChunks - 1);
+
+    auto distanceTo = [&](glm::ivec3 coord) {
+        glm::vec3 chunkMin = glm::vec3(coord) * float(chunkSize);
+        glm::vec3 closest = glm::clamp(position, chunkMin, chunkMin + float(chunkSize));
+        return glm::length(closest - position);
+    };
+
+    std::vector<glm::ivec3> wanted;
+    for (int z = minChunk.z; z <= maxChunk.z; ++z) {
+        for (int y = minChunk.y; y <= maxChunk.y; ++y) {
+            for (int x = minChunk.x; x <= maxChunk.x; ++x) {
+                if (distanceTo({x, y, z}) <= radius) {
+                    wanted.emplace_back(x, y, z);
+                }
+            }
+        }
+    }
+
+    std::sort(wanted.begin(), wanted.end(), [&](glm::ivec3 a, glm::ivec3 b) {
+        return distanceTo(a) < distanceTo(b);
+    });
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_position = position;
+
+        // Asking for more than fits would only evict what was just loaded.
+        // Resident chunks count with their size, chunks loaded before with
+        // what they took then and the others with what a full one takes.
+        size_t wantedBytes = 0;
+        size_t numWanted = 0;
+        for (; numWanted < wanted.size(); ++numWanted) {
+            uint64_t key = ChunkResidency::key(wanted[numWanted]);
+            auto resident = m_resident.find(key);
+            size_t bytes = resident != m_resident.end() ? resident->second->sizeBytes()
+                           : m_emptyChunks.contains(key) ? sizeof(Chunk)
+                                                         : fullChunkBytes();
+            if (numWanted > 0 && wantedBytes + bytes > m_budgetBytes) {
+                break;
+            }
+            wantedBytes += bytes;
+        }
+        wanted.resize(numWanted);
+
+        m_wanted.clear();
+        for (size_t i = 0; i < wanted.size(); ++i) {
+            m_wanted.emplace(ChunkResidency::key(wanted[i]), i);
+        }
+
+        m_queue.clear();
+        // Stored back to front so the loader pops the nearest chunk from the back
+        for (auto it = wanted.rbegin(); it != wanted.rend(); ++it) {
+            if (!m_resident.contains(ChunkResidency::key(*it))) {
+                m_queue.push_back(*it);
+            }
+        }
+    }
+    m_loadQueued.notify_one();
+}
+
+void ChunkedWorld::waitForLoads() {
+    std::unique_lock lock(m_mutex);
+    m_loadFinished.wait(lock, [&] { return m_queue.empty() && !m_loading; });
+}
+
+std::shared_ptr<ChunkResidency const> ChunkedWorld::beginFrame() {
+    auto residency = std::make_shared<ChunkResidency>();
+    residency->size = m_size;
+    residency->hits = &m_hits;
+    residency->misses = &m_misses;
+
+    std::lock_guard lock(m_mutex);
+    residency->frame = ++m_frame;
+    residency->chunks.reserve(m_resident.size());
+    for (auto const& [key, chunk] : m_resident) {
+        residency->chunks.emplace(key, chunk);
+    }
+    return residency;
+}
+
+ChunkCacheStats ChunkedWorld::stats() const {
+    ChunkCacheStats stats;
+    std::lock_guard lock(m_mutex);
+    stats.residentChunks = m_resident.size();
+    stats.residentBytes = m_residentBytes;
+    stats.budgetBytes = m_budgetBytes;
+    stats.queuedLoads = m_queue.size();
+    stats.loads = m_loads;
+    stats.evictions = m_evictions;
+    stats.hits = m_hits.load(std::memory_order_relaxed);
+    stats.misses = m_misses.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ChunkedWorld::loaderLoop() {
+    std::unique_lock lock(m_mutex);
+
+    while (true) {
+        m_loadQueued.wait(lock, [&] { return m_stopping || !m_queue.empty(); });
+        if (m_stopping) {
+            return;
+        }
+
+        glm::ivec3 coord = m_queue.back();
+        m_queue.pop_back();
+        m_loading = true;
+        lock.unlock();
+
+        auto chunk = std::make_shared<Chunk>();
+        {
+            TRACE_SCOPE("loadChunk");
+            chunk->coord = coord;
+            chunk->indices.assign(size_t(chunkSize) * chunkSize * chunkSize, 0);
+            m_source->loadChunk(coord, *chunk);
+            finishChunk(*chunk);
+        }
+
+        lock.lock();
+        uint64_t key = ChunkResidency::key(coord);
+        if (chunk->empty) {
+            m_emptyChunks.insert(key);
+        }
+        if (!m_resident.contains(key)) {
+            // Counts as just used, or it would be the first thing evicted
+            chunk->lastUsedFrame.store(m_frame, std::memory_order_relaxed);
+            m_residentBytes += chunk->sizeBytes();
+            m_resident.emplace(key, std::move(chunk));
+            ++m_loads;
+            evictOverBudget(key);
+        }
+        m_loading = false;
+        m_loadFinished.notify_all();
+    }
+}
+
+void ChunkedWorld::evictOverBudget(uint64_t keep) {
+    while (m_residentBytes > m_budgetBytes && m_resident.size() > 1) {
+        // Chunks the camera does not want first, least recently entered by
+        // a ray and the farthest from the camera on ties. Loads are picked
+        // by distance alone, so evicting a wanted chunk that no ray enters
+        // (e.g. one behind the camera) would only queue it again.
+        auto victim = m_resident.end();
+        bool victimWanted = true;
+        size_t victimRank = 0;
+        uint32_t victimFrame = std::numeric_limits<uint32_t>::max();
+        float victimDistance = 0;
+
+        for (auto it = m_resident.begin(); it != m_resident.end(); ++it) {
+            if (it->first == keep) {
+                continue;
+            }
+
+            auto wanted = m_wanted.find(it->first);
+            if (wanted != m_wanted.end()) {
+                // Only once nothing else is left, the farthest one
+                if (victimWanted && (victim == m_resident.end() || wanted->second > victimRank)) {
+                    victim = it;
+                    victimRank = wanted->second;
+                }
+                continue;
+            }
+
+            uint32_t frame = it->second->lastUsedFrame.load(std::memory_order_relaxed);
+            glm::vec3 center = (glm::vec3(it->second->coord) + 0.5f) * float(chunkSize);
+            float distance = glm::length(center - m_position);
+            if (victimWanted || frame < victimFrame || (frame == victimFrame && distance > victimDistance)) {
+                victim = it;
+                victimWanted = false;
+                victimFrame = frame;
+                victimDistance = distance;
+            }
+        }
+
+        m_residentBytes -= victim->second->sizeBytes();
+        m_resident.erase(victim);
+        ++m_evictions;
+    }
+}
+
+WorldHit traceWorld(ChunkResidency const& residency, glm::vec3 rayPos, glm::vec3 rayDir, int numSteps) {
+    WorldHit hit;
+
+    DDA dda;
+    initDDA(dda, rayPos, rayDir);
+
+    glm::ivec3 size{residency.size};
+    glm::ivec3 chunkCoord{-1};
+    Chunk const* chunk = nullptr;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    for (int i = 0; i < numSteps; ++i) {
+        glm::ivec3 voxel{dda.pos};
+
+        if (glm::all(glm::greaterThanEqual(voxel, glm::ivec3(0))) && glm::all(glm::lessThan(voxel, size))) {
+            glm::ivec3 coord = voxel / int(chunkSize);
+            if (coord != chunkCoord) {
+                chunkCoord = coord;
+                chunk = residency.find(coord);
+                if (chunk) {
+                    ++hits;
+                    if (chunk->lastUsedFrame.load(std::memory_order_relaxed) != residency.frame) {
+                        chunk->lastUsedFrame.store(residency.frame, std::memory_order_relaxed);
+                    }
+                } else {
+                    ++misses;
+                }
+            }
+
+            glm::uvec3 local = glm::uvec3(voxel - coord * int(chunkSize));
+            if (!chunk || chunk->empty) {
+                advanceThroughCell(dda, float(chunkSize));
+            } else if (!chunk->coarse.occupied(local / coarseCellSize)) {
+                advanceThroughCell(dda, float(coarseCellSize));
+            } else if (!chunk->bricks.occupied(local / brickSize)) {
+                advanceThroughCell(dda, float(brickSize));
+            } else if (uint8_t index = chunk->indices[(size_t(local.z) * chunkSize + local.y) * chunkSize + local.x]) {
+                hit.hit = true;
+                hit.normal = dda.normal;
+                hit.dist = dda.dist;
+                hit.paletteIndex = index;
+                break;
+            }
+        } else {
+            // Outside the world and moving away from it, this also ends
+            // shadow rays starting just above the surface right away
+            bool leaving = false;
+            for (int axis = 0; axis < 3; ++axis) {
+                leaving |= (voxel[axis] < 0 && dda.rayStep[axis] < 0) || (voxel[axis] >= size[axis] && dda.rayStep[axis] > 0);
+            }
+            if (leaving) {
+                break;
+            }
+        }
+
+        iterDDA(dda);
+    }
+
+    if (hits) {
+        residency.hits->fetch_add(hits, std::memory_order_relaxed);
+    }
+    if (misses) {
+        residency.misses->fetch_add(misses, std::memory_order_relaxed);
+    }
+
+    return hit;
+}
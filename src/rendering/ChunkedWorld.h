@@ -0,0 +1,179 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "Occupancy.h"
+
+struct Model;
+
+// Worlds too large for one dense Model are split into chunkSize^3 chunks
+// that are paged in around the camera by a background loader. Once the
+// resident chunks exceed a memory budget, those outside the wanted set
+// around the camera are evicted least recently used first.
+constexpr uint32_t chunkSize = 64;
+
+struct Chunk {
+    size_t sizeBytes() const {
+        return sizeof(Chunk) + indices.size() + (bricks.bits.size() + coarse.bits.size()) * sizeof(uint32_t);
+    }
+
+    glm::ivec3 coord{0};
+    // Chunks without solid voxels keep no payload and are skipped as a whole
+    bool empty = true;
+    // Palette indices, x fastest, 0 meaning empty
+    std::vector<uint8_t> indices;
+    // Occupancy of the bricks and coarse cells of the chunk, for skipping
+    // empty space like Model::occupancy
+    OccupancyLevel bricks;
+    OccupancyLevel coarse;
+    // Frame in which a ray last entered the chunk, for LRU eviction
+    mutable std::atomic<uint32_t> lastUsedFrame{0};
+};
+
+// Produces chunks on demand. Called from the loader thread only.
+class ChunkSource {
+public:
+    virtual ~ChunkSource() = default;
+
+    // World extent in voxels
+    virtual glm::uvec3 worldSize() const = 0;
+    virtual std::array<uint32_t, 256> const& palette() const = 0;
+
+    // Fills chunk.indices (already sized to chunkSize^3 and zeroed) for the
+    // chunk at coord
+    virtual void loadChunk(glm::ivec3 coord, Chunk& chunk) const = 0;
+};
+
+// Repeats a model tiles.x * tiles.y * tiles.z times, for worlds far larger
+// than the memory the model itself takes.
+class TiledModelSource : public ChunkSource {
+public:
+    TiledModelSource(Model const& model, glm::uvec3 tiles);
+
+    glm::uvec3 worldSize() const override;
+    std::array<uint32_t, 256> const& palette() const override;
+    void loadChunk(glm::ivec3 coord, Chunk& chunk) const override;
+
+private:
+    Model const& m_model;
+    glm::uvec3 m_tiles;
+};
+
+struct ChunkCacheStats {
+    size_t residentChunks = 0;
+    size_t residentBytes = 0;
+    size_t budgetBytes = 0;
+    size_t queuedLoads = 0;
+    uint64_t loads = 0;
+    uint64_t evictions = 0;
+    // Chunk entries of rays that found the chunk resident, and that did not
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    double hitRate() const { return hits + misses > 0 ? double(hits) / double(hits + misses) : 1.0; }
+};
+
+// The chunks resident at the start of a frame. Immutable, so rays read it
+// without locking while the loader keeps working on the next one. Chunks
+// evicted in the meantime stay alive until the residency is released.
+struct ChunkResidency {
+    static uint64_t key(glm::ivec3 coord) {
+        return uint64_t(coord.x) | (uint64_t(coord.y) << 21) | (uint64_t(coord.z) << 42);
+    }
+
+    Chunk const* find(glm::ivec3 coord) const {
+        auto it = chunks.find(key(coord));
+        return it != chunks.end() ? it->second.get() : nullptr;
+    }
+
+    glm::uvec3 size{0};
+    uint32_t frame = 0;
+    std::unordered_map<uint64_t, std::shared_ptr<Chunk const>> chunks;
+    // Where traversals report their hit and miss counts
+    std::atomic<uint64_t>* hits = nullptr;
+    std::atomic<uint64_t>* misses = nullptr;
+};
+
+class ChunkedWorld {
+public:
+    ChunkedWorld(std::unique_ptr<ChunkSource> source, size_t budgetBytes);
+    ~ChunkedWorld();
+
+    ChunkedWorld(ChunkedWorld const&) = delete;
+    ChunkedWorld& operator=(ChunkedWorld const&) = delete;
+
+    // Makes the chunks within radius voxels of position the wanted set,
+    // nearest first and no more than the budget can hold, and queues the
+    // non-resident ones for loading. Chunks queued earlier that are no longer
+    // wanted are dropped. Wanted chunks are only evicted when nothing else is
+    // left, so a camera that holds still stops loading.
+    void update(glm::vec3 position, float radius);
+
+    // Blocks until the load queue is empty
+    void waitForLoads();
+
+    // Snapshot of the resident chunks for the next frame
+    std::shared_ptr<ChunkResidency const> beginFrame();
+
+    ChunkCacheStats stats() const;
+
+    glm::uvec3 size() const { return m_size; }
+    std::array<uint32_t, 256> const& palette() const { return m_source->palette(); }
+
+private:
+    void loaderLoop();
+    void evictOverBudget(uint64_t keep);
+
+    std::unique_ptr<ChunkSource> m_source;
+    glm::uvec3 m_size;
+    glm::ivec3 m_numChunks;
+    size_t m_budgetBytes;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_loadQueued;
+    std::condition_variable m_loadFinished;
+    std::unordered_map<uint64_t, std::shared_ptr<Chunk>> m_resident;
+    // Key -> rank by distance of the chunks the last update wanted
+    std::unordered_map<uint64_t, size_t> m_wanted;
+    // Chunks found empty when they were loaded, which take next to nothing
+    // when they are loaded again
+    std::unordered_set<uint64_t> m_emptyChunks;
+    std::vector<glm::ivec3> m_queue;
+    bool m_loading = false;
+    bool m_stopping = false;
+    glm::vec3 m_position{0};
+    uint32_t m_frame = 0;
+    size_t m_residentBytes = 0;
+    uint64_t m_loads = 0;
+    uint64_t m_evictions = 0;
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+
+    std::thread m_loader;
+};
+
+struct WorldHit {
+    bool hit = false;
+    glm::vec3 normal{0};
+    // Ray parameter where the ray enters the voxel
+    float dist = 0;
+    uint8_t paletteIndex = 0;
+};
+
+// DDA through the resident chunks for at most numSteps steps. Empty bricks,
+// coarse cells and chunks as well as chunks that are not resident are
+// skipped in one step each, so a missing chunk shows up as empty space
+// instead of stalling the ray.
+WorldHit traceWorld(ChunkResidency const& residency, glm::vec3 rayPos, glm::vec3 rayDir, int numSteps);
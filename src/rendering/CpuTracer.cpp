@@ -0,0 +1,541 @@
+#include "CpuTracer.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "ChunkedWorld.h"
+#include "Dda.h"
+#include "Denoiser.h"
+#include "IrradianceCache.h"
+#include "PacketTracer.h"
+#include "SunVisibility.h"
+#include "VoxelDag.h"
+#include "../util/ThreadPool.h"
+#include "../util/Trace.h"
+
+#define INV_GAMMA 0.4545f
+
+namespace {
+    constexpr float pi = 3.14159265359f;
+    constexpr float twoPi = 2 * pi;
+}
+
+// random stuff taken from https://www.shadertoy.com/view/tsBBWW
+uint32_t wangHash(uint32_t& seed) {
+    seed = (seed ^ 61u) ^ (seed >> 16u);
+    seed *= 9u;
+    seed = seed ^ (seed >> 4);
+    seed *= 0x27d4eb2du;
+    seed = seed ^ (seed >> 15);
+    return seed;
+}
+
+float randomFloat(uint32_t& state) {
+    return float(wangHash(state)) / 4294967296.0f;
+}
+
+glm::vec3 randomUnitVector(glm::vec2 u) {
+    float z = u.x * 2.0f - 1.0f;
+    float a = u.y * twoPi;
+    float r = std::sqrt(1.0f - z * z);
+    float x = r * std::cos(a);
+    float y = r * std::sin(a);
+    return {x, y, z};
+}
+
+glm::vec3 randomInHemisphere(glm::vec2 u, glm::vec3 normal) {
+    glm::vec3 inUnitSphere = randomUnitVector(u);
+    if (glm::dot(inUnitSphere, normal) > 0) {
+        return inUnitSphere;
+    } else {
+        return -inUnitSphere;
+    }
+}
+
+// Sky color example from Ray Tracing In One Weekend
+glm::vec3 skyColor(glm::vec3 rayDir) {
+    float t = 0.5f * (rayDir.y + 1);
+    return (1 - t) * glm::vec3(1) + t * glm::vec3(0.5f, 0.7f, 1.0f);
+}
+
+glm::vec2 intersectBox(glm::vec3 rayPos, glm::vec3 invRayDir, glm::vec3 boxMin, glm::vec3 boxMax) {
+    glm::vec3 tMin = (boxMin - rayPos) * invRayDir;
+    glm::vec3 tMax = (boxMax - rayPos) * invRayDir;
+
+    glm::vec3 t1 = glm::min(tMin, tMax);
+    glm::vec3 t2 = glm::max(tMin, tMax);
+
+    float tNear = std::max(std::max(t1.x, t1.y), t1.z);
+    float tFar = std::min(std::min(t2.x, t2.y), t2.z);
+
+    return {tNear, tFar};
+}
+
+glm::vec4 decodeColor(uint32_t paletteColor) {
+    return glm::vec4(
+            (paletteColor >> 24) & 0xff,
+            (paletteColor >> 16) & 0xff,
+            (paletteColor >> 8) & 0xff,
+            paletteColor & 0xff
+    ) / 255.0f;
+}
+
+CpuTracer::CpuTracer(Model const& model, RenderSettings const& settings)
+        : m_model(model), m_settings(settings) {
+}
+
+bool CpuTracer::inVoxelBuffer(glm::ivec3 vx) const {
+    return (vx.x >= 0 && vx.x < int(m_model.size.x)) &&
+           (vx.y >= 0 && vx.y < int(m_model.size.y)) &&
+           (vx.z >= 0 && vx.z < int(m_model.size.z));
+}
+
+Material CpuTracer::material(uint32_t paletteIndex) const {
+    Material material;
+    material.albedo = glm::vec3(decodeColor(m_model.palette[paletteIndex]));
+    material.emissive = material.albedo * m_model.materials[paletteIndex].emission;
+    material.metal = m_model.materials[paletteIndex].metal != 0;
+    return material;
+}
+
+void CpuTracer::getVoxel(glm::vec3 pos, VoxelHit& hit) const {
+    glm::uvec3 voxelPos{pos};
+
+    if (m_model.isSolid(voxelPos)) {
+        hit.hit = true;
+        hit.material = material(m_model.paletteIndex(voxelPos));
+    }
+}
+
+VoxelHit CpuTracer::traceVoxel(glm::vec3 rayPos, glm::vec3 rayDir) const {
+    if (m_dag) {
+        return traceVoxelDag(rayPos, rayDir);
+    }
+    if (m_world) {
+        return traceVoxelWorld(rayPos, rayDir);
+    }
+
+    DDA dda;
+    initDDA(dda, rayPos, rayDir);
+
+    return traceVoxelFrom(dda, rayPos, rayDir, m_settings.maxDDADepth);
+}
+
+VoxelHit CpuTracer::traceVoxelFrom(DDA& dda, glm::vec3 rayPos, glm::vec3 rayDir, int numSteps) const {
+    VoxelHit hit;
+
+    bool entered = false;
+
+    for (int i = 0; i < numSteps; ++i) {
+        if (inVoxelBuffer(glm::ivec3(dda.pos))) {
+            entered = true;
+
+            // A skipped cell costs a single step, like a single voxel
+            if (!m_settings.enableEmptySpaceSkipping || !skipEmptyCell(dda, m_model.occupancy)) {
+                getVoxel(dda.pos, hit);
+                if (hit.hit) {
+                    hit.position = rayPos + dda.dist * rayDir;
+                    hit.normal = dda.normal;
+                    break;
+                }
+            }
+        } else if (entered) {
+            // The map is convex, a ray that left it cannot come back
+            break;
+        }
+
+        iterDDA(dda);
+    }
+
+    return hit;
+}
+
+VoxelHit CpuTracer::traceVoxelDag(glm::vec3 rayPos, glm::vec3 rayDir) const {
+    VoxelHit hit;
+
+    // traceVoxelFrom checks the voxel it starts in and maxDDADepth - 1 more
+    DagStepLimit limit{m_settings.maxDDADepth - 1, m_settings.enableEmptySpaceSkipping, true};
+    DagHit dagHit = traceDag(*m_dag, rayPos, rayDir, 0, INFINITY, limit);
+    if (dagHit.hit) {
+        hit.hit = true;
+        hit.position = rayPos + (dagHit.dist - 3 * EPSILON) * rayDir;
+        hit.normal = dagHit.normal;
+        hit.material = material(dagHit.paletteIndex);
+    }
+
+    return hit;
+}
+
+VoxelHit CpuTracer::traceVoxelWorld(glm::vec3 rayPos, glm::vec3 rayDir) const {
+    VoxelHit hit;
+
+    WorldHit worldHit = traceWorld(*m_world, rayPos, rayDir, m_settings.maxDDADepth);
+    if (worldHit.hit) {
+        hit.hit = true;
+        hit.position = rayPos + worldHit.dist * rayDir;
+        hit.normal = worldHit.normal;
+        hit.material = material(worldHit.paletteIndex);
+    }
+
+    return hit;
+}
+
+bool CpuTracer::pointIsShadowed(glm::vec3 point) const {
+    glm::vec3 lightDir = glm::normalize(m_settings.sunDir);
+
+    if (m_dag) {
+        // The DDA below steps before its first check, maxDDADepth voxels
+        DagStepLimit limit{m_settings.maxDDADepth, m_settings.enableEmptySpaceSkipping, false};
+        return traceDag(*m_dag, point, lightDir, 0, INFINITY, limit).hit;
+    }
+    if (m_world) {
+        return traceWorld(*m_world, point, lightDir, m_settings.maxDDADepth).hit;
+    }
+
+    DDA lightDDA;
+    initDDA(lightDDA, point, lightDir);
+
+    for (int i = 0; i < m_settings.maxDDADepth; ++i) {
+        iterDDA(lightDDA);
+
+        // The shader samples before the bounds check, which only works because
+        // SSBO reads out of range return zero. Check first here.
+        if (!inVoxelBuffer(glm::ivec3(lightDDA.pos))) {
+            return false;
+        }
+
+        if (m_settings.enableEmptySpaceSkipping && skipEmptyCell(lightDDA, m_model.occupancy)) {
+            continue;
+        }
+
+        VoxelHit lightHit;
+        getVoxel(lightDDA.pos, lightHit);
+
+        if (lightHit.hit) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CpuTracer::hitIsShadowed(VoxelHit const& hit) const {
+    // The bits are in model coordinates, a streamed world has none
+    if (m_sunVisibility && !m_world && m_sunVisibility->sunDir == m_settings.sunDir) {
+        return !m_sunVisibility->hitLit(hit.position, hit.normal);
+    }
+    return pointIsShadowed(hit.position);
+}
+
+bool CpuTracer::voxelVisible(glm::vec3 point, glm::vec3 rayDir, glm::uvec3 voxel) const {
+    VoxelHit hit = traceVoxel(point, rayDir);
+    // Hits are a little in front of the face they hit
+    return hit.hit && glm::uvec3(glm::floor(hit.position - 0.5f * hit.normal)) == voxel;
+}
+
+bool CpuTracer::samplesLights() const {
+    // The light list is in model coordinates, a streamed world has none
+    return m_settings.enableLightSampling && !m_world && !m_model.lights.empty();
+}
+
+glm::vec3 CpuTracer::directLight(VoxelHit const& hit, PixelSampler const& sampler, uint32_t vertex) const {
+    glm::vec3 light{0};
+
+    glm::vec3 sunDir = glm::normalize(m_settings.sunDir);
+    float sunCos = glm::dot(hit.normal, sunDir);
+    if (sunCos > 0 && !(m_settings.enableShadows && hitIsShadowed(hit))) {
+        light += m_settings.sunStrength * sunCos;
+    }
+
+    if (samplesLights()) {
+        uint32_t dimension = vertexDimension(vertex);
+        LightSample lightSample = sampleLight(m_model.lights.lights, hit.position,
+                                              sampler.get(dimension + lightChoiceDimension),
+                                              sampler.get(dimension + lightPointDimension));
+        glm::vec3 toLight = lightSample.position - hit.position;
+        float distanceSquared = glm::dot(toLight, toLight);
+        if (lightSample.pdf > 0 && distanceSquared > 0) {
+            glm::vec3 lightDir = toLight / std::sqrt(distanceSquared);
+            float surfaceCos = glm::dot(hit.normal, lightDir);
+            float lightCos = -glm::dot(lightSample.normal, lightDir);
+            if (surfaceCos > 0 && lightCos > 0 && voxelVisible(hit.position, lightDir, lightSample.voxel)) {
+                // Lambert's 1 / pi, and the area pdf turned into solid angle
+                light += material(lightSample.paletteIndex).emissive * (surfaceCos * lightCos) /
+                         (pi * distanceSquared * lightSample.pdf);
+            }
+        }
+    }
+
+    return light;
+}
+
+glm::vec4 CpuTracer::traceRay(glm::vec3 rayPos, glm::vec3 rayDir, PixelSampler const& sampler,
+                              SurfaceSample* surface) const {
+    glm::vec3 origRayPos = rayPos;
+
+    // Ray misses the voxel box
+    if (!enterVoxelBox(rayPos, rayDir)) {
+        return {skyColor(rayDir), 0};
+    }
+
+    // First ray bounce
+    VoxelHit hit = traceVoxel(rayPos, rayDir);
+    return shadePrimaryHit(hit, origRayPos, rayDir, sampler, surface);
+}
+
+bool CpuTracer::enterVoxelBox(glm::vec3& rayPos, glm::vec3 rayDir) const {
+    glm::vec3 invRayDir = 1.0f / rayDir;
+    glm::vec3 mapSize{m_world ? m_world->size : m_model.size};
+    glm::vec2 intersection = intersectBox(rayPos, invRayDir, glm::vec3(0), mapSize);
+
+    if (intersection.x > intersection.y) {
+        return false;
+    }
+
+    // Advance ray start to box
+    if (intersection.x > 0) {
+        rayPos += rayDir * (intersection.x - 3 * EPSILON);
+    }
+
+    return true;
+}
+
+glm::vec4 CpuTracer::shadePrimaryHit(VoxelHit hit, glm::vec3 origRayPos, glm::vec3 rayDir,
+                                     PixelSampler const& sampler, SurfaceSample* surface) const {
+    if (!hit.hit) {
+        return {skyColor(rayDir), 0};
+    }
+    if (surface) {
+        surface->normal = hit.normal;
+        surface->albedo = hit.material.albedo;
+    }
+
+    float depth = glm::length(hit.position - origRayPos);
+    glm::vec3 color = hit.material.emissive;
+
+    if (!m_settings.enableGlobalIllumination) {
+        float lightMultiplier = 1.0f;
+        if (m_settings.enableShadows && hitIsShadowed(hit)) {
+            lightMultiplier = m_settings.shadowMultiplier;
+        }
+        return {color + lightMultiplier * hit.material.albedo, depth};
+    }
+
+    // Every vertex a bounce leaves from adds the light it gets directly, and
+    // the sky light if the bounce escapes. Emissive voxels that are sampled
+    // directly are not counted again when a bounce hits them. A normal plus
+    // a uniform unit vector is cosine distributed, so a bounce only weighs
+    // the light it brings by the albedo.
+    bool samplingLights = samplesLights();
+    glm::vec3 throughput{1};
+    for (int vertex = 0; vertex + 1 < m_settings.numRayBounces; ++vertex) {
+        throughput *= hit.material.albedo;
+        color += throughput * directLight(hit, sampler, uint32_t(vertex));
+
+        glm::vec3 rayPos = hit.position;
+        glm::vec2 u = sampler.get(vertexDimension(uint32_t(vertex)) + bounceDimension);
+        rayDir = hit.normal + randomUnitVector(u);
+        hit = traceVoxel(rayPos, rayDir);
+
+        if (!hit.hit) {
+            color += throughput;
+            break;
+        }
+        if (!samplingLights) {
+            color += throughput * hit.material.emissive;
+        }
+    }
+
+    // The last vertex reflects what the cache holds for its face, which
+    // stands in for the direct light and all further bounces
+    if (m_irradianceCache && !m_world && hit.hit) {
+        color += throughput * hit.material.albedo * m_irradianceCache->lookup(hit.position, hit.normal);
+    }
+
+    return {color, depth};
+}
+
+glm::vec4 gammaCorrect(glm::vec4 pixelColor) {
+    glm::vec3 corrected = glm::clamp(glm::pow(glm::vec3(pixelColor), glm::vec3(INV_GAMMA)), glm::vec3(0), glm::vec3(1));
+    return {corrected, pixelColor.w};
+}
+
+float sampleLuminance(glm::vec4 pixelColor) {
+    return glm::dot(glm::vec3(pixelColor), glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// Standard error of the mean, sqrt(sample variance / n)
+float standardError(glm::vec2 moments, int numSamples) {
+    if (numSamples < 2) {
+        return INFINITY;
+    }
+    float variance = std::max(moments.y - moments.x * moments.x, 0.0f);
+    return std::sqrt(variance / float(numSamples - 1));
+}
+
+PixelSampler CpuTracer::pixelSampler(glm::ivec2 outputCoords, uint32_t sampleIndex) const {
+    return {m_settings.sampler, glm::uvec2(outputCoords), sampleIndex, m_blueNoise};
+}
+
+void CpuTracer::cameraRay(Camera const& camera, glm::ivec2 outputCoords, glm::ivec2 screenSize,
+                          PixelSampler const& sampler, glm::vec3& rayPos, glm::vec3& rayDir) const {
+    glm::vec2 rayNoise{0};
+    if (m_settings.enableRayRandomization) {
+        rayNoise = sampler.get(jitterDimension);
+    }
+    glm::vec2 screenCoords = (glm::vec2(outputCoords) + rayNoise) / glm::vec2(screenSize) * 2.0f - 1.0f;
+
+    rayPos = camera.m_invViewMat * glm::vec4(0, 0, 0, 1);
+    rayDir = glm::normalize(glm::vec3(camera.m_invCenteredMat * camera.m_invProjectionMat * glm::vec4(screenCoords, 0, 1))) + EPSILON;
+}
+
+glm::vec4 CpuTracer::tracePixel(Camera const& camera, glm::ivec2 outputCoords, glm::ivec2 screenSize,
+                                uint32_t sampleIndex, SurfaceSample* surface) const {
+    PixelSampler sampler = pixelSampler(outputCoords, sampleIndex);
+
+    glm::vec3 rayPos;
+    glm::vec3 rayDir;
+    cameraRay(camera, outputCoords, screenSize, sampler, rayPos, rayDir);
+
+    return gammaCorrect(traceRay(rayPos, rayDir, sampler, surface));
+}
+
+Image CpuTracer::render(Camera const& camera, int width, int height, ThreadPool& pool, int tileSize,
+                        RenderStats* stats, GBuffer* gbuffer) const {
+    return renderRegion(camera, {width, height}, {0, 0}, {width, height}, pool, tileSize, stats, gbuffer);
+}
+
+Image CpuTracer::renderRegion(Camera const& camera, glm::ivec2 screenSize, glm::ivec2 regionMin,
+                              glm::ivec2 regionMax, ThreadPool& pool, int tileSize, RenderStats* stats,
+                              GBuffer* gbuffer) const {
+    TRACE_SCOPE("render");
+    int width = regionMax.x - regionMin.x;
+    int height = regionMax.y - regionMin.y;
+    Image image{width, height};
+    if (gbuffer) {
+        *gbuffer = GBuffer{width, height};
+    }
+
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int tilesY = (height + tileSize - 1) / tileSize;
+    bool usePackets = m_settings.enablePacketTracing && !m_dag && !m_world && activeSimdLevel() != SimdLevel::Scalar;
+    bool adaptive = m_settings.enableAdaptiveSampling;
+
+    std::atomic<uint64_t> samplesTraced{0};
+    std::atomic<size_t> convergedTiles{0};
+
+    pool.parallelFor(size_t(tilesX) * tilesY, [&](size_t tile) {
+        TRACE_SCOPE("tile");
+        // In screen coordinates, the image is offset by regionMin
+        int x0 = regionMin.x + int(tile % tilesX) * tileSize;
+        int y0 = regionMin.y + int(tile / tilesX) * tileSize;
+        int x1 = std::min(x0 + tileSize, regionMax.x);
+        int y1 = std::min(y0 + tileSize, regionMax.y);
+
+        std::vector<glm::vec2> moments(adaptive ? size_t(x1 - x0) * (y1 - y0) : 0);
+        int numSamples = 0;
+
+        // Same running mean as mix(prev, new, 1 / numSamples) in the shader
+        for (int sample = 1; sample <= m_settings.numSamples; ++sample) {
+            float weight = 1.0f / float(sample);
+            float maxError = 0;
+
+            auto accumulate = [&](int x, int y, glm::vec4 pixelColor, SurfaceSample const& surface) {
+                glm::vec4& pixel = image.at(x - regionMin.x, y - regionMin.y);
+                pixel = glm::mix(pixel, pixelColor, weight);
+                if (gbuffer) {
+                    // Albedo is gamma corrected like the color, so that
+                    // dividing by it leaves the light
+                    size_t index = size_t(y - regionMin.y) * width + (x - regionMin.x);
+                    glm::vec3 albedo{gammaCorrect(glm::vec4(surface.albedo, 0))};
+                    gbuffer->normals[index] = glm::mix(gbuffer->normals[index], surface.normal, weight);
+                    gbuffer->albedo[index] = glm::mix(gbuffer->albedo[index], albedo, weight);
+                }
+                if (adaptive) {
+                    float luminance = sampleLuminance(pixelColor);
+                    glm::vec2& pixelMoments = moments[size_t(y - y0) * (x1 - x0) + (x - x0)];
+                    pixelMoments = glm::mix(pixelMoments, glm::vec2(luminance, luminance * luminance), weight);
+                    maxError = std::max(maxError, standardError(pixelMoments, sample));
+                }
+            };
+
+            for (int y = y0; y < y1; ++y) {
+                if (usePackets) {
+                    for (int x = x0; x < x1; x += packetWidth) {
+                        std::array<glm::vec4, packetWidth> pixelColors;
+                        std::array<SurfaceSample, packetWidth> surfaces;
+                        int numPixels = std::min(packetWidth, x1 - x);
+                        tracePixelPacket(camera, {x, y}, numPixels, screenSize, uint32_t(sample - 1),
+                                         pixelColors.data(), gbuffer ? surfaces.data() : nullptr);
+                        for (int lane = 0; lane < numPixels; ++lane) {
+                            accumulate(x + lane, y, pixelColors[lane], surfaces[lane]);
+                        }
+                    }
+                    continue;
+                }
+
+                for (int x = x0; x < x1; ++x) {
+                    SurfaceSample surface;
+                    glm::vec4 pixelColor = tracePixel(camera, {x, y}, screenSize, uint32_t(sample - 1),
+                                                      gbuffer ? &surface : nullptr);
+                    accumulate(x, y, pixelColor, surface);
+                }
+            }
+
+            numSamples = sample;
+            if (adaptive && sample >= m_settings.adaptiveMinSamples && maxError < m_settings.adaptiveThreshold) {
+                break;
+            }
+        }
+
+        samplesTraced += uint64_t(numSamples) * (x1 - x0) * (y1 - y0);
+        if (numSamples < m_settings.numSamples) {
+            ++convergedTiles;
+        }
+    });
+
+    if (stats) {
+        stats->samplesTraced = samplesTraced;
+        stats->samplesBudget = uint64_t(m_settings.numSamples) * width * height;
+        stats->numTiles = size_t(tilesX) * tilesY;
+        stats->convergedTiles = convergedTiles;
+    }
+
+    return image;
+}
+
+void CpuTracer::tracePixelPacket(Camera const& camera, glm::ivec2 firstCoords, int numPixels, glm::ivec2 screenSize,
+                                 uint32_t sampleIndex, glm::vec4* pixelColors, SurfaceSample* surfaces) const {
+    RayPacket packet{};
+    std::array<PixelSampler, packetWidth> samplers{};
+    std::array<glm::vec3, packetWidth> origins{};
+    std::array<glm::vec3, packetWidth> directions{};
+
+    for (int lane = 0; lane < numPixels; ++lane) {
+        glm::ivec2 outputCoords{firstCoords.x + lane, firstCoords.y};
+        samplers[lane] = pixelSampler(outputCoords, sampleIndex);
+        cameraRay(camera, outputCoords, screenSize, samplers[lane], origins[lane], directions[lane]);
+
+        glm::vec3 rayPos = origins[lane];
+        if (enterVoxelBox(rayPos, directions[lane])) {
+            packet.setRay(lane, rayPos, directions[lane]);
+        }
+    }
+
+    std::array<VoxelHit, packetWidth> hits{};
+    traceVoxelPacket(*this, packet, hits.data());
+
+    for (int lane = 0; lane < numPixels; ++lane) {
+        glm::vec4 pixelColor = packet.isActive(lane)
+                ? shadePrimaryHit(hits[lane], origins[lane], directions[lane], samplers[lane],
+                                  surfaces ? &surfaces[lane] : nullptr)
+                : glm::vec4(skyColor(directions[lane]), 0);
+
+        pixelColors[lane] = gammaCorrect(pixelColor);
+    }
+}
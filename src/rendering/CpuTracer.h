@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "Camera.h"
+#include "Image.h"
+#include "Model.h"
+#include "Sampler.h"
+
+class IrradianceCache;
+class ThreadPool;
+struct ChunkResidency;
+struct DDA;
+struct GBuffer;
+struct SunVisibility;
+struct VoxelDag;
+
+// Mirrors the uniforms of voxel.comp.
+struct RenderSettings {
+    int numSamples = 1;
+    int numRayBounces = 3;
+    int maxDDADepth = 300;
+    glm::vec3 sunDir{-100, 200, -100};
+    bool enableShadows = true;
+    bool enableGlobalIllumination = false;
+    bool enableRayRandomization = true;
+    // Source of the pixel jitter and bounce directions, see Sampler.h
+    SamplerType sampler = SamplerType::Sobol;
+    float shadowMultiplier = 0.5f;
+    // With global illumination, sunlit surfaces get albedo * sunStrength *
+    // cos(angle to the sun) on top of the sky light
+    float sunStrength = 1.0f;
+    // Sample the emissive voxels at every path vertex (next event
+    // estimation) instead of only counting the ones bounces happen to hit
+    bool enableLightSampling = true;
+    // Skip empty bricks and coarse cells using Model::occupancy
+    bool enableEmptySpaceSkipping = true;
+    // Trace coherent primary rays in SIMD packets when the CPU supports it
+    bool enablePacketTracing = true;
+    // Stop sampling a tile once the standard error of every pixel's
+    // luminance is below adaptiveThreshold, after adaptiveMinSamples samples
+    bool enableAdaptiveSampling = false;
+    float adaptiveThreshold = 0.01f;
+    int adaptiveMinSamples = 8;
+};
+
+struct RenderStats {
+    // Pixel samples traced, and what numSamples for every pixel would have been
+    uint64_t samplesTraced = 0;
+    uint64_t samplesBudget = 0;
+    size_t numTiles = 0;
+    // Tiles that stopped before numSamples
+    size_t convergedTiles = 0;
+};
+
+struct Material {
+    bool metal;
+    glm::vec3 albedo;
+    glm::vec3 emissive;
+};
+
+struct VoxelHit {
+    bool hit = false;
+    glm::vec3 position{0};
+    glm::vec3 normal{0};
+    Material material{};
+};
+
+// What a sample hit first, for the denoiser's G-buffer. Samples that see the
+// sky keep the defaults.
+struct SurfaceSample {
+    glm::vec3 normal{0};
+    glm::vec3 albedo{1};
+};
+
+// C++ port of the traversal in assets/shaders/voxel.comp, for rendering
+// without a GL context.
+struct CpuTracer {
+    CpuTracer(Model const& model, RenderSettings const& settings);
+
+    bool inVoxelBuffer(glm::ivec3 vx) const;
+    Material material(uint32_t paletteIndex) const;
+    void getVoxel(glm::vec3 pos, VoxelHit& hit) const;
+    VoxelHit traceVoxel(glm::vec3 rayPos, glm::vec3 rayDir) const;
+    VoxelHit traceVoxelDag(glm::vec3 rayPos, glm::vec3 rayDir) const;
+    VoxelHit traceVoxelWorld(glm::vec3 rayPos, glm::vec3 rayDir) const;
+    // Continues a traversal for at most numSteps more DDA steps
+    VoxelHit traceVoxelFrom(DDA& dda, glm::vec3 rayPos, glm::vec3 rayDir, int numSteps) const;
+    bool pointIsShadowed(glm::vec3 point) const;
+    // Whether the sun is blocked at a hit: a lookup in m_sunVisibility when
+    // it was baked for the current sun, otherwise pointIsShadowed
+    bool hitIsShadowed(VoxelHit const& hit) const;
+    // Whether the first voxel a ray from point hits is voxel
+    bool voxelVisible(glm::vec3 point, glm::vec3 rayDir, glm::uvec3 voxel) const;
+    // Light a path vertex gets directly from the sun and, with light
+    // sampling, from one sampled emissive voxel, to be scaled by its albedo
+    glm::vec3 directLight(VoxelHit const& hit, PixelSampler const& sampler, uint32_t vertex) const;
+    bool samplesLights() const;
+    // The first hit is written to surface when it is given
+    glm::vec4 traceRay(glm::vec3 rayPos, glm::vec3 rayDir, PixelSampler const& sampler,
+                       SurfaceSample* surface = nullptr) const;
+
+    // The pieces of traceRay, so that primary traversal can be swapped out:
+    // enterVoxelBox advances rayPos to the map box and returns false on a miss,
+    // shadePrimaryHit does shadows and GI bounces for the first hit.
+    bool enterVoxelBox(glm::vec3& rayPos, glm::vec3 rayDir) const;
+    glm::vec4 shadePrimaryHit(VoxelHit hit, glm::vec3 origRayPos, glm::vec3 rayDir,
+                              PixelSampler const& sampler, SurfaceSample* surface = nullptr) const;
+
+    // Samples of sample sampleIndex of the pixel at outputCoords
+    PixelSampler pixelSampler(glm::ivec2 outputCoords, uint32_t sampleIndex) const;
+    void cameraRay(Camera const& camera, glm::ivec2 outputCoords, glm::ivec2 screenSize, PixelSampler const& sampler,
+                   glm::vec3& rayPos, glm::vec3& rayDir) const;
+
+    // Sample sampleIndex (from 0) of the pixel at outputCoords (origin bottom
+    // left), gamma corrected, with the hit depth in w. Equivalent to one
+    // voxel.comp invocation.
+    glm::vec4 tracePixel(Camera const& camera, glm::ivec2 outputCoords, glm::ivec2 screenSize,
+                         uint32_t sampleIndex, SurfaceSample* surface = nullptr) const;
+
+    // Renders numSamples accumulated samples per pixel, split into
+    // tileSize x tileSize tiles that are scheduled on the pool. With adaptive
+    // sampling, tiles stop early once they converged. The normals and
+    // albedo of the first hits are averaged into gbuffer when it is given.
+    Image render(Camera const& camera, int width, int height, ThreadPool& pool, int tileSize = 32,
+                 RenderStats* stats = nullptr, GBuffer* gbuffer = nullptr) const;
+    // Renders the pixels in [regionMin, regionMax) of a screenSize image like
+    // render, into an image (and gbuffer) of just the region. Its tiles start
+    // at regionMin.
+    Image renderRegion(Camera const& camera, glm::ivec2 screenSize, glm::ivec2 regionMin, glm::ivec2 regionMax,
+                       ThreadPool& pool, int tileSize = 32, RenderStats* stats = nullptr,
+                       GBuffer* gbuffer = nullptr) const;
+
+    // Traces one sample for numPixels (<= packetWidth) pixels of a row starting
+    // at firstCoords as a single ray packet, like tracePixel for each of them.
+    void tracePixelPacket(Camera const& camera, glm::ivec2 firstCoords, int numPixels, glm::ivec2 screenSize,
+                          uint32_t sampleIndex, glm::vec4* pixelColors, SurfaceSample* surfaces = nullptr) const;
+
+    Model const& m_model;
+    RenderSettings m_settings;
+    // When set, rays are traced through the DAG instead of the dense arrays
+    VoxelDag const* m_dag = nullptr;
+    // When set, rays are traced through the resident chunks of a streamed
+    // world instead, m_model only provides the palette
+    ChunkResidency const* m_world = nullptr;
+    // Mask of SamplerType::BlueNoise, the sampler falls back to Sobol without
+    NoiseImages const* m_blueNoise = nullptr;
+    // When set, sun shadows of the model are looked up instead of traced
+    SunVisibility const* m_sunVisibility = nullptr;
+    // When set, global illumination paths end in a lookup of the light the
+    // rest of the path would have brought
+    IrradianceCache const* m_irradianceCache = nullptr;
+};
+
+// Helpers shared with the GLSL side (random.glsl, sky.glsl, box.glsl).
+uint32_t wangHash(uint32_t& seed);
+float randomFloat(uint32_t& state);
+// Uniform directions from a 2D sample in [0, 1)^2
+glm::vec3 randomUnitVector(glm::vec2 u);
+glm::vec3 randomInHemisphere(glm::vec2 u, glm::vec3 normal);
+glm::vec3 skyColor(glm::vec3 rayDir);
+glm::vec2 intersectBox(glm::vec3 rayPos, glm::vec3 invRayDir, glm::vec3 boxMin, glm::vec3 boxMax);
+glm::vec4 decodeColor(uint32_t paletteColor);
+glm::vec4 gammaCorrect(glm::vec4 pixelColor);
+
+// Adaptive sampling, as in voxel.comp. moments holds the running means of the
+// luminance of a pixel's samples and of its square.
+float sampleLuminance(glm::vec4 pixelColor);
+float standardError(glm::vec2 moments, int numSamples);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+// CPU counterpart of assets/shaders/dda.glsl. Keep both in sync.
+
+// For fixing floating point errors
+constexpr float EPSILON = 0.0001f;
+
+struct DDA {
+    glm::vec3 pos;
+    glm::vec3 rayStep;
+    glm::vec3 deltaDist;
+    glm::vec3 sideDist;
+    glm::vec3 normal{0};
+    float dist = 0;
+};
+
+inline void initDDA(DDA& dda, glm::vec3 rayPos, glm::vec3 rayDir) {
+    dda.pos = glm::floor(rayPos);
+    dda.rayStep = glm::sign(rayDir);
+    dda.deltaDist = dda.rayStep / rayDir;
+    dda.sideDist = (glm::sign(rayDir) * (dda.pos - rayPos) + (glm::sign(rayDir) * 0.5f) + 0.5f) * dda.deltaDist;
+    dda.normal = glm::vec3(0);
+    dda.dist = 0;
+}
+
+inline void iterDDA(DDA& dda) {
+    glm::vec3 const& s = dda.sideDist;
+    glm::vec3 mask{
+            s.x <= glm::min(s.y, s.z) ? 1.0f : 0.0f,
+            s.y <= glm::min(s.z, s.x) ? 1.0f : 0.0f,
+            s.z <= glm::min(s.x, s.y) ? 1.0f : 0.0f,
+    };
+
+    dda.dist = glm::length(mask * dda.sideDist) - 3 * EPSILON;
+    dda.sideDist += mask * dda.deltaDist;
+    dda.pos += mask * dda.rayStep;
+    dda.normal = mask * -dda.rayStep;
+}
@@ -0,0 +1,298 @@
+#include "Denoiser.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#include <glm/common.hpp>
+
+#include "PacketTracer.h"
+#include "../util/ThreadPool.h"
+#include "../util/Trace.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DRAFT_X86 1
+#include <immintrin.h>
+#endif
+
+#ifdef __GNUC__
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+    // B3 spline, the taps of a pass are kernelRadius * step pixels apart at most
+    constexpr int kernelRadius = 2;
+    constexpr float kernel[2 * kernelRadius + 1] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+    // Keeps dark voxels from blowing up the light they were divided by
+    constexpr float minAlbedo = 0.01f;
+    // Normal weight is max(0, dot(n, n'))^(2^normalSquarings)
+    constexpr int normalSquarings = 3;
+    constexpr int rowsPerTask = 8;
+    constexpr int runWidth = 8;
+
+    // Image planes, so that runs of pixels load as vectors
+    struct Light {
+        explicit Light(size_t numPixels) : r(numPixels), g(numPixels), b(numPixels), luminance(numPixels) {}
+
+        std::vector<float> r;
+        std::vector<float> g;
+        std::vector<float> b;
+        std::vector<float> luminance;
+    };
+
+    struct Guide {
+        explicit Guide(size_t numPixels) : depth(numPixels), nx(numPixels), ny(numPixels), nz(numPixels) {}
+
+        std::vector<float> depth;
+        std::vector<float> nx;
+        std::vector<float> ny;
+        std::vector<float> nz;
+    };
+
+    struct Pass {
+        int width;
+        int height;
+        int step;
+        float invSigmaLuminance;
+        // Over the pixel's depth
+        float invSigmaDepth;
+    };
+
+    float luminance(float r, float g, float b) {
+        return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+    }
+
+    // e^x for x <= 0, with a polynomial for 2^fraction. The AVX2 version
+    // does the same operations.
+    float fastExp(float x) {
+        float t = std::max(x, -80.0f) * 1.44269504f;
+        float whole = std::floor(t);
+        float f = t - whole;
+        float p = 0.00133336f;
+        for (float c : {0.00961813f, 0.05550411f, 0.24022651f, 0.69314718f, 1.0f}) {
+            p = c + f * p;
+        }
+        return p * std::bit_cast<float>((int32_t(whole) + 127) << 23);
+    }
+
+    void filterPixel(Light const& in, Guide const& guide, Light& out, Pass const& pass, int x, int y) {
+        size_t p = size_t(y) * pass.width + x;
+        float depth = guide.depth[p];
+        float r = in.r[p];
+        float g = in.g[p];
+        float b = in.b[p];
+
+        // Sky stays as it is
+        if (depth > 0) {
+            float invSigmaDepth = pass.invSigmaDepth / depth;
+            float sumR = 0;
+            float sumG = 0;
+            float sumB = 0;
+            float sumWeight = 0;
+            for (int dy = -kernelRadius; dy <= kernelRadius; ++dy) {
+                int ty = y + dy * pass.step;
+                if (ty < 0 || ty >= pass.height) {
+                    continue;
+                }
+                for (int dx = -kernelRadius; dx <= kernelRadius; ++dx) {
+                    int tx = x + dx * pass.step;
+                    if (tx < 0 || tx >= pass.width) {
+                        continue;
+                    }
+
+                    size_t q = size_t(ty) * pass.width + tx;
+                    float tapDepth = guide.depth[q];
+                    if (tapDepth == 0) {
+                        continue;
+                    }
+                    float normalWeight = std::max(
+                            0.0f, guide.nx[p] * guide.nx[q] + guide.ny[p] * guide.ny[q] + guide.nz[p] * guide.nz[q]);
+                    for (int i = 0; i < normalSquarings; ++i) {
+                        normalWeight *= normalWeight;
+                    }
+                    float edgeDistance = std::abs(in.luminance[p] - in.luminance[q]) * pass.invSigmaLuminance +
+                                     std::abs(depth - tapDepth) * invSigmaDepth;
+                    float weight = kernel[dy + kernelRadius] * kernel[dx + kernelRadius] * normalWeight *
+                                   fastExp(-edgeDistance);
+
+                    sumR += weight * in.r[q];
+                    sumG += weight * in.g[q];
+                    sumB += weight * in.b[q];
+                    sumWeight += weight;
+                }
+            }
+
+            if (sumWeight > 0) {
+                r = sumR / sumWeight;
+                g = sumG / sumWeight;
+                b = sumB / sumWeight;
+            }
+        }
+
+        out.r[p] = r;
+        out.g[p] = g;
+        out.b[p] = b;
+        out.luminance[p] = luminance(r, g, b);
+    }
+
+#ifdef DRAFT_X86
+    TARGET_AVX2 __m256 fastExp(__m256 x) {
+        __m256 t = _mm256_mul_ps(_mm256_max_ps(x, _mm256_set1_ps(-80.0f)), _mm256_set1_ps(1.44269504f));
+        __m256 whole = _mm256_floor_ps(t);
+        __m256 f = _mm256_sub_ps(t, whole);
+        __m256 p = _mm256_set1_ps(0.00133336f);
+        for (float c : {0.00961813f, 0.05550411f, 0.24022651f, 0.69314718f, 1.0f}) {
+            p = _mm256_add_ps(_mm256_set1_ps(c), _mm256_mul_ps(f, p));
+        }
+        __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(whole), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+    }
+
+    TARGET_AVX2 __m256 absDiff(__m256 a, __m256 b) {
+        return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_sub_ps(a, b));
+    }
+
+    // filterPixel for runWidth pixels whose taps are all inside the row
+    TARGET_AVX2 void filterRunAvx2(Light const& in, Guide const& guide, Light& out, Pass const& pass, int x, int y) {
+        size_t p = size_t(y) * pass.width + x;
+        __m256 const zero = _mm256_setzero_ps();
+        __m256 depth = _mm256_loadu_ps(&guide.depth[p]);
+        __m256 nx = _mm256_loadu_ps(&guide.nx[p]);
+        __m256 ny = _mm256_loadu_ps(&guide.ny[p]);
+        __m256 nz = _mm256_loadu_ps(&guide.nz[p]);
+        __m256 lum = _mm256_loadu_ps(&in.luminance[p]);
+        __m256 r = _mm256_loadu_ps(&in.r[p]);
+        __m256 g = _mm256_loadu_ps(&in.g[p]);
+        __m256 b = _mm256_loadu_ps(&in.b[p]);
+
+        __m256 isSurface = _mm256_cmp_ps(depth, zero, _CMP_GT_OQ);
+        // Sky lanes divide by 1 and are blended out below
+        __m256 invSigmaDepth = _mm256_div_ps(_mm256_set1_ps(pass.invSigmaDepth),
+                                             _mm256_blendv_ps(_mm256_set1_ps(1.0f), depth, isSurface));
+        __m256 invSigmaLuminance = _mm256_set1_ps(pass.invSigmaLuminance);
+
+        __m256 sumR = zero;
+        __m256 sumG = zero;
+        __m256 sumB = zero;
+        __m256 sumWeight = zero;
+        for (int dy = -kernelRadius; dy <= kernelRadius; ++dy) {
+            int ty = y + dy * pass.step;
+            if (ty < 0 || ty >= pass.height) {
+                continue;
+            }
+            for (int dx = -kernelRadius; dx <= kernelRadius; ++dx) {
+                size_t q = size_t(ty) * pass.width + x + dx * pass.step;
+                __m256 tapDepth = _mm256_loadu_ps(&guide.depth[q]);
+                __m256 normalWeight = _mm256_mul_ps(nx, _mm256_loadu_ps(&guide.nx[q]));
+                normalWeight = _mm256_add_ps(normalWeight, _mm256_mul_ps(ny, _mm256_loadu_ps(&guide.ny[q])));
+                normalWeight = _mm256_add_ps(normalWeight, _mm256_mul_ps(nz, _mm256_loadu_ps(&guide.nz[q])));
+                normalWeight = _mm256_max_ps(zero, normalWeight);
+                for (int i = 0; i < normalSquarings; ++i) {
+                    normalWeight = _mm256_mul_ps(normalWeight, normalWeight);
+                }
+                __m256 edgeDistance = _mm256_add_ps(
+                        _mm256_mul_ps(absDiff(lum, _mm256_loadu_ps(&in.luminance[q])), invSigmaLuminance),
+                        _mm256_mul_ps(absDiff(depth, tapDepth), invSigmaDepth));
+                __m256 weight = _mm256_mul_ps(
+                        _mm256_set1_ps(kernel[dy + kernelRadius] * kernel[dx + kernelRadius]), normalWeight);
+                weight = _mm256_mul_ps(weight, fastExp(_mm256_sub_ps(zero, edgeDistance)));
+                weight = _mm256_and_ps(weight, _mm256_cmp_ps(tapDepth, zero, _CMP_NEQ_OQ));
+
+                sumR = _mm256_add_ps(sumR, _mm256_mul_ps(weight, _mm256_loadu_ps(&in.r[q])));
+                sumG = _mm256_add_ps(sumG, _mm256_mul_ps(weight, _mm256_loadu_ps(&in.g[q])));
+                sumB = _mm256_add_ps(sumB, _mm256_mul_ps(weight, _mm256_loadu_ps(&in.b[q])));
+                sumWeight = _mm256_add_ps(sumWeight, weight);
+            }
+        }
+
+        __m256 filtered = _mm256_and_ps(isSurface, _mm256_cmp_ps(sumWeight, zero, _CMP_GT_OQ));
+        __m256 invSumWeight = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_max_ps(sumWeight, _mm256_set1_ps(1e-30f)));
+        r = _mm256_blendv_ps(r, _mm256_mul_ps(sumR, invSumWeight), filtered);
+        g = _mm256_blendv_ps(g, _mm256_mul_ps(sumG, invSumWeight), filtered);
+        b = _mm256_blendv_ps(b, _mm256_mul_ps(sumB, invSumWeight), filtered);
+
+        __m256 outLum = _mm256_mul_ps(_mm256_set1_ps(0.2126f), r);
+        outLum = _mm256_add_ps(outLum, _mm256_mul_ps(_mm256_set1_ps(0.7152f), g));
+        outLum = _mm256_add_ps(outLum, _mm256_mul_ps(_mm256_set1_ps(0.0722f), b));
+
+        _mm256_storeu_ps(&out.r[p], r);
+        _mm256_storeu_ps(&out.g[p], g);
+        _mm256_storeu_ps(&out.b[p], b);
+        _mm256_storeu_ps(&out.luminance[p], outLum);
+    }
+#endif
+
+    void filterRow(Light const& in, Guide const& guide, Light& out, Pass const& pass, int y, bool vectorized) {
+        int reach = kernelRadius * pass.step;
+        int x = 0;
+        while (x < pass.width) {
+#ifdef DRAFT_X86
+            if (vectorized && x >= reach && x + runWidth - 1 + reach < pass.width) {
+                filterRunAvx2(in, guide, out, pass, x, y);
+                x += runWidth;
+                continue;
+            }
+#endif
+            filterPixel(in, guide, out, pass, x, y);
+            ++x;
+        }
+    }
+}
+
+GBuffer::GBuffer(int width, int height)
+        : width(width), height(height), normals(size_t(width) * height, glm::vec3(0)),
+          albedo(size_t(width) * height, glm::vec3(1)) {}
+
+void denoise(Image& image, GBuffer const& gbuffer, DenoiseSettings const& settings, ThreadPool& pool) {
+    if (gbuffer.width != image.width || gbuffer.height != image.height) {
+        throw std::runtime_error("G-buffer size does not match the image");
+    }
+
+    TRACE_SCOPE("denoise");
+
+    size_t numPixels = image.pixels.size();
+    Light light{numPixels};
+    Light filtered{numPixels};
+    Guide guide{numPixels};
+    for (size_t i = 0; i < numPixels; ++i) {
+        glm::vec4 color = image.pixels[i];
+        glm::vec3 albedo = glm::max(gbuffer.albedo[i], glm::vec3(minAlbedo));
+        light.r[i] = color.x / albedo.x;
+        light.g[i] = color.y / albedo.y;
+        light.b[i] = color.z / albedo.z;
+        light.luminance[i] = luminance(light.r[i], light.g[i], light.b[i]);
+        guide.depth[i] = color.w;
+        guide.nx[i] = gbuffer.normals[i].x;
+        guide.ny[i] = gbuffer.normals[i].y;
+        guide.nz[i] = gbuffer.normals[i].z;
+    }
+
+    bool vectorized = activeSimdLevel() == SimdLevel::Avx2;
+    int numTasks = (image.height + rowsPerTask - 1) / rowsPerTask;
+    for (int iteration = 0; iteration < settings.iterations; ++iteration) {
+        Pass pass{};
+        pass.width = image.width;
+        pass.height = image.height;
+        pass.step = 1 << iteration;
+        pass.invSigmaLuminance = float(pass.step) / settings.sigmaLuminance;
+        pass.invSigmaDepth = 1.0f / (settings.sigmaDepth * float(pass.step));
+
+        pool.parallelFor(size_t(numTasks), [&](size_t task) {
+            int end = std::min(image.height, int(task + 1) * rowsPerTask);
+            for (int y = int(task) * rowsPerTask; y < end; ++y) {
+                filterRow(light, guide, filtered, pass, y, vectorized);
+            }
+        });
+        std::swap(light, filtered);
+    }
+
+    for (size_t i = 0; i < numPixels; ++i) {
+        glm::vec3 albedo = glm::max(gbuffer.albedo[i], glm::vec3(minAlbedo));
+        glm::vec3 color = glm::vec3(light.r[i], light.g[i], light.b[i]) * albedo;
+        image.pixels[i] = glm::vec4(color, image.pixels[i].w);
+    }
+}
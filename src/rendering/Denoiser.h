@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "Image.h"
+
+class ThreadPool;
+
+// CPU counterpart of assets/shaders/denoise.comp. Keep both in sync.
+
+// Features of the primary hits, averaged over a pixel's samples like its
+// color. The hit depth is in the color's w, 0 for the sky. Sky pixels have
+// a normal of 0 and an albedo of 1.
+struct GBuffer {
+    GBuffer() = default;
+    GBuffer(int width, int height);
+
+    int width = 0;
+    int height = 0;
+    std::vector<glm::vec3> normals;
+    // Gamma corrected like the color
+    std::vector<glm::vec3> albedo;
+};
+
+struct DenoiseSettings {
+    // Passes of the 5x5 kernel, the taps of pass i are 2^i pixels apart
+    int iterations = 4;
+    // Luminance difference of the light (the color over the albedo) that
+    // lowers a tap's weight by 1/e, halved every pass so later, wider
+    // passes only smooth what is left of the noise
+    float sigmaLuminance = 1.0f;
+    // Depth difference, relative to the pixel's depth and per pixel of
+    // distance, that lowers a tap's weight by 1/e
+    float sigmaDepth = 0.01f;
+};
+
+// Edge avoiding a-trous wavelet filter (Dammertz et al. 2010). Every pass
+// averages 5x5 taps with B3 spline weights, scaled down across depth,
+// normal and luminance edges. The color is divided by the albedo first and
+// multiplied back last, so textures stay sharp while the light is smoothed.
+// Sky pixels are left as they are. Rows are spread over the pool and done
+// 8 pixels at a time with AVX2 where the CPU supports it.
+void denoise(Image& image, GBuffer const& gbuffer, DenoiseSettings const& settings, ThreadPool& pool);
@@ -0,0 +1,646 @@
+#include "DistributedRender.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "Denoiser.h"
+#include "../util/Message.h"
+#include "../util/Socket.h"
+#include "../util/ThreadPool.h"
+#include "../util/Trace.h"
+
+namespace {
+    // Bumped whenever a message changes
+    constexpr uint32_t protocolVersion = 1;
+
+    enum MessageType : uint32_t {
+        // worker -> coordinator: protocol version, sizeof(RenderSettings),
+        // threads, pid, hostname
+        HelloMessage = 1,
+        // coordinator -> worker: the RenderJob
+        JobMessage,
+        // coordinator -> worker: tile index
+        TileMessage,
+        // worker -> coordinator: tile index, samples traced, whether it
+        // converged early, pixels, and normals and albedo when denoising
+        TileResultMessage,
+        // coordinator -> worker: tile index another worker finished first
+        CancelMessage,
+        // coordinator -> worker: every tile is done
+        DoneMessage,
+        // worker -> coordinator: why the job could not be set up
+        ErrorMessage,
+        // worker -> coordinator: the scene is loaded, tiles can come
+        ReadyMessage,
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    void writeOptionalVec3(MessageWriter& writer, std::optional<glm::vec3> const& value) {
+        writer.write(uint8_t(value.has_value()));
+        writer.write(value.value_or(glm::vec3{0}));
+    }
+
+    std::optional<glm::vec3> readOptionalVec3(MessageReader& reader) {
+        bool hasValue = reader.read<uint8_t>();
+        glm::vec3 value = reader.read<glm::vec3>();
+        return hasValue ? std::optional(value) : std::nullopt;
+    }
+
+    Message jobMessage(RenderJob const& job) {
+        MessageWriter writer;
+        writer.writeString(job.scenePath);
+        writer.write(uint8_t(job.layout.has_value()));
+        writer.write(job.layout.value_or(VoxelLayout::Linear));
+        writer.write(job.width);
+        writer.write(job.height);
+        writer.write(job.tileSize);
+        writer.write(job.settings);
+        writeOptionalVec3(writer, job.cameraPosition);
+        writeOptionalVec3(writer, job.cameraTarget);
+        writer.write(uint8_t(job.useDag));
+        writer.write(uint8_t(job.useSunCache));
+        writer.write(job.irradiancePasses);
+        writer.write(uint8_t(job.denoise));
+        writer.write(job.denoiseSettings);
+        return writer.finish(JobMessage);
+    }
+
+    RenderJob readJob(Message const& message) {
+        MessageReader reader(message);
+        RenderJob job;
+        job.scenePath = reader.readString();
+        bool hasLayout = reader.read<uint8_t>();
+        VoxelLayout layout = reader.read<VoxelLayout>();
+        if (hasLayout) {
+            job.layout = layout;
+        }
+        job.width = reader.read<int>();
+        job.height = reader.read<int>();
+        job.tileSize = reader.read<int>();
+        job.settings = reader.read<RenderSettings>();
+        job.cameraPosition = readOptionalVec3(reader);
+        job.cameraTarget = readOptionalVec3(reader);
+        job.useDag = reader.read<uint8_t>();
+        job.useSunCache = reader.read<uint8_t>();
+        job.irradiancePasses = reader.read<int>();
+        job.denoise = reader.read<uint8_t>();
+        job.denoiseSettings = reader.read<DenoiseSettings>();
+        return job;
+    }
+
+    Message indexMessage(MessageType type, uint32_t tile) {
+        MessageWriter writer;
+        writer.write(tile);
+        return writer.finish(type);
+    }
+
+    // The job's tile grid over the whole image, tiles are numbered row by row
+    struct TileGrid {
+        explicit TileGrid(RenderJob const& job)
+            : width(job.width), height(job.height), tileSize(job.tileSize),
+              tilesX((job.width + job.tileSize - 1) / job.tileSize),
+              tilesY((job.height + job.tileSize - 1) / job.tileSize) {}
+
+        size_t size() const { return size_t(tilesX) * tilesY; }
+
+        glm::ivec2 min(uint32_t tile) const {
+            return {int(tile % tilesX) * tileSize, int(tile / tilesX) * tileSize};
+        }
+
+        glm::ivec2 max(uint32_t tile) const {
+            return glm::min(min(tile) + tileSize, glm::ivec2{width, height});
+        }
+
+        int width;
+        int height;
+        int tileSize;
+        int tilesX;
+        int tilesY;
+    };
+
+    std::string localHostname() {
+#ifndef _WIN32
+        char name[256] = {};
+        if (gethostname(name, sizeof(name) - 1) == 0) {
+            return name;
+        }
+#endif
+        return "unknown";
+    }
+
+    // A worker as the coordinator sees it
+    struct WorkerConnection {
+        Socket socket;
+        // Bytes of a message that has not fully arrived yet
+        std::vector<uint8_t> received;
+        // Tiles are only sent once it loaded the scene
+        bool ready = false;
+        std::string name;
+        unsigned numThreads = 0;
+        // Tiles sent and not answered or cancelled, oldest first
+        std::deque<uint32_t> tiles;
+        Clock::time_point lastMessage = Clock::now();
+    };
+
+    struct TileState {
+        // Workers that currently hold the tile
+        int copies = 0;
+        bool done = false;
+    };
+
+#ifndef _WIN32
+    // Starts draft --render-worker processes, and waits for them on the way
+    // out. The ones still running after a grace period are killed.
+    class LocalWorkers {
+    public:
+        LocalWorkers(std::string const& address, DistributedOptions const& options) {
+            unsigned numThreads = options.workerThreads;
+            if (numThreads == 0) {
+                numThreads = std::max(1u, std::thread::hardware_concurrency() / unsigned(options.localWorkers));
+            }
+            for (int worker = 0; worker < options.localWorkers; ++worker) {
+                std::vector<std::string> args{"draft", "--render-worker", address, "--threads",
+                                              std::to_string(numThreads)};
+                if (worker == 0 && options.crashWorkerAfter >= 0) {
+                    args.insert(args.end(), {"--exit-after", std::to_string(options.crashWorkerAfter)});
+                }
+                std::vector<char*> argv;
+                for (std::string& arg : args) {
+                    argv.push_back(arg.data());
+                }
+                argv.push_back(nullptr);
+
+                pid_t pid = fork();
+                if (pid < 0) {
+                    throw std::runtime_error("Failed to start worker process");
+                }
+                if (pid == 0) {
+                    execv("/proc/self/exe", argv.data());
+                    std::_Exit(127);
+                }
+                m_pids.push_back(pid);
+            }
+        }
+
+        ~LocalWorkers() {
+            auto deadline = Clock::now() + std::chrono::seconds(5);
+            while (running() > 0 && Clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            for (pid_t pid : m_pids) {
+                kill(pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+            }
+        }
+
+        LocalWorkers(LocalWorkers const&) = delete;
+        LocalWorkers& operator=(LocalWorkers const&) = delete;
+
+        // Reaps the workers that exited and returns how many have not
+        size_t running() {
+            std::erase_if(m_pids, [](pid_t pid) { return waitpid(pid, nullptr, WNOHANG) == pid; });
+            return m_pids.size();
+        }
+
+    private:
+        std::vector<pid_t> m_pids;
+    };
+#endif
+}
+
+#ifdef _WIN32
+Image renderDistributed(RenderJob const&, DistributedOptions const&, DistributedStats*, GBuffer*, std::ostream*) {
+    throw std::runtime_error("Distributed rendering is not supported on Windows");
+}
+
+void runRenderWorker(std::string const&, WorkerOptions const&) {
+    throw std::runtime_error("Distributed rendering is not supported on Windows");
+}
+#else
+Image renderDistributed(RenderJob const& job, DistributedOptions const& options, DistributedStats* stats,
+                        GBuffer* gbuffer, std::ostream* log) {
+    TRACE_SCOPE("renderDistributed");
+    if (options.localWorkers <= 0 && options.listenAddress.empty()) {
+        throw std::runtime_error("A distributed render needs local workers or an address to listen on");
+    }
+
+    std::string address = options.listenAddress;
+    if (address.empty()) {
+        auto path = std::filesystem::temp_directory_path() / ("draft-render-" + std::to_string(getpid()) + ".sock");
+        address = "unix:" + path.string();
+    }
+    // Declared first, so that the workers are disconnected by the time it
+    // waits for them to exit
+    std::optional<LocalWorkers> localWorkers;
+    Socket listener = Socket::listen(address);
+    // Resolves port 0
+    address = listener.localAddress();
+    if (log) {
+        *log << "Listening for workers on " << address << std::endl;
+    }
+
+    TileGrid grid(job);
+    Image image{job.width, job.height};
+    if (gbuffer) {
+        *gbuffer = GBuffer{job.width, job.height};
+    }
+    bool gatherSurfaces = gbuffer && job.denoise;
+
+    std::vector<TileState> tileStates(grid.size());
+    std::deque<uint32_t> queue;
+    for (uint32_t tile = 0; tile < grid.size(); ++tile) {
+        queue.push_back(tile);
+    }
+    size_t tilesDone = 0;
+
+    DistributedStats result;
+    result.numTiles = grid.size();
+    result.render.numTiles = grid.size();
+    result.render.samplesBudget = uint64_t(job.settings.numSamples) * job.width * job.height;
+
+    std::vector<std::unique_ptr<WorkerConnection>> workers;
+    Message jobDescription = jobMessage(job);
+    auto timeout = std::chrono::seconds(options.workerTimeoutSeconds);
+    auto lastWorkerSeen = Clock::now();
+
+    if (options.localWorkers > 0) {
+        localWorkers.emplace(address, options);
+    }
+
+    auto dropWorker = [&](WorkerConnection& worker, std::string const& reason) {
+        if (log) {
+            *log << "Lost worker " << worker.name << ": " << reason << ", retrying " << worker.tiles.size()
+                 << " tiles" << std::endl;
+        }
+        for (uint32_t tile : worker.tiles) {
+            TileState& state = tileStates[tile];
+            --state.copies;
+            if (!state.done && state.copies == 0) {
+                queue.push_front(tile);
+                ++result.tilesRetried;
+            }
+        }
+        worker.tiles.clear();
+        worker.socket.close();
+        ++result.workersLost;
+    };
+
+    // Sends fail when the worker is gone, which the next poll() reports
+    auto send = [&](WorkerConnection& worker, Message const& message) {
+        try {
+            sendMessage(worker.socket, message);
+        } catch (std::exception const&) {
+        }
+    };
+
+    auto assignTile = [&](WorkerConnection& worker, uint32_t tile) {
+        ++tileStates[tile].copies;
+        worker.tiles.push_back(tile);
+        send(worker, indexMessage(TileMessage, tile));
+    };
+
+    // The newest tile of the busiest other worker that nobody else is
+    // working on too
+    auto stealTile = [&](WorkerConnection const& thief) -> std::optional<uint32_t> {
+        WorkerConnection* victim = nullptr;
+        for (auto& worker : workers) {
+            if (worker.get() != &thief && worker->socket.valid() &&
+                (!victim || worker->tiles.size() > victim->tiles.size())) {
+                victim = worker.get();
+            }
+        }
+        if (!victim) {
+            return std::nullopt;
+        }
+        for (auto tile = victim->tiles.rbegin(); tile != victim->tiles.rend(); ++tile) {
+            if (tileStates[*tile].copies == 1 && !tileStates[*tile].done) {
+                return *tile;
+            }
+        }
+        return std::nullopt;
+    };
+
+    auto handleMessage = [&](WorkerConnection& worker, Message const& message) {
+        MessageReader reader(message);
+        switch (message.type) {
+        case HelloMessage: {
+            uint32_t version = reader.read<uint32_t>();
+            uint32_t settingsSize = reader.read<uint32_t>();
+            worker.numThreads = std::max(1u, reader.read<uint32_t>());
+            uint32_t pid = reader.read<uint32_t>();
+            worker.name = reader.readString() + ":" + std::to_string(pid);
+            if (version != protocolVersion || settingsSize != sizeof(RenderSettings)) {
+                throw std::runtime_error("Worker " + worker.name + " is a different build");
+            }
+            ++result.workersConnected;
+            send(worker, jobDescription);
+            if (log) {
+                *log << "Worker " << worker.name << " connected with " << worker.numThreads << " threads"
+                     << std::endl;
+            }
+            break;
+        }
+        case ReadyMessage:
+            worker.ready = true;
+            break;
+        case TileResultMessage: {
+            uint32_t tile = reader.read<uint32_t>();
+            uint64_t samplesTraced = reader.read<uint64_t>();
+            bool converged = reader.read<uint8_t>();
+            auto pixels = reader.readVector<glm::vec4>();
+            auto normals = reader.readVector<glm::vec3>();
+            auto albedo = reader.readVector<glm::vec3>();
+            if (tile >= grid.size()) {
+                throw std::runtime_error("Worker " + worker.name + " sent tile " + std::to_string(tile));
+            }
+
+            glm::ivec2 tileMin = grid.min(tile);
+            glm::ivec2 tileMax = grid.max(tile);
+            int tileWidth = tileMax.x - tileMin.x;
+            size_t numPixels = size_t(tileWidth) * (tileMax.y - tileMin.y);
+            if (pixels.size() != numPixels ||
+                (gatherSurfaces && (normals.size() != numPixels || albedo.size() != numPixels))) {
+                throw std::runtime_error("Worker " + worker.name + " sent a malformed tile");
+            }
+
+            auto held = std::find(worker.tiles.begin(), worker.tiles.end(), tile);
+            if (held != worker.tiles.end()) {
+                worker.tiles.erase(held);
+                --tileStates[tile].copies;
+            }
+            if (tileStates[tile].done) {
+                ++result.duplicateResults;
+                break;
+            }
+
+            tileStates[tile].done = true;
+            ++tilesDone;
+            result.render.samplesTraced += samplesTraced;
+            result.render.convergedTiles += converged;
+            for (int y = tileMin.y; y < tileMax.y; ++y) {
+                for (int x = tileMin.x; x < tileMax.x; ++x) {
+                    size_t source = size_t(y - tileMin.y) * tileWidth + (x - tileMin.x);
+                    image.at(x, y) = pixels[source];
+                    if (gatherSurfaces) {
+                        size_t target = size_t(y) * job.width + x;
+                        gbuffer->normals[target] = normals[source];
+                        gbuffer->albedo[target] = albedo[source];
+                    }
+                }
+            }
+
+            // Whoever else got a copy can skip it
+            for (auto& other : workers) {
+                auto copy = std::find(other->tiles.begin(), other->tiles.end(), tile);
+                if (copy != other->tiles.end()) {
+                    other->tiles.erase(copy);
+                    --tileStates[tile].copies;
+                    send(*other, indexMessage(CancelMessage, tile));
+                }
+            }
+            break;
+        }
+        case ErrorMessage:
+            // Every worker would fail the same way
+            throw std::runtime_error("Worker " + worker.name + " failed: " + reader.readString());
+        default:
+            throw std::runtime_error("Worker " + worker.name + " sent unknown message " +
+                                     std::to_string(message.type));
+        }
+    };
+
+    while (tilesDone < grid.size()) {
+        std::vector<pollfd> fds{{listener.fd(), POLLIN, 0}};
+        for (auto& worker : workers) {
+            fds.push_back({worker->socket.fd(), POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR) {
+            throw std::runtime_error("Failed to wait for workers");
+        }
+
+        if (fds[0].revents & POLLIN) {
+            auto worker = std::make_unique<WorkerConnection>();
+            worker->socket = listener.accept();
+            worker->name = "#" + std::to_string(workers.size() + result.workersLost);
+            workers.push_back(std::move(worker));
+        }
+
+        auto now = Clock::now();
+        for (size_t i = 1; i < fds.size(); ++i) {
+            WorkerConnection& worker = *workers[i - 1];
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                uint8_t buffer[64 * 1024];
+                size_t received = 0;
+                try {
+                    received = worker.socket.receive(buffer, sizeof(buffer));
+                } catch (std::exception const& e) {
+                    dropWorker(worker, e.what());
+                    continue;
+                }
+                if (received == 0) {
+                    dropWorker(worker, "disconnected");
+                    continue;
+                }
+                worker.received.insert(worker.received.end(), buffer, buffer + received);
+                worker.lastMessage = now;
+
+                Message message;
+                try {
+                    while (worker.socket.valid() && takeMessage(worker.received, message)) {
+                        handleMessage(worker, message);
+                    }
+                } catch (std::runtime_error const& e) {
+                    // A broken worker, unless the job itself failed
+                    if (message.type == ErrorMessage) {
+                        throw;
+                    }
+                    dropWorker(worker, e.what());
+                    continue;
+                }
+            } else if (!worker.tiles.empty() && now - worker.lastMessage > timeout) {
+                dropWorker(worker, "not responding");
+            }
+        }
+        std::erase_if(workers, [](auto const& worker) { return !worker->socket.valid(); });
+
+        if (!workers.empty()) {
+            lastWorkerSeen = now;
+        } else if (now - lastWorkerSeen > timeout) {
+            throw std::runtime_error("No workers connected for " + std::to_string(options.workerTimeoutSeconds) +
+                                     " s");
+        } else if (options.listenAddress.empty() && localWorkers->running() == 0) {
+            throw std::runtime_error("All local workers exited");
+        }
+
+        for (auto& worker : workers) {
+            if (!worker->ready) {
+                continue;
+            }
+            // Keep every thread busy and the next tiles queued
+            while (worker->tiles.size() < 2 * worker->numThreads && !queue.empty()) {
+                uint32_t tile = queue.front();
+                queue.pop_front();
+                if (!tileStates[tile].done) {
+                    assignTile(*worker, tile);
+                }
+            }
+            // Out of tiles, idle threads duplicate the work most likely to
+            // finish last
+            while (queue.empty() && worker->tiles.size() < worker->numThreads) {
+                std::optional<uint32_t> tile = stealTile(*worker);
+                if (!tile) {
+                    break;
+                }
+                assignTile(*worker, *tile);
+                ++result.tilesStolen;
+            }
+        }
+    }
+
+    for (auto& worker : workers) {
+        send(*worker, Message{DoneMessage, {}});
+    }
+
+    if (stats) {
+        *stats = result;
+    }
+    return image;
+}
+
+void runRenderWorker(std::string const& address, WorkerOptions const& options) {
+    Socket socket;
+    auto connectDeadline = Clock::now() + std::chrono::seconds(options.connectTimeoutSeconds);
+    while (!socket.valid()) {
+        try {
+            socket = Socket::connect(address);
+        } catch (std::runtime_error const&) {
+            if (Clock::now() > connectDeadline) {
+                throw;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+
+    ThreadPool pool(options.numThreads > 0 ? options.numThreads : std::thread::hardware_concurrency());
+
+    MessageWriter hello;
+    hello.write(protocolVersion);
+    hello.write(uint32_t(sizeof(RenderSettings)));
+    hello.write(uint32_t(pool.size()));
+    hello.write(uint32_t(getpid()));
+    hello.writeString(localHostname());
+    Message message;
+    try {
+        sendMessage(socket, hello.finish(HelloMessage));
+        if (!receiveMessage(socket, message)) {
+            return;
+        }
+    } catch (std::runtime_error const&) {
+        // The render failed or finished before this worker got to it
+        return;
+    }
+    if (message.type != JobMessage) {
+        throw std::runtime_error("Expected a job, got message " + std::to_string(message.type));
+    }
+    RenderJob job = readJob(message);
+
+    std::optional<PreparedRender> prepared;
+    try {
+        prepared.emplace(job, pool);
+    } catch (std::exception const& e) {
+        MessageWriter error;
+        error.writeString(e.what());
+        try {
+            sendMessage(socket, error.finish(ErrorMessage));
+        } catch (std::exception const&) {
+            // Another worker already told the coordinator
+        }
+        throw;
+    }
+    Camera camera = prepared->camera();
+    TileGrid grid(job);
+    sendMessage(socket, Message{ReadyMessage, {}});
+
+    std::vector<std::atomic<bool>> cancelled(grid.size());
+    std::atomic<bool> stopping{false};
+    std::atomic<int> tilesRendered{0};
+    std::mutex sendMutex;
+
+    auto renderTile = [&](uint32_t tile) {
+        if (stopping || cancelled[tile]) {
+            return;
+        }
+        TRACE_SCOPE("workerTile");
+        RenderStats tileStats;
+        GBuffer tileSurfaces;
+        Image pixels = prepared->tracer->renderRegion(camera, {job.width, job.height}, grid.min(tile),
+                                                      grid.max(tile), pool, job.tileSize, &tileStats,
+                                                      job.denoise ? &tileSurfaces : nullptr);
+
+        MessageWriter writer;
+        writer.write(tile);
+        writer.write(uint64_t(tileStats.samplesTraced));
+        writer.write(uint8_t(tileStats.convergedTiles > 0));
+        writer.writeVector(pixels.pixels);
+        writer.writeVector(tileSurfaces.normals);
+        writer.writeVector(tileSurfaces.albedo);
+        Message result = writer.finish(TileResultMessage);
+
+        std::lock_guard lock(sendMutex);
+        if (options.exitAfterTiles >= 0 && tilesRendered >= options.exitAfterTiles) {
+            // As if the machine went away in the middle of the render
+            std::_Exit(1);
+        }
+        try {
+            sendMessage(socket, result);
+            ++tilesRendered;
+        } catch (std::exception const&) {
+            // The coordinator is gone, the main thread notices as well
+            stopping = true;
+        }
+    };
+
+    try {
+        while (receiveMessage(socket, message)) {
+            MessageReader reader(message);
+            if (message.type == DoneMessage) {
+                break;
+            }
+            uint32_t tile = reader.read<uint32_t>();
+            if (tile >= grid.size()) {
+                throw std::runtime_error("Tile " + std::to_string(tile) + " out of range");
+            }
+            if (message.type == TileMessage) {
+                pool.submit([&renderTile, tile] { renderTile(tile); });
+            } else if (message.type == CancelMessage) {
+                cancelled[tile] = true;
+            }
+        }
+    } catch (...) {
+        // The queued tiles refer to this frame
+        stopping = true;
+        pool.wait();
+        throw;
+    }
+
+    stopping = true;
+    pool.wait();
+}
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+#include "CpuTracer.h"
+#include "Image.h"
+#include "RenderJob.h"
+
+struct GBuffer;
+
+// Renders a job's tiles in worker processes. The coordinator listens on a
+// socket, sends every worker that connects the job, and hands out tiles as
+// workers ask for more. Workers load the scene themselves, so relative paths
+// in the job have to resolve for them too.
+//
+// Workers hold up to twice as many tiles as they have threads. Once the queue
+// is empty, a worker with idle threads gets a copy of the newest tile queued
+// at the busiest worker, whichever finishes first wins and the other one is
+// cancelled. The tiles of workers that disconnect or stop answering go back
+// into the queue. Every pixel comes out the same as with CpuTracer::render.
+
+struct DistributedOptions {
+    // Worker processes to start on this machine
+    int localWorkers = 0;
+    // Where workers connect, empty for a private Unix domain socket that only
+    // the local workers know about
+    std::string listenAddress;
+    // Threads of each local worker, 0 to split the cores between them
+    unsigned workerThreads = 0;
+    // A worker that has tiles but sent nothing for this long is dropped, and
+    // the render fails when there was no worker at all for this long
+    int workerTimeoutSeconds = 30;
+    // The first local worker exits after this many tiles, to test retries
+    int crashWorkerAfter = -1;
+};
+
+struct DistributedStats {
+    size_t numTiles = 0;
+    // Tiles queued again after their worker was lost
+    size_t tilesRetried = 0;
+    // Tile copies given to idle workers, and results that came second
+    size_t tilesStolen = 0;
+    size_t duplicateResults = 0;
+    size_t workersConnected = 0;
+    size_t workersLost = 0;
+    RenderStats render;
+};
+
+// Connection events go to log when it is given. The normals and albedo of
+// the first hits are gathered into gbuffer when it is given.
+Image renderDistributed(RenderJob const& job, DistributedOptions const& options, DistributedStats* stats = nullptr,
+                        GBuffer* gbuffer = nullptr, std::ostream* log = nullptr);
+
+struct WorkerOptions {
+    unsigned numThreads = 0;
+    // Exits without a word after rendering this many tiles, to test retries
+    int exitAfterTiles = -1;
+    // The coordinator may not be listening yet
+    int connectTimeoutSeconds = 10;
+};
+
+// The worker side of renderDistributed: connects to the coordinator, renders
+// the tiles it gets and returns once it is told to stop or the coordinator is
+// gone.
+void runRenderWorker(std::string const& address, WorkerOptions const& options);
@@ -0,0 +1,68 @@
+#include "FrameWriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <utility>
+
+#include "../util/Trace.h"
+
+FrameWriter::FrameWriter(unsigned numThreads, size_t maxQueued)
+        : m_maxQueued(std::max<size_t>(maxQueued, 1)), m_pool(numThreads) {
+}
+
+FrameWriter::~FrameWriter() {
+    m_pool.wait();
+}
+
+void FrameWriter::write(Image image, std::string filename) {
+    std::exception_ptr error;
+    {
+        std::unique_lock lock(m_mutex);
+        auto start = std::chrono::steady_clock::now();
+        m_written.wait(lock, [&] { return m_queued < m_maxQueued || m_error; });
+        m_waitedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        error = std::exchange(m_error, nullptr);
+        if (!error) {
+            ++m_queued;
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    m_pool.submit([this, image = std::move(image), filename = std::move(filename)] {
+        try {
+            TRACE_SCOPE("writeFrame");
+            std::string partial = filename + ".partial";
+            writePng(image, partial);
+            std::filesystem::rename(partial, filename);
+        } catch (...) {
+            std::lock_guard lock(m_mutex);
+            if (!m_error) {
+                m_error = std::current_exception();
+            }
+        }
+        {
+            std::lock_guard lock(m_mutex);
+            --m_queued;
+        }
+        m_written.notify_all();
+    });
+}
+
+void FrameWriter::finish() {
+    m_pool.wait();
+    rethrowError();
+}
+
+void FrameWriter::rethrowError() {
+    std::exception_ptr error;
+    {
+        std::lock_guard lock(m_mutex);
+        error = std::exchange(m_error, nullptr);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
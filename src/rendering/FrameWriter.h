@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <string>
+
+#include "Image.h"
+#include "../util/ThreadPool.h"
+
+// Encodes and writes images on a pool of its own, so that rendering the next
+// frame overlaps with compressing and storing the previous ones. At most
+// maxQueued images wait or are being written at a time, write() blocks
+// while the queue is full.
+class FrameWriter {
+public:
+    FrameWriter(unsigned numThreads, size_t maxQueued);
+    // Waits for the queued writes, their errors are dropped
+    ~FrameWriter();
+
+    FrameWriter(FrameWriter const&) = delete;
+    FrameWriter& operator=(FrameWriter const&) = delete;
+
+    // Queues image to be written as a PNG. It goes to a temporary file first
+    // and is renamed when complete, so a file at filename is never partial.
+    // Rethrows the first error of an earlier write.
+    void write(Image image, std::string filename);
+    // Waits for every queued write and rethrows the first error
+    void finish();
+
+    // Time write() spent blocked on a full queue
+    double waitedMs() const { return m_waitedMs; }
+
+private:
+    void rethrowError();
+
+    size_t m_maxQueued;
+    double m_waitedMs = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_written;
+    size_t m_queued = 0;
+    std::exception_ptr m_error;
+
+    // Last, so that its destructor waits for the writes while the rest is
+    // still there
+    ThreadPool m_pool;
+};
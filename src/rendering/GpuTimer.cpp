@@ -0,0 +1,66 @@
+#include "GpuTimer.h"
+
+#include <algorithm>
+
+GpuTimer::GpuTimer() : m_track(traceTrack("GPU")) {
+}
+
+GpuTimer::~GpuTimer() {
+    for (Query const& query : m_pending) {
+        m_freeQueries.push_back(query.id);
+    }
+    if (!m_freeQueries.empty()) {
+        glDeleteQueries(GLsizei(m_freeQueries.size()), m_freeQueries.data());
+    }
+}
+
+void GpuTimer::begin(char const* name) {
+    if (!tracingEnabled() || m_active) {
+        return;
+    }
+
+    if (m_freeQueries.empty()) {
+        GLuint id;
+        glGenQueries(1, &id);
+        m_freeQueries.push_back(id);
+    }
+
+    Query query{m_freeQueries.back(), name, traceNowNs()};
+    m_freeQueries.pop_back();
+
+    glBeginQuery(GL_TIME_ELAPSED, query.id);
+    m_pending.push_back(query);
+    m_active = true;
+}
+
+void GpuTimer::end() {
+    if (!m_active) {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    m_active = false;
+}
+
+void GpuTimer::collect() {
+    // Queries finish in order, stop at the first one that is still running
+    while (!m_pending.empty() && !(m_active && m_pending.size() == 1)) {
+        Query query = m_pending.front();
+
+        GLint available{GL_FALSE};
+        glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+
+        GLuint64 elapsedNs{0};
+        glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &elapsedNs);
+
+        uint64_t startNs = std::max(query.issuedNs, m_cursorNs);
+        m_cursorNs = startNs + elapsedNs;
+        recordTraceEvent(query.name, startNs, m_cursorNs, m_track);
+
+        m_pending.pop_front();
+        m_freeQueries.push_back(query.id);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "../util/Trace.h"
+
+// Times GPU stages with GL_TIME_ELAPSED queries and records them on the "GPU"
+// trace track. Results are collected a few frames later once the GPU is done
+// with them, so timing never stalls the pipeline. Does nothing while tracing
+// is disabled.
+class GpuTimer {
+public:
+    GpuTimer();
+    ~GpuTimer();
+
+    GpuTimer(GpuTimer const&) = delete;
+    GpuTimer& operator=(GpuTimer const&) = delete;
+
+    // Stages cannot nest, GL allows one GL_TIME_ELAPSED query at a time
+    void begin(char const* name);
+    void end();
+
+    // Records the stages whose results are available. Call once a frame.
+    void collect();
+
+private:
+    struct Query {
+        GLuint id;
+        char const* name;
+        // CPU time of begin(), where the stage starts on the GPU track at the earliest
+        uint64_t issuedNs;
+    };
+
+    std::vector<GLuint> m_freeQueries;
+    std::deque<Query> m_pending;
+    bool m_active = false;
+    TraceTrack* m_track;
+    // End of the last recorded stage, the GPU runs stages one after another
+    uint64_t m_cursorNs = 0;
+};
+
+// Times a GPU stage for the rest of the enclosing block
+class ScopedGpuTimer {
+public:
+    ScopedGpuTimer(GpuTimer& timer, char const* name) : m_timer(timer) { m_timer.begin(name); }
+    ~ScopedGpuTimer() { m_timer.end(); }
+
+    ScopedGpuTimer(ScopedGpuTimer const&) = delete;
+    ScopedGpuTimer& operator=(ScopedGpuTimer const&) = delete;
+
+private:
+    GpuTimer& m_timer;
+};
@@ -0,0 +1,54 @@
+#include "Image.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+Image::Image(int width, int height)
+        : width(width), height(height), pixels(static_cast<size_t>(width) * height, glm::vec4(0)) {
+}
+
+std::vector<uint8_t> encodeRgb8(Image const& image) {
+    std::vector<uint8_t> rgb(static_cast<size_t>(image.width) * image.height * 3);
+
+    auto toByte = [](float value) {
+        return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    };
+
+    for (int y = 0; y < image.height; ++y) {
+        uint8_t* row = &rgb[static_cast<size_t>(image.height - 1 - y) * image.width * 3];
+        for (int x = 0; x < image.width; ++x) {
+            glm::vec4 const& pixel = image.at(x, y);
+            row[x * 3 + 0] = toByte(pixel.x);
+            row[x * 3 + 1] = toByte(pixel.y);
+            row[x * 3 + 2] = toByte(pixel.z);
+        }
+    }
+
+    return rgb;
+}
+
+void writePng(Image const& image, std::string const& filename) {
+    std::vector<uint8_t> rgb = encodeRgb8(image);
+
+    if (!stbi_write_png(filename.c_str(), image.width, image.height, 3, rgb.data(), image.width * 3)) {
+        throw std::runtime_error("Failed to write image: " + filename);
+    }
+}
+
+std::vector<uint8_t> encodePng(Image const& image) {
+    std::vector<uint8_t> rgb = encodeRgb8(image);
+
+    std::vector<uint8_t> png;
+    auto append = [](void* context, void* data, int size) {
+        auto& out = *static_cast<std::vector<uint8_t>*>(context);
+        auto bytes = static_cast<uint8_t const*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    };
+    if (!stbi_write_png_to_func(append, &png, image.width, image.height, 3, rgb.data(), image.width * 3)) {
+        throw std::runtime_error("Failed to encode image");
+    }
+    return png;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/vec4.hpp>
+
+// Linear RGBA float image. Row 0 is the bottom row, like the GL render texture.
+struct Image {
+    Image() = default;
+    Image(int width, int height);
+
+    glm::vec4& at(int x, int y) { return pixels[y * width + x]; }
+    glm::vec4 const& at(int x, int y) const { return pixels[y * width + x]; }
+
+    int width = 0;
+    int height = 0;
+    std::vector<glm::vec4> pixels;
+};
+
+// Converts to 8 bit RGB, flipping rows so the PNG is top-down.
+std::vector<uint8_t> encodeRgb8(Image const& image);
+void writePng(Image const& image, std::string const& filename);
+// The PNG file writePng would write, in memory
+std::vector<uint8_t> encodePng(Image const& image);
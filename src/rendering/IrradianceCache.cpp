@@ -0,0 +1,219 @@
+#include "IrradianceCache.h"
+
+#include <algorithm>
+
+#include <glm/common.hpp>
+#include <glm/vector_relational.hpp>
+
+#include "CpuTracer.h"
+#include "Dda.h"
+#include "SunVisibility.h"
+#include "VoxelEdit.h"
+#include "../util/ThreadPool.h"
+#include "../util/Trace.h"
+
+namespace {
+    // Entries traced by one task
+    constexpr size_t entriesPerTask = 16;
+
+    // The exposed faces of a brick in one direction, as their voxels
+    void exposedFaces(Model const& model, glm::uvec3 brick, int face, std::vector<glm::uvec3>& voxels) {
+        int axis = face / 2;
+        int side = face % 2 ? 1 : -1;
+        glm::uvec3 origin = brick * brickSize;
+        glm::uvec3 end = glm::min(origin + brickSize, model.size);
+        for (uint32_t z = origin.z; z < end.z; ++z) {
+            for (uint32_t y = origin.y; y < end.y; ++y) {
+                for (uint32_t x = origin.x; x < end.x; ++x) {
+                    if (!model.isSolid({x, y, z})) {
+                        continue;
+                    }
+                    glm::ivec3 neighbor{x, y, z};
+                    neighbor[axis] += side;
+                    bool inside = neighbor[axis] >= 0 && neighbor[axis] < int(model.size[axis]);
+                    if (!inside || !model.isSolid(glm::uvec3(neighbor))) {
+                        voxels.push_back({x, y, z});
+                    }
+                }
+            }
+        }
+    }
+}
+
+IrradianceCache::IrradianceCache(Model const& model, IrradianceCacheSettings const& settings)
+        : m_model(model), m_settings(settings), m_brickGridSize(model.occupancy.bricks.size) {
+    size_t numBricks = size_t(m_brickGridSize.x) * m_brickGridSize.y * m_brickGridSize.z;
+    m_entries.assign(numBricks * facesPerBrick, glm::vec4(0));
+    m_updates.assign(numBricks * facesPerBrick, 0);
+    m_isPending.assign(numBricks, 0);
+}
+
+int IrradianceCache::faceIndex(glm::vec3 normal) {
+    int axis = normal.x != 0 ? 0 : normal.y != 0 ? 1 : 2;
+    return axis * 2 + (normal[axis] > 0 ? 1 : 0);
+}
+
+glm::vec3 IrradianceCache::lookup(glm::vec3 position, glm::vec3 normal) const {
+    glm::ivec3 voxel{glm::floor(position - 0.5f * normal)};
+    if (glm::any(glm::lessThan(voxel, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(voxel, glm::ivec3(m_model.size)))) {
+        return glm::vec3(0);
+    }
+    size_t brickIndex = m_model.occupancy.bricks.cellIndex(glm::uvec3(voxel) / brickSize);
+    return glm::vec3(m_entries[brickIndex * facesPerBrick + faceIndex(normal)]);
+}
+
+glm::uvec3 IrradianceCache::brick(size_t brickIndex) const {
+    return {brickIndex % m_brickGridSize.x, (brickIndex / m_brickGridSize.x) % m_brickGridSize.y,
+            brickIndex / (size_t(m_brickGridSize.x) * m_brickGridSize.y)};
+}
+
+bool IrradianceCache::brickOccupied(size_t brickIndex) const {
+    return m_model.occupancy.bricks.occupied(brick(brickIndex));
+}
+
+glm::vec3 IrradianceCache::traceEstimate(CpuTracer const& tracer, size_t entry) const {
+    int face = int(entry % facesPerBrick);
+    std::vector<glm::uvec3> voxels;
+    exposedFaces(m_model, brick(entry / facesPerBrick), face, voxels);
+    if (voxels.empty()) {
+        return glm::vec3(0);
+    }
+
+    int axis = face / 2;
+    float side = face % 2 ? 1.0f : -1.0f;
+    bool samplingLights = tracer.samplesLights();
+
+    glm::vec3 sum{0};
+    for (int ray = 0; ray < m_settings.raysPerUpdate; ++ray) {
+        // Every entry walks a sequence of its own, the jitter pair picks the
+        // point on the face
+        uint32_t sampleIndex = m_updates[entry] * uint32_t(m_settings.raysPerUpdate) + uint32_t(ray);
+        PixelSampler sampler{SamplerType::Sobol, glm::uvec2(uint32_t(entry), 0), sampleIndex, nullptr};
+        glm::uvec3 voxel = voxels[hashCombine(uint32_t(entry), sampleIndex) % voxels.size()];
+        glm::vec2 u = sampler.get(jitterDimension);
+
+        VoxelHit hit;
+        hit.hit = true;
+        hit.normal = glm::vec3(0);
+        hit.normal[axis] = side;
+        hit.position = glm::vec3(voxel) + 0.5f;
+        hit.position[axis] += side * (0.5f + 3 * EPSILON);
+        hit.position[(axis + 1) % 3] += u.x - 0.5f;
+        hit.position[(axis + 2) % 3] += u.y - 0.5f;
+
+        glm::vec3 light = tracer.directLight(hit, sampler, 0);
+
+        glm::vec3 rayDir = hit.normal + randomUnitVector(sampler.get(vertexDimension(0) + bounceDimension));
+        VoxelHit bounce = tracer.traceVoxel(hit.position, rayDir);
+        if (!bounce.hit) {
+            light += glm::vec3(1);
+        } else {
+            if (!samplingLights) {
+                light += bounce.material.emissive;
+            }
+            light += bounce.material.albedo * lookup(bounce.position, bounce.normal);
+        }
+        sum += light;
+    }
+    return sum / float(m_settings.raysPerUpdate);
+}
+
+size_t IrradianceCache::update(CpuTracer const& tracer, size_t budget, ThreadPool& pool, DirtyRanges* dirty) {
+    TRACE_SCOPE("updateIrradianceCache");
+
+    // Reset bricks first, then the round robin
+    std::vector<size_t> entries;
+    while (!m_pending.empty() && entries.size() < budget) {
+        uint32_t brickIndex = m_pending.back();
+        m_pending.pop_back();
+        m_isPending[brickIndex] = 0;
+        if (!brickOccupied(brickIndex)) {
+            continue;
+        }
+        for (int face = 0; face < facesPerBrick; ++face) {
+            entries.push_back(size_t(brickIndex) * facesPerBrick + face);
+        }
+    }
+
+    size_t numBricks = m_isPending.size();
+    for (size_t visited = 0; visited < numBricks && entries.size() < budget; ++visited) {
+        size_t brickIndex = m_cursor;
+        m_cursor = (m_cursor + 1) % numBricks;
+        if (!brickOccupied(brickIndex)) {
+            continue;
+        }
+        for (int face = 0; face < facesPerBrick; ++face) {
+            entries.push_back(brickIndex * facesPerBrick + face);
+        }
+    }
+
+    // Estimates read the entries as they were before this update, so they
+    // are applied once all of them are done
+    std::vector<glm::vec3> estimates(entries.size());
+    pool.parallelFor((entries.size() + entriesPerTask - 1) / entriesPerTask, [&](size_t task) {
+        size_t end = std::min(entries.size(), (task + 1) * entriesPerTask);
+        for (size_t i = task * entriesPerTask; i < end; ++i) {
+            estimates[i] = traceEstimate(tracer, entries[i]);
+        }
+    });
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        glm::vec4& entry = m_entries[entries[i]];
+        entry.w = std::min(entry.w + 1, float(m_settings.maxSamples));
+        entry = glm::vec4(glm::mix(glm::vec3(entry), estimates[i], 1 / entry.w), entry.w);
+        ++m_updates[entries[i]];
+        if (dirty) {
+            dirty->add(entries[i] * sizeof(glm::vec4), (entries[i] + 1) * sizeof(glm::vec4));
+        }
+    }
+
+    return entries.size();
+}
+
+void IrradianceCache::reset(size_t brickIndex) {
+    for (int face = 0; face < facesPerBrick; ++face) {
+        m_entries[brickIndex * facesPerBrick + face].w = 0;
+    }
+    if (!m_isPending[brickIndex]) {
+        m_isPending[brickIndex] = 1;
+        m_pending.push_back(uint32_t(brickIndex));
+    }
+}
+
+void IrradianceCache::invalidate(glm::uvec3 min, glm::uvec3 max) {
+    max = glm::min(max, m_model.size);
+    if (glm::any(glm::greaterThanEqual(min, max))) {
+        return;
+    }
+
+    glm::ivec3 radius{m_settings.invalidationRadius};
+    glm::uvec3 firstBrick = glm::uvec3(glm::max(glm::ivec3(min) - radius, glm::ivec3(0))) / brickSize;
+    glm::uvec3 lastBrick = glm::min(glm::uvec3(glm::ivec3(max) - 1 + radius) / brickSize, m_brickGridSize - 1u);
+    for (uint32_t z = firstBrick.z; z <= lastBrick.z; ++z) {
+        for (uint32_t y = firstBrick.y; y <= lastBrick.y; ++y) {
+            for (uint32_t x = firstBrick.x; x <= lastBrick.x; ++x) {
+                reset(m_model.occupancy.bricks.cellIndex({x, y, z}));
+            }
+        }
+    }
+}
+
+void IrradianceCache::invalidateSunVisibility(SunVisibility const& visibility, DirtyRanges const& dirty) {
+    glm::uvec3 size = visibility.size;
+    size_t numVoxels = size_t(size.x) * size.y * size.z;
+    for (ByteRange range : dirty.ranges()) {
+        // Eight voxels to a word
+        size_t begin = range.begin / sizeof(uint32_t) * 8;
+        size_t end = std::min(numVoxels, range.end / sizeof(uint32_t) * 8);
+        for (size_t index = begin; index < end; ++index) {
+            glm::uvec3 voxel{index % size.x, (index / size.x) % size.y, index / (size_t(size.x) * size.y)};
+            reset(m_model.occupancy.bricks.cellIndex(voxel / brickSize));
+        }
+    }
+}
+
+void IrradianceCache::invalidateAll() {
+    for (size_t brickIndex = 0; brickIndex < m_isPending.size(); ++brickIndex) {
+        reset(brickIndex);
+    }
+}
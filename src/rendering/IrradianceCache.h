@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+class DirtyRanges;
+class ThreadPool;
+struct CpuTracer;
+struct Model;
+struct SunVisibility;
+
+// CPU counterpart of assets/shaders/irradiance.glsl. Keep both in sync.
+
+struct IrradianceCacheSettings {
+    // Paths traced per entry and update, averaged into one estimate
+    int raysPerUpdate = 4;
+    // Estimates are averaged up to this many, later ones are blended in
+    // with weight 1 / maxSamples so the cache follows changes of the scene
+    int maxSamples = 64;
+    // Edits reset the entries of the bricks up to this many voxels away
+    int invalidationRadius = 8;
+};
+
+// The light leaving the exposed voxel faces of a model as if they were
+// white, so that a face's outgoing light is its albedo times the cache.
+// Entries are kept per brick (see Occupancy.h) and face direction, six to
+// a brick in the order -x, +x, -y, +y, -z, +z, as rgb and the number of
+// estimates averaged in w.
+//
+// An update traces one diffuse bounce from a random point on the brick's
+// exposed faces of that direction: the direct light there, plus the sky if
+// the bounce escapes or the cache at the face it hits. Reading the cache at
+// the end of the bounce makes every update carry one more bounce than the
+// last one did, so the entries converge to multi-bounce light while a path
+// through the cache costs a fixed number of rays.
+class IrradianceCache {
+public:
+    static constexpr int facesPerBrick = 6;
+
+    IrradianceCache(Model const& model, IrradianceCacheSettings const& settings = {});
+
+    static int faceIndex(glm::vec3 normal);
+
+    // The cached light of the face a hit is in front of, like the
+    // traversal returns hits
+    glm::vec3 lookup(glm::vec3 position, glm::vec3 normal) const;
+
+    // Traces the paths of up to budget entries with tracer, reset entries
+    // first and then the rest round robin, spread over the pool. Entries of
+    // empty bricks are skipped without counting against the budget. The
+    // changed entries are added to dirty, in bytes, when it is given.
+    // Returns the number of entries updated.
+    size_t update(CpuTracer const& tracer, size_t budget, ThreadPool& pool, DirtyRanges* dirty = nullptr);
+
+    // Forget the estimates of the bricks around the voxels in [min, max)
+    void invalidate(glm::uvec3 min, glm::uvec3 max);
+    // Forget the estimates of the bricks of the voxels whose words of
+    // visibility.bits are in dirty, in bytes, as rebakeSunVisibility
+    // reports them
+    void invalidateSunVisibility(SunVisibility const& visibility, DirtyRanges const& dirty);
+    // After changes to the sun, which lights everything
+    void invalidateAll();
+
+    // Bricks that were reset and wait for their update
+    size_t numPending() const { return m_pending.size(); }
+
+    std::vector<glm::vec4> const& entries() const { return m_entries; }
+    glm::uvec3 brickGridSize() const { return m_brickGridSize; }
+
+private:
+    glm::uvec3 brick(size_t brickIndex) const;
+    bool brickOccupied(size_t brickIndex) const;
+    void reset(size_t brickIndex);
+    glm::vec3 traceEstimate(CpuTracer const& tracer, size_t entry) const;
+
+    Model const& m_model;
+    IrradianceCacheSettings m_settings;
+    glm::uvec3 m_brickGridSize;
+    std::vector<glm::vec4> m_entries;
+    // Updates of every entry so far, to walk its sample sequence
+    std::vector<uint32_t> m_updates;
+    // Bricks reset since their last update, and whether they are in there
+    std::vector<uint32_t> m_pending;
+    std::vector<uint8_t> m_isPending;
+    size_t m_cursor = 0;
+};
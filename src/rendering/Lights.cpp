@@ -0,0 +1,210 @@
+#include "Lights.h"
+
+#include <algorithm>
+
+#include <glm/common.hpp>
+#include <glm/vector_relational.hpp>
+
+#include "CpuTracer.h"
+#include "Model.h"
+#include "../util/Trace.h"
+
+namespace {
+    int exposedFaces(Model const& model, glm::uvec3 voxel) {
+        int exposed = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int side : {-1, 1}) {
+                glm::ivec3 neighbor{voxel};
+                neighbor[axis] += side;
+                bool inside = neighbor[axis] >= 0 && neighbor[axis] < int(model.size[axis]);
+                exposed += !inside || !model.isSolid(glm::uvec3(neighbor));
+            }
+        }
+        return exposed;
+    }
+
+    // Voxels buried in others cannot light anything, their power is 0
+    float lightPower(Model const& model, glm::uvec3 voxel) {
+        if (!model.isSolid(voxel)) {
+            return 0;
+        }
+        uint8_t paletteIndex = model.paletteIndex(voxel);
+        float emission = model.materials[paletteIndex].emission;
+        if (emission <= 0) {
+            return 0;
+        }
+        return emission * sampleLuminance(decodeColor(model.palette[paletteIndex])) *
+               float(exposedFaces(model, voxel));
+    }
+
+    // Vose's variant, O(n) and exact up to rounding
+    void buildAliasTable(std::vector<EmissiveLight>& lights, std::vector<float> const& powers, float totalPower) {
+        size_t numLights = lights.size();
+        std::vector<float> scaled(numLights);
+        std::vector<uint32_t> small;
+        std::vector<uint32_t> large;
+        for (size_t i = 0; i < numLights; ++i) {
+            scaled[i] = powers[i] * float(numLights) / totalPower;
+            (scaled[i] < 1 ? small : large).push_back(uint32_t(i));
+            lights[i].pdf = powers[i] / totalPower;
+        }
+
+        while (!small.empty() && !large.empty()) {
+            uint32_t less = small.back();
+            small.pop_back();
+            uint32_t more = large.back();
+            large.pop_back();
+
+            lights[less].probability = scaled[less];
+            lights[less].alias = more;
+            scaled[more] += scaled[less] - 1;
+            (scaled[more] < 1 ? small : large).push_back(more);
+        }
+
+        // Whatever is left is 1 up to rounding
+        for (std::vector<uint32_t> const* rest : {&small, &large}) {
+            for (uint32_t i : *rest) {
+                lights[i].probability = 1;
+                lights[i].alias = i;
+            }
+        }
+    }
+
+    // Appends the lights in [min, max)
+    void addLights(LightList& list, Model const& model, glm::uvec3 min, glm::uvec3 max) {
+        for (uint32_t z = min.z; z < max.z; ++z) {
+            for (uint32_t y = min.y; y < max.y; ++y) {
+                for (uint32_t x = min.x; x < max.x; ++x) {
+                    float power = lightPower(model, {x, y, z});
+                    if (power <= 0) {
+                        continue;
+                    }
+                    list.lights.push_back({x, y, z, model.paletteIndex({x, y, z}), 1, 0, 0, 0});
+                    list.powers.push_back(power);
+                }
+            }
+        }
+    }
+
+    // Sums the powers again rather than adjusting the total, which would
+    // drift over many edits
+    void rebuildAliasTable(LightList& list) {
+        list.totalPower = 0;
+        for (float power : list.powers) {
+            list.totalPower += power;
+        }
+        if (!list.lights.empty()) {
+            buildAliasTable(list.lights, list.powers, list.totalPower);
+        }
+    }
+}
+
+LightList buildLightList(Model const& model) {
+    LightList list;
+    if (std::none_of(model.materials.begin(), model.materials.end(),
+                     [](PaletteMaterial const& material) { return material.emission > 0; })) {
+        return list;
+    }
+
+    TRACE_SCOPE("buildLightList");
+    addLights(list, model, glm::uvec3(0), model.size);
+    rebuildAliasTable(list);
+    return list;
+}
+
+void updateLightList(LightList& list, Model const& model, glm::uvec3 min, glm::uvec3 max) {
+    TRACE_SCOPE("updateLightList");
+    min = glm::uvec3(glm::max(glm::ivec3(min) - 1, 0));
+    max = glm::min(max + 1u, model.size);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < list.lights.size(); ++i) {
+        EmissiveLight const& light = list.lights[i];
+        glm::uvec3 voxel{light.x, light.y, light.z};
+        if (glm::all(glm::greaterThanEqual(voxel, min)) && glm::all(glm::lessThan(voxel, max))) {
+            continue;
+        }
+        list.lights[kept] = light;
+        list.powers[kept] = list.powers[i];
+        ++kept;
+    }
+    list.lights.resize(kept);
+    list.powers.resize(kept);
+
+    addLights(list, model, min, max);
+    rebuildAliasTable(list);
+}
+
+void updateLightPowers(LightList& list, Model const& model, uint8_t paletteIndex, uint32_t previousColor) {
+    if (sampleLuminance(decodeColor(previousColor)) <= 0) {
+        list = buildLightList(model);
+        return;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < list.lights.size(); ++i) {
+        EmissiveLight const& light = list.lights[i];
+        float power = list.powers[i];
+        if (light.paletteIndex == paletteIndex) {
+            power = lightPower(model, {light.x, light.y, light.z});
+            if (power <= 0) {
+                continue;
+            }
+        }
+        list.lights[kept] = light;
+        list.powers[kept] = power;
+        ++kept;
+    }
+    list.lights.resize(kept);
+    list.powers.resize(kept);
+    rebuildAliasTable(list);
+}
+
+LightSample sampleLight(std::span<EmissiveLight const> lights, glm::vec3 point, glm::vec2 u, glm::vec2 v) {
+    LightSample sample;
+    if (lights.empty()) {
+        return sample;
+    }
+
+    // The fraction of u.x left after picking an entry decides about the alias
+    uint32_t numLights = uint32_t(lights.size());
+    float scaled = u.x * float(numLights);
+    uint32_t index = std::min(uint32_t(scaled), numLights - 1);
+    if (scaled - float(index) >= lights[index].probability) {
+        index = lights[index].alias;
+    }
+    EmissiveLight const& light = lights[index];
+
+    // At most one face per axis faces the point
+    glm::vec3 voxelMin{float(light.x), float(light.y), float(light.z)};
+    glm::vec3 normals[3];
+    int numFaces = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        glm::vec3 normal{0};
+        if (point[axis] > voxelMin[axis] + 1) {
+            normal[axis] = 1;
+            normals[numFaces++] = normal;
+        } else if (point[axis] < voxelMin[axis]) {
+            normal[axis] = -1;
+            normals[numFaces++] = normal;
+        }
+    }
+    if (numFaces == 0) {
+        return sample;
+    }
+
+    glm::vec3 normal = normals[std::min(int(u.y * float(numFaces)), numFaces - 1)];
+    int axis = normal.x != 0 ? 0 : normal.y != 0 ? 1 : 2;
+    glm::vec3 position = voxelMin;
+    position[axis] += normal[axis] > 0 ? 1.0f : 0.0f;
+    position[(axis + 1) % 3] += v.x;
+    position[(axis + 2) % 3] += v.y;
+
+    sample.position = position;
+    sample.normal = normal;
+    sample.voxel = {light.x, light.y, light.z};
+    sample.paletteIndex = light.paletteIndex;
+    // Faces have an area of 1
+    sample.pdf = light.pdf / float(numFaces);
+    return sample;
+}
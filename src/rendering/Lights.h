@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+struct Model;
+
+// CPU counterpart of assets/shaders/lights.glsl. Keep both in sync.
+
+// Material of a palette entry, from the MATL chunks of vox files. Laid out
+// like PaletteMaterial in voxel.comp.
+struct PaletteMaterial {
+    // Radiance of the faces of the voxel relative to its palette color, 0 for
+    // voxels that do not emit
+    float emission = 0;
+    uint32_t metal = 0;
+};
+
+// An emissive voxel with at least one exposed face and its entry of the
+// alias table. Laid out like EmissiveLight in voxel.comp.
+struct EmissiveLight {
+    uint32_t x;
+    uint32_t y;
+    uint32_t z;
+    uint32_t paletteIndex;
+    // Walker's alias method: a uniform entry i is kept with this
+    // probability, otherwise alias is taken
+    float probability;
+    uint32_t alias;
+    // Probability of picking this light, its power over the total power
+    float pdf;
+    uint32_t padding;
+};
+
+// The emissive voxels of a model, picked in proportion to their power
+// (emission times luminance times exposed faces) in constant time.
+struct LightList {
+    bool empty() const { return lights.empty(); }
+
+    std::vector<EmissiveLight> lights;
+    // Power of each light, for rebuilding the alias table after an edit
+    std::vector<float> powers;
+    float totalPower = 0;
+};
+
+LightList buildLightList(Model const& model);
+
+// Brings list up to date after the voxels in [min, max) changed. Only the
+// lights in the box grown by one voxel, whose exposed faces may have changed,
+// are looked at again, then the alias table is rebuilt.
+void updateLightList(LightList& list, Model const& model, glm::uvec3 min, glm::uvec3 max);
+
+// Brings the lights of paletteIndex up to date after its color changed from
+// previousColor. Lights that went black are dropped. Voxels of a color that
+// was black were no lights, the list is built again to find them.
+void updateLightPowers(LightList& list, Model const& model, uint8_t paletteIndex, uint32_t previousColor);
+
+// A point on a light, pdf is per area and includes picking the light. A pdf
+// of 0 means there was nothing to sample.
+struct LightSample {
+    glm::vec3 position{0};
+    glm::vec3 normal{0};
+    glm::uvec3 voxel{0};
+    uint32_t paletteIndex = 0;
+    float pdf = 0;
+};
+
+// Picks a light with u.x and one of its faces that face point with u.y, and
+// a uniform point on that face with v. The faces of a cube that face a point
+// are exactly the ones it can see, so no visible point is left out.
+LightSample sampleLight(std::span<EmissiveLight const> lights, glm::vec3 point, glm::vec2 u, glm::vec2 v);
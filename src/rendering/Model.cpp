@@ -1,17 +1,18 @@
 #include "Model.h"
 
+#include "VoxFile.h"
+
+#include <glm/common.hpp>
 #include <glm/geometric.hpp>
-#include <fstream>
-#include <iterator>
-#include <iostream>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
 
-#ifdef __GNUC__
-#define PACK( __Declaration__ ) __Declaration__ __attribute__((__packed__))
-#endif
+#include "../util/Trace.h"
 
-#ifdef _MSC_VER
-#define PACK( __Declaration__ ) __pragma( pack(push, 1) ) __Declaration__ __pragma( pack(pop))
-#endif
+// Scenes are flattened into one dense grid, keep that grid reasonable
+constexpr int maxVoxSceneExtent = 2048;
 
 uint32_t defaultPalette[256] {
         0x00000000, 0xffffffff, 0xffccffff, 0xff99ffff, 0xff66ffff, 0xff33ffff, 0xff00ffff, 0xffffccff, 0xffccccff, 0xff99ccff, 0xff66ccff, 0xff33ccff, 0xff00ccff, 0xffff99ff, 0xffcc99ff, 0xff9999ff,
@@ -32,145 +33,144 @@ uint32_t defaultPalette[256] {
         0xff880000, 0xff770000, 0xff550000, 0xff440000, 0xff220000, 0xff110000, 0xffeeeeee, 0xffdddddd, 0xffbbbbbb, 0xffaaaaaa, 0xff888888, 0xff777777, 0xff555555, 0xff444444, 0xff222222, 0xff111111
 };
 
-Model loadExampleModel() {
+// MATL property as a float, fallback if missing or malformed
+static float materialFloat(VoxMaterial const& material, std::string_view key, float fallback) {
+    std::string_view text = findVoxDictValue(material.properties, key);
+    float value = fallback;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && std::isfinite(value) ? value : fallback;
+}
+
+// MATL ids are palette indices. MagicaVoxel has no units for _emit and
+// _flux, an emitter of _emit 1 and _flux 0 is as bright as the sky.
+static std::array<PaletteMaterial, 256> paletteMaterials(VoxScene const& scene) {
+    std::array<PaletteMaterial, 256> materials{};
+    for (VoxMaterial const& material : scene.materials) {
+        if (material.id < 0 || material.id > 255) {
+            continue;
+        }
+        std::string_view type = findVoxDictValue(material.properties, "_type");
+        PaletteMaterial& paletteMaterial = materials[material.id];
+        if (type == "_emit") {
+            float emit = std::max(materialFloat(material, "_emit", 0), 0.0f);
+            float flux = std::max(materialFloat(material, "_flux", 0), 0.0f);
+            paletteMaterial.emission = emit * (1 + flux);
+        }
+        paletteMaterial.metal = type == "_metal";
+    }
+    return materials;
+}
+
+void Model::allocate(glm::uvec3 newSize, VoxelLayout newLayout) {
+    size = newSize;
+    layout = newLayout;
+
+    if (layout == VoxelLayout::Linear) {
+        indices.assign(size_t(size.x) * size.y * size.z, 0);
+        solid.assign(indices.size(), 0);
+    } else {
+        glm::uvec3 bricks = brickGridSize();
+        size_t numBricks = size_t(bricks.x) * bricks.y * bricks.z;
+        indices.assign(numBricks * 64, 0);
+        solid.assign(numBricks * 8, 0);
+    }
+}
+
+Model loadExampleModel(VoxelLayout layout) {
     Model model;
-    model.size = {32, 32, 32};
-    model.indices.resize(model.size.x * model.size.y * model.size.z);
+    model.allocate({32, 32, 32}, layout);
 
     for (int z = 0; z < model.size.z; ++z) {
         for (int y = 0; y < model.size.y; ++y) {
             for (int x = 0; x < model.size.x; ++x) {
-                int index = (z * model.size.y * model.size.x + y * model.size.x + x);
-
                 float const sphereRadius = 14;
                 if (glm::length(glm::vec3(x, y, z) - glm::vec3(16)) < sphereRadius){// && (x % 2 + y % 2 + z % 2 == 0)) {
-                    model.indices[index] = rand() % 256;
+                    model.setVoxel(glm::uvec3(x, y, z), (rand() % 255) + 1);
                 } else if (y == 0 || x == model.size.x - 1 || z == model.size.z - 1) {
-                    model.indices[index] = (rand() % 255) + 1;
-                } else {
-                    model.indices[index] = 0;
+                    model.setVoxel(glm::uvec3(x, y, z), (rand() % 255) + 1);
                 }
             }
         }
     }
 
     std::copy_n(defaultPalette, 256, model.palette.begin());
+    model.occupancy = buildOccupancyPyramid(model);
 
     return model;
 }
 
-Model loadVoxModel(std::string const& filename) {
-    std::ifstream ifs(filename, std::ios::in | std::ios::binary);
-
-    if (!ifs.is_open()) {
-        throw std::runtime_error("Failed to open file: " + filename);
+Model convertLayout(Model const& model, VoxelLayout layout) {
+    TRACE_SCOPE("convertLayout");
+    Model converted;
+    converted.allocate(model.size, layout);
+    converted.palette = model.palette;
+    converted.materials = model.materials;
+
+    for (uint32_t z = 0; z < model.size.z; ++z) {
+        for (uint32_t y = 0; y < model.size.y; ++y) {
+            for (uint32_t x = 0; x < model.size.x; ++x) {
+                if (model.isSolid({x, y, z})) {
+                    converted.setVoxel({x, y, z}, model.paletteIndex({x, y, z}));
+                }
+            }
+        }
     }
 
-    std::streampos fileSize;
-    ifs.seekg(0, std::ios::end);
-    fileSize = ifs.tellg();
-    ifs.seekg(0, std::ios::beg);
-
-    std::vector<char> voxData(fileSize);
-    ifs.read(&voxData[0], fileSize);
-
-    PACK(struct VoxHeader {
-        char id[4];
-        int32_t version;
-    });
-
-    PACK(struct ChunkHeader {
-        char id[4];
-        int32_t numChunkBytes;
-        int32_t numChildBytes;
-    });
-
-    PACK(struct SIZEChunk {
-        int32_t sizeX;
-        int32_t sizeY;
-        int32_t sizeZ;
-    });
-
-    PACK(struct XYZIChunk {
-        int32_t numVoxels;
-    });
-
-    PACK(struct RGBAChunk {
-        uint32_t palette[256];
-    });
-
-    PACK(struct Voxel {
-        int8_t x;
-        int8_t y;
-        int8_t z;
-        int8_t i;
-    });
-
-    auto strEqual = [](const char* expected, const char* actual, size_t size) {
-        return std::equal(expected, expected + size, actual);
-    };
+    converted.occupancy = model.occupancy;
+    converted.lights = model.lights;
+    return converted;
+}
 
-    VoxHeader* header = reinterpret_cast<VoxHeader*>(voxData.data());
-    if (!strEqual("VOX ", header->id, 4)) {
-        throw std::runtime_error("Not a valid vox file");
-    }
+Model loadVoxModel(std::string const& filename, VoxelLayout layout) {
+    TRACE_SCOPE("loadVoxModel");
+    VoxScene scene = parseVoxFile(filename);
+    std::vector<VoxInstance> instances = flattenVoxScene(scene);
 
-    if (header->version != 150) {
-        throw std::runtime_error("Unexpected vox version");
+    if (instances.empty()) {
+        throw std::runtime_error("Vox file has no visible models: " + filename);
     }
 
-    Model model;
-    bool paletteLoaded = false;
-
-    ChunkHeader* chunkHeader = reinterpret_cast<ChunkHeader*>(header + 1);
-    while (chunkHeader != (ChunkHeader*)&voxData[voxData.size()]) {
-        std::string chunkId(chunkHeader->id, chunkHeader->id + 4);
-        std::cout << "id: " << chunkId;
-        std::cout << ", content: " << chunkHeader->numChunkBytes;
-        std::cout << ", child: " << chunkHeader->numChildBytes << std::endl;
-
-        if (chunkId == "MAIN") {
-            ++chunkHeader;
-            continue;
-        }
+    auto worldPos = [&](VoxInstance const& instance, glm::ivec3 voxel) {
+        glm::ivec3 size = scene.models[instance.modelId].size;
+        return instance.rotation * (voxel - size / 2) + instance.translation;
+    };
 
-        if (chunkId == "SIZE") {
-            SIZEChunk* sizeChunk = reinterpret_cast<SIZEChunk*>(chunkHeader + 1);
-            model.size = {sizeChunk->sizeX, sizeChunk->sizeZ, sizeChunk->sizeY};
-            model.indices.resize(sizeChunk->sizeX * sizeChunk->sizeY * sizeChunk->sizeY);
-            model.solid.resize(model.indices.size());
+    glm::ivec3 minCorner(INT32_MAX);
+    glm::ivec3 maxCorner(INT32_MIN);
+    for (VoxInstance const& instance : instances) {
+        glm::ivec3 size = scene.models[instance.modelId].size;
+        for (glm::ivec3 corner : {glm::ivec3(0), size - 1}) {
+            glm::ivec3 pos = worldPos(instance, corner);
+            minCorner = glm::min(minCorner, pos);
+            maxCorner = glm::max(maxCorner, pos);
         }
+    }
 
-        if (chunkId == "XYZI") {
-            XYZIChunk* xyziChunk = reinterpret_cast<XYZIChunk*>(chunkHeader + 1);
-            Voxel* voxel = reinterpret_cast<Voxel*>(xyziChunk + 1);
-
-            for (int i = 0; i < xyziChunk->numVoxels; ++i) {
-                int x = model.size.x - voxel->x - 1;
-                int y = voxel->z;
-                int z = voxel->y;
+    glm::ivec3 extent = maxCorner - minCorner + 1;
+    if (extent.x > maxVoxSceneExtent || extent.y > maxVoxSceneExtent || extent.z > maxVoxSceneExtent) {
+        throw std::runtime_error("Vox scene too large: " + filename);
+    }
 
-                int voxelIndex = z * model.size.y * model.size.x + y * model.size.x + x;
-                model.indices[voxelIndex] = voxel->i;
-                model.solid[voxelIndex] = 1;
-                ++voxel;
-            }
-        }
+    // vox files are z up, the renderer is y up
+    Model model;
+    model.allocate(glm::uvec3(extent.x, extent.z, extent.y), layout);
 
-        if (chunkId == "RGBA") {
-            RGBAChunk* rgbaChunk = reinterpret_cast<RGBAChunk*>(chunkHeader + 1);
-            std::copy_n(rgbaChunk->palette, 256, model.palette.begin());
-            paletteLoaded = true;
+    for (VoxInstance const& instance : instances) {
+        for (VoxVoxel const& voxel : scene.models[instance.modelId].voxels) {
+            glm::ivec3 pos = worldPos(instance, {voxel.x, voxel.y, voxel.z}) - minCorner;
+            model.setVoxel(glm::uvec3(extent.x - pos.x - 1, pos.z, pos.y), voxel.colorIndex);
         }
-
-        char* rawPtr = reinterpret_cast<char*>(chunkHeader);
-        rawPtr += chunkHeader->numChunkBytes + sizeof(ChunkHeader);
-        chunkHeader = reinterpret_cast<ChunkHeader*>(rawPtr);
     }
 
-    if (!paletteLoaded) {
+    if (scene.hasPalette) {
+        std::copy(scene.palette.begin(), scene.palette.end(), model.palette.begin());
+    } else {
         std::copy_n(defaultPalette, 256, model.palette.begin());
     }
+    model.materials = paletteMaterials(scene);
+
+    model.occupancy = buildOccupancyPyramid(model);
+    model.lights = buildLightList(model);
 
     return model;
 }
@@ -6,12 +6,83 @@
 
 #include <glm/vec3.hpp>
 
+#include "Lights.h"
+#include "Occupancy.h"
+
+enum class VoxelLayout {
+    // indices and solid hold one byte per voxel, z*Y*X + y*X + x
+    Linear,
+    // The map is cut into 4^3 bricks stored one after another (x fastest),
+    // with the 64 voxels of a brick in Morton order. A brick's palette
+    // indices fill exactly one 64 byte cache line, 0 meaning empty, and
+    // solid holds its occupancy as one bit per voxel (8 bytes per brick).
+    Bricked,
+};
+
 struct Model {
+    // Morton index of a voxel inside its brick: bits x0 y0 z0 x1 y1 z1
+    static uint32_t mortonInBrick(glm::uvec3 voxel) {
+        return (voxel.x & 1u) | ((voxel.y & 1u) << 1) | ((voxel.z & 1u) << 2) |
+               ((voxel.x & 2u) << 2) | ((voxel.y & 2u) << 3) | ((voxel.z & 2u) << 4);
+    }
+
+    glm::uvec3 brickGridSize() const { return (size + 3u) / 4u; }
+
+    // Index into indices for a voxel inside the map
+    size_t voxelOffset(glm::uvec3 voxel) const {
+        if (layout == VoxelLayout::Linear) {
+            return (size_t(voxel.z) * size.y + voxel.y) * size.x + voxel.x;
+        }
+
+        glm::uvec3 bricks = brickGridSize();
+        glm::uvec3 brick = voxel / 4u;
+        size_t brickIndex = (size_t(brick.z) * bricks.y + brick.y) * bricks.x + brick.x;
+        return brickIndex * 64 + mortonInBrick(voxel);
+    }
+
+    bool isSolid(glm::uvec3 voxel) const {
+        size_t offset = voxelOffset(voxel);
+        if (layout == VoxelLayout::Linear) {
+            return solid[offset] != 0;
+        }
+        return (solid[offset >> 3] >> (offset & 7)) & 1u;
+    }
+
+    uint8_t paletteIndex(glm::uvec3 voxel) const {
+        return indices[voxelOffset(voxel)];
+    }
+
+    // In the bricked layout palette index 0 is reserved for empty voxels
+    void setVoxel(glm::uvec3 voxel, uint8_t paletteIndex, bool isSolid = true) {
+        size_t offset = voxelOffset(voxel);
+
+        if (layout == VoxelLayout::Linear) {
+            indices[offset] = paletteIndex;
+            solid[offset] = isSolid ? 1 : 0;
+            return;
+        }
+
+        isSolid = isSolid && paletteIndex != 0;
+        indices[offset] = isSolid ? paletteIndex : 0;
+        uint8_t bit = uint8_t(1u << (offset & 7));
+        solid[offset >> 3] = isSolid ? (solid[offset >> 3] | bit) : (solid[offset >> 3] & ~bit);
+    }
+
+    // Sizes indices and solid for an empty map of the given size
+    void allocate(glm::uvec3 newSize, VoxelLayout newLayout);
+
     glm::uvec3 size;
+    VoxelLayout layout = VoxelLayout::Linear;
     std::array<uint32_t, 256> palette;
+    std::array<PaletteMaterial, 256> materials{};
     std::vector<uint8_t> indices;
     std::vector<uint8_t> solid;
+    // Built from solid by the loaders, used to skip empty space while tracing
+    OccupancyPyramid occupancy;
+    // Built from materials by the loaders, for sampling emissive voxels
+    LightList lights;
 };
 
-Model loadExampleModel();
-Model loadVoxModel(std::string const& filename);
\ No newline at end of file
+Model loadExampleModel(VoxelLayout layout = VoxelLayout::Linear);
+Model loadVoxModel(std::string const& filename, VoxelLayout layout = VoxelLayout::Linear);
+Model convertLayout(Model const& model, VoxelLayout layout);
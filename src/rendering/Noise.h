@@ -4,9 +4,12 @@
 
 #include <GL/glew.h>
 
+#include "NoiseImages.h"
+
 struct Noise {
-    static Noise LoadBlueNoise(std::string const& imageDir);
-    static Noise LoadWhiteNoise(int numLayers, int extent);
+    static Noise LoadBlueNoise(std::string const& imageDir, ThreadPool& pool);
+    // Uploads images decoded by loadNoiseImages
+    static Noise FromImages(NoiseImages const& images);
 
     GLuint textureId;
     int textureWidth;
@@ -0,0 +1,49 @@
+#include "NoiseImages.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "../util/ThreadPool.h"
+
+NoiseImages loadNoiseImages(std::string const& imageDir, ThreadPool& pool) {
+    std::vector<std::filesystem::path> paths;
+    for (auto const& entry : std::filesystem::directory_iterator(imageDir)) {
+        paths.push_back(entry.path());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    struct Decoded {
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> pixels;
+    };
+    std::vector<Decoded> decoded(paths.size());
+
+    pool.parallelFor(paths.size(), [&](size_t i) {
+        int channels;
+        unsigned char* pixels = stbi_load(paths[i].string().c_str(), &decoded[i].width, &decoded[i].height, &channels, 4);
+        if (pixels) {
+            decoded[i].pixels.assign(pixels, pixels + size_t(decoded[i].width) * decoded[i].height * 4);
+            stbi_image_free(pixels);
+        }
+    });
+
+    NoiseImages images;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (decoded[i].pixels.empty()) {
+            throw std::runtime_error("Failed to load noise image: " + paths[i].string());
+        }
+        if (i > 0 && (decoded[i].width != images.width || decoded[i].height != images.height)) {
+            throw std::runtime_error("Noise image size differs from the others: " + paths[i].string());
+        }
+        images.width = decoded[i].width;
+        images.height = decoded[i].height;
+        images.layers.push_back(std::move(decoded[i].pixels));
+    }
+
+    return images;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// CPU side of a noise texture array: one RGBA8 image per layer, decoded
+// without a GL context so it can happen on a worker.
+struct NoiseImages {
+    int width = 0;
+    int height = 0;
+    std::vector<std::vector<uint8_t>> layers;
+};
+
+// Decodes every image in imageDir, in file name order, spread over the pool.
+// Throws std::runtime_error if an image fails to load or the sizes differ.
+NoiseImages loadNoiseImages(std::string const& imageDir, ThreadPool& pool);
@@ -0,0 +1,43 @@
+#include "Occupancy.h"
+
+#include "Model.h"
+#include "../util/Trace.h"
+
+static OccupancyLevel makeLevel(glm::uvec3 mapSize, uint32_t cellSize) {
+    OccupancyLevel level;
+    level.cellSize = cellSize;
+    level.size = (mapSize + cellSize - 1u) / cellSize;
+    level.bits.resize((size_t(level.size.x) * level.size.y * level.size.z + 31) / 32);
+    return level;
+}
+
+OccupancyPyramid buildOccupancyPyramid(Model const& model) {
+    TRACE_SCOPE("buildOccupancyPyramid");
+    OccupancyPyramid occupancy;
+    occupancy.bricks = makeLevel(model.size, brickSize);
+    occupancy.coarse = makeLevel(model.size, coarseCellSize);
+
+    for (uint32_t z = 0; z < model.size.z; ++z) {
+        for (uint32_t y = 0; y < model.size.y; ++y) {
+            for (uint32_t x = 0; x < model.size.x; ++x) {
+                if (model.isSolid({x, y, z})) {
+                    occupancy.bricks.set(glm::uvec3(x, y, z) / brickSize);
+                }
+            }
+        }
+    }
+
+    // A coarse cell is occupied if any of its bricks is
+    uint32_t bricksPerCell = coarseCellSize / brickSize;
+    for (uint32_t z = 0; z < occupancy.bricks.size.z; ++z) {
+        for (uint32_t y = 0; y < occupancy.bricks.size.y; ++y) {
+            for (uint32_t x = 0; x < occupancy.bricks.size.x; ++x) {
+                if (occupancy.bricks.occupied({x, y, z})) {
+                    occupancy.coarse.set(glm::uvec3(x, y, z) / bricksPerCell);
+                }
+            }
+        }
+    }
+
+    return occupancy;
+}
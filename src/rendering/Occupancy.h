@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "Dda.h"
+
+struct Model;
+
+// Edge lengths in voxels of the two occupancy levels. Keep in sync with
+// assets/shaders/occupancy.glsl.
+constexpr uint32_t brickSize = 4;
+constexpr uint32_t coarseCellSize = 16;
+
+// One bit per cell of cellSize^3 voxels, set if any voxel in it is solid.
+// Cells are laid out x fastest like the voxel arrays, packed 32 to a word so
+// the bits can be uploaded as an SSBO as is.
+struct OccupancyLevel {
+    size_t cellIndex(glm::uvec3 cell) const {
+        return (size_t(cell.z) * size.y + cell.y) * size.x + cell.x;
+    }
+
+    bool occupied(glm::uvec3 cell) const {
+        size_t index = cellIndex(cell);
+        return (bits[index >> 5] >> (index & 31)) & 1u;
+    }
+
+    void set(glm::uvec3 cell) {
+        size_t index = cellIndex(cell);
+        bits[index >> 5] |= 1u << (index & 31);
+    }
+
+    void clear(glm::uvec3 cell) {
+        size_t index = cellIndex(cell);
+        bits[index >> 5] &= ~(1u << (index & 31));
+    }
+
+    uint32_t cellSize = 0;
+    glm::uvec3 size{0};
+    std::vector<uint32_t> bits;
+};
+
+struct OccupancyPyramid {
+    OccupancyLevel bricks;
+    OccupancyLevel coarse;
+};
+
+OccupancyPyramid buildOccupancyPyramid(Model const& model);
+
+// Moves dda through the cell of cellSize^3 voxels it currently is in, up to
+// the last voxel before the ray leaves the cell. The next iterDDA then
+// crosses the cell boundary. Every axis is advanced by the number of
+// boundary crossings the plain DDA would have made before that point.
+inline void advanceThroughCell(DDA& dda, float cellSize) {
+    glm::vec3 cellMin = glm::floor(dda.pos / cellSize) * cellSize;
+
+    glm::vec3 inside;
+    float exitDist = INFINITY;
+    for (int axis = 0; axis < 3; ++axis) {
+        inside[axis] = dda.rayStep[axis] > 0
+                ? cellMin[axis] + cellSize - 1 - dda.pos[axis]
+                : dda.pos[axis] - cellMin[axis];
+
+        float axisExit = inside[axis] > 0
+                ? dda.sideDist[axis] + inside[axis] * dda.deltaDist[axis]
+                : dda.sideDist[axis];
+        if (axisExit < exitDist) {
+            exitDist = axisExit;
+        }
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+        if (dda.sideDist[axis] < exitDist) {
+            float crossings = std::min(std::ceil((exitDist - dda.sideDist[axis]) / dda.deltaDist[axis]), inside[axis]);
+            dda.sideDist[axis] += crossings * dda.deltaDist[axis];
+            dda.pos[axis] += crossings * dda.rayStep[axis];
+        }
+    }
+}
+
+// If dda.pos (inside the map) lies in an empty coarse cell or brick, skips to
+// the end of it and returns true. The voxel dda is left on is empty.
+inline bool skipEmptyCell(DDA& dda, OccupancyPyramid const& occupancy) {
+    glm::uvec3 voxel{dda.pos};
+
+    if (!occupancy.coarse.occupied(voxel / coarseCellSize)) {
+        advanceThroughCell(dda, float(coarseCellSize));
+        return true;
+    }
+
+    if (!occupancy.bricks.occupied(voxel / brickSize)) {
+        advanceThroughCell(dda, float(brickSize));
+        return true;
+    }
+
+    return false;
+}
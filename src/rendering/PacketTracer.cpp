@@ -0,0 +1,292 @@
+#include "PacketTracer.h"
+
+#include <bit>
+#include <cstdlib>
+#include <string_view>
+
+#include "CpuTracer.h"
+#include "Dda.h"
+#include "Model.h"
+#include "Occupancy.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DRAFT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef __GNUC__
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+    // Below this many live lanes the vector loop does more wasted work than
+    // the scalar DDA, so the remaining rays are handed over to it.
+    constexpr int minPacketLanes = 3;
+
+    void traceVoxelPacketScalar(CpuTracer const& tracer, RayPacket const& packet, VoxelHit* hits) {
+        for (int lane = 0; lane < packetWidth; ++lane) {
+            if (packet.isActive(lane)) {
+                hits[lane] = tracer.traceVoxel(
+                        {packet.posX[lane], packet.posY[lane], packet.posZ[lane]},
+                        {packet.dirX[lane], packet.dirY[lane], packet.dirZ[lane]});
+            }
+        }
+    }
+
+#ifdef DRAFT_X86
+    TARGET_AVX2 __m256 sign(__m256 v) {
+        __m256 one = _mm256_set1_ps(1.0f);
+        __m256 zero = _mm256_setzero_ps();
+        return _mm256_sub_ps(_mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GT_OQ), one),
+                             _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_LT_OQ), one));
+    }
+
+    TARGET_AVX2 float lane(__m256 v, int i) {
+        alignas(32) float values[packetWidth];
+        _mm256_store_ps(values, v);
+        return values[i];
+    }
+
+    // Vector form of advanceThroughCell() for the lanes set in skipLanes, with
+    // the same operation order so results match the scalar path exactly.
+    TARGET_AVX2 void advanceThroughCells(__m256 cellSize, __m256 skipLanes,
+                                         __m256 (&pos)[3], __m256 (&side)[3],
+                                         __m256 const (&rayStep)[3], __m256 const (&delta)[3]) {
+        __m256 const one = _mm256_set1_ps(1.0f);
+        __m256 const zero = _mm256_setzero_ps();
+
+        __m256 inside[3];
+        __m256 exitDist = _mm256_set1_ps(INFINITY);
+        for (int axis = 0; axis < 3; ++axis) {
+            __m256 cellMin = _mm256_mul_ps(_mm256_floor_ps(_mm256_div_ps(pos[axis], cellSize)), cellSize);
+            __m256 forward = _mm256_sub_ps(_mm256_sub_ps(_mm256_add_ps(cellMin, cellSize), one), pos[axis]);
+            __m256 backward = _mm256_sub_ps(pos[axis], cellMin);
+            inside[axis] = _mm256_blendv_ps(backward, forward, _mm256_cmp_ps(rayStep[axis], zero, _CMP_GT_OQ));
+
+            __m256 axisExit = _mm256_blendv_ps(
+                    side[axis],
+                    _mm256_add_ps(side[axis], _mm256_mul_ps(inside[axis], delta[axis])),
+                    _mm256_cmp_ps(inside[axis], zero, _CMP_GT_OQ));
+            exitDist = _mm256_blendv_ps(exitDist, axisExit, _mm256_cmp_ps(axisExit, exitDist, _CMP_LT_OQ));
+        }
+
+        for (int axis = 0; axis < 3; ++axis) {
+            __m256 crossings = _mm256_min_ps(
+                    inside[axis],
+                    _mm256_ceil_ps(_mm256_div_ps(_mm256_sub_ps(exitDist, side[axis]), delta[axis])));
+            __m256 apply = _mm256_and_ps(skipLanes, _mm256_cmp_ps(side[axis], exitDist, _CMP_LT_OQ));
+
+            side[axis] = _mm256_blendv_ps(side[axis], _mm256_add_ps(side[axis], _mm256_mul_ps(crossings, delta[axis])), apply);
+            pos[axis] = _mm256_blendv_ps(pos[axis], _mm256_add_ps(pos[axis], _mm256_mul_ps(crossings, rayStep[axis])), apply);
+        }
+    }
+
+    TARGET_AVX2 void traceVoxelPacketAvx2(CpuTracer const& tracer, RayPacket const& packet, VoxelHit* hits) {
+        glm::uvec3 const& mapSize = tracer.m_model.size;
+        Model const& model = tracer.m_model;
+        OccupancyPyramid const& occupancy = tracer.m_model.occupancy;
+        bool const skipEmptySpace = tracer.m_settings.enableEmptySpaceSkipping;
+        int const maxDDADepth = tracer.m_settings.maxDDADepth;
+
+        __m256 const one = _mm256_set1_ps(1.0f);
+        __m256 const half = _mm256_set1_ps(0.5f);
+        __m256 const zero = _mm256_setzero_ps();
+        __m256 const distBias = _mm256_set1_ps(3 * EPSILON);
+        __m256i const sizeX = _mm256_set1_epi32(int(mapSize.x));
+        __m256i const sizeY = _mm256_set1_epi32(int(mapSize.y));
+        __m256i const sizeZ = _mm256_set1_epi32(int(mapSize.z));
+        __m256i const minusOne = _mm256_set1_epi32(-1);
+
+        __m256 rayX = _mm256_load_ps(packet.posX);
+        __m256 rayY = _mm256_load_ps(packet.posY);
+        __m256 rayZ = _mm256_load_ps(packet.posZ);
+        __m256 dirX = _mm256_load_ps(packet.dirX);
+        __m256 dirY = _mm256_load_ps(packet.dirY);
+        __m256 dirZ = _mm256_load_ps(packet.dirZ);
+
+        // initDDA
+        __m256 ray[3] = {rayX, rayY, rayZ};
+        __m256 dir[3] = {dirX, dirY, dirZ};
+        __m256 pos[3];
+        __m256 rayStep[3];
+        __m256 delta[3];
+        __m256 side[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            pos[axis] = _mm256_floor_ps(ray[axis]);
+            rayStep[axis] = sign(dir[axis]);
+            delta[axis] = _mm256_div_ps(rayStep[axis], dir[axis]);
+            side[axis] = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rayStep[axis], _mm256_sub_ps(pos[axis], ray[axis])), _mm256_mul_ps(rayStep[axis], half)), half), delta[axis]);
+        }
+        __m256 normal[3] = {zero, zero, zero};
+        __m256 dist = zero;
+
+        uint32_t active = packet.activeMask;
+        uint32_t entered = 0;
+        int step = 0;
+
+        for (; step < maxDDADepth && std::popcount(active) >= minPacketLanes; ++step) {
+            // inVoxelBuffer: positions are whole numbers, so truncation is exact
+            __m256i vx = _mm256_cvttps_epi32(pos[0]);
+            __m256i vy = _mm256_cvttps_epi32(pos[1]);
+            __m256i vz = _mm256_cvttps_epi32(pos[2]);
+            __m256i inside = _mm256_and_si256(
+                    _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(vx, minusOne), _mm256_cmpgt_epi32(sizeX, vx)),
+                                     _mm256_and_si256(_mm256_cmpgt_epi32(vy, minusOne), _mm256_cmpgt_epi32(sizeY, vy))),
+                    _mm256_and_si256(_mm256_cmpgt_epi32(vz, minusOne), _mm256_cmpgt_epi32(sizeZ, vz)));
+            uint32_t insideLanes = uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(inside)));
+            uint32_t candidates = insideLanes & active;
+
+            // Lanes that have left the map can never hit anything again
+            entered |= candidates;
+            active &= ~(entered & ~insideLanes);
+
+            alignas(32) int32_t voxel[3][packetWidth];
+            if (candidates) {
+                _mm256_store_si256(reinterpret_cast<__m256i*>(voxel[0]), vx);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(voxel[1]), vy);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(voxel[2]), vz);
+            }
+
+            if (candidates && skipEmptySpace) {
+                alignas(32) float cellSizes[packetWidth] = {};
+
+                uint32_t skipping = 0;
+                for (uint32_t bits = candidates; bits; bits &= bits - 1) {
+                    int i = std::countr_zero(bits);
+                    glm::uvec3 cell(voxel[0][i], voxel[1][i], voxel[2][i]);
+
+                    if (!occupancy.coarse.occupied(cell / coarseCellSize)) {
+                        cellSizes[i] = float(coarseCellSize);
+                    } else if (!occupancy.bricks.occupied(cell / brickSize)) {
+                        cellSizes[i] = float(brickSize);
+                    } else {
+                        continue;
+                    }
+                    skipping |= 1u << i;
+                }
+
+                if (skipping) {
+                    __m256 cellSize = _mm256_load_ps(cellSizes);
+                    __m256 skipLanes = _mm256_cmp_ps(cellSize, zero, _CMP_GT_OQ);
+                    advanceThroughCells(cellSize, skipLanes, pos, side, rayStep, delta);
+                    candidates &= ~skipping;
+                }
+            }
+
+            if (candidates) {
+                for (uint32_t bits = candidates; bits; bits &= bits - 1) {
+                    int i = std::countr_zero(bits);
+                    if (!model.isSolid(glm::uvec3(voxel[0][i], voxel[1][i], voxel[2][i]))) {
+                        continue;
+                    }
+
+                    glm::vec3 voxelPos{lane(pos[0], i), lane(pos[1], i), lane(pos[2], i)};
+                    glm::vec3 rayPos{packet.posX[i], packet.posY[i], packet.posZ[i]};
+                    glm::vec3 rayDir{packet.dirX[i], packet.dirY[i], packet.dirZ[i]};
+
+                    VoxelHit& hit = hits[i];
+                    tracer.getVoxel(voxelPos, hit);
+                    hit.position = rayPos + lane(dist, i) * rayDir;
+                    hit.normal = {lane(normal[0], i), lane(normal[1], i), lane(normal[2], i)};
+                    active &= ~(1u << i);
+                }
+            }
+
+            // iterDDA. Finished lanes keep stepping, their results are never read.
+            __m256 mask[3] = {
+                    _mm256_and_ps(_mm256_cmp_ps(side[0], _mm256_min_ps(side[1], side[2]), _CMP_LE_OQ), one),
+                    _mm256_and_ps(_mm256_cmp_ps(side[1], _mm256_min_ps(side[2], side[0]), _CMP_LE_OQ), one),
+                    _mm256_and_ps(_mm256_cmp_ps(side[2], _mm256_min_ps(side[0], side[1]), _CMP_LE_OQ), one),
+            };
+
+            __m256 mx = _mm256_mul_ps(mask[0], side[0]);
+            __m256 my = _mm256_mul_ps(mask[1], side[1]);
+            __m256 mz = _mm256_mul_ps(mask[2], side[2]);
+            dist = _mm256_sub_ps(_mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mx, mx), _mm256_mul_ps(my, my)), _mm256_mul_ps(mz, mz))), distBias);
+
+            for (int axis = 0; axis < 3; ++axis) {
+                side[axis] = _mm256_add_ps(side[axis], _mm256_mul_ps(mask[axis], delta[axis]));
+                pos[axis] = _mm256_add_ps(pos[axis], _mm256_mul_ps(mask[axis], rayStep[axis]));
+                normal[axis] = _mm256_mul_ps(mask[axis], _mm256_sub_ps(zero, rayStep[axis]));
+            }
+        }
+
+        if (step == maxDDADepth) {
+            return;
+        }
+
+        // Packet diverged: hand the remaining lanes over to the scalar DDA
+        for (uint32_t bits = active; bits; bits &= bits - 1) {
+            int i = std::countr_zero(bits);
+
+            DDA dda;
+            for (int axis = 0; axis < 3; ++axis) {
+                dda.pos[axis] = lane(pos[axis], i);
+                dda.rayStep[axis] = lane(rayStep[axis], i);
+                dda.deltaDist[axis] = lane(delta[axis], i);
+                dda.sideDist[axis] = lane(side[axis], i);
+                dda.normal[axis] = lane(normal[axis], i);
+            }
+            dda.dist = lane(dist, i);
+
+            hits[i] = tracer.traceVoxelFrom(
+                    dda,
+                    {packet.posX[i], packet.posY[i], packet.posZ[i]},
+                    {packet.dirX[i], packet.dirY[i], packet.dirZ[i]},
+                    maxDDADepth - step);
+        }
+    }
+#endif
+}
+
+SimdLevel detectSimdLevel() {
+#if defined(DRAFT_X86) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::Avx2;
+    }
+#elif defined(DRAFT_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, 7, 0);
+    if (info[1] & (1 << 5)) {
+        return SimdLevel::Avx2;
+    }
+#endif
+    return SimdLevel::Scalar;
+}
+
+SimdLevel activeSimdLevel() {
+    static SimdLevel const level = [] {
+        char const* override = std::getenv("DRAFT_SIMD");
+        if (override && std::string_view(override) == "scalar") {
+            return SimdLevel::Scalar;
+        }
+        return detectSimdLevel();
+    }();
+
+    return level;
+}
+
+char const* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Avx2:
+            return "avx2";
+        case SimdLevel::Scalar:
+        default:
+            return "scalar";
+    }
+}
+
+void traceVoxelPacket(CpuTracer const& tracer, RayPacket const& packet, VoxelHit* hits) {
+#ifdef DRAFT_X86
+    if (activeSimdLevel() == SimdLevel::Avx2) {
+        traceVoxelPacketAvx2(tracer, packet, hits);
+        return;
+    }
+#endif
+    traceVoxelPacketScalar(tracer, packet, hits);
+}
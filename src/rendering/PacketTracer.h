@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+struct CpuTracer;
+struct VoxelHit;
+
+// Number of rays traversed together, one AVX2 register of floats.
+constexpr int packetWidth = 8;
+
+enum class SimdLevel {
+    Scalar,
+    Avx2,
+};
+
+// Best level the running CPU supports, detected once.
+SimdLevel detectSimdLevel();
+// detectSimdLevel(), unless forced down with DRAFT_SIMD=scalar.
+SimdLevel activeSimdLevel();
+char const* simdLevelName(SimdLevel level);
+
+// Structure of arrays layout of packetWidth rays. Lanes that are not set stay
+// inactive and are ignored by the traversal.
+struct RayPacket {
+    void setRay(int lane, glm::vec3 pos, glm::vec3 dir) {
+        posX[lane] = pos.x;
+        posY[lane] = pos.y;
+        posZ[lane] = pos.z;
+        dirX[lane] = dir.x;
+        dirY[lane] = dir.y;
+        dirZ[lane] = dir.z;
+        activeMask |= 1u << lane;
+    }
+
+    bool isActive(int lane) const { return (activeMask >> lane) & 1u; }
+
+    alignas(32) float posX[packetWidth];
+    alignas(32) float posY[packetWidth];
+    alignas(32) float posZ[packetWidth];
+    alignas(32) float dirX[packetWidth];
+    alignas(32) float dirY[packetWidth];
+    alignas(32) float dirZ[packetWidth];
+    uint32_t activeMask;
+};
+
+// Packet version of CpuTracer::traceVoxel: steps all active lanes through the
+// grid in lockstep and writes one hit per lane. Once a packet has diverged so
+// far that only a few lanes are left, those are finished with the scalar DDA.
+void traceVoxelPacket(CpuTracer const& tracer, RayPacket const& packet, VoxelHit* hits);
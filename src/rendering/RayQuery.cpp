@@ -0,0 +1,147 @@
+#include "RayQuery.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+
+#include "CpuTracer.h"
+#include "Dda.h"
+#include "Model.h"
+#include "Occupancy.h"
+#include "../util/ThreadPool.h"
+#include "../util/Trace.h"
+
+// Rays per pool task, enough to hide the cost of scheduling a task
+constexpr size_t raysPerBlock = 1024;
+
+RayQuery::RayQuery(Model const& model) : m_model(model) {
+}
+
+RayQueryHit RayQuery::closestHit(glm::vec3 origin, glm::vec3 direction, float maxDistance) const {
+    RayQueryHit hit;
+    trace<true>(origin, direction, maxDistance, &hit);
+    return hit;
+}
+
+bool RayQuery::anyHit(glm::vec3 origin, glm::vec3 direction, float maxDistance) const {
+    return trace<false>(origin, direction, maxDistance, nullptr);
+}
+
+template<bool closest>
+bool RayQuery::trace(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayQueryHit* hit) const {
+    float length = glm::length(direction);
+    if (!(length > 0)) {
+        return false;
+    }
+
+    // Axis aligned rays would divide zero by zero in the DDA
+    glm::vec3 rayDir = direction / length;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (rayDir[axis] == 0) {
+            rayDir[axis] = 1e-30f;
+        }
+    }
+
+    glm::vec2 range = intersectBox(origin, 1.0f / rayDir, glm::vec3(0), glm::vec3(m_model.size));
+    float endDist = std::min(range.y, maxDistance);
+    if (range.x > endDist || range.y < 0) {
+        return false;
+    }
+
+    // Rays from outside start just before the map, so the step into it
+    // reports the face they entered through
+    float startDist = std::max(range.x - 3 * EPSILON, 0.0f);
+    DDA dda;
+    initDDA(dda, origin + startDist * rayDir, rayDir);
+
+    glm::ivec3 size{m_model.size};
+    // Distance from the start of the DDA to where it entered the current voxel
+    float voxelDist = 0;
+    bool entered = false;
+    int maxSteps = size.x + size.y + size.z + 3;
+
+    for (int i = 0; i < maxSteps && startDist + voxelDist <= endDist; ++i) {
+        glm::ivec3 voxel{dda.pos};
+
+        if (glm::all(glm::greaterThanEqual(voxel, glm::ivec3(0))) && glm::all(glm::lessThan(voxel, size))) {
+            entered = true;
+
+            if (!skipEmptyCell(dda, m_model.occupancy) && m_model.isSolid(glm::uvec3(voxel))) {
+                if constexpr (closest) {
+                    hit->hit = true;
+                    hit->voxel = voxel;
+                    hit->normal = dda.normal;
+                    hit->distance = startDist + voxelDist;
+                    hit->paletteIndex = m_model.paletteIndex(glm::uvec3(voxel));
+                }
+                return true;
+            }
+        } else if (entered) {
+            // The map is convex, a ray that left it cannot come back
+            break;
+        }
+
+        voxelDist = glm::min(dda.sideDist.x, glm::min(dda.sideDist.y, dda.sideDist.z));
+        iterDDA(dda);
+    }
+
+    return false;
+}
+
+static void checkBatch(RayBatch const& rays, size_t numResults) {
+    size_t numRays = rays.origins.size();
+    if (rays.directions.size() != numRays || (!rays.maxDistances.empty() && rays.maxDistances.size() != numRays)) {
+        throw std::runtime_error("Ray batch origins, directions and max distances differ in length");
+    }
+    if (numResults != numRays) {
+        throw std::runtime_error("Ray batch has " + std::to_string(numRays) + " rays but room for " +
+                                 std::to_string(numResults) + " results");
+    }
+}
+
+// Calls body(begin, end) for blocks of rays, on the pool if there is one
+template<typename F>
+static void forEachBlock(size_t numRays, ThreadPool* pool, F const& body) {
+    size_t numBlocks = (numRays + raysPerBlock - 1) / raysPerBlock;
+    auto block = [&](size_t index) {
+        size_t begin = index * raysPerBlock;
+        body(begin, std::min(begin + raysPerBlock, numRays));
+    };
+
+    if (pool && numBlocks > 1) {
+        pool->parallelFor(numBlocks, block);
+    } else {
+        for (size_t index = 0; index < numBlocks; ++index) {
+            block(index);
+        }
+    }
+}
+
+void RayQuery::closestHit(RayBatch const& rays, std::span<RayQueryHit> hits, ThreadPool* pool) const {
+    checkBatch(rays, hits.size());
+    TRACE_SCOPE("rayQuery closestHit");
+
+    forEachBlock(rays.origins.size(), pool, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            float maxDistance = rays.maxDistances.empty() ? INFINITY : rays.maxDistances[i];
+            hits[i] = {};
+            trace<true>(rays.origins[i], rays.directions[i], maxDistance, &hits[i]);
+        }
+    });
+}
+
+void RayQuery::anyHit(RayBatch const& rays, std::span<uint8_t> occluded, ThreadPool* pool) const {
+    checkBatch(rays, occluded.size());
+    TRACE_SCOPE("rayQuery anyHit");
+
+    forEachBlock(rays.origins.size(), pool, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            float maxDistance = rays.maxDistances.empty() ? INFINITY : rays.maxDistances[i];
+            occluded[i] = trace<false>(rays.origins[i], rays.directions[i], maxDistance, nullptr);
+        }
+    });
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+#include <glm/vec3.hpp>
+
+struct Model;
+class ThreadPool;
+
+// Line of sight, picking and distance queries against a Model, for code that
+// needs answers about a scene rather than pictures of it, such as game logic
+// on a server. Needs no GL context.
+//
+// Rays are segments of origin + t * normalize(direction) for t in
+// [0, maxDistance], so distances are in voxels whatever the length of the
+// direction. A ray starting inside a solid voxel hits it at distance 0.
+
+struct RayQueryHit {
+    bool hit = false;
+    // The solid voxel hit
+    glm::ivec3 voxel{0};
+    // Normal of the face the ray entered the voxel through, 0 when the ray
+    // started inside it
+    glm::vec3 normal{0};
+    float distance = 0;
+    uint8_t paletteIndex = 0;
+};
+
+// Rays of a batch as parallel spans. maxDistances may be empty for rays that
+// run until they leave the map.
+struct RayBatch {
+    std::span<glm::vec3 const> origins;
+    std::span<glm::vec3 const> directions;
+    std::span<float const> maxDistances;
+};
+
+class RayQuery {
+public:
+    explicit RayQuery(Model const& model);
+
+    RayQueryHit closestHit(glm::vec3 origin, glm::vec3 direction, float maxDistance = INFINITY) const;
+
+    // Whether anything is hit at all. The DDA reaches voxels in order, so this
+    // is the same traversal as closestHit minus building the hit record.
+    bool anyHit(glm::vec3 origin, glm::vec3 direction, float maxDistance = INFINITY) const;
+
+    // One result per ray of the batch. The batch is split into blocks of
+    // rays that run on the pool, or on the calling thread when pool is null.
+    void closestHit(RayBatch const& rays, std::span<RayQueryHit> hits, ThreadPool* pool = nullptr) const;
+    void anyHit(RayBatch const& rays, std::span<uint8_t> occluded, ThreadPool* pool = nullptr) const;
+
+private:
+    template<bool closest>
+    bool trace(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayQueryHit* hit) const;
+
+    Model const& m_model;
+};
@@ -0,0 +1,113 @@
+#include "RenderJob.h"
+
+#include <chrono>
+#include <sstream>
+
+#include "BakedScene.h"
+#include "../util/ThreadPool.h"
+
+namespace {
+    double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+PreparedRender::PreparedRender(RenderJob const& job, ThreadPool& pool, std::ostream* log) : job(job) {
+    auto loadStart = std::chrono::steady_clock::now();
+    bool hasBakedDag = false;
+    if (isBakedSceneFile(job.scenePath)) {
+        BakedScene baked = loadBakedScene(job.scenePath);
+        model = job.layout && baked.model.layout != *job.layout ? convertLayout(baked.model, *job.layout)
+                                                                  : std::move(baked.model);
+        dag = std::move(baked.dag);
+        hasBakedDag = baked.hasDag;
+    } else {
+        model = loadVoxModel(job.scenePath, job.layout.value_or(VoxelLayout::Linear));
+    }
+    if (log) {
+        *log << "Loaded " << job.scenePath << " in " << millisecondsSince(loadStart) << " ms" << std::endl;
+    }
+
+    tracer.emplace(model, job.settings);
+
+    if (job.settings.sampler == SamplerType::BlueNoise) {
+        blueNoise = loadNoiseImages("assets/noise/256_256", pool);
+        tracer->m_blueNoise = &blueNoise;
+    }
+
+    if (job.useDag && hasBakedDag) {
+        tracer->m_dag = &dag;
+    } else if (job.useDag) {
+        DagBuildStats stats;
+        dag = buildVoxelDag(model, &stats);
+        tracer->m_dag = &dag;
+        if (log) {
+            *log << "Built DAG in " << stats.buildMs << " ms: " << dag.sizeBytes() << " bytes vs "
+                 << denseModelBytes(model) << " dense" << std::endl;
+        }
+    }
+
+    if (job.settings.enableShadows && job.useSunCache) {
+        auto bakeStart = std::chrono::steady_clock::now();
+        sunVisibility = bakeSunVisibility(*tracer, pool);
+        tracer->m_sunVisibility = &sunVisibility;
+        if (log) {
+            *log << "Baked sun visibility in " << millisecondsSince(bakeStart) << " ms: "
+                 << sunVisibility.bits.size() * sizeof(uint32_t) << " bytes" << std::endl;
+        }
+    }
+
+    if (job.settings.enableGlobalIllumination && job.irradiancePasses > 0) {
+        auto cacheStart = std::chrono::steady_clock::now();
+        irradianceCache.emplace(model);
+        // Every pass updates every entry once, and adds one bounce
+        for (int pass = 0; pass < job.irradiancePasses; ++pass) {
+            irradianceCache->update(*tracer, irradianceCache->entries().size(), pool);
+        }
+        tracer->m_irradianceCache = &*irradianceCache;
+        if (log) {
+            *log << "Refined irradiance cache " << job.irradiancePasses << " times in "
+                 << millisecondsSince(cacheStart) << " ms: " << irradianceCache->entries().size() << " entries"
+                 << std::endl;
+        }
+    }
+}
+
+Camera PreparedRender::camera() const {
+    // Same default view as the interactive mode
+    return {
+            job.cameraPosition.value_or(glm::vec3{-1, 0.5f, -1} * glm::vec3{model.size}),
+            job.cameraTarget.value_or(glm::vec3{model.size / 2u}),
+            job.width,
+            job.height,
+    };
+}
+
+void PreparedRender::setJob(RenderJob const& next) {
+    job = next;
+    tracer->m_settings = next.settings;
+}
+
+std::string preparationKey(RenderJob const& job) {
+    RenderSettings const& settings = job.settings;
+    bool bakesSun = settings.enableShadows && job.useSunCache;
+    bool refinesIrradiance = settings.enableGlobalIllumination && job.irradiancePasses > 0;
+
+    std::ostringstream key;
+    // Exact floats, a slightly different sun is a different bake
+    key << std::hexfloat << job.scenePath << '\n'
+        << "layout " << (job.layout ? int(*job.layout) : -1) << " dag " << job.useDag << " blueNoise "
+        << (settings.sampler == SamplerType::BlueNoise);
+    if (bakesSun || refinesIrradiance) {
+        // Both trace shadow rays, which give up after maxDDADepth steps, and
+        // with empty space skipping a step may cross a whole cell
+        key << " sun " << settings.sunDir.x << ',' << settings.sunDir.y << ',' << settings.sunDir.z << " sunCache "
+            << bakesSun << " depth " << settings.maxDDADepth << " skipping " << settings.enableEmptySpaceSkipping;
+    }
+    if (refinesIrradiance) {
+        // What IrradianceCache::update traces with
+        key << " irradiance " << job.irradiancePasses << ' ' << settings.enableShadows << ' ' << settings.sunStrength
+            << ' ' << settings.shadowMultiplier << ' ' << settings.enableLightSampling;
+    }
+    return key.str();
+}
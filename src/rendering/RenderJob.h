@@ -0,0 +1,70 @@
+#pragma once
+
+#include <optional>
+#include <ostream>
+#include <string>
+
+#include <glm/vec3.hpp>
+
+#include "Camera.h"
+#include "CpuTracer.h"
+#include "Denoiser.h"
+#include "IrradianceCache.h"
+#include "Model.h"
+#include "NoiseImages.h"
+#include "SunVisibility.h"
+#include "VoxelDag.h"
+
+class ThreadPool;
+
+// A headless render as draft --render takes it from its options. It is also
+// what the coordinator of a distributed render sends its workers, which set
+// up the same tracer from it.
+struct RenderJob {
+    // .vox, or .vxc as written by draft --bake
+    std::string scenePath;
+    // Converts the scene when set, otherwise .vox scenes load linear and baked
+    // ones keep their layout
+    std::optional<VoxelLayout> layout;
+    int width = 1920;
+    int height = 1010;
+    int tileSize = 32;
+    RenderSettings settings;
+    // The view of the interactive mode when not set
+    std::optional<glm::vec3> cameraPosition;
+    std::optional<glm::vec3> cameraTarget;
+    // Trace through a DAG, the baked one or one built from the scene
+    bool useDag = false;
+    bool useSunCache = true;
+    // Refinements of an irradiance cache before rendering, 0 for none
+    int irradiancePasses = 0;
+    bool denoise = false;
+    DenoiseSettings denoiseSettings;
+};
+
+// The scene of a job loaded and the tracer set up with the caches it asked
+// for. Not movable, the tracer points into it.
+struct PreparedRender {
+    // Progress and timings go to log when it is given
+    PreparedRender(RenderJob const& job, ThreadPool& pool, std::ostream* log = nullptr);
+
+    PreparedRender(PreparedRender const&) = delete;
+    PreparedRender& operator=(PreparedRender const&) = delete;
+
+    Camera camera() const;
+    // Switches to another job with the same preparationKey, which only
+    // differs in what is set per render
+    void setJob(RenderJob const& next);
+
+    RenderJob job;
+    Model model;
+    VoxelDag dag;
+    NoiseImages blueNoise;
+    SunVisibility sunVisibility;
+    std::optional<IrradianceCache> irradianceCache;
+    std::optional<CpuTracer> tracer;
+};
+
+// Everything PreparedRender derives from a job: the scene and the caches, and
+// the settings they depend on. Jobs with the same key can share one.
+std::string preparationKey(RenderJob const& job);
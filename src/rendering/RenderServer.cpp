@@ -0,0 +1,466 @@
+#include "RenderServer.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+#include "Denoiser.h"
+#include "Image.h"
+#include "RenderJob.h"
+#include "../util/Json.h"
+#include "../util/Socket.h"
+#include "../util/ThreadPool.h"
+#include "../util/Trace.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double millisecondsBetween(Clock::time_point start, Clock::time_point end) {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    enum class ImageFormat {
+        Png,
+        Rgb8,
+    };
+
+    struct ClientConnection {
+        // Answers are sent from the render thread
+        void send(std::string const& header, std::vector<uint8_t> const& image = {}) {
+            std::lock_guard lock(mutex);
+            if (failed) {
+                return;
+            }
+            try {
+                socket.sendAll(header.data(), header.size());
+                socket.sendAll(image.data(), image.size());
+            } catch (std::exception const&) {
+                // Gone, its other jobs are skipped
+                failed = true;
+            }
+        }
+
+        Socket socket;
+        // Bytes of a line that has not fully arrived yet
+        std::string received;
+        // The client sent everything it is going to send
+        bool doneSending = false;
+        std::mutex mutex;
+        std::atomic<bool> failed{false};
+    };
+
+    struct ServerJob {
+        RenderJob job;
+        JsonValue id;
+        int priority = 0;
+        ImageFormat format = ImageFormat::Png;
+        std::shared_ptr<ClientConnection> client;
+        // Jobs of the same priority run in the order they came
+        uint64_t sequence = 0;
+        Clock::time_point queued;
+    };
+
+    struct LaterJob {
+        bool operator()(ServerJob const& a, ServerJob const& b) const {
+            return a.priority != b.priority ? a.priority < b.priority : a.sequence > b.sequence;
+        }
+    };
+
+    glm::vec3 parseVec3(JsonValue const& value) {
+        if (value.type != JsonType::Array || value.array.size() != 3) {
+            throw std::runtime_error("Expected [x, y, z], got " + formatJson(value));
+        }
+        return {float(value.array[0].asNumber()), float(value.array[1].asNumber()), float(value.array[2].asNumber())};
+    }
+
+    VoxelLayout parseLayout(JsonValue const& value) {
+        if (value.asString() == "linear") {
+            return VoxelLayout::Linear;
+        }
+        if (value.asString() == "bricked") {
+            return VoxelLayout::Bricked;
+        }
+        throw std::runtime_error("Unknown voxel layout: " + value.asString());
+    }
+
+    SamplerType parseSampler(JsonValue const& value) {
+        for (SamplerType type : {SamplerType::Random, SamplerType::Sobol, SamplerType::R2, SamplerType::BlueNoise}) {
+            if (value.asString() == samplerName(type)) {
+                return type;
+            }
+        }
+        throw std::runtime_error("Unknown sampler: " + value.asString());
+    }
+
+    // Unknown keys are errors, a typo should not silently render defaults
+    void parseJob(JsonValue const& request, ServerJob& result) {
+        RenderJob& job = result.job;
+        RenderSettings& settings = job.settings;
+        for (auto const& [key, value] : request.object) {
+            try {
+                if (key == "id") {
+                    result.id = value;
+                } else if (key == "priority") {
+                    result.priority = value.asInt();
+                } else if (key == "format") {
+                    if (value.asString() == "png") {
+                        result.format = ImageFormat::Png;
+                    } else if (value.asString() == "rgb8") {
+                        result.format = ImageFormat::Rgb8;
+                    } else {
+                        throw std::runtime_error("Unknown format: " + value.asString());
+                    }
+                } else if (key == "scenePath") {
+                    job.scenePath = value.asString();
+                } else if (key == "layout") {
+                    job.layout = parseLayout(value);
+                } else if (key == "width") {
+                    job.width = value.asInt();
+                } else if (key == "height") {
+                    job.height = value.asInt();
+                } else if (key == "tileSize") {
+                    job.tileSize = value.asInt();
+                } else if (key == "cameraPosition") {
+                    job.cameraPosition = parseVec3(value);
+                } else if (key == "cameraTarget") {
+                    job.cameraTarget = parseVec3(value);
+                } else if (key == "useDag") {
+                    job.useDag = value.asBool();
+                } else if (key == "useSunCache") {
+                    job.useSunCache = value.asBool();
+                } else if (key == "irradiancePasses") {
+                    job.irradiancePasses = value.asInt();
+                } else if (key == "denoise") {
+                    job.denoise = value.asBool();
+                } else if (key == "denoiseSettings") {
+                    for (auto const& [name, member] : value.object) {
+                        if (name == "iterations") {
+                            job.denoiseSettings.iterations = member.asInt();
+                        } else if (name == "sigmaLuminance") {
+                            job.denoiseSettings.sigmaLuminance = float(member.asNumber());
+                        } else if (name == "sigmaDepth") {
+                            job.denoiseSettings.sigmaDepth = float(member.asNumber());
+                        } else {
+                            throw std::runtime_error("Unknown key: " + name);
+                        }
+                    }
+                } else if (key == "numSamples") {
+                    settings.numSamples = value.asInt();
+                } else if (key == "numRayBounces") {
+                    settings.numRayBounces = value.asInt();
+                } else if (key == "maxDDADepth") {
+                    settings.maxDDADepth = value.asInt();
+                } else if (key == "sunDir") {
+                    settings.sunDir = parseVec3(value);
+                } else if (key == "enableShadows") {
+                    settings.enableShadows = value.asBool();
+                } else if (key == "enableGlobalIllumination") {
+                    settings.enableGlobalIllumination = value.asBool();
+                } else if (key == "enableRayRandomization") {
+                    settings.enableRayRandomization = value.asBool();
+                } else if (key == "sampler") {
+                    settings.sampler = parseSampler(value);
+                } else if (key == "shadowMultiplier") {
+                    settings.shadowMultiplier = float(value.asNumber());
+                } else if (key == "sunStrength") {
+                    settings.sunStrength = float(value.asNumber());
+                } else if (key == "enableLightSampling") {
+                    settings.enableLightSampling = value.asBool();
+                } else if (key == "enableEmptySpaceSkipping") {
+                    settings.enableEmptySpaceSkipping = value.asBool();
+                } else if (key == "enablePacketTracing") {
+                    settings.enablePacketTracing = value.asBool();
+                } else if (key == "enableAdaptiveSampling") {
+                    settings.enableAdaptiveSampling = value.asBool();
+                } else if (key == "adaptiveThreshold") {
+                    settings.adaptiveThreshold = float(value.asNumber());
+                } else if (key == "adaptiveMinSamples") {
+                    settings.adaptiveMinSamples = value.asInt();
+                } else {
+                    throw std::runtime_error("Unknown key");
+                }
+            } catch (std::runtime_error const& e) {
+                throw std::runtime_error(key + ": " + e.what());
+            }
+        }
+
+        if (job.scenePath.empty()) {
+            throw std::runtime_error("Missing scenePath");
+        }
+        if (job.width <= 0 || job.height <= 0 || job.tileSize <= 0 || settings.numSamples <= 0) {
+            throw std::runtime_error("Width, height, tile size and samples must be positive");
+        }
+    }
+
+    std::string errorHeader(JsonValue const& id, std::string const& error) {
+        return "{\"id\":" + formatJson(id) + ",\"status\":\"error\",\"error\":" + quoteJson(error) + "}\n";
+    }
+
+    // Prepared scenes by preparationKey and the time the scene file was last
+    // written, most recently used first
+    class SceneCache {
+    public:
+        explicit SceneCache(size_t capacity) : m_capacity(std::max<size_t>(capacity, 1)) {}
+
+        // Null when the job's scene is not loaded
+        PreparedRender* find(std::string const& key) {
+            for (auto entry = m_entries.begin(); entry != m_entries.end(); ++entry) {
+                if (entry->key == key) {
+                    m_entries.splice(m_entries.begin(), m_entries, entry);
+                    return m_entries.front().prepared.get();
+                }
+            }
+            return nullptr;
+        }
+
+        PreparedRender& insert(std::string const& key, std::unique_ptr<PreparedRender> prepared) {
+            if (m_entries.size() >= m_capacity) {
+                m_entries.pop_back();
+            }
+            m_entries.push_front({key, std::move(prepared)});
+            return *m_entries.front().prepared;
+        }
+
+    private:
+        struct Entry {
+            std::string key;
+            std::unique_ptr<PreparedRender> prepared;
+        };
+
+        size_t m_capacity;
+        std::list<Entry> m_entries;
+    };
+
+    std::string cacheKey(RenderJob const& job) {
+        std::error_code error;
+        auto written = std::filesystem::last_write_time(job.scenePath, error);
+        // A missing file fails in PreparedRender, with a proper message
+        return preparationKey(job) + " written " +
+               (error ? "never" : std::to_string(written.time_since_epoch().count()));
+    }
+
+    // Takes jobs off the queue by priority and renders them one at a time,
+    // each on the whole pool
+    class JobQueue {
+    public:
+        void push(ServerJob job) {
+            {
+                std::lock_guard lock(m_mutex);
+                job.sequence = m_nextSequence++;
+                m_jobs.push(std::move(job));
+            }
+            m_changed.notify_one();
+        }
+
+        // Lets pop() return nothing once the queue ran empty
+        void close() {
+            {
+                std::lock_guard lock(m_mutex);
+                m_closed = true;
+            }
+            m_changed.notify_all();
+        }
+
+        std::optional<ServerJob> pop() {
+            std::unique_lock lock(m_mutex);
+            m_changed.wait(lock, [&] { return !m_jobs.empty() || m_closed; });
+            if (m_jobs.empty()) {
+                return std::nullopt;
+            }
+            ServerJob job = m_jobs.top();
+            m_jobs.pop();
+            return job;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::priority_queue<ServerJob, std::vector<ServerJob>, LaterJob> m_jobs;
+        uint64_t m_nextSequence = 0;
+        bool m_closed = false;
+    };
+
+    void renderJob(ServerJob const& request, SceneCache& cache, ThreadPool& pool, std::ostream* log) {
+        TRACE_SCOPE("serverJob");
+        auto start = Clock::now();
+        RenderJob const& job = request.job;
+
+        std::string key = cacheKey(job);
+        PreparedRender* prepared = cache.find(key);
+        bool cached = prepared != nullptr;
+        if (!prepared) {
+            prepared = &cache.insert(key, std::make_unique<PreparedRender>(job, pool));
+        }
+        prepared->setJob(job);
+        auto prepareEnd = Clock::now();
+
+        GBuffer gbuffer;
+        Image image = prepared->tracer->render(prepared->camera(), job.width, job.height, pool, job.tileSize, nullptr,
+                                               job.denoise ? &gbuffer : nullptr);
+        if (job.denoise) {
+            denoise(image, gbuffer, job.denoiseSettings, pool);
+        }
+        auto renderEnd = Clock::now();
+
+        std::vector<uint8_t> encoded = request.format == ImageFormat::Png ? encodePng(image) : encodeRgb8(image);
+        auto encodeEnd = Clock::now();
+
+        double queueMs = millisecondsBetween(request.queued, start);
+        double prepareMs = millisecondsBetween(start, prepareEnd);
+        double renderMs = millisecondsBetween(prepareEnd, renderEnd);
+        double encodeMs = millisecondsBetween(renderEnd, encodeEnd);
+        request.client->send("{\"id\":" + formatJson(request.id) + ",\"status\":\"ok\",\"format\":\"" +
+                                     (request.format == ImageFormat::Png ? "png" : "rgb8") +
+                                     "\",\"width\":" + std::to_string(job.width) +
+                                     ",\"height\":" + std::to_string(job.height) +
+                                     ",\"size\":" + std::to_string(encoded.size()) +
+                                     ",\"cached\":" + (cached ? "true" : "false") +
+                                     ",\"queueMs\":" + std::to_string(queueMs) +
+                                     ",\"prepareMs\":" + std::to_string(prepareMs) +
+                                     ",\"renderMs\":" + std::to_string(renderMs) +
+                                     ",\"encodeMs\":" + std::to_string(encodeMs) + "}\n",
+                             encoded);
+
+        if (log) {
+            *log << "Job " << formatJson(request.id) << ": " << job.width << "x" << job.height << " @ "
+                 << job.settings.numSamples << " spp of " << job.scenePath << (cached ? " (cached)" : "")
+                 << ", queued " << queueMs << " ms, prepared " << prepareMs << " ms, rendered " << renderMs
+                 << " ms, encoded " << encodeMs << " ms" << std::endl;
+        }
+    }
+}
+
+#ifdef _WIN32
+void runRenderServer(std::string const&, RenderServerOptions const&, std::ostream*) {
+    throw std::runtime_error("The render server is not supported on Windows");
+}
+#else
+namespace {
+    // Reads the clients' lines into the queue until one asks for a shutdown.
+    // Clients that closed their end are only forgotten, their answers still
+    // go out.
+    void serveClients(Socket const& listener, JobQueue& queue) {
+        std::vector<std::shared_ptr<ClientConnection>> clients;
+        while (true) {
+            std::vector<pollfd> fds{{listener.fd(), POLLIN, 0}};
+            for (auto& client : clients) {
+                fds.push_back({client->socket.fd(), POLLIN, 0});
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Failed to wait for clients");
+            }
+
+            if (fds[0].revents & POLLIN) {
+                auto client = std::make_shared<ClientConnection>();
+                client->socket = listener.accept();
+                clients.push_back(std::move(client));
+            }
+
+            for (size_t i = 1; i < fds.size(); ++i) {
+                std::shared_ptr<ClientConnection> const& client = clients[i - 1];
+                if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                    continue;
+                }
+                char buffer[16 * 1024];
+                size_t received = 0;
+                try {
+                    received = client->socket.receive(buffer, sizeof(buffer));
+                } catch (std::exception const&) {
+                }
+                if (received == 0) {
+                    client->doneSending = true;
+                    continue;
+                }
+                client->received.append(buffer, received);
+
+                size_t lineEnd;
+                while ((lineEnd = client->received.find('\n')) != std::string::npos) {
+                    std::string line = client->received.substr(0, lineEnd);
+                    client->received.erase(0, lineEnd + 1);
+                    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                        continue;
+                    }
+
+                    ServerJob job;
+                    job.client = client;
+                    job.queued = Clock::now();
+                    try {
+                        JsonValue request = parseJson(line);
+                        if (request.type != JsonType::Object) {
+                            throw std::runtime_error("Expected a job object");
+                        }
+                        if (request["shutdown"].type == JsonType::Bool && request["shutdown"].asBool()) {
+                            return;
+                        }
+                        parseJob(request, job);
+                    } catch (std::runtime_error const& e) {
+                        client->send(errorHeader(job.id, e.what()));
+                        continue;
+                    }
+                    queue.push(std::move(job));
+                }
+            }
+            std::erase_if(clients, [](auto const& client) { return client->doneSending; });
+        }
+    }
+}
+
+void runRenderServer(std::string const& address, RenderServerOptions const& options, std::ostream* log) {
+    Socket listener = Socket::listen(address);
+    if (log) {
+        *log << "Serving render jobs on " << listener.localAddress() << std::endl;
+    }
+
+    ThreadPool pool(options.numThreads);
+    SceneCache cache(options.cacheSize);
+    JobQueue queue;
+
+    std::thread renderThread([&] {
+        setTraceThreadName("render");
+        while (std::optional<ServerJob> job = queue.pop()) {
+            if (job->client->failed) {
+                continue;
+            }
+            try {
+                renderJob(*job, cache, pool, log);
+            } catch (std::exception const& e) {
+                job->client->send(errorHeader(job->id, e.what()));
+                if (log) {
+                    *log << "Job " << formatJson(job->id) << " failed: " << e.what() << std::endl;
+                }
+            }
+        }
+    });
+
+    try {
+        serveClients(listener, queue);
+    } catch (...) {
+        queue.close();
+        renderThread.join();
+        throw;
+    }
+
+    // The queued jobs are still rendered
+    queue.close();
+    renderThread.join();
+    if (log) {
+        *log << "Render server stopped" << std::endl;
+    }
+}
+#endif
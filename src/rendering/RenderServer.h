@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Long running renderer for many small jobs. Clients connect to a socket and
+// send jobs as JSON, one object per line:
+//
+//   {"id": 7, "scenePath": "assets/vox/monu1.vox", "width": 640, "height": 360,
+//    "numSamples": 4, "cameraPosition": [-120, 60, -120], "enableShadows": false}
+//
+// The keys are the members of RenderJob, with those of its settings at the
+// top level, vectors as [x, y, z] and enums by the names draft --render
+// takes. Besides, "id" is any value, "priority" orders the queue (higher
+// first, default 0) and "format" is "png" (default) or "rgb8" for raw rows,
+// top-down. Every job is answered with one JSON line, followed by the image
+// when "status" is "ok":
+//
+//   {"id": 7, "status": "ok", "format": "png", "width": 640, "height": 360,
+//    "size": 81234, "cached": true, "queueMs": 0.1, "prepareMs": 0,
+//    "renderMs": 41.2, "encodeMs": 3.5}
+//   <size bytes>
+//
+//   {"id": 8, "status": "error", "error": "Failed to open file: ..."}
+//
+// Answers come in the order the jobs finish, the id is passed through as is.
+// {"shutdown": true} finishes the queued jobs and stops the server.
+//
+// Loaded scenes with their DAG, sun visibility and irradiance cache are kept
+// for the next job with the same preparationKey, so a job against a warm
+// scene only pays for tracing and encoding.
+
+struct RenderServerOptions {
+    unsigned numThreads = std::thread::hardware_concurrency();
+    // Prepared scenes kept loaded, the least recently used one goes first
+    size_t cacheSize = 4;
+};
+
+// Serves clients on address (host:port or unix:path) until one of them asks
+// for a shutdown. Every job is logged to log when it is given.
+void runRenderServer(std::string const& address, RenderServerOptions const& options, std::ostream* log = nullptr);
@@ -0,0 +1,60 @@
+#include "ResolutionController.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/common.hpp>
+
+ResolutionController::ResolutionController(ResolutionControllerSettings const& settings)
+        : m_settings(settings), m_scale(settings.maxScale) {
+}
+
+void ResolutionController::setSettings(ResolutionControllerSettings const& settings) {
+    m_settings = settings;
+    m_scale = std::clamp(m_scale, m_settings.minScale, m_settings.maxScale);
+}
+
+void ResolutionController::reset() {
+    m_scale = m_settings.maxScale;
+    m_averageMs = 0;
+    m_frames = 0;
+}
+
+float ResolutionController::update(float frameMs) {
+    if (m_frames++ == 0) {
+        return m_scale;
+    }
+    m_averageMs = m_frames == 2 ? frameMs : glm::mix(m_averageMs, frameMs, m_settings.smoothing);
+
+    if (m_frames <= m_settings.settleFrames || m_averageMs <= 0) {
+        return m_scale;
+    }
+    if (std::abs(m_averageMs / m_settings.targetMs - 1) <= m_settings.tolerance) {
+        return m_scale;
+    }
+
+    // Pixels, and so time, go with the square of the scale
+    float wanted = m_scale * std::sqrt(m_settings.targetMs / m_averageMs);
+    wanted = std::min(wanted, m_scale * m_settings.maxGrowth);
+    float next = std::round(wanted / m_settings.step) * m_settings.step;
+    // Outside the tolerance is worth at least one step
+    if (std::abs(next - m_scale) < 0.5f * m_settings.step) {
+        next = m_scale + (wanted > m_scale ? m_settings.step : -m_settings.step);
+    }
+    next = std::clamp(next, m_settings.minScale, m_settings.maxScale);
+
+    if (next != m_scale) {
+        m_scale = next;
+        m_averageMs = 0;
+        m_frames = 0;
+    }
+    return m_scale;
+}
+
+glm::ivec2 scaledResolution(glm::ivec2 windowSize, float scale) {
+    return glm::max(glm::ivec2(glm::round(glm::vec2(windowSize) * scale)), glm::ivec2(1));
+}
+
+glm::ivec2 workGroupCount(glm::ivec2 size, int groupSize) {
+    return (size + groupSize - 1) / groupSize;
+}
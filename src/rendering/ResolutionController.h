@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+
+// Dynamic resolution: rays are traced for scale * window size pixels and the
+// result is stretched over the window, with the scale chosen each frame so
+// frames take about targetMs. Frame time is assumed to grow with the number
+// of pixels, i.e. with scale^2.
+struct ResolutionControllerSettings {
+    float targetMs = 16.6f;
+    float minScale = 0.25f;
+    float maxScale = 1.0f;
+    // Weight of the newest frame in the running average frame time
+    float smoothing = 0.2f;
+    // Averages within this fraction of targetMs leave the scale alone
+    float tolerance = 0.1f;
+    // Scales are multiples of this, so noise does not resize every frame
+    float step = 0.05f;
+    // Frames averaged after a change before the next one. The first frame
+    // at a new scale is not counted, it pays for the resize.
+    int settleFrames = 4;
+    // Largest growth of the scale in one change, shrinking is not limited
+    // so that a sudden slowdown is corrected at once
+    float maxGrowth = 1.1f;
+};
+
+class ResolutionController {
+public:
+    explicit ResolutionController(ResolutionControllerSettings const& settings = {});
+
+    // Takes the duration of the last frame, rendered at scale(), and returns
+    // the scale for the next one
+    float update(float frameMs);
+
+    // Starts over at maxScale, e.g. after the target changed
+    void reset();
+
+    float scale() const { return m_scale; }
+    // Running average of the frames at the current scale, 0 before the first
+    float averageMs() const { return m_averageMs; }
+
+    ResolutionControllerSettings const& settings() const { return m_settings; }
+    void setSettings(ResolutionControllerSettings const& settings);
+
+private:
+    ResolutionControllerSettings m_settings;
+    float m_scale;
+    float m_averageMs = 0;
+    // Frames at the current scale, including the skipped first one
+    int m_frames = 0;
+};
+
+// Pixels traced for a window at the given scale, at least one per axis
+glm::ivec2 scaledResolution(glm::ivec2 windowSize, float scale);
+
+// Work groups of groupSize^2 invocations covering size, the last row and
+// column of groups only partly inside
+glm::ivec2 workGroupCount(glm::ivec2 size, int groupSize);
@@ -0,0 +1,116 @@
+#include "Sampler.h"
+
+#include "NoiseImages.h"
+
+namespace {
+    // Maps 32 random bits to [0, 1) without rounding up to 1
+    float toUnitFloat(uint32_t bits) {
+        return float(bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+    uint32_t reverseBits(uint32_t x) {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Second dimension of the Sobol sequence, the first is reverseBits
+    uint32_t sobolSecond(uint32_t index) {
+        uint32_t result = 0;
+        for (uint32_t direction = 1u << 31; index != 0; index >>= 1, direction ^= direction >> 1) {
+            if (index & 1u) {
+                result ^= direction;
+            }
+        }
+        return result;
+    }
+
+    uint32_t pixelSeed(glm::uvec2 pixel, uint32_t dimension) {
+        return hashCombine(hashCombine(hashUint(pixel.x), pixel.y), dimension);
+    }
+}
+
+char const* samplerName(SamplerType type) {
+    switch (type) {
+    case SamplerType::Random:
+        return "random";
+    case SamplerType::Sobol:
+        return "sobol";
+    case SamplerType::R2:
+        return "r2";
+    case SamplerType::BlueNoise:
+        return "blue-noise";
+    }
+    return "unknown";
+}
+
+uint32_t hashUint(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+uint32_t hashCombine(uint32_t seed, uint32_t value) {
+    return hashUint(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+    // Laine-Karras permutation on the reversed bits
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+glm::vec2 sobol2D(uint32_t index, uint32_t seed) {
+    // Shuffling the index first keeps different seeds from sharing the
+    // order in which they fill in the strata
+    uint32_t shuffled = nestedUniformScramble(index, hashCombine(seed, 0));
+    uint32_t x = nestedUniformScramble(reverseBits(shuffled), hashCombine(seed, 1));
+    uint32_t y = nestedUniformScramble(sobolSecond(shuffled), hashCombine(seed, 2));
+    return {toUnitFloat(x), toUnitFloat(y)};
+}
+
+glm::vec2 r2(uint32_t index, uint32_t seed) {
+    // 2^32 / g and 2^32 / g^2, g being the plastic number. Fixed point keeps
+    // the sequence exact for large indices.
+    uint32_t x = hashCombine(seed, 0) + index * 0xc13fa9a9u;
+    uint32_t y = hashCombine(seed, 1) + index * 0x91e10da5u;
+    return {toUnitFloat(x), toUnitFloat(y)};
+}
+
+glm::vec2 sample2D(SamplerType type, glm::uvec2 pixel, uint32_t sampleIndex, uint32_t dimension,
+                   NoiseImages const* blueNoise) {
+    switch (type) {
+    case SamplerType::Random: {
+        uint32_t x = hashCombine(pixelSeed(pixel, dimension), sampleIndex);
+        return {toUnitFloat(x), toUnitFloat(hashUint(x))};
+    }
+    case SamplerType::R2:
+        return r2(sampleIndex, pixelSeed(pixel, dimension));
+    case SamplerType::BlueNoise:
+        if (blueNoise && !blueNoise->layers.empty()) {
+            // Dimensions beyond the layers reuse them at another offset
+            uint32_t numLayers = uint32_t(blueNoise->layers.size());
+            uint32_t offset = hashUint(dimension / numLayers);
+            uint32_t x = (pixel.x + offset) % uint32_t(blueNoise->width);
+            uint32_t y = (pixel.y + (offset >> 16)) % uint32_t(blueNoise->height);
+            uint32_t rank = blueNoise->layers[dimension % numLayers][(size_t(y) * blueNoise->width + x) * 4];
+            // XOR keeps aligned blocks of 2^k samples together, every
+            // pixel's first 2^k samples are still a stratified set
+            return sobol2D(sampleIndex ^ rank, hashUint(dimension));
+        }
+        return sobol2D(sampleIndex, pixelSeed(pixel, dimension));
+    case SamplerType::Sobol:
+        break;
+    }
+    return sobol2D(sampleIndex, pixelSeed(pixel, dimension));
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/vec2.hpp>
+
+struct NoiseImages;
+
+// CPU counterpart of assets/shaders/sampler.glsl. Keep both in sync.
+//
+// Every random decision of the tracers takes a 2D sample in [0, 1)^2 that is
+// a pure function of the pixel, the sample index (the number of samples
+// accumulated before, so a pixel's samples are consecutive points of a
+// sequence) and the dimension pair. Low discrepancy sequences stay evenly
+// spread over the accumulated samples of every dimension, which converges
+// faster than independent random numbers.
+enum class SamplerType {
+    // Hashed white noise
+    Random,
+    // Sobol (0,2)-sequence with hash based Owen scrambling, seeded per pixel
+    // and dimension pair
+    Sobol,
+    // Roberts' R2 sequence, shifted per pixel and dimension pair
+    R2,
+    // One Owen scrambled Sobol sequence for all pixels, entered by every
+    // pixel at a rank read from a blue noise mask. Neighboring pixels take
+    // different points of the same well spread set, so their errors are
+    // spread like blue noise. Sobol without a mask.
+    BlueNoise,
+};
+
+// Dimension pairs used by the tracers. Path vertex n (0 being the primary
+// hit) takes dimensionsPerVertex pairs from vertexDimension(n) on, in the
+// order of the offsets below.
+constexpr uint32_t jitterDimension = 0;
+constexpr uint32_t dimensionsPerVertex = 3;
+constexpr uint32_t lightChoiceDimension = 0;
+constexpr uint32_t lightPointDimension = 1;
+constexpr uint32_t bounceDimension = 2;
+
+constexpr uint32_t vertexDimension(uint32_t vertex) {
+    return 1 + dimensionsPerVertex * vertex;
+}
+
+char const* samplerName(SamplerType type);
+
+uint32_t hashUint(uint32_t x);
+uint32_t hashCombine(uint32_t seed, uint32_t value);
+
+// Owen scrambling of the bits of x, as a function of seed (Burley 2020)
+uint32_t nestedUniformScramble(uint32_t x, uint32_t seed);
+
+// Point index of a scrambled 2D Sobol sequence, a different sequence per seed
+glm::vec2 sobol2D(uint32_t index, uint32_t seed);
+// Point index of the R2 sequence, shifted by a hash of seed
+glm::vec2 r2(uint32_t index, uint32_t seed);
+
+// Sample of the given dimension pair of sample sampleIndex of a pixel.
+// blueNoise is the mask of the BlueNoise sampler, ranks are read from the
+// red channel of one layer per dimension pair.
+glm::vec2 sample2D(SamplerType type, glm::uvec2 pixel, uint32_t sampleIndex, uint32_t dimension,
+                   NoiseImages const* blueNoise = nullptr);
+
+// The samples of one pixel sample
+struct PixelSampler {
+    glm::vec2 get(uint32_t dimension) const {
+        return sample2D(type, pixel, sampleIndex, dimension, blueNoise);
+    }
+
+    SamplerType type = SamplerType::Sobol;
+    glm::uvec2 pixel{0};
+    uint32_t sampleIndex = 0;
+    NoiseImages const* blueNoise = nullptr;
+};
@@ -1,36 +1,137 @@
 #include "Shader.h"
 
-#include <fstream>
-#include <sstream>
+#include <cstdint>
+#include <cstdio>
 #include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+    constexpr uint32_t programBinaryMagic = 0x42505844; // "DXPB"
+
+    // Shared by the shaders compiled straight from a file
+    ShaderPreprocessor& defaultPreprocessor() {
+        static ShaderPreprocessor preprocessor;
+        return preprocessor;
+    }
+
+    std::string programInfoLog(GLuint program) {
+        GLint infoLogLength{0};
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
+
+        std::vector<char> infoLog;
+        infoLog.resize(infoLogLength + 1);
+
+        glGetProgramInfoLog(program, infoLogLength, nullptr, infoLog.data());
+        return infoLog.data();
+    }
+
+    bool linkStatus(GLuint program) {
+        GLint status{GL_TRUE};
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        return status == GL_TRUE;
+    }
+
+    void linkShaders(GLuint program, const std::vector<GLuint>& shaders) {
+        for (GLuint shader : shaders) {
+            glAttachShader(program, shader);
+        }
+
+        glLinkProgram(program);
+
+        if (!linkStatus(program)) {
+            throw std::runtime_error(programInfoLog(program));
+        }
+
+        for (GLuint shader : shaders) {
+            glDetachShader(program, shader);
+        }
+    }
+
+    bool programBinariesSupported() {
+        GLint numFormats{0};
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        return numFormats > 0;
+    }
+
+    std::string glString(GLenum name) {
+        auto string = reinterpret_cast<const char*>(glGetString(name));
+        return string ? string : "";
+    }
 
-std::string loadShaderSource(const std::string& filename) {
-    std::ostringstream iss;
-    std::ifstream ifs(filename);
+    // Binaries are only valid for the driver that produced them, so the
+    // renderer and version go into the key along with the sources
+    std::filesystem::path programBinaryPath(const std::vector<ShaderStage>& stages, const std::string& cacheDir) {
+        uint64_t hash = hashShaderSource(glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION));
+        for (const auto& stage : stages) {
+            hash = hashShaderSource(std::to_string(stage.type) + ':' + std::to_string(stage.source.hash) + '\n', hash);
+        }
 
-    if (!ifs.is_open()) {
-        throw std::runtime_error("Failed to open file: " + filename);
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(hash));
+        return std::filesystem::path(cacheDir) / name;
     }
 
-    std::string line;
-    while (std::getline(ifs, line)) {
-        if (line.starts_with("#include")) {
-            std::string fileDir = std::filesystem::path(filename).parent_path().string();
-            std::string includedFile = line.substr(line.find('"') + 1, std::string::npos);
-            includedFile = includedFile.substr(0, includedFile.size() - 1);
-            line = loadShaderSource(fileDir + '/' + includedFile);
+    bool loadProgramBinary(GLuint program, const std::filesystem::path& path) {
+        std::ifstream ifs(path, std::ios::in | std::ios::binary);
+        if (!ifs.is_open()) {
+            return false;
+        }
+
+        uint32_t header[3]{}; // magic, format, length
+        if (!ifs.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != programBinaryMagic) {
+            return false;
         }
-        iss << line << "\n";
+
+        std::vector<char> binary(header[2]);
+        if (!ifs.read(binary.data(), binary.size())) {
+            return false;
+        }
+
+        glProgramBinary(program, header[1], binary.data(), static_cast<GLsizei>(binary.size()));
+        return linkStatus(program);
     }
 
-    return iss.str();
+    void saveProgramBinary(GLuint program, const std::filesystem::path& path) {
+        GLint length{0};
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+
+        std::vector<char> binary(length);
+        GLenum format{0};
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(path.parent_path(), error);
+
+        // Written next to the target and renamed, so a crash or a second
+        // instance never leaves a truncated binary behind
+        std::filesystem::path tempPath = path;
+        tempPath += ".tmp";
+        {
+            std::ofstream ofs(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+            uint32_t header[3]{programBinaryMagic, format, static_cast<uint32_t>(length)};
+            ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+            ofs.write(binary.data(), length);
+            if (!ofs) {
+                std::filesystem::remove(tempPath, error);
+                return;
+            }
+        }
+        std::filesystem::rename(tempPath, path, error);
+    }
 }
 
-Shader::Shader(const std::string &filename, GLenum type) {
+Shader::Shader(const std::string &filename, GLenum type)
+        : Shader(defaultPreprocessor().preprocess(filename), type) {
+}
+
+Shader::Shader(const ShaderSource &source, GLenum type) {
     id = glCreateShader(type);
 
-    auto srcCode = loadShaderSource(filename);
-    auto srcCodeCstr = srcCode.c_str();
+    auto srcCodeCstr = source.code.c_str();
 
     glShaderSource(id, 1, &srcCodeCstr, nullptr);
     glCompileShader(id);
@@ -46,7 +147,8 @@ Shader::Shader(const std::string &filename, GLenum type) {
         infoLog.resize(infoLogLength + 1);
 
         glGetShaderInfoLog(id, infoLogLength, nullptr, infoLog.data());
-        throw std::runtime_error(filename + ":\n" + infoLog.data());
+        glDeleteShader(id);
+        throw std::runtime_error(source.files.front() + ":\n" + mapShaderLog(infoLog.data(), source.files));
     }
 }
 
@@ -57,31 +159,55 @@ Shader::~Shader() {
 ShaderProgram::ShaderProgram(const std::vector<Shader> &shaders) {
     id = glCreateProgram();
 
+    std::vector<GLuint> shaderIds;
     for (const auto& shader : shaders) {
-        glAttachShader(id, shader.id);
+        shaderIds.push_back(shader.id);
     }
 
-    glLinkProgram(id);
-
-    GLint status{GL_TRUE};
-    glGetProgramiv(id, GL_LINK_STATUS, &status);
+    try {
+        linkShaders(id, shaderIds);
+    } catch (...) {
+        glDeleteProgram(id);
+        throw;
+    }
+}
 
-    if (status == GL_FALSE) {
-        GLint infoLogLength{0};
-        glGetProgramiv(id, GL_LINK_STATUS, &infoLogLength);
+ShaderProgram::ShaderProgram(const std::vector<ShaderStage> &stages, const std::string &binaryCacheDir) {
+    id = glCreateProgram();
 
-        std::vector<char> infoLog;
-        infoLog.resize(infoLogLength + 1);
+    bool useCache = !binaryCacheDir.empty() && programBinariesSupported();
+    std::filesystem::path binaryPath;
+    if (useCache) {
+        binaryPath = programBinaryPath(stages, binaryCacheDir);
+        if (loadProgramBinary(id, binaryPath)) {
+            return;
+        }
+        // A failed glProgramBinary leaves the program unlinked, start over
+        // with a fresh one rather than relying on relinking it
+        glDeleteProgram(id);
+        id = glCreateProgram();
+        glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
 
-        glGetProgramInfoLog(id, infoLogLength, nullptr, infoLog.data());
-        throw std::runtime_error(infoLog.data());
+    try {
+        // Reserved so the shaders are never copied, that would delete them twice
+        std::vector<Shader> shaders;
+        shaders.reserve(stages.size());
+        std::vector<GLuint> shaderIds;
+        for (const auto& stage : stages) {
+            shaderIds.push_back(shaders.emplace_back(stage.source, stage.type).id);
+        }
+        linkShaders(id, shaderIds);
+    } catch (...) {
+        glDeleteProgram(id);
+        throw;
     }
 
-    for (const auto& shader : shaders) {
-        glDetachShader(id, shader.id);
+    if (useCache) {
+        saveProgramBinary(id, binaryPath);
     }
 }
 
 ShaderProgram::~ShaderProgram() {
     glDeleteProgram(id);
-}
\ No newline at end of file
+}
@@ -5,15 +5,30 @@
 
 #include <GL/glew.h>
 
+#include "ShaderPreprocessor.h"
+
 struct Shader {
     Shader(const std::string& filename, GLenum type);
+    // Compiles source that was preprocessed ahead of time. Line numbers in
+    // the compile log are mapped back to the included files.
+    Shader(const ShaderSource& source, GLenum type);
     ~Shader();
 
     GLuint id;
 };
 
+struct ShaderStage {
+    ShaderSource source;
+    GLenum type;
+};
+
 struct ShaderProgram {
     ShaderProgram(const std::vector<Shader>& shaders);
+    // Links the stages, or with a non-empty binaryCacheDir loads the program
+    // binary the driver returned the last time the same sources were linked
+    // on the same GL renderer and version. Falls back to compiling when the
+    // driver rejects the cached binary, and caches the result for next time.
+    ShaderProgram(const std::vector<ShaderStage>& stages, const std::string& binaryCacheDir = "");
     ~ShaderProgram();
 
     GLuint id;
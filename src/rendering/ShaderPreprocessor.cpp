@@ -0,0 +1,148 @@
+#include "ShaderPreprocessor.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+    // The quoted file name of an #include line, or empty
+    std::string parseInclude(std::string_view line) {
+        size_t pos = line.find_first_not_of(" \t");
+        if (pos == std::string_view::npos || line[pos] != '#') {
+            return {};
+        }
+        pos = line.find_first_not_of(" \t", pos + 1);
+        if (pos == std::string_view::npos || line.substr(pos, 7) != "include") {
+            return {};
+        }
+
+        size_t open = line.find_first_of("\"<", pos + 7);
+        if (open == std::string_view::npos) {
+            return {};
+        }
+        size_t close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+        if (close == std::string_view::npos) {
+            return {};
+        }
+        return std::string(line.substr(open + 1, close - open - 1));
+    }
+
+    bool isVersionLine(std::string_view line) {
+        size_t pos = line.find_first_not_of(" \t");
+        return pos != std::string_view::npos && line.substr(pos).starts_with("#version");
+    }
+}
+
+std::shared_ptr<ShaderPreprocessor::ParsedFile const> ShaderPreprocessor::parse(std::string const& filename) {
+    {
+        std::lock_guard lock(m_mutex);
+        if (auto it = m_files.find(filename); it != m_files.end()) {
+            return it->second;
+        }
+    }
+
+    std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+    if (!ifs.is_open()) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+    std::stringstream contents;
+    contents << ifs.rdbuf();
+
+    auto file = std::make_shared<ParsedFile>();
+    std::string directory = std::filesystem::path(filename).parent_path().string();
+    std::string line;
+    while (std::getline(contents, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (std::string include = parseInclude(line); !include.empty()) {
+            std::filesystem::path path = std::filesystem::path(directory) / include;
+            file->includes.emplace(file->lines.size(), path.lexically_normal().generic_string());
+        }
+        file->lines.push_back(std::move(line));
+    }
+
+    // Two threads may parse the same file, either result is fine
+    std::lock_guard lock(m_mutex);
+    return m_files.emplace(filename, std::move(file)).first->second;
+}
+
+void ShaderPreprocessor::expand(std::string const& filename, ShaderSource& source, std::vector<std::string>& included) {
+    std::shared_ptr<ParsedFile const> file = parse(filename);
+
+    size_t fileIndex = source.files.size();
+    source.files.push_back(filename);
+    std::string lineDirective = " " + std::to_string(fileIndex) + "\n";
+
+    size_t first = 0;
+    if (fileIndex == 0 && !file->lines.empty() && isVersionLine(file->lines[0])) {
+        // #version has to stay the first line of the shader
+        source.code += file->lines[0] + "\n";
+        first = 1;
+    }
+    source.code += "#line " + std::to_string(first + 1) + lineDirective;
+
+    for (size_t i = first; i < file->lines.size(); ++i) {
+        auto include = file->includes.find(i);
+        if (include == file->includes.end()) {
+            source.code += file->lines[i];
+            source.code += '\n';
+            continue;
+        }
+
+        if (std::find(included.begin(), included.end(), include->second) == included.end()) {
+            included.push_back(include->second);
+            expand(include->second, source, included);
+        }
+        source.code += "#line " + std::to_string(i + 2) + lineDirective;
+    }
+}
+
+ShaderSource ShaderPreprocessor::preprocess(std::string const& filename) {
+    ShaderSource source;
+    std::string root = std::filesystem::path(filename).lexically_normal().generic_string();
+    std::vector<std::string> included{root};
+
+    expand(root, source, included);
+    source.hash = hashShaderSource(source.code);
+    return source;
+}
+
+void ShaderPreprocessor::clear() {
+    std::lock_guard lock(m_mutex);
+    m_files.clear();
+}
+
+uint64_t hashShaderSource(std::string_view code, uint64_t seed) {
+    uint64_t hash = seed;
+    for (char c : code) {
+        hash = (hash ^ uint8_t(c)) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::string mapShaderLog(std::string const& log, std::vector<std::string> const& files) {
+    // A source string number directly followed by "(line)" or ":line"
+    static std::regex const location(R"((^|[^0-9A-Za-z_])([0-9]+)([(:])([0-9]+))");
+
+    std::string mapped;
+    auto last = log.cbegin();
+    for (std::sregex_iterator it(log.begin(), log.end(), location), end; it != end; ++it) {
+        std::smatch const& match = *it;
+        size_t fileIndex = std::stoul(match[2].str());
+        if (fileIndex >= files.size()) {
+            continue;
+        }
+        mapped.append(last, match[2].first);
+        mapped += files[fileIndex];
+        mapped += match[3].str() == "(" ? "(" : ":";
+        mapped += match[4].str();
+        last = match[4].second;
+    }
+    mapped.append(last, log.cend());
+    return mapped;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// A shader with its #include lines expanded, ready for glShaderSource
+struct ShaderSource {
+    std::string code;
+    // Every file that went into code. The #line directives in code refer to
+    // files by their index in this list, GLSL has no file names in #line.
+    std::vector<std::string> files;
+    // FNV-1a of code
+    uint64_t hash = 0;
+};
+
+// Expands #include "file" relative to the including file. Each file is
+// included at most once per shader, later includes of it (and include
+// cycles) expand to nothing. #line directives after every file boundary keep
+// compiler messages pointing at the original file and line.
+//
+// Files are read and split into lines once and cached, so shaders sharing
+// includes do not read them again. Safe to use from several threads.
+class ShaderPreprocessor {
+public:
+    ShaderSource preprocess(std::string const& filename);
+
+    // Drops the cached files, for picking up edits
+    void clear();
+
+private:
+    struct ParsedFile {
+        std::vector<std::string> lines;
+        // Index into lines -> included path, for the #include lines
+        std::unordered_map<size_t, std::string> includes;
+    };
+
+    std::shared_ptr<ParsedFile const> parse(std::string const& filename);
+    void expand(std::string const& filename, ShaderSource& source, std::vector<std::string>& included);
+
+    std::mutex m_mutex;
+    std::unordered_map<std::string, std::shared_ptr<ParsedFile const>> m_files;
+};
+
+uint64_t hashShaderSource(std::string_view code, uint64_t seed = 0xcbf29ce484222325ull);
+
+// Replaces the source string numbers in a driver's info log ("2(15): error"
+// on NVIDIA, "ERROR: 2:15:" on Mesa and AMD) by the file names in files.
+std::string mapShaderLog(std::string const& log, std::vector<std::string> const& files);
@@ -0,0 +1,212 @@
+#include "SunVisibility.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+
+#include "CpuTracer.h"
+#include "Dda.h"
+#include "VoxelEdit.h"
+#include "../util/ThreadPool.h"
+#include "../util/Trace.h"
+
+namespace {
+    constexpr size_t voxelsPerWord = 8;
+    // Words baked by one task
+    constexpr size_t wordsPerTask = 512;
+    // Shadow rays start this far off the face centers, by amounts that are no
+    // simple fraction of a voxel. With sun directions like the default
+    // (-1, 2, -1), a ray from the exact center runs through voxel edges and
+    // corners, where the dense DDA steps diagonally past the voxels on both
+    // sides while the DAG counts the edge as a hit, so the bakes differed.
+    constexpr float faceOffsets[3] = {0.0137f, 0.0071f, 0.0103f};
+
+    // The four bits of each of the voxels of a word
+    uint32_t bakeWord(SunVisibility const& visibility, CpuTracer const& tracer, size_t word) {
+        Model const& model = tracer.m_model;
+        glm::uvec3 size = visibility.size;
+        size_t numVoxels = size_t(size.x) * size.y * size.z;
+
+        uint32_t bits = 0;
+        for (size_t i = 0; i < voxelsPerWord; ++i) {
+            size_t index = word * voxelsPerWord + i;
+            if (index >= numVoxels) {
+                break;
+            }
+
+            glm::uvec3 voxel{index % size.x, (index / size.x) % size.y, index / (size_t(size.x) * size.y)};
+            if (!model.isSolid(voxel)) {
+                continue;
+            }
+
+            for (int axis = 0; axis < 3; ++axis) {
+                if (visibility.sunDir[axis] == 0) {
+                    continue;
+                }
+
+                int side = visibility.sunDir[axis] > 0 ? 1 : -1;
+                glm::ivec3 neighbor{voxel};
+                neighbor[axis] += side;
+                bool inside = neighbor[axis] >= 0 && neighbor[axis] < int(size[axis]);
+                if (inside && model.isSolid(glm::uvec3(neighbor))) {
+                    continue;
+                }
+
+                // Just in front of the face, like the hits shading starts from
+                glm::vec3 center = glm::vec3(voxel) + 0.5f;
+                for (int other = 0; other < 3; ++other) {
+                    center[other] += other == axis ? float(side) * (0.5f + 3 * EPSILON) : faceOffsets[other];
+                }
+                if (!tracer.pointIsShadowed(center)) {
+                    bits |= 1u << (i * 4 + axis);
+                }
+            }
+        }
+        return bits;
+    }
+}
+
+bool SunVisibility::hitLit(glm::vec3 position, glm::vec3 normal) const {
+    int axis = normal.x != 0 ? 0 : normal.y != 0 ? 1 : 2;
+    // Faces turned away from the sun are in their own shadow
+    if (normal[axis] * sunDir[axis] <= 0) {
+        return false;
+    }
+
+    glm::ivec3 voxel{glm::floor(position - 0.5f * normal)};
+    if (glm::any(glm::lessThan(voxel, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(voxel, glm::ivec3(size)))) {
+        return false;
+    }
+    return lit(glm::uvec3(voxel), axis);
+}
+
+SunVisibility bakeSunVisibility(CpuTracer const& tracer, ThreadPool& pool) {
+    TRACE_SCOPE("bakeSunVisibility");
+
+    SunVisibility visibility;
+    visibility.size = tracer.m_model.size;
+    visibility.sunDir = tracer.m_settings.sunDir;
+    size_t numVoxels = size_t(visibility.size.x) * visibility.size.y * visibility.size.z;
+    size_t numWords = (numVoxels + voxelsPerWord - 1) / voxelsPerWord;
+    visibility.bits.assign(numWords, 0);
+
+    pool.parallelFor((numWords + wordsPerTask - 1) / wordsPerTask, [&](size_t task) {
+        size_t end = std::min(numWords, (task + 1) * wordsPerTask);
+        for (size_t word = task * wordsPerTask; word < end; ++word) {
+            visibility.bits[word] = bakeWord(visibility, tracer, word);
+        }
+    });
+
+    return visibility;
+}
+
+void rebakeSunVisibility(SunVisibility& visibility, CpuTracer const& tracer, glm::uvec3 min, glm::uvec3 max,
+                         ThreadPool& pool, DirtyRanges* dirty) {
+    glm::uvec3 size = visibility.size;
+    max = glm::min(max, size);
+    if (glm::any(glm::greaterThanEqual(min, max))) {
+        return;
+    }
+
+    TRACE_SCOPE("rebakeSunVisibility");
+
+    // The words to re-trace, in bytes so that DirtyRanges can merge them
+    DirtyRanges region;
+    auto addBox = [&](glm::ivec3 boxMin, glm::ivec3 boxMax) {
+        boxMin = glm::max(boxMin, glm::ivec3(0));
+        boxMax = glm::min(boxMax, glm::ivec3(size));
+        if (glm::any(glm::greaterThanEqual(boxMin, boxMax))) {
+            return;
+        }
+        for (int z = boxMin.z; z < boxMax.z; ++z) {
+            for (int y = boxMin.y; y < boxMax.y; ++y) {
+                size_t begin = visibility.voxelIndex(glm::uvec3(boxMin.x, y, z)) / voxelsPerWord;
+                size_t end = visibility.voxelIndex(glm::uvec3(boxMax.x - 1, y, z)) / voxelsPerWord + 1;
+                region.add(begin * sizeof(uint32_t), end * sizeof(uint32_t));
+            }
+        }
+    };
+
+    // Faces of the box and of its neighbors, which may have been covered or
+    // uncovered
+    addBox(glm::ivec3(min) - 1, glm::ivec3(max) + 1);
+
+    // Faces whose shadow rays cross the box, one layer of the axis the sun
+    // is steepest along at a time, walking away from the sun. A layer's rays
+    // are within the box's layers after travelling [near, far] along the
+    // axis, and drift sideways by the slope of the sun meanwhile.
+    glm::vec3 sunDir = visibility.sunDir;
+    glm::vec3 absSunDir = glm::abs(sunDir);
+    int axis = absSunDir.x >= absSunDir.y && absSunDir.x >= absSunDir.z ? 0 : absSunDir.y >= absSunDir.z ? 1 : 2;
+    if (sunDir[axis] != 0) {
+        bool towardsMax = sunDir[axis] > 0;
+        int step = towardsMax ? -1 : 1;
+        for (int layer = towardsMax ? int(max[axis]) - 1 : int(min[axis]); layer >= 0 && layer < int(size[axis]);
+             layer += step) {
+            float near = towardsMax ? std::max(0.0f, float(min[axis]) - float(layer + 1))
+                                    : std::max(0.0f, float(layer) - float(max[axis]));
+            float far = towardsMax ? float(max[axis]) - float(layer) : float(layer + 1) - float(min[axis]);
+
+            glm::ivec3 layerMin{0};
+            glm::ivec3 layerMax{0};
+            layerMin[axis] = layer;
+            layerMax[axis] = layer + 1;
+            bool inMap = true;
+            for (int other : {(axis + 1) % 3, (axis + 2) % 3}) {
+                float slope = sunDir[other] / absSunDir[axis];
+                float low = std::min(near * slope, far * slope);
+                float high = std::max(near * slope, far * slope);
+                // One voxel of margin for the offsets of the face centers
+                layerMin[other] = int(std::floor(float(min[other]) - high)) - 1;
+                layerMax[other] = int(std::ceil(float(max[other]) - low)) + 1;
+                inMap = inMap && layerMax[other] > 0 && layerMin[other] < int(size[other]);
+            }
+            // The drift only grows from here on
+            if (!inMap) {
+                break;
+            }
+            addBox(layerMin, layerMax);
+        }
+    }
+
+    // Bake into a scratch buffer first, then keep the words that changed.
+    // Ranges are cut into tasks, a large edit coalesces into few of them.
+    struct WordSpan {
+        size_t begin;
+        size_t end;
+        size_t scratch;
+    };
+    std::vector<WordSpan> spans;
+    size_t numWords = 0;
+    for (ByteRange range : region.ranges()) {
+        for (size_t word = range.begin / sizeof(uint32_t); word < range.end / sizeof(uint32_t);
+             word += wordsPerTask) {
+            size_t end = std::min(range.end / sizeof(uint32_t), word + wordsPerTask);
+            spans.push_back({word, end, numWords});
+            numWords += end - word;
+        }
+    }
+    std::vector<uint32_t> baked(numWords);
+
+    pool.parallelFor(spans.size(), [&](size_t task) {
+        WordSpan span = spans[task];
+        for (size_t word = span.begin; word < span.end; ++word) {
+            baked[span.scratch + word - span.begin] = bakeWord(visibility, tracer, word);
+        }
+    });
+
+    for (WordSpan span : spans) {
+        for (size_t word = span.begin; word < span.end; ++word) {
+            uint32_t bits = baked[span.scratch + word - span.begin];
+            if (bits != visibility.bits[word]) {
+                visibility.bits[word] = bits;
+                if (dirty) {
+                    dirty->add(word * sizeof(uint32_t), (word + 1) * sizeof(uint32_t));
+                }
+            }
+        }
+    }
+}
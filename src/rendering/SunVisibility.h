@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+class DirtyRanges;
+class ThreadPool;
+struct CpuTracer;
+
+// CPU counterpart of assets/shaders/sunvisibility.glsl. Keep both in sync.
+
+// Whether the sun reaches each exposed voxel face, so that shading reads a
+// bit instead of tracing a shadow ray. Only the (at most three) faces that
+// face the sun can be lit. Voxels get four bits, x fastest like the linear
+// voxel layout and eight to a word: bit axis is the face on that axis that
+// faces the sun. A face counts as lit if the shadow ray from its center
+// (nudged off it a little, see bakeWord) reaches the sky, so shadow edges
+// follow the voxel faces.
+struct SunVisibility {
+    size_t voxelIndex(glm::uvec3 voxel) const {
+        return (size_t(voxel.z) * size.y + voxel.y) * size.x + voxel.x;
+    }
+
+    bool lit(glm::uvec3 voxel, int axis) const {
+        size_t bit = voxelIndex(voxel) * 4 + axis;
+        return (bits[bit >> 5] >> (bit & 31)) & 1u;
+    }
+
+    // Whether the sun reaches a hit, given its position (a little in front
+    // of the face it hit, like the traversal returns them) and normal
+    bool hitLit(glm::vec3 position, glm::vec3 normal) const;
+
+    glm::uvec3 size{0};
+    // The sun direction the bits were baked for
+    glm::vec3 sunDir{0};
+    std::vector<uint32_t> bits;
+};
+
+// Traces the face centers with tracer.pointIsShadowed, spread over the pool
+SunVisibility bakeSunVisibility(CpuTracer const& tracer, ThreadPool& pool);
+
+// Re-traces the faces whose visibility may have changed after the voxels in
+// [min, max) were edited: the faces around the box and the faces whose
+// shadow rays pass through it. The words that were rewritten are added to
+// dirty, in bytes, when it is given.
+void rebakeSunVisibility(SunVisibility& visibility, CpuTracer const& tracer, glm::uvec3 min, glm::uvec3 max,
+                         ThreadPool& pool, DirtyRanges* dirty = nullptr);
@@ -0,0 +1,324 @@
+#include "VoxFile.h"
+
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "../util/Trace.h"
+
+namespace {
+    // Bounds checked little endian cursor over a byte range of the mapping
+    struct Reader {
+        uint8_t const* pos;
+        uint8_t const* end;
+        std::string const& filename;
+
+        [[noreturn]] void fail(std::string const& what) const {
+            throw std::runtime_error("Malformed vox file " + filename + ": " + what);
+        }
+
+        size_t remaining() const { return size_t(end - pos); }
+
+        void require(size_t numBytes, char const* what) const {
+            if (numBytes > remaining()) {
+                fail(std::string("truncated ") + what);
+            }
+        }
+
+        uint8_t const* take(size_t numBytes, char const* what) {
+            require(numBytes, what);
+            uint8_t const* start = pos;
+            pos += numBytes;
+            return start;
+        }
+
+        int32_t readInt(char const* what) {
+            int32_t value;
+            std::memcpy(&value, take(sizeof(value), what), sizeof(value));
+            return value;
+        }
+
+        int32_t readCount(char const* what, size_t elementSize) {
+            int32_t count = readInt(what);
+            if (count < 0 || size_t(count) > remaining() / elementSize) {
+                fail(std::string("invalid ") + what);
+            }
+            return count;
+        }
+
+        std::string_view readString(char const* what) {
+            int32_t length = readCount(what, 1);
+            return {reinterpret_cast<char const*>(take(size_t(length), what)), size_t(length)};
+        }
+
+        VoxDict readDict(char const* what) {
+            // Every pair needs at least two length fields
+            int32_t numPairs = readCount(what, 2 * sizeof(int32_t));
+            VoxDict dict;
+            dict.reserve(size_t(numPairs));
+            for (int32_t i = 0; i < numPairs; ++i) {
+                std::string_view key = readString(what);
+                std::string_view value = readString(what);
+                dict.emplace_back(key, value);
+            }
+            return dict;
+        }
+    };
+
+    bool chunkIs(uint8_t const* id, char const (&name)[5]) {
+        return std::memcmp(id, name, 4) == 0;
+    }
+
+    // _t "x y z"
+    glm::ivec3 parseTranslation(std::string_view text, Reader const& reader) {
+        glm::ivec3 translation{0};
+        char const* pos = text.data();
+        char const* end = text.data() + text.size();
+        for (int axis = 0; axis < 3; ++axis) {
+            while (pos < end && *pos == ' ') {
+                ++pos;
+            }
+            auto [next, error] = std::from_chars(pos, end, translation[axis]);
+            if (error != std::errc()) {
+                reader.fail("invalid translation");
+            }
+            pos = next;
+        }
+        return translation;
+    }
+
+    // _r: bits 0-1 column of the non zero entry in row 0, bits 2-3 the one in
+    // row 1, bits 4-6 the signs of rows 0-2
+    VoxRotation parseRotation(std::string_view text, Reader const& reader) {
+        int packed = 0;
+        auto [next, error] = std::from_chars(text.data(), text.data() + text.size(), packed);
+        if (error != std::errc()) {
+            reader.fail("invalid rotation");
+        }
+
+        int column0 = packed & 3;
+        int column1 = (packed >> 2) & 3;
+        if (column0 > 2 || column1 > 2 || column0 == column1) {
+            reader.fail("invalid rotation");
+        }
+        int column2 = 3 - column0 - column1;
+
+        VoxRotation rotation;
+        int columns[3] = {column0, column1, column2};
+        for (int row = 0; row < 3; ++row) {
+            rotation.rows[row] = glm::ivec3(0);
+            rotation.rows[row][columns[row]] = (packed >> (4 + row)) & 1 ? -1 : 1;
+        }
+        return rotation;
+    }
+
+    void parseChunk(VoxScene& scene, uint8_t const* id, Reader content, glm::ivec3& pendingSize, bool& hasPendingSize) {
+        if (chunkIs(id, "SIZE")) {
+            if (hasPendingSize) {
+                content.fail("SIZE without XYZI");
+            }
+            pendingSize = {content.readInt("SIZE"), content.readInt("SIZE"), content.readInt("SIZE")};
+            if (pendingSize.x <= 0 || pendingSize.y <= 0 || pendingSize.z <= 0 ||
+                pendingSize.x > 256 || pendingSize.y > 256 || pendingSize.z > 256) {
+                content.fail("invalid SIZE");
+            }
+            hasPendingSize = true;
+        } else if (chunkIs(id, "XYZI")) {
+            if (!hasPendingSize) {
+                content.fail("XYZI without SIZE");
+            }
+            int32_t numVoxels = content.readCount("XYZI", sizeof(VoxVoxel));
+            auto voxels = reinterpret_cast<VoxVoxel const*>(content.take(size_t(numVoxels) * sizeof(VoxVoxel), "XYZI"));
+            scene.models.push_back({pendingSize, {voxels, size_t(numVoxels)}});
+            hasPendingSize = false;
+        } else if (chunkIs(id, "RGBA")) {
+            std::memcpy(scene.palette.data(), content.take(sizeof(scene.palette), "RGBA"), sizeof(scene.palette));
+            scene.hasPalette = true;
+        } else if (chunkIs(id, "MATL")) {
+            VoxMaterial material;
+            material.id = content.readInt("MATL");
+            material.properties = content.readDict("MATL");
+            scene.materials.push_back(std::move(material));
+        } else if (chunkIs(id, "nTRN")) {
+            VoxNode node;
+            node.type = VoxNodeType::Transform;
+            node.id = content.readInt("nTRN");
+            node.attributes = content.readDict("nTRN");
+            node.children.push_back(content.readInt("nTRN"));
+            content.readInt("nTRN"); // reserved
+            node.layerId = content.readInt("nTRN");
+            int32_t numFrames = content.readCount("nTRN", sizeof(int32_t));
+            for (int32_t frame = 0; frame < numFrames; ++frame) {
+                VoxDict frameAttributes = content.readDict("nTRN");
+                if (frame != 0) {
+                    continue;
+                }
+                if (auto t = findVoxDictValue(frameAttributes, "_t"); !t.empty()) {
+                    node.translation = parseTranslation(t, content);
+                }
+                if (auto r = findVoxDictValue(frameAttributes, "_r"); !r.empty()) {
+                    node.rotation = parseRotation(r, content);
+                }
+            }
+            scene.nodes.push_back(std::move(node));
+        } else if (chunkIs(id, "nGRP")) {
+            VoxNode node;
+            node.type = VoxNodeType::Group;
+            node.id = content.readInt("nGRP");
+            node.attributes = content.readDict("nGRP");
+            int32_t numChildren = content.readCount("nGRP", sizeof(int32_t));
+            for (int32_t i = 0; i < numChildren; ++i) {
+                node.children.push_back(content.readInt("nGRP"));
+            }
+            scene.nodes.push_back(std::move(node));
+        } else if (chunkIs(id, "nSHP")) {
+            VoxNode node;
+            node.type = VoxNodeType::Shape;
+            node.id = content.readInt("nSHP");
+            node.attributes = content.readDict("nSHP");
+            int32_t numModels = content.readCount("nSHP", 2 * sizeof(int32_t));
+            for (int32_t i = 0; i < numModels; ++i) {
+                node.children.push_back(content.readInt("nSHP"));
+                content.readDict("nSHP");
+            }
+            scene.nodes.push_back(std::move(node));
+        } else if (chunkIs(id, "LAYR")) {
+            VoxLayer layer;
+            layer.id = content.readInt("LAYR");
+            layer.attributes = content.readDict("LAYR");
+            scene.layers.push_back(std::move(layer));
+        }
+        // Anything else (rOBJ, rCAM, NOTE, IMAP, PACK, ...) does not affect the voxels
+    }
+}
+
+std::string_view findVoxDictValue(VoxDict const& dict, std::string_view key) {
+    for (auto const& [entryKey, value] : dict) {
+        if (entryKey == key) {
+            return value;
+        }
+    }
+    return {};
+}
+
+VoxScene parseVoxFile(std::string const& filename) {
+    TRACE_SCOPE("parseVoxFile");
+    return parseVoxData(MappedFile(filename), filename);
+}
+
+VoxScene parseVoxData(MappedFile file, std::string const& filename) {
+    VoxScene scene;
+    scene.file = std::move(file);
+
+    Reader reader{scene.file.data(), scene.file.data() + scene.file.size(), filename};
+
+    if (!chunkIs(reader.take(4, "header"), "VOX ")) {
+        throw std::runtime_error("Not a valid vox file: " + filename);
+    }
+
+    scene.version = reader.readInt("header");
+    if (scene.version != 150 && scene.version != 200) {
+        throw std::runtime_error("Unexpected vox version " + std::to_string(scene.version) + ": " + filename);
+    }
+
+    uint8_t const* mainId = reader.take(4, "MAIN");
+    if (!chunkIs(mainId, "MAIN")) {
+        reader.fail("expected MAIN chunk");
+    }
+    int32_t mainContentBytes = reader.readCount("MAIN", 1);
+    int32_t mainChildBytes = reader.readCount("MAIN", 1);
+    reader.take(size_t(mainContentBytes), "MAIN");
+    reader.require(size_t(mainChildBytes), "MAIN children");
+
+    Reader children{reader.pos, reader.pos + mainChildBytes, filename};
+    glm::ivec3 pendingSize{0};
+    bool hasPendingSize = false;
+
+    while (children.remaining() > 0) {
+        uint8_t const* id = children.take(4, "chunk header");
+        int32_t contentBytes = children.readCount("chunk size", 1);
+        int32_t childBytes = children.readCount("chunk size", 1);
+
+        Reader content{children.take(size_t(contentBytes), "chunk"), children.pos, filename};
+        children.take(size_t(childBytes), "chunk children");
+
+        parseChunk(scene, id, content, pendingSize, hasPendingSize);
+    }
+
+    if (hasPendingSize) {
+        reader.fail("SIZE without XYZI");
+    }
+    if (scene.models.empty()) {
+        reader.fail("no models");
+    }
+
+    for (VoxModel const& model : scene.models) {
+        for (VoxVoxel const& voxel : model.voxels) {
+            if (voxel.x >= model.size.x || voxel.y >= model.size.y || voxel.z >= model.size.z) {
+                reader.fail("voxel outside of its model");
+            }
+        }
+    }
+
+    return scene;
+}
+
+std::vector<VoxInstance> flattenVoxScene(VoxScene const& scene) {
+    std::vector<VoxInstance> instances;
+
+    if (scene.nodes.empty()) {
+        for (size_t i = 0; i < scene.models.size(); ++i) {
+            instances.push_back({int32_t(i), glm::ivec3(0), VoxRotation{}});
+        }
+        return instances;
+    }
+
+    std::unordered_map<int32_t, VoxNode const*> nodesById;
+    for (VoxNode const& node : scene.nodes) {
+        nodesById[node.id] = &node;
+    }
+
+    std::unordered_map<int32_t, bool> hiddenLayers;
+    for (VoxLayer const& layer : scene.layers) {
+        hiddenLayers[layer.id] = findVoxDictValue(layer.attributes, "_hidden") == "1";
+    }
+
+    auto visit = [&](auto& self, int32_t nodeId, glm::ivec3 translation, VoxRotation rotation, size_t depth) -> void {
+        auto it = nodesById.find(nodeId);
+        // The depth limit also stops cycles in malformed graphs
+        if (it == nodesById.end() || depth > scene.nodes.size()) {
+            throw std::runtime_error("Malformed vox scene graph");
+        }
+        VoxNode const& node = *it->second;
+
+        if (findVoxDictValue(node.attributes, "_hidden") == "1") {
+            return;
+        }
+
+        switch (node.type) {
+            case VoxNodeType::Transform:
+                if (hiddenLayers[node.layerId]) {
+                    return;
+                }
+                self(self, node.children[0], rotation * node.translation + translation, rotation * node.rotation, depth + 1);
+                break;
+            case VoxNodeType::Group:
+                for (int32_t child : node.children) {
+                    self(self, child, translation, rotation, depth + 1);
+                }
+                break;
+            case VoxNodeType::Shape:
+                for (int32_t modelId : node.children) {
+                    if (modelId < 0 || size_t(modelId) >= scene.models.size()) {
+                        throw std::runtime_error("Malformed vox scene graph: unknown model");
+                    }
+                    instances.push_back({modelId, translation, rotation});
+                }
+                break;
+        }
+    };
+
+    visit(visit, scene.nodes.front().id, glm::ivec3(0), VoxRotation{}, 0);
+    return instances;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../util/MappedFile.h"
+
+// MagicaVoxel .vox file parsed in place. Every view points into the mapped
+// file, so a VoxScene must outlive anything taken from it.
+// Format: https://github.com/ephtracy/voxel-model/blob/master/MagicaVoxel-file-format-vox.txt
+
+// DICT: string key/value pairs
+using VoxDict = std::vector<std::pair<std::string_view, std::string_view>>;
+
+std::string_view findVoxDictValue(VoxDict const& dict, std::string_view key);
+
+struct VoxVoxel {
+    uint8_t x;
+    uint8_t y;
+    uint8_t z;
+    uint8_t colorIndex;
+};
+
+// One SIZE/XYZI pair, in vox coordinates (z up)
+struct VoxModel {
+    glm::ivec3 size;
+    std::span<VoxVoxel const> voxels;
+};
+
+// MATL
+struct VoxMaterial {
+    int32_t id;
+    VoxDict properties;
+};
+
+// Signed permutation matrix from the _r attribute of a transform
+struct VoxRotation {
+    glm::ivec3 operator*(glm::ivec3 v) const {
+        glm::ivec3 result;
+        for (int row = 0; row < 3; ++row) {
+            result[row] = rows[row].x * v.x + rows[row].y * v.y + rows[row].z * v.z;
+        }
+        return result;
+    }
+
+    VoxRotation operator*(VoxRotation const& other) const {
+        VoxRotation result;
+        for (int row = 0; row < 3; ++row) {
+            for (int column = 0; column < 3; ++column) {
+                result.rows[row][column] = rows[row].x * other.rows[0][column] +
+                                           rows[row].y * other.rows[1][column] +
+                                           rows[row].z * other.rows[2][column];
+            }
+        }
+        return result;
+    }
+
+    glm::ivec3 rows[3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+};
+
+enum class VoxNodeType {
+    Transform,
+    Group,
+    Shape,
+};
+
+// nTRN, nGRP or nSHP scene graph node. Only the first animation frame of a
+// transform and the first model of a shape are kept.
+struct VoxNode {
+    VoxNodeType type;
+    int32_t id;
+    VoxDict attributes;
+    // Transform: the child node. Group: the children. Shape: the model ids.
+    std::vector<int32_t> children;
+    int32_t layerId = -1;
+    glm::ivec3 translation{0};
+    VoxRotation rotation;
+};
+
+// LAYR
+struct VoxLayer {
+    int32_t id;
+    VoxDict attributes;
+};
+
+struct VoxScene {
+    MappedFile file;
+    int32_t version = 0;
+    std::vector<VoxModel> models;
+    std::array<uint32_t, 256> palette{};
+    bool hasPalette = false;
+    std::vector<VoxMaterial> materials;
+    std::vector<VoxNode> nodes;
+    std::vector<VoxLayer> layers;
+};
+
+// Maps and validates the file. Throws std::runtime_error on malformed input.
+VoxScene parseVoxFile(std::string const& filename);
+VoxScene parseVoxData(MappedFile file, std::string const& filename);
+
+// A model placed into the scene: worldPos = rotation * (voxel - size / 2) + translation
+struct VoxInstance {
+    int32_t modelId;
+    glm::ivec3 translation;
+    VoxRotation rotation;
+};
+
+// Resolves the scene graph into visible model instances. Files without a
+// scene graph yield every model once at the origin.
+std::vector<VoxInstance> flattenVoxScene(VoxScene const& scene);
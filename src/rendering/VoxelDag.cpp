@@ -0,0 +1,281 @@
+#include "VoxelDag.h"
+
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <string_view>
+#include <unordered_map>
+
+#include <glm/common.hpp>
+#include <glm/vector_relational.hpp>
+
+#include "Dda.h"
+#include "Model.h"
+#include "Occupancy.h"
+#include "../util/Trace.h"
+
+namespace {
+    struct NodeHash {
+        size_t operator()(std::vector<uint32_t> const& words) const {
+            return std::hash<std::string_view>{}(std::string_view(
+                    reinterpret_cast<char const*>(words.data()), words.size() * sizeof(uint32_t)));
+        }
+    };
+
+    struct DagBuilder {
+        Model const& model;
+        VoxelDag& dag;
+        DagBuildStats& stats;
+        // One table per level, a leaf and an inner node can share the same words
+        std::vector<std::unordered_map<std::vector<uint32_t>, uint32_t, NodeHash>> uniqueNodes;
+
+        uint32_t addNode(uint32_t level, std::vector<uint32_t> const& words) {
+            ++stats.octreeNodes;
+
+            auto [it, inserted] = uniqueNodes[level].try_emplace(words, uint32_t(dag.nodes.size()));
+            if (inserted) {
+                dag.nodes.insert(dag.nodes.end(), words.begin(), words.end());
+            }
+            return it->second;
+        }
+
+        bool solidAt(glm::uvec3 voxel, uint8_t& paletteIndex) const {
+            if (voxel.x >= model.size.x || voxel.y >= model.size.y || voxel.z >= model.size.z) {
+                return false;
+            }
+            paletteIndex = model.paletteIndex(voxel);
+            return model.isSolid(voxel);
+        }
+
+        // Nodes of 4 and 16 voxels line up with the occupancy bricks and coarse
+        // cells, which answers "is this subtree empty" with a single bit.
+        bool knownEmpty(glm::uvec3 origin, uint32_t side) const {
+            if (origin.x >= model.size.x || origin.y >= model.size.y || origin.z >= model.size.z) {
+                return true;
+            }
+            if (side == coarseCellSize) {
+                return !model.occupancy.coarse.occupied(origin / coarseCellSize);
+            }
+            if (side == brickSize) {
+                return !model.occupancy.bricks.occupied(origin / brickSize);
+            }
+            return false;
+        }
+
+        uint32_t build(uint32_t level, glm::uvec3 origin) {
+            uint32_t side = 1u << level;
+            if (knownEmpty(origin, side)) {
+                return VoxelDag::emptyNode;
+            }
+
+            uint32_t half = side / 2;
+            std::vector<uint32_t> words(1, 0);
+
+            if (level == 1) {
+                words.resize(3, 0);
+                for (uint32_t c = 0; c < 8; ++c) {
+                    uint8_t paletteIndex = 0;
+                    if (solidAt(origin + glm::uvec3(c & 1, (c >> 1) & 1, (c >> 2) & 1), paletteIndex)) {
+                        words[0] |= 1u << c;
+                        words[1 + c / 4] |= uint32_t(paletteIndex) << ((c % 4) * 8);
+                    }
+                }
+            } else {
+                for (uint32_t c = 0; c < 8; ++c) {
+                    uint32_t child = build(level - 1, origin + half * glm::uvec3(c & 1, (c >> 1) & 1, (c >> 2) & 1));
+                    if (child != VoxelDag::emptyNode) {
+                        words[0] |= 1u << c;
+                        words.push_back(child);
+                    }
+                }
+            }
+
+            if (words[0] == 0) {
+                return VoxelDag::emptyNode;
+            }
+            return addNode(level, words);
+        }
+    };
+
+    struct DagTraversal {
+        VoxelDag const& dag;
+        glm::vec3 rayPos;
+        glm::vec3 rayDir;
+        glm::vec3 invRayDir;
+        // Children visited in order c ^ mirror are front to back for this ray
+        uint32_t mirror;
+
+        bool traceNode(uint32_t node, uint32_t level, glm::vec3 origin, float tMin, float tMax, DagHit& hit) const {
+            uint32_t mask = dag.nodes[node];
+            float half = float(1u << (level - 1));
+
+            for (uint32_t i = 0; i < 8; ++i) {
+                uint32_t c = i ^ mirror;
+                if (!(mask & (1u << c))) {
+                    continue;
+                }
+
+                glm::vec3 childMin = origin + half * glm::vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+                glm::vec3 t1 = (childMin - rayPos) * invRayDir;
+                glm::vec3 t2 = (childMin + half - rayPos) * invRayDir;
+                glm::vec3 tNear = glm::min(t1, t2);
+                glm::vec3 tFar = glm::max(t1, t2);
+
+                float entry = std::max(std::max(tNear.x, tNear.y), tNear.z);
+                float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+                float childMinT = std::max(entry, tMin);
+                float childMaxT = std::min(exit, tMax);
+                if (childMinT > childMaxT) {
+                    continue;
+                }
+
+                if (level > 1) {
+                    uint32_t child = dag.nodes[node + 1 + std::popcount(mask & ((1u << c) - 1))];
+                    if (traceNode(child, level - 1, childMin, childMinT, childMaxT, hit)) {
+                        return true;
+                    }
+                    continue;
+                }
+
+                int axis = tNear.x >= tNear.y ? (tNear.x >= tNear.z ? 0 : 2) : (tNear.y >= tNear.z ? 1 : 2);
+                hit.hit = true;
+                hit.voxel = glm::uvec3(childMin);
+                hit.normal = glm::vec3(0);
+                hit.normal[axis] = rayDir[axis] > 0 ? -1.0f : 1.0f;
+                hit.dist = childMinT;
+                hit.paletteIndex = uint8_t(dag.nodes[node + 1 + c / 4] >> ((c % 4) * 8));
+                return true;
+            }
+
+            return false;
+        }
+    };
+
+    // Whether the node of 2^level voxels per side holding voxel is empty
+    bool dagCellEmpty(VoxelDag const& dag, glm::uvec3 voxel, uint32_t level) {
+        uint32_t node = dag.root;
+        for (uint32_t nodeLevel = dag.levels; nodeLevel > level && node != VoxelDag::emptyNode; --nodeLevel) {
+            uint32_t mask = dag.nodes[node];
+            uint32_t c = 0;
+            for (int axis = 0; axis < 3; ++axis) {
+                c |= ((voxel[axis] >> (nodeLevel - 1)) & 1u) << axis;
+            }
+            if (!(mask & (1u << c))) {
+                return true;
+            }
+            if (nodeLevel == 1) {
+                return false;
+            }
+            node = dag.nodes[node + 1 + std::popcount(mask & ((1u << c) - 1))];
+        }
+        return node == VoxelDag::emptyNode;
+    }
+
+    // Replays the DDA of CpuTracer up to the hit voxel, with the DAG standing
+    // in for the occupancy pyramid, and returns whether it gets there within
+    // limit.maxSteps steps
+    bool ddaReaches(VoxelDag const& dag, glm::vec3 rayPos, glm::vec3 rayDir, glm::ivec3 target,
+                    DagStepLimit const& limit) {
+        constexpr uint32_t brickLevel = std::countr_zero(brickSize);
+        constexpr uint32_t coarseLevel = std::countr_zero(coarseCellSize);
+
+        DDA dda;
+        initDDA(dda, rayPos, rayDir);
+        bool check = limit.checksStart;
+        for (int steps = 0;; ++steps) {
+            glm::ivec3 voxel{dda.pos};
+            glm::ivec3 remaining = glm::abs(target - voxel);
+            // Each step moves at least one voxel closer
+            if (int64_t(steps) + remaining.x + remaining.y + remaining.z <= limit.maxSteps) {
+                return true;
+            }
+            if (steps == limit.maxSteps) {
+                return false;
+            }
+
+            bool inside = glm::all(glm::greaterThanEqual(voxel, glm::ivec3(0))) &&
+                          glm::all(glm::lessThan(voxel, glm::ivec3(dag.size)));
+            if (check && inside) {
+                if (dagCellEmpty(dag, glm::uvec3(voxel), coarseLevel)) {
+                    advanceThroughCell(dda, float(coarseCellSize));
+                } else if (dagCellEmpty(dag, glm::uvec3(voxel), brickLevel)) {
+                    advanceThroughCell(dda, float(brickSize));
+                }
+            }
+            check = true;
+            iterDDA(dda);
+        }
+    }
+}
+
+VoxelDag buildVoxelDag(Model const& model, DagBuildStats* stats) {
+    TRACE_SCOPE("buildVoxelDag");
+    auto start = std::chrono::steady_clock::now();
+
+    VoxelDag dag;
+    dag.size = model.size;
+    uint32_t maxExtent = std::max(std::max(model.size.x, model.size.y), std::max(model.size.z, 2u));
+    dag.levels = uint32_t(std::bit_width(maxExtent - 1));
+
+    DagBuildStats localStats;
+    DagBuilder builder{model, dag, stats ? *stats : localStats, {}};
+    builder.uniqueNodes.resize(dag.levels + 1);
+    dag.root = builder.build(dag.levels, glm::uvec3(0));
+    dag.nodes.shrink_to_fit();
+
+    if (stats) {
+        stats->uniqueNodes = 0;
+        for (auto const& levelNodes : builder.uniqueNodes) {
+            stats->uniqueNodes += levelNodes.size();
+        }
+        stats->buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    return dag;
+}
+
+size_t denseModelBytes(Model const& model) {
+    return model.indices.size() * sizeof(uint8_t) + model.solid.size() * sizeof(uint8_t);
+}
+
+DagHit traceDag(VoxelDag const& dag, glm::vec3 rayPos, glm::vec3 rayDir, float tMin, float tMax,
+                DagStepLimit const& limit) {
+    DagHit hit;
+    if (dag.root == VoxelDag::emptyNode) {
+        return hit;
+    }
+
+    glm::vec3 invRayDir;
+    for (int axis = 0; axis < 3; ++axis) {
+        // Keep the slab test free of 0 * inf
+        float dir = rayDir[axis] != 0 ? rayDir[axis] : 1e-20f;
+        invRayDir[axis] = 1.0f / dir;
+    }
+
+    uint32_t mirror = (rayDir.x < 0 ? 1u : 0u) | (rayDir.y < 0 ? 2u : 0u) | (rayDir.z < 0 ? 4u : 0u);
+    DagTraversal traversal{dag, rayPos, rayDir, invRayDir, mirror};
+
+    float rootSide = float(1u << dag.levels);
+    glm::vec3 t1 = -rayPos * invRayDir;
+    glm::vec3 t2 = (glm::vec3(rootSide) - rayPos) * invRayDir;
+    glm::vec3 tNear = glm::min(t1, t2);
+    glm::vec3 tFar = glm::max(t1, t2);
+    tMin = std::max(tMin, std::max(std::max(tNear.x, tNear.y), tNear.z));
+    tMax = std::min(tMax, std::min(std::min(tFar.x, tFar.y), tFar.z));
+
+    if (tMin <= tMax) {
+        traversal.traceNode(dag.root, dag.levels, glm::vec3(0), tMin, tMax, hit);
+    }
+
+    // The hit is the first voxel on the ray, if it is out of reach so is
+    // everything behind it. A DDA steps once per voxel it crosses, unless it
+    // skips empty cells, then only a replay tells how far it gets.
+    if (hit.hit) {
+        glm::ivec3 steps = glm::abs(glm::ivec3(hit.voxel) - glm::ivec3(glm::floor(rayPos)));
+        if (int64_t(steps.x) + steps.y + steps.z > limit.maxSteps &&
+            (!limit.skipEmptyCells || !ddaReaches(dag, rayPos, rayDir, glm::ivec3(hit.voxel), limit))) {
+            hit = {};
+        }
+    }
+    return hit;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+struct Model;
+
+// Sparse voxel octree with identical subtrees merged into one node (a DAG).
+// The root covers 2^levels voxels per axis, anchored at the map origin.
+//
+// Nodes live in one flat word array:
+//   inner node: [childMask] [offset of child]... one offset per set mask bit
+//   leaf node (2^3 voxels): [childMask] [palette indices 0-3] [palette indices 4-7]
+// Child c sits at origin + half * (c & 1, (c >> 1) & 1, (c >> 2) & 1).
+struct VoxelDag {
+    static constexpr uint32_t emptyNode = ~0u;
+
+    uint32_t levels = 0;
+    glm::uvec3 size{0};
+    uint32_t root = emptyNode;
+    std::vector<uint32_t> nodes;
+
+    size_t sizeBytes() const { return nodes.size() * sizeof(uint32_t); }
+};
+
+struct DagBuildStats {
+    // Nodes the plain octree would have had, and what is left after merging
+    size_t octreeNodes = 0;
+    size_t uniqueNodes = 0;
+    double buildMs = 0;
+};
+
+VoxelDag buildVoxelDag(Model const& model, DagBuildStats* stats = nullptr);
+
+// Bytes of the dense indices/solid arrays the DAG replaces
+size_t denseModelBytes(Model const& model);
+
+struct DagHit {
+    bool hit = false;
+    glm::uvec3 voxel{0};
+    glm::vec3 normal{0};
+    // Ray parameter where the ray enters the voxel
+    float dist = 0;
+    uint8_t paletteIndex = 0;
+};
+
+// How far traceDag reaches, counted like the dense DDA in CpuTracer counts
+// its steps
+struct DagStepLimit {
+    int maxSteps = INT_MAX;
+    // An empty brick or coarse cell the ray crosses is a single step, as with
+    // RenderSettings::enableEmptySpaceSkipping
+    bool skipEmptyCells = false;
+    // Whether the voxel holding rayPos is checked, and so skipped, before the
+    // first step. Shadow rays step first.
+    bool checksStart = true;
+};
+
+// Closest voxel along rayPos + t * rayDir for t in [tMin, tMax], visiting the
+// DAG front to back without expanding it. Like a DDA that gives up after
+// limit.maxSteps steps, a hit the DDA would not reach in time is a miss.
+DagHit traceDag(VoxelDag const& dag, glm::vec3 rayPos, glm::vec3 rayDir, float tMin = 0, float tMax = INFINITY,
+                DagStepLimit const& limit = {});
@@ -0,0 +1,223 @@
+#include "VoxelEdit.h"
+
+#include <algorithm>
+
+#include <glm/common.hpp>
+#include <glm/vector_relational.hpp>
+
+#include "Model.h"
+#include "../util/Trace.h"
+
+void DirtyRanges::add(size_t begin, size_t end) {
+    if (begin >= end) {
+        return;
+    }
+
+    // Edits mostly walk the arrays in order, extend the last range in place
+    if (m_coalesced && !m_ranges.empty()) {
+        ByteRange& last = m_ranges.back();
+        if (begin >= last.begin && begin <= last.end + m_mergeGap) {
+            last.end = std::max(last.end, end);
+            return;
+        }
+        m_coalesced = begin > last.end + m_mergeGap;
+    }
+    m_ranges.push_back({begin, end});
+}
+
+std::vector<ByteRange> const& DirtyRanges::ranges() const {
+    if (!m_coalesced) {
+        coalesce();
+    }
+    return m_ranges;
+}
+
+size_t DirtyRanges::bytes() const {
+    size_t total = 0;
+    for (ByteRange range : ranges()) {
+        total += range.end - range.begin;
+    }
+    return total;
+}
+
+void DirtyRanges::coalesce() const {
+    std::sort(m_ranges.begin(), m_ranges.end(), [](ByteRange a, ByteRange b) {
+        return a.begin < b.begin;
+    });
+
+    size_t merged = 0;
+    for (size_t i = 1; i < m_ranges.size(); ++i) {
+        if (m_ranges[i].begin <= m_ranges[merged].end + m_mergeGap) {
+            m_ranges[merged].end = std::max(m_ranges[merged].end, m_ranges[i].end);
+        } else {
+            m_ranges[++merged] = m_ranges[i];
+        }
+    }
+    m_ranges.resize(merged + 1);
+    m_coalesced = true;
+}
+
+VoxelEditor::VoxelEditor(Model& model, size_t mergeGap)
+        : m_model(model), m_edits(mergeGap) {
+}
+
+void VoxelEditor::setVoxel(glm::uvec3 voxel, uint8_t paletteIndex) {
+    writeBox(voxel, voxel + 1u, paletteIndex, true);
+}
+
+void VoxelEditor::clearVoxel(glm::uvec3 voxel) {
+    writeBox(voxel, voxel + 1u, 0, false);
+}
+
+void VoxelEditor::fillBox(glm::uvec3 min, glm::uvec3 max, uint8_t paletteIndex) {
+    writeBox(min, max, paletteIndex, true);
+}
+
+void VoxelEditor::clearBox(glm::uvec3 min, glm::uvec3 max) {
+    writeBox(min, max, 0, false);
+}
+
+void VoxelEditor::setPaletteColor(uint8_t index, uint32_t color) {
+    uint32_t previousColor = m_model.palette[index];
+    m_model.palette[index] = color;
+    m_edits.palette.add(index * sizeof(uint32_t), (index + 1) * sizeof(uint32_t));
+    if (m_model.materials[index].emission > 0) {
+        updateLightPowers(m_model.lights, m_model, index, previousColor);
+        m_edits.lights = true;
+    }
+}
+
+void VoxelEditor::writeBox(glm::uvec3 min, glm::uvec3 max, uint8_t paletteIndex, bool isSolid) {
+    max = glm::min(max, m_model.size);
+    if (glm::any(glm::greaterThanEqual(min, max))) {
+        return;
+    }
+
+    TRACE_SCOPE("editVoxels");
+    for (uint32_t z = min.z; z < max.z; ++z) {
+        for (uint32_t y = min.y; y < max.y; ++y) {
+            for (uint32_t x = min.x; x < max.x; ++x) {
+                m_model.setVoxel({x, y, z}, paletteIndex, isSolid);
+            }
+        }
+    }
+
+    markVoxels(min, max);
+    refitOccupancy(min, max);
+    refreshLights(min, max);
+}
+
+void VoxelEditor::refreshLights(glm::uvec3 min, glm::uvec3 max) {
+    // Light powers depend on the neighbors of an emissive voxel, so the
+    // lights next to the box may change too
+    bool hasEmissive = std::any_of(m_model.materials.begin(), m_model.materials.end(),
+                                   [](PaletteMaterial const& material) { return material.emission > 0; });
+    if (hasEmissive) {
+        updateLightList(m_model.lights, m_model, min, max);
+        m_edits.lights = true;
+    }
+}
+
+void VoxelEditor::markVoxels(glm::uvec3 min, glm::uvec3 max) {
+    m_edits.voxelsMin = glm::min(m_edits.voxelsMin, min);
+    m_edits.voxelsMax = glm::max(m_edits.voxelsMax, max);
+
+    if (m_model.layout == VoxelLayout::Linear) {
+        // One range per row of the box, rows of a thin box merge
+        for (uint32_t z = min.z; z < max.z; ++z) {
+            for (uint32_t y = min.y; y < max.y; ++y) {
+                size_t begin = m_model.voxelOffset({min.x, y, z});
+                size_t end = begin + (max.x - min.x);
+                m_edits.indices.add(begin, end);
+                m_edits.solid.add(begin, end);
+            }
+        }
+        return;
+    }
+
+    // Whole bricks, one range per row of bricks
+    glm::uvec3 firstBrick = min / brickSize;
+    glm::uvec3 lastBrick = (max - 1u) / brickSize;
+    for (uint32_t z = firstBrick.z; z <= lastBrick.z; ++z) {
+        for (uint32_t y = firstBrick.y; y <= lastBrick.y; ++y) {
+            size_t begin = m_model.voxelOffset(glm::uvec3(firstBrick.x, y, z) * brickSize) / 64;
+            size_t end = m_model.voxelOffset(glm::uvec3(lastBrick.x, y, z) * brickSize) / 64 + 1;
+            m_edits.indices.add(begin * 64, end * 64);
+            m_edits.solid.add(begin * 8, end * 8);
+        }
+    }
+}
+
+static bool brickHasSolid(Model const& model, glm::uvec3 brick) {
+    glm::uvec3 origin = brick * brickSize;
+    if (model.layout == VoxelLayout::Bricked) {
+        size_t offset = model.voxelOffset(origin) >> 3;
+        return std::any_of(model.solid.begin() + offset, model.solid.begin() + offset + 8, [](uint8_t bits) {
+            return bits != 0;
+        });
+    }
+
+    glm::uvec3 end = glm::min(origin + brickSize, model.size);
+    for (uint32_t z = origin.z; z < end.z; ++z) {
+        for (uint32_t y = origin.y; y < end.y; ++y) {
+            for (uint32_t x = origin.x; x < end.x; ++x) {
+                if (model.isSolid({x, y, z})) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Sets or clears the bit of a cell, marking its word dirty if it changed
+static void assignCell(OccupancyLevel& level, glm::uvec3 cell, bool occupied, DirtyRanges& dirty) {
+    if (level.occupied(cell) == occupied) {
+        return;
+    }
+
+    if (occupied) {
+        level.set(cell);
+    } else {
+        level.clear(cell);
+    }
+    size_t word = level.cellIndex(cell) >> 5;
+    dirty.add(word * sizeof(uint32_t), (word + 1) * sizeof(uint32_t));
+}
+
+void VoxelEditor::refitOccupancy(glm::uvec3 min, glm::uvec3 max) {
+    OccupancyPyramid& occupancy = m_model.occupancy;
+
+    glm::uvec3 firstBrick = min / brickSize;
+    glm::uvec3 lastBrick = (max - 1u) / brickSize;
+    for (uint32_t z = firstBrick.z; z <= lastBrick.z; ++z) {
+        for (uint32_t y = firstBrick.y; y <= lastBrick.y; ++y) {
+            for (uint32_t x = firstBrick.x; x <= lastBrick.x; ++x) {
+                assignCell(occupancy.bricks, {x, y, z}, brickHasSolid(m_model, {x, y, z}), m_edits.brickOccupancy);
+            }
+        }
+    }
+
+    // Coarse cells are refit from their bricks, not their voxels
+    uint32_t bricksPerCell = coarseCellSize / brickSize;
+    glm::uvec3 firstCell = min / coarseCellSize;
+    glm::uvec3 lastCell = (max - 1u) / coarseCellSize;
+    for (uint32_t z = firstCell.z; z <= lastCell.z; ++z) {
+        for (uint32_t y = firstCell.y; y <= lastCell.y; ++y) {
+            for (uint32_t x = firstCell.x; x <= lastCell.x; ++x) {
+                glm::uvec3 cellBricks = glm::uvec3(x, y, z) * bricksPerCell;
+                glm::uvec3 end = glm::min(cellBricks + bricksPerCell, occupancy.bricks.size);
+
+                bool occupied = false;
+                for (uint32_t bz = cellBricks.z; bz < end.z && !occupied; ++bz) {
+                    for (uint32_t by = cellBricks.y; by < end.y && !occupied; ++by) {
+                        for (uint32_t bx = cellBricks.x; bx < end.x && !occupied; ++bx) {
+                            occupied = occupancy.bricks.occupied({bx, by, bz});
+                        }
+                    }
+                }
+                assignCell(occupancy.coarse, {x, y, z}, occupied, m_edits.coarseOccupancy);
+            }
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+struct Model;
+
+// Half open range [begin, end) of bytes
+struct ByteRange {
+    size_t begin = 0;
+    size_t end = 0;
+};
+
+// The bytes of one array that changed since it was last uploaded, coalesced
+// into few ranges. Ranges at most mergeGap bytes apart are merged, as one
+// upload of a few unchanged bytes is cheaper than an extra upload call.
+class DirtyRanges {
+public:
+    explicit DirtyRanges(size_t mergeGap = 0) : m_mergeGap(mergeGap) {}
+
+    void add(size_t begin, size_t end);
+
+    // Sorted and more than mergeGap bytes apart
+    std::vector<ByteRange> const& ranges() const;
+
+    // Total size of the ranges
+    size_t bytes() const;
+
+    bool empty() const { return m_ranges.empty(); }
+    void clear() { m_ranges.clear(); m_coalesced = true; }
+
+private:
+    void coalesce() const;
+
+    size_t m_mergeGap;
+    mutable std::vector<ByteRange> m_ranges;
+    mutable bool m_coalesced = true;
+};
+
+// What changed in each array of a Model, in bytes of the array as uploaded
+struct ModelEdits {
+    explicit ModelEdits(size_t mergeGap = 0)
+            : indices(mergeGap), solid(mergeGap), palette(mergeGap),
+              brickOccupancy(mergeGap), coarseOccupancy(mergeGap) {}
+
+    bool empty() const {
+        return indices.empty() && solid.empty() && palette.empty() &&
+               brickOccupancy.empty() && coarseOccupancy.empty() && !lights;
+    }
+
+    void clear() {
+        indices.clear();
+        solid.clear();
+        palette.clear();
+        brickOccupancy.clear();
+        coarseOccupancy.clear();
+        lights = false;
+        voxelsMin = glm::uvec3(UINT32_MAX);
+        voxelsMax = glm::uvec3(0);
+    }
+
+    DirtyRanges indices;
+    DirtyRanges solid;
+    DirtyRanges palette;
+    DirtyRanges brickOccupancy;
+    DirtyRanges coarseOccupancy;
+    // Model::lights changed and has to be uploaded as a whole, every
+    // edit rebuilds its alias table
+    bool lights = false;
+    // Bounds [voxelsMin, voxelsMax) of the voxels written, for caches
+    // derived from the voxels, voxelsMin > voxelsMax if none were
+    glm::uvec3 voxelsMin{UINT32_MAX};
+    glm::uvec3 voxelsMax{0};
+};
+
+// Edits a loaded model in place. Only the bricks and coarse cells of the
+// occupancy pyramid that overlap an edit are refit, so an edit costs time
+// in proportion to its size rather than to the size of the map, and the
+// changed bytes are collected in edits() for the caller to upload and clear.
+// Models with emissive materials update the lights in and next to an edit.
+// A VoxelDag built from the model is not updated.
+class VoxelEditor {
+public:
+    explicit VoxelEditor(Model& model, size_t mergeGap = 256);
+
+    void setVoxel(glm::uvec3 voxel, uint8_t paletteIndex);
+    void clearVoxel(glm::uvec3 voxel);
+
+    // Boxes span [min, max) and are clipped to the map. In the bricked
+    // layout palette index 0 clears, like Model::setVoxel.
+    void fillBox(glm::uvec3 min, glm::uvec3 max, uint8_t paletteIndex);
+    void clearBox(glm::uvec3 min, glm::uvec3 max);
+
+    void setPaletteColor(uint8_t index, uint32_t color);
+
+    ModelEdits& edits() { return m_edits; }
+    Model const& model() const { return m_model; }
+
+private:
+    void writeBox(glm::uvec3 min, glm::uvec3 max, uint8_t paletteIndex, bool isSolid);
+    void markVoxels(glm::uvec3 min, glm::uvec3 max);
+    void refitOccupancy(glm::uvec3 min, glm::uvec3 max);
+    void refreshLights(glm::uvec3 min, glm::uvec3 max);
+
+    Model& m_model;
+    ModelEdits m_edits;
+};
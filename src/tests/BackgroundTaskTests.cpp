@@ -0,0 +1,63 @@
+#include "Test.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include "../util/BackgroundTask.h"
+#include "../util/ThreadPool.h"
+
+TEST(backgroundTaskPollsOncePerTask) {
+    ThreadPool pool(2);
+    BackgroundTask task(pool);
+    CHECK(!task.running());
+    CHECK(!task.poll());
+
+    std::atomic<bool> release{false};
+    std::atomic<int> runs{0};
+    task.start([&] {
+        while (!release) {
+            std::this_thread::yield();
+        }
+        ++runs;
+    });
+    CHECK(task.running());
+    CHECK(!task.poll());
+
+    release = true;
+    while (!task.poll()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(!task.running());
+    CHECK(!task.poll());
+    CHECK_EQ(runs.load(), 1);
+
+    task.start([&] { ++runs; });
+    CHECK_THROWS(task.start([] {}), std::runtime_error);
+    CHECK(task.wait());
+    CHECK(!task.wait());
+    CHECK_EQ(runs.load(), 2);
+}
+
+TEST(backgroundTaskRethrows) {
+    ThreadPool pool(1);
+    BackgroundTask task(pool);
+    task.start([] { throw std::runtime_error("failed"); });
+    CHECK_THROWS(task.wait(), std::runtime_error);
+    CHECK(!task.running());
+
+    // The pool does not see the error
+    pool.wait();
+    task.start([] {});
+    CHECK(task.wait());
+}
+
+TEST(backgroundTaskUsesNestedParallelFor) {
+    ThreadPool pool(2);
+    BackgroundTask task(pool);
+    std::atomic<int> total{0};
+    task.start([&] { pool.parallelFor(64, [&](size_t) { ++total; }); });
+    CHECK(task.wait());
+    CHECK_EQ(total.load(), 64);
+}
@@ -0,0 +1,46 @@
+#include "Test.h"
+
+#include <stdexcept>
+
+#include "../rendering/BakedScene.h"
+
+namespace {
+    // Writes model with dag and loads it again
+    BakedScene roundTrip(TemporaryDirectory const& directory, Model const& model, VoxelDag const& dag) {
+        std::string filename = (directory.path() / "scene.vxc").string();
+        writeBakedScene(filename, model, &dag);
+        return loadBakedScene(filename);
+    }
+}
+
+TEST(bakedSceneKeepsTheDag) {
+    TemporaryDirectory directory;
+    Model model = loadVoxModel("assets/vox/menger.vox");
+    VoxelDag dag = buildVoxelDag(model);
+
+    BakedScene scene = roundTrip(directory, model, dag);
+    REQUIRE(scene.hasDag);
+    CHECK_EQ(scene.dag.root, dag.root);
+    CHECK(scene.dag.nodes == dag.nodes);
+}
+
+TEST(bakedSceneRejectsBadDagNodes) {
+    TemporaryDirectory directory;
+    Model model = loadVoxModel("assets/vox/menger.vox");
+    VoxelDag dag = buildVoxelDag(model);
+    REQUIRE(dag.root != VoxelDag::emptyNode && dag.levels > 1);
+
+    // The checksum is written for the broken words, only the walk over the
+    // nodes can tell
+    VoxelDag outOfRange = dag;
+    outOfRange.nodes[outOfRange.root + 1] = uint32_t(outOfRange.nodes.size() + 5);
+    CHECK_THROWS(roundTrip(directory, model, outOfRange), std::runtime_error);
+
+    VoxelDag cycle = dag;
+    cycle.nodes[cycle.root + 1] = cycle.root;
+    CHECK_THROWS(roundTrip(directory, model, cycle), std::runtime_error);
+
+    VoxelDag badMask = dag;
+    badMask.nodes[badMask.root] = 0;
+    CHECK_THROWS(roundTrip(directory, model, badMask), std::runtime_error);
+}
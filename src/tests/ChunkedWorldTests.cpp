@@ -0,0 +1,113 @@
+#include "Test.h"
+
+#include <mutex>
+#include <set>
+#include <tuple>
+
+#include "../rendering/Camera.h"
+#include "../rendering/ChunkedWorld.h"
+#include "../rendering/CpuTracer.h"
+#include "../rendering/Model.h"
+#include "../util/ThreadPool.h"
+
+namespace {
+    // Records how often each chunk was loaded
+    class CountingSource : public TiledModelSource {
+    public:
+        CountingSource(Model const& model, glm::uvec3 tiles, std::multiset<std::tuple<int, int, int>>& loaded)
+                : TiledModelSource(model, tiles), m_loaded(loaded) {}
+
+        void loadChunk(glm::ivec3 coord, Chunk& chunk) const override {
+            TiledModelSource::loadChunk(coord, chunk);
+            m_loaded.emplace(coord.x, coord.y, coord.z);
+        }
+
+    private:
+        std::multiset<std::tuple<int, int, int>>& m_loaded;
+    };
+
+    // Loads and evictions of each of numFrames frames rendered from a camera
+    // that does not move
+    struct FrameCounts {
+        std::vector<uint64_t> loads;
+        std::vector<uint64_t> evictions;
+    };
+
+    FrameCounts renderStill(Model const& model, size_t budgetBytes, int numFrames) {
+        ThreadPool pool;
+        ChunkedWorld world(std::make_unique<TiledModelSource>(model, glm::uvec3(8, 1, 8)), budgetBytes);
+        glm::vec3 worldSize{world.size()};
+        glm::vec3 position = glm::vec3(0.5f, 1.5f, 0.5f) * worldSize;
+        Camera camera{position, position + glm::vec3(1, -1, 1) * float(model.size.y), 96, 54};
+
+        RenderSettings settings;
+        settings.enableRayRandomization = false;
+        FrameCounts counts;
+        ChunkCacheStats previous;
+        for (int frame = 0; frame < numFrames; ++frame) {
+            world.update(position, 256);
+            world.waitForLoads();
+            std::shared_ptr<ChunkResidency const> residency = world.beginFrame();
+            CpuTracer tracer(model, settings);
+            tracer.m_world = residency.get();
+            tracer.render(camera, 96, 54, pool);
+
+            ChunkCacheStats stats = world.stats();
+            CHECK(stats.residentBytes <= stats.budgetBytes);
+            counts.loads.push_back(stats.loads - previous.loads);
+            counts.evictions.push_back(stats.evictions - previous.evictions);
+            previous = stats;
+        }
+        return counts;
+    }
+}
+
+TEST(chunkedWorldStillCameraStopsLoading) {
+    Model model = loadVoxModel("assets/vox/monu1.vox");
+    // Budgets that hold a part of the chunks around the camera, and all of
+    // them
+    for (size_t budgetMiB : {8, 16, 64}) {
+        FrameCounts counts = renderStill(model, budgetMiB << 20, 6);
+        CHECK(counts.loads.front() > 0);
+        // Chunks are sized once loaded, the wanted set may grow once
+        for (size_t frame = 2; frame < counts.loads.size(); ++frame) {
+            CHECK_EQ(counts.loads[frame], uint64_t(0));
+            CHECK_EQ(counts.evictions[frame], uint64_t(0));
+        }
+    }
+}
+
+TEST(chunkedWorldFlightRarelyReloads) {
+    Model model = loadVoxModel("assets/vox/monu1.vox");
+    ThreadPool pool;
+    RenderSettings settings;
+    settings.enableRayRandomization = false;
+
+    for (size_t budgetMiB : {8, 16}) {
+        // Loaded from the loader thread, read here after waitForLoads
+        std::multiset<std::tuple<int, int, int>> loaded;
+        ChunkedWorld world(std::make_unique<CountingSource>(model, glm::uvec3(8, 1, 8), loaded), budgetMiB << 20);
+        glm::vec3 worldSize{world.size()};
+
+        // Straight ahead, so a chunk that gets out of the radius stays out
+        for (int frame = 0; frame < 40; ++frame) {
+            glm::vec3 position = glm::vec3(0.1f + 0.02f * float(frame), 1.5f, 0.1f + 0.02f * float(frame)) * worldSize;
+            Camera camera{position, position + glm::vec3(1, -1, 1) * float(model.size.y), 96, 54};
+            world.update(position, 256);
+            world.waitForLoads();
+            std::shared_ptr<ChunkResidency const> residency = world.beginFrame();
+            CpuTracer tracer(model, settings);
+            tracer.m_world = residency.get();
+            tracer.render(camera, 96, 54, pool);
+        }
+
+        int reloads = 0;
+        for (auto it = loaded.begin(); it != loaded.end(); it = loaded.upper_bound(*it)) {
+            reloads += int(loaded.count(*it)) - 1;
+        }
+        // Chunks at the edge of the wanted set may drop out of it as others
+        // come closer and back in later, everything else is loaded once.
+        // Evicting the wanted chunks no ray entered reloaded 138 at 16 MiB.
+        CHECK(reloads * 20 < int(loaded.size()));
+    }
+}
@@ -0,0 +1,100 @@
+#include "Test.h"
+
+#include <random>
+
+#include <glm/geometric.hpp>
+
+#include "../rendering/CpuTracer.h"
+#include "../rendering/Model.h"
+#include "../rendering/VoxelDag.h"
+
+namespace {
+    // Rays from around the map towards points inside it, in general
+    // directions so that no ray runs along voxel edges
+    struct TestRay {
+        glm::vec3 position;
+        glm::vec3 direction;
+    };
+
+    std::vector<TestRay> testRays(Model const& model, int count) {
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> unit(0, 1);
+        glm::vec3 size{model.size};
+        std::vector<TestRay> rays;
+        for (int i = 0; i < count; ++i) {
+            glm::vec3 from = (glm::vec3(unit(random), unit(random), unit(random)) * 3.0f - 1.0f) * size;
+            glm::vec3 to = glm::vec3(unit(random), unit(random), unit(random)) * size;
+            rays.push_back({from, glm::normalize(to - from)});
+        }
+        return rays;
+    }
+
+    // Traces rays through the dense arrays and the DAG and counts the rays
+    // whose hit differs
+    int countMismatches(Model const& model, VoxelDag const& dag, RenderSettings const& settings, int& hits) {
+        CpuTracer dense(model, settings);
+        CpuTracer viaDag(model, settings);
+        viaDag.m_dag = &dag;
+
+        int mismatches = 0;
+        hits = 0;
+        for (TestRay ray : testRays(model, 4000)) {
+            glm::vec3 position = ray.position;
+            if (!dense.enterVoxelBox(position, ray.direction)) {
+                continue;
+            }
+            VoxelHit a = dense.traceVoxel(position, ray.direction);
+            VoxelHit b = viaDag.traceVoxel(position, ray.direction);
+            hits += a.hit;
+            if (a.hit != b.hit || (a.hit && glm::distance(a.position, b.position) > 1e-3f)) {
+                ++mismatches;
+            }
+        }
+        return mismatches;
+    }
+}
+
+TEST(dagTraceMatchesDense) {
+    Model model = loadVoxModel("assets/vox/menger.vox");
+    VoxelDag dag = buildVoxelDag(model);
+
+    RenderSettings settings;
+    settings.enableEmptySpaceSkipping = false;
+    int hits = 0;
+    CHECK_EQ(countMismatches(model, dag, settings, hits), 0);
+    CHECK(hits > 1000);
+}
+
+TEST(dagTraceHonoursMaxDDADepth) {
+    Model model = loadVoxModel("assets/vox/menger.vox");
+    VoxelDag dag = buildVoxelDag(model);
+
+    // Short enough that many rays give up inside the sponge
+    RenderSettings settings;
+    settings.enableEmptySpaceSkipping = false;
+    settings.maxDDADepth = 12;
+    int limitedHits = 0;
+    CHECK_EQ(countMismatches(model, dag, settings, limitedHits), 0);
+
+    settings.maxDDADepth = 300;
+    int hits = 0;
+    countMismatches(model, dag, settings, hits);
+    CHECK(limitedHits < hits);
+}
+
+TEST(dagTraceHonoursMaxDDADepthWithSkipping) {
+    Model model = loadVoxModel("assets/vox/menger.vox");
+    VoxelDag dag = buildVoxelDag(model);
+
+    // The default settings skip empty cells, which reach further than the
+    // same number of single voxel steps
+    RenderSettings settings;
+    settings.maxDDADepth = 12;
+    int limitedHits = 0;
+    CHECK_EQ(countMismatches(model, dag, settings, limitedHits), 0);
+
+    settings.enableEmptySpaceSkipping = false;
+    int unskippedHits = 0;
+    countMismatches(model, dag, settings, unskippedHits);
+    CHECK(unskippedHits < limitedHits);
+}
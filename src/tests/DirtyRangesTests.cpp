@@ -0,0 +1,84 @@
+#include "Test.h"
+
+#include <utility>
+
+#include "../rendering/VoxelEdit.h"
+
+namespace {
+    bool rangesAre(DirtyRanges const& dirty, std::vector<std::pair<size_t, size_t>> const& expected) {
+        std::vector<ByteRange> const& ranges = dirty.ranges();
+        if (ranges.size() != expected.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            if (ranges[i].begin != expected[i].first || ranges[i].end != expected[i].second) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+TEST(dirtyRangesIgnoreEmptyRanges) {
+    DirtyRanges dirty;
+    dirty.add(10, 10);
+    dirty.add(20, 5);
+    CHECK(dirty.empty());
+    CHECK_EQ(dirty.bytes(), size_t(0));
+}
+
+TEST(dirtyRangesExtendInOrder) {
+    DirtyRanges dirty;
+    dirty.add(0, 4);
+    dirty.add(4, 8);
+    dirty.add(6, 12);
+    // Touching but not overlapping, with no gap allowed
+    dirty.add(12, 16);
+    dirty.add(20, 24);
+    CHECK(rangesAre(dirty, {{0, 16}, {20, 24}}));
+    CHECK_EQ(dirty.bytes(), size_t(20));
+}
+
+TEST(dirtyRangesMergeWithinGap) {
+    DirtyRanges dirty(8);
+    dirty.add(0, 4);
+    dirty.add(12, 16);
+    dirty.add(25, 30);
+    CHECK(rangesAre(dirty, {{0, 16}, {25, 30}}));
+    // The merged gap counts as dirty, it is uploaded
+    CHECK_EQ(dirty.bytes(), size_t(21));
+}
+
+TEST(dirtyRangesCoalesceOutOfOrder) {
+    DirtyRanges dirty;
+    dirty.add(100, 110);
+    dirty.add(0, 10);
+    dirty.add(50, 60);
+    dirty.add(5, 55);
+    dirty.add(200, 210);
+    dirty.add(105, 120);
+    CHECK(rangesAre(dirty, {{0, 60}, {100, 120}, {200, 210}}));
+
+    // Adding after coalescing keeps the ranges sorted
+    dirty.add(60, 100);
+    dirty.add(150, 160);
+    CHECK(rangesAre(dirty, {{0, 120}, {150, 160}, {200, 210}}));
+}
+
+TEST(dirtyRangesContainedRangeDoesNotShrink) {
+    DirtyRanges dirty;
+    dirty.add(0, 100);
+    dirty.add(10, 20);
+    CHECK(rangesAre(dirty, {{0, 100}}));
+}
+
+TEST(dirtyRangesClear) {
+    DirtyRanges dirty;
+    dirty.add(50, 60);
+    dirty.add(0, 10);
+    dirty.clear();
+    CHECK(dirty.empty());
+    dirty.add(30, 40);
+    dirty.add(40, 45);
+    CHECK(rangesAre(dirty, {{30, 45}}));
+}
@@ -0,0 +1,120 @@
+#include "Test.h"
+
+#include "../rendering/RenderJob.h"
+#include "../util/ThreadPool.h"
+
+namespace {
+    RenderJob smallJob() {
+        RenderJob job;
+        job.scenePath = "assets/vox/menger.vox";
+        job.width = 160;
+        job.height = 90;
+        return job;
+    }
+
+    bool sameImage(Image const& a, Image const& b) {
+        return a.width == b.width && a.height == b.height && a.pixels == b.pixels;
+    }
+}
+
+TEST(preparationKeySeparatesBakes) {
+    RenderJob base = smallJob();
+    std::string key = preparationKey(base);
+
+    // Each of these changes what the sun bake holds
+    RenderJob job = base;
+    job.settings.maxDDADepth = 2;
+    CHECK(preparationKey(job) != key);
+    job = base;
+    job.settings.enableEmptySpaceSkipping = false;
+    CHECK(preparationKey(job) != key);
+    job = base;
+    job.settings.sunDir.x += 1;
+    CHECK(preparationKey(job) != key);
+    job = base;
+    job.useDag = true;
+    CHECK(preparationKey(job) != key);
+    job = base;
+    job.useSunCache = false;
+    CHECK(preparationKey(job) != key);
+    job = base;
+    job.scenePath = "assets/vox/monu1.vox";
+    CHECK(preparationKey(job) != key);
+    job = base;
+    job.layout = VoxelLayout::Bricked;
+    CHECK(preparationKey(job) != key);
+
+    // And these only what is rendered with it
+    job = base;
+    job.settings.numSamples = 16;
+    job.settings.numRayBounces = 1;
+    job.width = 64;
+    job.cameraPosition = glm::vec3(1, 2, 3);
+    job.denoise = true;
+    CHECK_EQ(preparationKey(job), key);
+}
+
+TEST(preparationKeyIgnoresSettingsOfSkippedBakes) {
+    // No shadows, no sun bake that would depend on the sun or the depth
+    RenderJob base = smallJob();
+    base.settings.enableShadows = false;
+    RenderJob job = base;
+    job.settings.sunDir = {1, 1, 1};
+    job.settings.maxDDADepth = 2;
+    job.settings.enableEmptySpaceSkipping = false;
+    CHECK_EQ(preparationKey(job), preparationKey(base));
+}
+
+TEST(preparationKeySeparatesIrradiance) {
+    RenderJob base = smallJob();
+    base.settings.enableGlobalIllumination = true;
+    base.irradiancePasses = 2;
+    std::string key = preparationKey(base);
+
+    RenderJob job = base;
+    job.irradiancePasses = 3;
+    CHECK(preparationKey(job) != key);
+    job = base;
+    job.settings.sunStrength = 2;
+    CHECK(preparationKey(job) != key);
+    job = base;
+    job.settings.enableLightSampling = false;
+    CHECK(preparationKey(job) != key);
+    // Shadows are traced without the sun cache as well
+    job = base;
+    job.useSunCache = false;
+    job.settings.maxDDADepth = 2;
+    RenderJob other = job;
+    other.settings.maxDDADepth = 600;
+    CHECK(preparationKey(job) != preparationKey(other));
+}
+
+TEST(preparedRenderSharedByEqualKeys) {
+    ThreadPool pool;
+    RenderJob first = smallJob();
+    RenderJob second = first;
+    second.settings.numSamples = 2;
+    second.cameraPosition = glm::vec3(-60, 100, -40);
+    REQUIRE(preparationKey(first) == preparationKey(second));
+
+    PreparedRender shared(first, pool);
+    shared.setJob(second);
+    PreparedRender fresh(second, pool);
+    CHECK(sameImage(shared.tracer->render(shared.camera(), second.width, second.height, pool),
+                    fresh.tracer->render(fresh.camera(), second.width, second.height, pool)));
+}
+
+TEST(preparedRenderDepthChangesBake) {
+    // A job with a short depth followed by one with a long depth used to
+    // share the first one's bake
+    ThreadPool pool;
+    RenderJob shortJob = smallJob();
+    shortJob.settings.maxDDADepth = 2;
+    RenderJob longJob = smallJob();
+    longJob.settings.maxDDADepth = 600;
+
+    PreparedRender shortRender(shortJob, pool);
+    PreparedRender longRender(longJob, pool);
+    CHECK(shortRender.sunVisibility.bits != longRender.sunVisibility.bits);
+    CHECK(preparationKey(shortJob) != preparationKey(longJob));
+}
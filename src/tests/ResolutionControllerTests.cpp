@@ -0,0 +1,107 @@
+#include "Test.h"
+
+#include <cmath>
+
+#include "../rendering/ResolutionController.h"
+
+namespace {
+    // Feeds frames frame times of frameMs and returns the last scale
+    float run(ResolutionController& controller, int frames, float frameMs) {
+        float scale = controller.scale();
+        for (int i = 0; i < frames; ++i) {
+            scale = controller.update(frameMs);
+        }
+        return scale;
+    }
+
+    bool near(float a, float b) {
+        return std::abs(a - b) < 1e-4f;
+    }
+}
+
+TEST(resolutionStartsAtMaxScale) {
+    ResolutionControllerSettings settings;
+    settings.maxScale = 0.8f;
+    ResolutionController controller(settings);
+    CHECK_EQ(controller.scale(), 0.8f);
+    CHECK_EQ(controller.averageMs(), 0.0f);
+}
+
+TEST(resolutionWaitsForFramesToSettle) {
+    ResolutionController controller;
+    // The first frame pays for the resize and is not counted, the next
+    // settleFrames - 1 are only averaged
+    CHECK_EQ(run(controller, controller.settings().settleFrames, 40.0f), 1.0f);
+    CHECK_EQ(controller.averageMs(), 40.0f);
+    CHECK(controller.update(40.0f) < 1.0f);
+}
+
+TEST(resolutionHoldsWithinTolerance) {
+    ResolutionController controller;
+    // 10% around the 16.6 ms target
+    CHECK_EQ(run(controller, 100, 18.0f), 1.0f);
+    CHECK_EQ(run(controller, 100, 15.2f), 1.0f);
+
+    ResolutionControllerSettings settings;
+    settings.maxScale = 0.5f;
+    controller.setSettings(settings);
+    controller.reset();
+    CHECK_EQ(run(controller, 100, 18.0f), 0.5f);
+}
+
+TEST(resolutionShrinksAtOnce) {
+    ResolutionController controller;
+    // sqrt(16.6 / 40) = 0.644, rounded to the 0.05 step
+    CHECK(near(run(controller, 5, 40.0f), 0.65f));
+    // The average starts over at the new scale
+    CHECK_EQ(controller.averageMs(), 0.0f);
+}
+
+TEST(resolutionGrowsByAtMostMaxGrowth) {
+    ResolutionController controller;
+    run(controller, 5, 40.0f);
+    REQUIRE(near(controller.scale(), 0.65f));
+
+    // 5 ms frames would allow 0.65 * 1.8, but growth is limited
+    // to 10% per change: 0.715, rounded to the step
+    CHECK(near(run(controller, 5, 5.0f), 0.7f));
+    CHECK(near(run(controller, 5, 5.0f), 0.75f));
+}
+
+TEST(resolutionChangesAtLeastOneStep) {
+    ResolutionControllerSettings settings;
+    settings.tolerance = 0.02f;
+    ResolutionController controller(settings);
+    // 3.6% slow is outside the tolerance, but sqrt(16.6 / 17.2) = 0.982
+    // rounds back to 1.0
+    CHECK(near(run(controller, 5, 17.2f), 0.95f));
+}
+
+TEST(resolutionClampsToLimits) {
+    ResolutionController controller;
+    CHECK_EQ(run(controller, 5, 1000.0f), 0.25f);
+    CHECK_EQ(run(controller, 100, 1000.0f), 0.25f);
+    CHECK_EQ(run(controller, 1000, 1.0f), 1.0f);
+
+    ResolutionControllerSettings settings;
+    settings.minScale = 0.5f;
+    settings.maxScale = 0.75f;
+    controller.setSettings(settings);
+    CHECK_EQ(controller.scale(), 0.75f);
+    CHECK_EQ(run(controller, 100, 1000.0f), 0.5f);
+}
+
+TEST(resolutionResetStartsOver) {
+    ResolutionController controller;
+    run(controller, 5, 40.0f);
+    controller.reset();
+    CHECK_EQ(controller.scale(), 1.0f);
+    CHECK_EQ(controller.averageMs(), 0.0f);
+}
+
+TEST(resolutionScaledSizes) {
+    CHECK(scaledResolution({1920, 1080}, 0.5f) == glm::ivec2(960, 540));
+    CHECK(scaledResolution({3, 3}, 0.01f) == glm::ivec2(1, 1));
+    CHECK(workGroupCount({960, 540}, 8) == glm::ivec2(120, 68));
+    CHECK(workGroupCount({1, 1}, 8) == glm::ivec2(1, 1));
+}
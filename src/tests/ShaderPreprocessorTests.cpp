@@ -0,0 +1,90 @@
+#include "Test.h"
+
+#include "../rendering/ShaderPreprocessor.h"
+
+TEST(shaderIncludesExpandOnce) {
+    TemporaryDirectory directory;
+    std::string main = directory.write("main.glsl", "#version 450\n"
+                                                    "#include \"common.glsl\"\n"
+                                                    "#include \"lib/lighting.glsl\"\n"
+                                                    "void main() {}\n");
+    directory.write("common.glsl", "float common;\n");
+    // Back up to common.glsl, and a cycle back to the lighting file itself
+    directory.write("lib/lighting.glsl", "#include \"../common.glsl\"\n"
+                                         "#include \"lighting.glsl\"\n"
+                                         "float lighting;\n");
+
+    ShaderPreprocessor preprocessor;
+    ShaderSource source = preprocessor.preprocess(main);
+
+    REQUIRE(source.files.size() == 3);
+    CHECK(source.files[0].ends_with("main.glsl"));
+    CHECK(source.files[1].ends_with("common.glsl"));
+    CHECK(source.files[2].ends_with("lib/lighting.glsl"));
+    CHECK_EQ(source.code, std::string("#version 450\n"
+                                      "#line 2 0\n"
+                                      "#line 1 1\n"
+                                      "float common;\n"
+                                      "#line 3 0\n"
+                                      "#line 1 2\n"
+                                      "#line 2 2\n"
+                                      "#line 3 2\n"
+                                      "float lighting;\n"
+                                      "#line 4 0\n"
+                                      "void main() {}\n"));
+}
+
+TEST(shaderIncludesAreRelativeToTheIncludingFile) {
+    TemporaryDirectory directory;
+    std::string main = directory.write("shaders/main.glsl", "#include \"inc/a.glsl\"\n");
+    directory.write("shaders/inc/a.glsl", "#include \"b.glsl\"\n");
+    directory.write("shaders/inc/b.glsl", "float b;\n");
+
+    ShaderSource source = ShaderPreprocessor().preprocess(main);
+    REQUIRE(source.files.size() == 3);
+    CHECK(source.files[2].ends_with("shaders/inc/b.glsl"));
+    CHECK(source.code.find("float b;\n") != std::string::npos);
+}
+
+TEST(shaderMissingIncludeThrows) {
+    TemporaryDirectory directory;
+    std::string main = directory.write("main.glsl", "#include \"missing.glsl\"\n");
+    CHECK_THROWS(ShaderPreprocessor().preprocess(main), std::runtime_error);
+}
+
+TEST(shaderLogMapsSourceNumbersToFiles) {
+    std::vector<std::string> files{"voxel.comp", "shaders/common.glsl"};
+    CHECK_EQ(mapShaderLog("1(15) : error C0000: syntax error", files),
+             std::string("shaders/common.glsl(15) : error C0000: syntax error"));
+    CHECK_EQ(mapShaderLog("ERROR: 0:3: 'x' : undeclared identifier", files),
+             std::string("ERROR: voxel.comp:3: 'x' : undeclared identifier"));
+    // Out of range numbers and numbers inside words stay
+    CHECK_EQ(mapShaderLog("ERROR: 7:3: 'a1:2'", files), std::string("ERROR: 7:3: 'a1:2'"));
+}
+
+TEST(shaderHashIsStable) {
+    // FNV-1a 64, the on-disk program cache is keyed by these values
+    CHECK_EQ(hashShaderSource(""), 0xcbf29ce484222325ull);
+    CHECK_EQ(hashShaderSource("a"), 0xaf63dc4c8601ec8cull);
+    CHECK_EQ(hashShaderSource("foobar"), 0x85944171f73967e8ull);
+
+    TemporaryDirectory directory;
+    std::string main = directory.write("main.glsl", "#version 450\nvoid main() {}\n");
+    ShaderSource first = ShaderPreprocessor().preprocess(main);
+    ShaderSource second = ShaderPreprocessor().preprocess(main);
+    CHECK_EQ(first.hash, hashShaderSource(first.code));
+    CHECK_EQ(first.hash, second.hash);
+}
+
+TEST(shaderCacheKeepsFilesUntilCleared) {
+    TemporaryDirectory directory;
+    std::string main = directory.write("main.glsl", "float a;\n");
+
+    ShaderPreprocessor preprocessor;
+    uint64_t before = preprocessor.preprocess(main).hash;
+    directory.write("main.glsl", "float b;\n");
+    CHECK_EQ(preprocessor.preprocess(main).hash, before);
+
+    preprocessor.clear();
+    CHECK(preprocessor.preprocess(main).hash != before);
+}
@@ -0,0 +1,116 @@
+#include "Test.h"
+
+#include <bit>
+#include <random>
+
+#include "../rendering/CpuTracer.h"
+#include "../rendering/Model.h"
+#include "../rendering/SunVisibility.h"
+#include "../rendering/VoxelDag.h"
+#include "../rendering/VoxelEdit.h"
+#include "../util/ThreadPool.h"
+
+namespace {
+    int differentBits(SunVisibility const& a, SunVisibility const& b) {
+        int different = 0;
+        for (size_t i = 0; i < a.bits.size() && i < b.bits.size(); ++i) {
+            different += std::popcount(a.bits[i] ^ b.bits[i]);
+        }
+        return different;
+    }
+
+    int litBits(SunVisibility const& visibility) {
+        int lit = 0;
+        for (uint32_t word : visibility.bits) {
+            lit += std::popcount(word);
+        }
+        return lit;
+    }
+
+    // Bakes model through the dense arrays and through its DAG and returns
+    // the bits that differ
+    int denseDagDifference(Model const& model, VoxelDag const& dag, RenderSettings const& settings,
+                           ThreadPool& pool) {
+        CpuTracer dense(model, settings);
+        CpuTracer viaDag(model, settings);
+        viaDag.m_dag = &dag;
+
+        SunVisibility denseBake = bakeSunVisibility(dense, pool);
+        SunVisibility dagBake = bakeSunVisibility(viaDag, pool);
+        REQUIRE(denseBake.bits.size() == dagBake.bits.size());
+        CHECK(litBits(denseBake) > 0);
+        return differentBits(denseBake, dagBake);
+    }
+}
+
+TEST(sunBakeDagMatchesDense) {
+    ThreadPool pool;
+    for (char const* scene : {"assets/vox/monu1.vox", "assets/vox/menger.vox"}) {
+        Model model = loadVoxModel(scene);
+        VoxelDag dag = buildVoxelDag(model);
+
+        RenderSettings settings;
+        CHECK_EQ(denseDagDifference(model, dag, settings, pool), 0);
+        settings.sunDir = {0.3f, 1.0f, -0.7f};
+        CHECK_EQ(denseDagDifference(model, dag, settings, pool), 0);
+
+        // A depth that cuts shadow rays short, with a skipped cell as a
+        // single step and without skipping
+        settings.maxDDADepth = 20;
+        CHECK_EQ(denseDagDifference(model, dag, settings, pool), 0);
+        settings.enableEmptySpaceSkipping = false;
+        CHECK_EQ(denseDagDifference(model, dag, settings, pool), 0);
+    }
+}
+
+TEST(sunBakeDagRenderMatchesDense) {
+    ThreadPool pool;
+    Model model = loadVoxModel("assets/vox/monu1.vox");
+    VoxelDag dag = buildVoxelDag(model);
+
+    RenderSettings settings;
+    settings.enableGlobalIllumination = true;
+    settings.numSamples = 2;
+    CpuTracer dense(model, settings);
+    CpuTracer viaDag(model, settings);
+    viaDag.m_dag = &dag;
+    SunVisibility denseBake = bakeSunVisibility(dense, pool);
+    SunVisibility dagBake = bakeSunVisibility(viaDag, pool);
+    dense.m_sunVisibility = &denseBake;
+    viaDag.m_sunVisibility = &dagBake;
+
+    Camera camera{glm::vec3{-1, 0.5f, -1} * glm::vec3{model.size}, glm::vec3{model.size / 2u}, 160, 90};
+    Image a = dense.render(camera, 160, 90, pool);
+    Image b = viaDag.render(camera, 160, 90, pool);
+    REQUIRE(a.pixels.size() == b.pixels.size());
+    // The colors, w holds the hit depth, which the two traversals compute
+    // with different rounding
+    int different = 0;
+    for (size_t i = 0; i < a.pixels.size(); ++i) {
+        different += glm::vec3(a.pixels[i]) != glm::vec3(b.pixels[i]);
+    }
+    CHECK_EQ(different, 0);
+}
+
+TEST(sunRebakeAfterEditsMatchesFullBake) {
+    ThreadPool pool;
+    Model model = loadVoxModel("assets/vox/monu1.vox");
+    RenderSettings settings;
+    CpuTracer tracer(model, settings);
+    SunVisibility visibility = bakeSunVisibility(tracer, pool);
+
+    VoxelEditor editor(model);
+    std::mt19937 random(3);
+    for (int edit = 0; edit < 20; ++edit) {
+        glm::uvec3 min{random() % model.size.x, random() % model.size.y, random() % model.size.z};
+        glm::uvec3 max = glm::min(min + glm::uvec3(1 + random() % 8), model.size);
+        if (edit % 2) {
+            editor.fillBox(min, max, uint8_t(1 + random() % 255));
+        } else {
+            editor.clearBox(min, max);
+        }
+        rebakeSunVisibility(visibility, tracer, min, max, pool);
+    }
+
+    CHECK_EQ(differentBits(visibility, bakeSunVisibility(tracer, pool)), 0);
+}
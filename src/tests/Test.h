@@ -0,0 +1,89 @@
+#pragma once
+
+// Minimal test registry for draft_tests, see tests/Tests.cpp. A test is a
+// function registered with TEST(name), checks report the failing expression
+// and carry on, REQUIRE stops the test.
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct TestCase {
+    char const* name;
+    void (*run)();
+};
+
+std::vector<TestCase>& testRegistry();
+void reportFailure(char const* file, int line, std::string const& message);
+
+struct TestRegistration {
+    TestRegistration(char const* name, void (*run)()) { testRegistry().push_back({name, run}); }
+};
+
+// Thrown by REQUIRE to leave the current test
+struct TestAborted {};
+
+// A fresh directory under the system's temporary directory, removed with its
+// contents again at the end of the scope
+class TemporaryDirectory {
+public:
+    TemporaryDirectory();
+    ~TemporaryDirectory();
+
+    TemporaryDirectory(TemporaryDirectory const&) = delete;
+    TemporaryDirectory& operator=(TemporaryDirectory const&) = delete;
+
+    std::filesystem::path const& path() const { return m_path; }
+    // Writes contents to name inside the directory and returns its path
+    std::string write(std::string const& name, std::string const& contents) const;
+
+private:
+    std::filesystem::path m_path;
+};
+
+#define TEST(name)                                                     \
+    static void name();                                                \
+    static TestRegistration const name##Registration{#name, &name};   \
+    static void name()
+
+#define CHECK(condition)                                               \
+    do {                                                               \
+        if (!(condition)) {                                            \
+            reportFailure(__FILE__, __LINE__, "CHECK(" #condition ")"); \
+        }                                                              \
+    } while (false)
+
+#define REQUIRE(condition)                                               \
+    do {                                                                 \
+        if (!(condition)) {                                              \
+            reportFailure(__FILE__, __LINE__, "REQUIRE(" #condition ")"); \
+            throw TestAborted{};                                         \
+        }                                                                \
+    } while (false)
+
+#define CHECK_EQ(actual, expected)                                                         \
+    do {                                                                                   \
+        auto const& actualValue = (actual);                                                \
+        auto const& expectedValue = (expected);                                            \
+        if (!(actualValue == expectedValue)) {                                             \
+            std::ostringstream message;                                                    \
+            message << "CHECK_EQ(" #actual ", " #expected "): " << actualValue << " != "  \
+                    << expectedValue;                                                      \
+            reportFailure(__FILE__, __LINE__, message.str());                              \
+        }                                                                                  \
+    } while (false)
+
+// Passes if statement throws an exception of type exception
+#define CHECK_THROWS(statement, exception)                                                   \
+    do {                                                                                     \
+        bool thrown = false;                                                                 \
+        try {                                                                                \
+            statement;                                                                       \
+        } catch (exception const&) {                                                         \
+            thrown = true;                                                                   \
+        }                                                                                    \
+        if (!thrown) {                                                                       \
+            reportFailure(__FILE__, __LINE__, "CHECK_THROWS(" #statement ", " #exception ")"); \
+        }                                                                                    \
+    } while (false)
@@ -0,0 +1,79 @@
+// draft_tests: unit tests of the GL-free parts of draft. Runs every test, or
+// those whose name contains the first argument, and exits with the number of
+// failed tests. Tests that need scenes read them from assets/vox relative to
+// the working directory, ctest runs them from the repository root.
+
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "Test.h"
+
+namespace {
+    int failures = 0;
+}
+
+std::vector<TestCase>& testRegistry() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+void reportFailure(char const* file, int line, std::string const& message) {
+    std::cerr << file << ":" << line << ": " << message << std::endl;
+    ++failures;
+}
+
+TemporaryDirectory::TemporaryDirectory() {
+    static std::atomic<int> counter{0};
+    static unsigned const run = std::random_device{}();
+    m_path = std::filesystem::temp_directory_path() /
+             ("draft_tests_" + std::to_string(run) + "_" + std::to_string(counter++));
+    std::filesystem::create_directories(m_path);
+}
+
+TemporaryDirectory::~TemporaryDirectory() {
+    std::error_code error;
+    std::filesystem::remove_all(m_path, error);
+}
+
+std::string TemporaryDirectory::write(std::string const& name, std::string const& contents) const {
+    std::filesystem::path path = m_path / name;
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream file(path, std::ios::binary);
+    if (!file.write(contents.data(), std::streamsize(contents.size()))) {
+        throw std::runtime_error("Failed to write file: " + path.string());
+    }
+    return path.generic_string();
+}
+
+int main(int argc, char* argv[]) {
+    std::string filter = argc > 1 ? argv[1] : "";
+
+    int failedTests = 0;
+    int ran = 0;
+    for (TestCase const& test : testRegistry()) {
+        if (std::string(test.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        ++ran;
+
+        int failuresBefore = failures;
+        try {
+            test.run();
+        } catch (TestAborted const&) {
+        } catch (std::exception const& e) {
+            reportFailure(test.name, 0, std::string("Unexpected exception: ") + e.what());
+        }
+
+        bool passed = failures == failuresBefore;
+        failedTests += !passed;
+        std::cout << (passed ? "[ OK ] " : "[FAIL] ") << test.name << std::endl;
+    }
+
+    std::cout << ran - failedTests << "/" << ran << " tests passed" << std::endl;
+    return failedTests;
+}
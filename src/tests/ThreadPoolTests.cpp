@@ -0,0 +1,105 @@
+#include "Test.h"
+
+#include <atomic>
+#include <stdexcept>
+
+#include "../util/ThreadPool.h"
+
+TEST(threadPoolRunsEveryIndex) {
+    ThreadPool pool(4);
+    std::vector<std::atomic<int>> counts(1000);
+    pool.parallelFor(counts.size(), [&](size_t i) { ++counts[i]; });
+    for (auto const& count : counts) {
+        CHECK_EQ(count.load(), 1);
+    }
+}
+
+TEST(threadPoolNestedParallelFor) {
+    ThreadPool pool(2);
+    std::atomic<int> total{0};
+    pool.parallelFor(8, [&](size_t) { pool.parallelFor(8, [&](size_t) { ++total; }); });
+    CHECK_EQ(total.load(), 64);
+}
+
+TEST(threadPoolWaitRethrowsTaskErrors) {
+    ThreadPool pool(2);
+    std::atomic<int> finished{0};
+    for (int i = 0; i < 10; ++i) {
+        pool.submit([&finished, i] {
+            if (i == 3) {
+                throw std::runtime_error("task failed");
+            }
+            ++finished;
+        });
+    }
+    CHECK_THROWS(pool.wait(), std::runtime_error);
+    // The other tasks still ran, and the error is reported once
+    CHECK_EQ(finished.load(), 9);
+    pool.wait();
+
+    pool.submit([&finished] { ++finished; });
+    pool.wait();
+    CHECK_EQ(finished.load(), 10);
+}
+
+TEST(threadPoolParallelForRethrowsAfterAllTasks) {
+    ThreadPool pool(4);
+    for (int repeat = 0; repeat < 20; ++repeat) {
+        std::atomic<int> running{0};
+        std::atomic<int> stillRunning{0};
+        bool thrown = false;
+        try {
+            pool.parallelFor(256, [&](size_t i) {
+                ++running;
+                if (i % 7 == 0) {
+                    --running;
+                    throw std::runtime_error("body failed");
+                }
+                --running;
+            });
+        } catch (std::runtime_error const&) {
+            thrown = true;
+            stillRunning = running.load();
+        }
+        CHECK(thrown);
+        // No body is still running on the caller's stack
+        CHECK_EQ(stillRunning.load(), 0);
+    }
+
+    // parallelFor errors belong to its caller, not to wait()
+    pool.wait();
+    std::atomic<int> total{0};
+    pool.parallelFor(16, [&](size_t) { ++total; });
+    CHECK_EQ(total.load(), 16);
+}
+
+TEST(threadPoolNestedParallelForPropagates) {
+    ThreadPool pool(2);
+    CHECK_THROWS(pool.parallelFor(4, [&](size_t i) {
+        pool.parallelFor(4, [&](size_t j) {
+            if (i == 2 && j == 1) {
+                throw std::runtime_error("inner failed");
+            }
+        });
+    }), std::runtime_error);
+}
+
+TEST(threadPoolWaitFromATaskThrows) {
+    ThreadPool pool(2);
+    std::atomic<int> nested{0};
+    pool.submit([&] {
+        // Would wait for this very task, parallelFor is the way to nest
+        pool.parallelFor(4, [&](size_t) { ++nested; });
+        pool.wait();
+    });
+    CHECK_THROWS(pool.wait(), std::runtime_error);
+    CHECK_EQ(nested.load(), 4);
+
+    // Another pool's tasks can wait for this one
+    ThreadPool other(1);
+    std::atomic<int> finished{0};
+    pool.submit([&finished] { ++finished; });
+    other.submit([&pool] { pool.wait(); });
+    other.wait();
+    CHECK_EQ(finished.load(), 1);
+}
@@ -0,0 +1,52 @@
+#include "Test.h"
+
+#include <algorithm>
+
+#include "../util/Trace.h"
+
+namespace {
+    TraceHistograms::Stage const* findStage(TraceHistograms const& histograms, std::string const& name) {
+        auto const& stages = histograms.stages();
+        auto it = std::find_if(stages.begin(), stages.end(), [&](TraceHistograms::Stage const& stage) {
+            return stage.name == name;
+        });
+        return it != stages.end() ? &*it : nullptr;
+    }
+}
+
+TEST(traceHistogramsLineUpStages) {
+    clearTrace();
+    TraceHistograms histograms;
+    TraceTrack* track = traceTrack("histogram test");
+
+    // 2 ms of render in two events, 1 ms of denoise
+    recordTraceEvent("render", 0, 1000000, track);
+    recordTraceEvent("render", 1000000, 2000000, track);
+    recordTraceEvent("denoise", 2000000, 3000000, track);
+    histograms.update();
+
+    // Denoising switched off, a new stage starts
+    recordTraceEvent("render", 3000000, 7000000, track);
+    recordTraceEvent("upload", 7000000, 8000000, track);
+    histograms.update();
+
+    TraceHistograms::Stage const* render = findStage(histograms, "render");
+    TraceHistograms::Stage const* denoise = findStage(histograms, "denoise");
+    TraceHistograms::Stage const* upload = findStage(histograms, "upload");
+    REQUIRE(render && denoise && upload);
+    CHECK(render->history == std::vector<float>({2.0f, 4.0f}));
+    CHECK(denoise->history == std::vector<float>({1.0f, 0.0f}));
+    CHECK(upload->history == std::vector<float>({0.0f, 1.0f}));
+    CHECK_EQ(denoise->latestMs, 0.0f);
+    CHECK_EQ(denoise->meanMs, 0.5f);
+    CHECK_EQ(upload->meanMs, 0.5f);
+
+    // A stage that stays off decays to 0
+    for (int i = 0; i < 300; ++i) {
+        histograms.update();
+    }
+    CHECK_EQ(denoise->history.size(), size_t(240));
+    CHECK_EQ(denoise->meanMs, 0.0f);
+    CHECK_EQ(denoise->p95Ms, 0.0f);
+    clearTrace();
+}
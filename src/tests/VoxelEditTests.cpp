@@ -0,0 +1,93 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <tuple>
+
+#include "../rendering/Model.h"
+#include "../rendering/VoxelEdit.h"
+
+namespace {
+    // Lights in scan order, an updated list keeps them in another order
+    std::vector<EmissiveLight> sortedLights(LightList const& list) {
+        std::vector<EmissiveLight> lights = list.lights;
+        std::sort(lights.begin(), lights.end(), [](EmissiveLight const& a, EmissiveLight const& b) {
+            return std::tie(a.z, a.y, a.x) < std::tie(b.z, b.y, b.x);
+        });
+        return lights;
+    }
+
+    // Whether list holds the same lights with the same probabilities as a
+    // list built from scratch
+    bool matchesRebuild(LightList const& list, Model const& model) {
+        LightList rebuilt = buildLightList(model);
+        std::vector<EmissiveLight> a = sortedLights(list);
+        std::vector<EmissiveLight> b = sortedLights(rebuilt);
+        if (a.size() != b.size() || std::abs(list.totalPower - rebuilt.totalPower) > 1e-3f * rebuilt.totalPower) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].z != b[i].z ||
+                a[i].paletteIndex != b[i].paletteIndex || std::abs(a[i].pdf - b[i].pdf) > 1e-6f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // monu1 with the color of its first solid voxel and a white color 7
+    // made emissive
+    Model emissiveModel() {
+        Model model = loadVoxModel("assets/vox/monu1.vox");
+        for (size_t i = 0; i < size_t(model.size.x) * model.size.y * model.size.z; ++i) {
+            glm::uvec3 voxel{i % model.size.x, (i / model.size.x) % model.size.y,
+                             i / (size_t(model.size.x) * model.size.y)};
+            if (model.isSolid(voxel)) {
+                model.materials[model.paletteIndex(voxel)].emission = 1;
+                break;
+            }
+        }
+        model.palette[7] = 0xffffffff;
+        model.materials[7].emission = 2;
+        model.lights = buildLightList(model);
+        return model;
+    }
+}
+
+TEST(editedLightsMatchRebuild) {
+    Model model = emissiveModel();
+    VoxelEditor editor(model);
+    REQUIRE(!model.lights.empty());
+
+    std::mt19937 random(3);
+    for (int i = 0; i < 20; ++i) {
+        glm::uvec3 min{random() % model.size.x, random() % model.size.y, random() % model.size.z};
+        glm::uvec3 max = min + glm::uvec3(1 + random() % 6, 1 + random() % 6, 1 + random() % 6);
+        if (i % 3 == 0) {
+            editor.clearBox(min, max);
+        } else {
+            editor.fillBox(min, max, uint8_t(i % 2 ? 7 : 1 + random() % 255));
+        }
+        CHECK(editor.edits().lights);
+        editor.edits().clear();
+        CHECK(matchesRebuild(model.lights, model));
+    }
+}
+
+TEST(recoloredLightsMatchRebuild) {
+    Model model = emissiveModel();
+    VoxelEditor editor(model);
+    editor.fillBox(glm::uvec3(2), glm::uvec3(6), 7);
+    size_t numLights = model.lights.lights.size();
+
+    // Black lights are dropped, and found again when they light up
+    editor.setPaletteColor(7, 0x000000ff);
+    CHECK(matchesRebuild(model.lights, model));
+    CHECK(model.lights.lights.size() < numLights);
+    editor.setPaletteColor(7, 0x80ff40ff);
+    CHECK(matchesRebuild(model.lights, model));
+    CHECK_EQ(model.lights.lights.size(), numLights);
+    editor.setPaletteColor(7, 0x2040ffff);
+    CHECK(matchesRebuild(model.lights, model));
+}
@@ -0,0 +1,61 @@
+#include "AssetPipeline.h"
+
+#include <algorithm>
+
+AssetPipeline::~AssetPipeline() {
+    std::unique_lock lock(m_mutex);
+    m_decodeFinished.wait(lock, [this] { return m_decoding.empty(); });
+}
+
+void AssetPipeline::addPending(std::string const& name) {
+    std::lock_guard lock(m_mutex);
+    m_decoding.push_back(name);
+    ++m_numQueued;
+}
+
+void AssetPipeline::finishDecode(std::string const& name, std::function<void()> upload) {
+    // Notified under the lock, once the destructor sees no decodes left the
+    // pipeline may be gone
+    std::lock_guard lock(m_mutex);
+    m_decoding.erase(std::find(m_decoding.begin(), m_decoding.end(), name));
+    m_uploads.push_back({name, std::move(upload)});
+    m_decodeFinished.notify_all();
+}
+
+bool AssetPipeline::processUploads() {
+    while (true) {
+        Upload upload;
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_uploads.empty()) {
+                break;
+            }
+            upload = std::move(m_uploads.front());
+            m_uploads.pop_front();
+            // Counted before running, so a throwing upload does not keep the
+            // pipeline from ever finishing
+            ++m_numUploaded;
+        }
+
+        // Outside the lock, uploads may queue further assets
+        ScopedTrace trace(internTraceName("upload " + upload.name));
+        upload.run();
+    }
+
+    return done();
+}
+
+bool AssetPipeline::done() const {
+    std::lock_guard lock(m_mutex);
+    return m_numUploaded == m_numQueued;
+}
+
+float AssetPipeline::progress() const {
+    std::lock_guard lock(m_mutex);
+    return m_numQueued > 0 ? float(m_numUploaded) / float(m_numQueued) : 1.0f;
+}
+
+std::vector<std::string> AssetPipeline::pendingNames() const {
+    std::lock_guard lock(m_mutex);
+    return m_decoding;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "Trace.h"
+
+// Loads assets in two halves: the decode step (file reads, parsing, building
+// CPU side buffers) runs on a worker pool, the upload step runs on the thread
+// that calls processUploads(), which is the one owning the GL context. Startup
+// then takes as long as the slowest asset rather than the sum of all of them.
+class AssetPipeline {
+public:
+    explicit AssetPipeline(ThreadPool& pool) : m_pool(pool) {}
+
+    // Waits for its outstanding decodes, not for other users of the pool.
+    // Their uploads are dropped.
+    ~AssetPipeline();
+
+    AssetPipeline(AssetPipeline const&) = delete;
+    AssetPipeline& operator=(AssetPipeline const&) = delete;
+
+    // Queues decode() on the pool. Its result is handed to upload() from the
+    // next processUploads() after it finished. An exception thrown by
+    // decode() is rethrown from processUploads().
+    template<typename T>
+    void load(std::string name, std::function<T()> decode, std::function<void(T&)> upload) {
+        addPending(name);
+        char const* traceName = internTraceName("decode " + name);
+        m_pool.submit([this, name = std::move(name), traceName, decode = std::move(decode), upload = std::move(upload)]() mutable {
+            std::function<void()> finish;
+            try {
+                TRACE_SCOPE(traceName);
+                auto result = std::make_shared<T>(decode());
+                finish = [result, upload = std::move(upload)] { upload(*result); };
+            } catch (...) {
+                finish = [error = std::current_exception()] { std::rethrow_exception(error); };
+            }
+            finishDecode(name, std::move(finish));
+        });
+    }
+
+    // Runs the uploads of every asset decoded so far. Returns true once all
+    // queued assets are uploaded. Exceptions from decode or upload propagate,
+    // the remaining uploads run on the next call.
+    bool processUploads();
+
+    bool done() const;
+    // Fraction of queued assets that are uploaded, for a progress bar
+    float progress() const;
+    // Names of the assets that are still decoding
+    std::vector<std::string> pendingNames() const;
+
+private:
+    struct Upload {
+        std::string name;
+        std::function<void()> run;
+    };
+
+    void addPending(std::string const& name);
+    void finishDecode(std::string const& name, std::function<void()> upload);
+
+    ThreadPool& m_pool;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_decodeFinished;
+    std::vector<std::string> m_decoding;
+    std::deque<Upload> m_uploads;
+    size_t m_numQueued = 0;
+    size_t m_numUploaded = 0;
+};
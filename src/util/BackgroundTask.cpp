@@ -0,0 +1,72 @@
+#include "BackgroundTask.h"
+
+#include <stdexcept>
+#include <utility>
+
+BackgroundTask::~BackgroundTask() {
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+void BackgroundTask::start(std::function<void()> task) {
+    if (m_started) {
+        throw std::runtime_error("Background task started while the previous one was running");
+    }
+    m_started = true;
+
+    m_pool.submit([this, task = std::move(task)] {
+        std::exception_ptr error;
+        try {
+            task();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        // Notified under the lock, once wait() returns this may be gone
+        std::lock_guard lock(m_mutex);
+        m_finished = true;
+        m_error = error;
+        m_finishedCondition.notify_all();
+    });
+}
+
+bool BackgroundTask::poll() {
+    if (!m_started) {
+        return false;
+    }
+    {
+        std::lock_guard lock(m_mutex);
+        if (!m_finished) {
+            return false;
+        }
+    }
+    return collect();
+}
+
+bool BackgroundTask::wait() {
+    if (!m_started) {
+        return false;
+    }
+    {
+        std::unique_lock lock(m_mutex);
+        m_finishedCondition.wait(lock, [this] { return m_finished; });
+    }
+    return collect();
+}
+
+bool BackgroundTask::collect() {
+    std::exception_ptr error;
+    {
+        std::lock_guard lock(m_mutex);
+        m_finished = false;
+        error = std::exchange(m_error, nullptr);
+    }
+    m_started = false;
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+
+#include "ThreadPool.h"
+
+// One task at a time on a pool, for work that the thread owning the GL
+// context starts and then polls once per frame instead of blocking on it.
+// start(), poll() and wait() are called from that thread only.
+class BackgroundTask {
+public:
+    explicit BackgroundTask(ThreadPool& pool) : m_pool(pool) {}
+    // Waits for a running task, its error is dropped
+    ~BackgroundTask();
+
+    BackgroundTask(BackgroundTask const&) = delete;
+    BackgroundTask& operator=(BackgroundTask const&) = delete;
+
+    // Queues task on the pool. The previous one must have been collected.
+    void start(std::function<void()> task);
+
+    // Started and not collected yet
+    bool running() const { return m_started; }
+
+    // Collects a finished task: returns true once after every task, false
+    // while it runs and when none was started. Rethrows what the task threw.
+    bool poll();
+    // Blocks until the task finished and collects it like poll()
+    bool wait();
+
+private:
+    bool collect();
+
+    ThreadPool& m_pool;
+    bool m_started = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_finishedCondition;
+    bool m_finished = false;
+    std::exception_ptr m_error;
+};
@@ -0,0 +1,380 @@
+#include "Json.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+    // Deeper documents are rejected instead of exhausting the stack
+    constexpr int maxDepth = 64;
+
+    char const* typeName(JsonType type) {
+        switch (type) {
+        case JsonType::Null:
+            return "null";
+        case JsonType::Bool:
+            return "a boolean";
+        case JsonType::Number:
+            return "a number";
+        case JsonType::String:
+            return "a string";
+        case JsonType::Array:
+            return "an array";
+        case JsonType::Object:
+            return "an object";
+        }
+        return "unknown";
+    }
+
+    void expectType(JsonValue const& value, JsonType type) {
+        if (value.type != type) {
+            throw std::runtime_error(std::string("Expected ") + typeName(type) + ", got " + typeName(value.type));
+        }
+    }
+
+    void appendUtf8(std::string& out, uint32_t codePoint) {
+        if (codePoint < 0x80) {
+            out += char(codePoint);
+        } else if (codePoint < 0x800) {
+            out += char(0xc0 | (codePoint >> 6));
+            out += char(0x80 | (codePoint & 0x3f));
+        } else if (codePoint < 0x10000) {
+            out += char(0xe0 | (codePoint >> 12));
+            out += char(0x80 | ((codePoint >> 6) & 0x3f));
+            out += char(0x80 | (codePoint & 0x3f));
+        } else {
+            out += char(0xf0 | (codePoint >> 18));
+            out += char(0x80 | ((codePoint >> 12) & 0x3f));
+            out += char(0x80 | ((codePoint >> 6) & 0x3f));
+            out += char(0x80 | (codePoint & 0x3f));
+        }
+    }
+
+    class JsonParser {
+    public:
+        explicit JsonParser(std::string_view text) : m_text(text) {}
+
+        JsonValue parseDocument() {
+            JsonValue value = parseValue(0);
+            skipWhitespace();
+            if (m_offset != m_text.size()) {
+                fail("Unexpected data after the value");
+            }
+            return value;
+        }
+
+    private:
+        [[noreturn]] void fail(std::string const& what) const {
+            throw std::runtime_error("Invalid JSON at offset " + std::to_string(m_offset) + ": " + what);
+        }
+
+        void skipWhitespace() {
+            while (m_offset < m_text.size() &&
+                   (m_text[m_offset] == ' ' || m_text[m_offset] == '\t' || m_text[m_offset] == '\n' ||
+                    m_text[m_offset] == '\r')) {
+                ++m_offset;
+            }
+        }
+
+        char peek() const { return m_offset < m_text.size() ? m_text[m_offset] : '\0'; }
+
+        void expect(char c) {
+            if (peek() != c) {
+                fail(std::string("Expected '") + c + "'");
+            }
+            ++m_offset;
+        }
+
+        bool consume(std::string_view literal) {
+            if (m_text.substr(m_offset, literal.size()) != literal) {
+                return false;
+            }
+            m_offset += literal.size();
+            return true;
+        }
+
+        JsonValue parseValue(int depth) {
+            if (depth > maxDepth) {
+                fail("Nested too deeply");
+            }
+            skipWhitespace();
+            JsonValue value;
+            char c = peek();
+            if (c == '{') {
+                value.type = JsonType::Object;
+                ++m_offset;
+                skipWhitespace();
+                if (peek() == '}') {
+                    ++m_offset;
+                    return value;
+                }
+                while (true) {
+                    skipWhitespace();
+                    std::string key = parseString();
+                    skipWhitespace();
+                    expect(':');
+                    value.object.emplace_back(std::move(key), parseValue(depth + 1));
+                    skipWhitespace();
+                    if (peek() == '}') {
+                        ++m_offset;
+                        return value;
+                    }
+                    expect(',');
+                }
+            }
+            if (c == '[') {
+                value.type = JsonType::Array;
+                ++m_offset;
+                skipWhitespace();
+                if (peek() == ']') {
+                    ++m_offset;
+                    return value;
+                }
+                while (true) {
+                    value.array.push_back(parseValue(depth + 1));
+                    skipWhitespace();
+                    if (peek() == ']') {
+                        ++m_offset;
+                        return value;
+                    }
+                    expect(',');
+                }
+            }
+            if (c == '"') {
+                value.type = JsonType::String;
+                value.string = parseString();
+                return value;
+            }
+            if (consume("true")) {
+                value.type = JsonType::Bool;
+                value.boolean = true;
+                return value;
+            }
+            if (consume("false")) {
+                value.type = JsonType::Bool;
+                return value;
+            }
+            if (consume("null")) {
+                return value;
+            }
+            value.type = JsonType::Number;
+            value.number = parseNumber();
+            return value;
+        }
+
+        double parseNumber() {
+            size_t start = m_offset;
+            auto isDigit = [&] { return peek() >= '0' && peek() <= '9'; };
+            auto digits = [&] {
+                if (!isDigit()) {
+                    fail("Expected a digit");
+                }
+                while (isDigit()) {
+                    ++m_offset;
+                }
+            };
+            if (peek() == '-') {
+                ++m_offset;
+            }
+            digits();
+            if (peek() == '.') {
+                ++m_offset;
+                digits();
+            }
+            if (peek() == 'e' || peek() == 'E') {
+                ++m_offset;
+                if (peek() == '+' || peek() == '-') {
+                    ++m_offset;
+                }
+                digits();
+            }
+            double number = 0;
+            auto result = std::from_chars(m_text.data() + start, m_text.data() + m_offset, number);
+            if (result.ec != std::errc()) {
+                fail("Number out of range");
+            }
+            return number;
+        }
+
+        uint32_t parseHex4() {
+            if (m_offset + 4 > m_text.size()) {
+                fail("Truncated escape");
+            }
+            uint32_t value = 0;
+            auto result = std::from_chars(m_text.data() + m_offset, m_text.data() + m_offset + 4, value, 16);
+            if (result.ptr != m_text.data() + m_offset + 4) {
+                fail("Invalid escape");
+            }
+            m_offset += 4;
+            return value;
+        }
+
+        std::string parseString() {
+            expect('"');
+            std::string out;
+            while (true) {
+                if (m_offset >= m_text.size()) {
+                    fail("Unterminated string");
+                }
+                char c = m_text[m_offset++];
+                if (c == '"') {
+                    return out;
+                }
+                if (uint8_t(c) < 0x20) {
+                    fail("Control character in string");
+                }
+                if (c != '\\') {
+                    out += c;
+                    continue;
+                }
+                char escape = peek();
+                ++m_offset;
+                switch (escape) {
+                case '"':
+                case '\\':
+                case '/':
+                    out += escape;
+                    break;
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'n':
+                    out += '\n';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'u': {
+                    uint32_t codePoint = parseHex4();
+                    // Characters outside the BMP come as UTF-16 surrogate pairs
+                    if (codePoint >= 0xd800 && codePoint < 0xdc00 && consume("\\u")) {
+                        uint32_t low = parseHex4();
+                        if (low < 0xdc00 || low >= 0xe000) {
+                            fail("Invalid surrogate pair");
+                        }
+                        codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    appendUtf8(out, codePoint);
+                    break;
+                }
+                default:
+                    fail("Invalid escape");
+                }
+            }
+        }
+
+        std::string_view m_text;
+        size_t m_offset = 0;
+    };
+}
+
+JsonValue const& JsonValue::operator[](std::string_view key) const {
+    static JsonValue const null;
+    for (auto const& [name, value] : object) {
+        if (name == key) {
+            return value;
+        }
+    }
+    return null;
+}
+
+bool JsonValue::asBool() const {
+    expectType(*this, JsonType::Bool);
+    return boolean;
+}
+
+double JsonValue::asNumber() const {
+    expectType(*this, JsonType::Number);
+    return number;
+}
+
+int JsonValue::asInt() const {
+    expectType(*this, JsonType::Number);
+    if (number != std::floor(number) || std::abs(number) > 2147483647.0) {
+        throw std::runtime_error("Expected an integer, got " + formatJson(*this));
+    }
+    return int(number);
+}
+
+std::string const& JsonValue::asString() const {
+    expectType(*this, JsonType::String);
+    return string;
+}
+
+JsonValue parseJson(std::string_view text) {
+    return JsonParser(text).parseDocument();
+}
+
+std::string quoteJson(std::string_view text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (uint8_t(c) < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", unsigned(c));
+                out += escape;
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+std::string formatJson(JsonValue const& value) {
+    switch (value.type) {
+    case JsonType::Null:
+        return "null";
+    case JsonType::Bool:
+        return value.boolean ? "true" : "false";
+    case JsonType::Number: {
+        if (!std::isfinite(value.number)) {
+            return "null";
+        }
+        char text[32];
+        auto result = std::to_chars(text, text + sizeof(text), value.number);
+        return {text, result.ptr};
+    }
+    case JsonType::String:
+        return quoteJson(value.string);
+    case JsonType::Array: {
+        std::string out = "[";
+        for (size_t i = 0; i < value.array.size(); ++i) {
+            out += (i > 0 ? "," : "") + formatJson(value.array[i]);
+        }
+        return out + "]";
+    }
+    case JsonType::Object: {
+        std::string out = "{";
+        for (size_t i = 0; i < value.object.size(); ++i) {
+            out += (i > 0 ? "," : "") + quoteJson(value.object[i].first) + ":" + formatJson(value.object[i].second);
+        }
+        return out + "}";
+    }
+    }
+    return "null";
+}
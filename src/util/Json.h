@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+enum class JsonType {
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object,
+};
+
+// Parsed JSON document, as the render server reads its jobs. Objects keep
+// their members in order and are searched linearly, they are small.
+struct JsonValue {
+    // Null when the object has no member key
+    JsonValue const& operator[](std::string_view key) const;
+
+    bool isNull() const { return type == JsonType::Null; }
+
+    // Throw when the value has another type
+    bool asBool() const;
+    double asNumber() const;
+    int asInt() const;
+    std::string const& asString() const;
+
+    JsonType type = JsonType::Null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+};
+
+// Throws on malformed input, with the offset of the error
+JsonValue parseJson(std::string_view text);
+
+// Writes value back as compact JSON
+std::string formatJson(JsonValue const& value);
+// text as a JSON string literal, with quotes
+std::string quoteJson(std::string_view text);
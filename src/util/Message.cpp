@@ -0,0 +1,58 @@
+#include "Message.h"
+
+#include "Socket.h"
+
+namespace {
+    struct MessageHeader {
+        uint32_t type;
+        uint32_t size;
+    };
+
+    // Anything larger is a peer speaking some other protocol
+    constexpr uint32_t maxPayloadSize = 1u << 30;
+
+    MessageHeader checkedHeader(MessageHeader header) {
+        if (header.size > maxPayloadSize) {
+            throw std::runtime_error("Message too large: " + std::to_string(header.size) + " bytes");
+        }
+        return header;
+    }
+}
+
+void sendMessage(Socket const& socket, Message const& message) {
+    if (message.payload.size() > maxPayloadSize) {
+        throw std::runtime_error("Message too large: " + std::to_string(message.payload.size()) + " bytes");
+    }
+    MessageHeader header{message.type, uint32_t(message.payload.size())};
+    std::vector<uint8_t> bytes(sizeof(header) + message.payload.size());
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    std::memcpy(bytes.data() + sizeof(header), message.payload.data(), message.payload.size());
+    socket.sendAll(bytes.data(), bytes.size());
+}
+
+bool receiveMessage(Socket const& socket, Message& message) {
+    MessageHeader header;
+    if (!socket.receiveAll(&header, sizeof(header))) {
+        return false;
+    }
+    header = checkedHeader(header);
+    message.type = header.type;
+    message.payload.resize(header.size);
+    return socket.receiveAll(message.payload.data(), header.size);
+}
+
+bool takeMessage(std::vector<uint8_t>& received, Message& message) {
+    if (received.size() < sizeof(MessageHeader)) {
+        return false;
+    }
+    MessageHeader header;
+    std::memcpy(&header, received.data(), sizeof(header));
+    header = checkedHeader(header);
+    if (received.size() < sizeof(header) + header.size) {
+        return false;
+    }
+    message.type = header.type;
+    message.payload.assign(received.begin() + sizeof(header), received.begin() + sizeof(header) + header.size);
+    received.erase(received.begin(), received.begin() + sizeof(header) + header.size);
+    return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class Socket;
+
+// Length prefixed binary messages over a Socket: a type and a payload. Values
+// are written in the native layout, both ends have to be the same build.
+struct Message {
+    uint32_t type = 0;
+    std::vector<uint8_t> payload;
+};
+
+void sendMessage(Socket const& socket, Message const& message);
+// Blocks for the next message, false once the peer closed the connection
+bool receiveMessage(Socket const& socket, Message& message);
+// Takes the first message off the bytes received so far, for readers that
+// poll() several sockets. Returns false while it is incomplete.
+bool takeMessage(std::vector<uint8_t>& received, Message& message);
+
+class MessageWriter {
+public:
+    template<typename T>
+    void write(T const& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto bytes = reinterpret_cast<uint8_t const*>(&value);
+        m_bytes.insert(m_bytes.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<typename T>
+    void writeVector(std::vector<T> const& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write(uint64_t(values.size()));
+        auto bytes = reinterpret_cast<uint8_t const*>(values.data());
+        m_bytes.insert(m_bytes.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+
+    void writeString(std::string const& text) {
+        write(uint64_t(text.size()));
+        m_bytes.insert(m_bytes.end(), text.begin(), text.end());
+    }
+
+    Message finish(uint32_t type) { return {type, std::move(m_bytes)}; }
+
+private:
+    std::vector<uint8_t> m_bytes;
+};
+
+// Reads what MessageWriter wrote, in the same order. Throws when the payload
+// ends early.
+class MessageReader {
+public:
+    explicit MessageReader(Message const& message) : m_bytes(message.payload) {}
+
+    template<typename T>
+    T read() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template<typename T>
+    std::vector<T> readVector() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint64_t count = read<uint64_t>();
+        if (count > (m_bytes.size() - m_offset) / sizeof(T)) {
+            throw std::runtime_error("Truncated message");
+        }
+        std::vector<T> values(count);
+        std::memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+        return values;
+    }
+
+    std::string readString() {
+        uint64_t size = read<uint64_t>();
+        if (size > m_bytes.size() - m_offset) {
+            throw std::runtime_error("Truncated message");
+        }
+        auto text = reinterpret_cast<char const*>(take(size));
+        return {text, text + size};
+    }
+
+private:
+    uint8_t const* take(size_t size) {
+        if (size > m_bytes.size() - m_offset) {
+            throw std::runtime_error("Truncated message");
+        }
+        uint8_t const* data = m_bytes.data() + m_offset;
+        m_offset += size;
+        return data;
+    }
+
+    std::vector<uint8_t> const& m_bytes;
+    size_t m_offset = 0;
+};
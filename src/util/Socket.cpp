@@ -0,0 +1,278 @@
+#include "Socket.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+Socket Socket::connect(std::string const& address) {
+    throw std::runtime_error("Sockets are not supported on Windows: " + address);
+}
+
+Socket Socket::listen(std::string const& address, int) {
+    throw std::runtime_error("Sockets are not supported on Windows: " + address);
+}
+
+Socket Socket::accept() const {
+    return {};
+}
+
+std::string Socket::localAddress() const {
+    return {};
+}
+
+void Socket::sendAll(void const*, size_t) const {}
+
+size_t Socket::receive(void*, size_t) const {
+    return 0;
+}
+
+bool Socket::receiveAll(void*, size_t) const {
+    return false;
+}
+
+void Socket::close() {}
+#else
+namespace {
+    constexpr std::string_view unixPrefix = "unix:";
+
+#ifdef MSG_NOSIGNAL
+    // A peer that is gone is reported by send() instead of killing the process
+    constexpr int sendFlags = MSG_NOSIGNAL;
+#else
+    constexpr int sendFlags = 0;
+#endif
+
+    std::string errorText(std::string const& what) {
+        return what + ": " + std::strerror(errno);
+    }
+
+    sockaddr_un unixAddress(std::string const& address) {
+        std::string path = address.substr(unixPrefix.size());
+        sockaddr_un result{};
+        result.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(result.sun_path)) {
+            throw std::runtime_error("Invalid Unix domain socket path: " + address);
+        }
+        std::memcpy(result.sun_path, path.c_str(), path.size() + 1);
+        return result;
+    }
+
+    struct AddressInfo {
+        ~AddressInfo() {
+            if (list) {
+                freeaddrinfo(list);
+            }
+        }
+
+        addrinfo* list = nullptr;
+    };
+
+    // "host:port" or "[v6 host]:port", an empty host listens on every
+    // interface
+    void resolveTcp(std::string const& address, bool passive, AddressInfo& info) {
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::runtime_error("Expected host:port or unix:path, got: " + address);
+        }
+        std::string host = address.substr(0, colon);
+        std::string port = address.substr(colon + 1);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+            host = host.substr(1, host.size() - 2);
+        }
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+        int status = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &info.list);
+        if (status != 0) {
+            throw std::runtime_error("Failed to resolve " + address + ": " + gai_strerror(status));
+        }
+    }
+
+    int openSocket(int family) {
+        int fd = ::socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::runtime_error(errorText("Failed to create socket"));
+        }
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        return fd;
+    }
+}
+
+Socket Socket::connect(std::string const& address) {
+    if (address.starts_with(unixPrefix)) {
+        sockaddr_un target = unixAddress(address);
+        Socket socket{openSocket(AF_UNIX)};
+        if (::connect(socket.m_fd, reinterpret_cast<sockaddr*>(&target), sizeof(target)) != 0) {
+            throw std::runtime_error(errorText("Failed to connect to " + address));
+        }
+        return socket;
+    }
+
+    AddressInfo info;
+    resolveTcp(address, false, info);
+    for (addrinfo* candidate = info.list; candidate; candidate = candidate->ai_next) {
+        Socket socket{openSocket(candidate->ai_family)};
+        if (::connect(socket.m_fd, candidate->ai_addr, candidate->ai_addrlen) == 0) {
+            // Messages are written whole, there is nothing to coalesce
+            int one = 1;
+            setsockopt(socket.m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return socket;
+        }
+    }
+    throw std::runtime_error(errorText("Failed to connect to " + address));
+}
+
+Socket Socket::listen(std::string const& address, int backlog) {
+    if (address.starts_with(unixPrefix)) {
+        sockaddr_un local = unixAddress(address);
+        Socket socket{openSocket(AF_UNIX)};
+        // Left behind by a process that did not get to clean up
+        unlink(local.sun_path);
+        if (bind(socket.m_fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+            throw std::runtime_error(errorText("Failed to bind " + address));
+        }
+        socket.m_unixPath = local.sun_path;
+        if (::listen(socket.m_fd, backlog) != 0) {
+            throw std::runtime_error(errorText("Failed to listen on " + address));
+        }
+        return socket;
+    }
+
+    AddressInfo info;
+    resolveTcp(address, true, info);
+    for (addrinfo* candidate = info.list; candidate; candidate = candidate->ai_next) {
+        Socket socket{openSocket(candidate->ai_family)};
+        int one = 1;
+        setsockopt(socket.m_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(socket.m_fd, candidate->ai_addr, candidate->ai_addrlen) == 0 &&
+            ::listen(socket.m_fd, backlog) == 0) {
+            return socket;
+        }
+    }
+    throw std::runtime_error(errorText("Failed to listen on " + address));
+}
+
+Socket Socket::accept() const {
+    int fd = ::accept(m_fd, nullptr, nullptr);
+    if (fd < 0) {
+        throw std::runtime_error(errorText("Failed to accept connection"));
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    return Socket{fd};
+}
+
+std::string Socket::localAddress() const {
+    if (!m_unixPath.empty()) {
+        return std::string(unixPrefix) + m_unixPath;
+    }
+
+    sockaddr_storage local{};
+    socklen_t length = sizeof(local);
+    if (getsockname(m_fd, reinterpret_cast<sockaddr*>(&local), &length) != 0) {
+        throw std::runtime_error(errorText("Failed to get socket address"));
+    }
+    char host[NI_MAXHOST];
+    char port[NI_MAXSERV];
+    if (getnameinfo(reinterpret_cast<sockaddr*>(&local), length, host, sizeof(host), port, sizeof(port),
+                    NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        throw std::runtime_error("Failed to format socket address");
+    }
+    std::string hostText = host;
+    if (hostText.find(':') != std::string::npos) {
+        hostText = "[" + hostText + "]";
+    }
+    return hostText + ":" + port;
+}
+
+void Socket::sendAll(void const* data, size_t size) const {
+    auto bytes = static_cast<char const*>(data);
+    while (size > 0) {
+        ssize_t sent = ::send(m_fd, bytes, size, sendFlags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(errorText("Failed to send"));
+        }
+        bytes += sent;
+        size -= size_t(sent);
+    }
+}
+
+size_t Socket::receive(void* data, size_t size) const {
+    while (true) {
+        ssize_t received = ::recv(m_fd, data, size, 0);
+        if (received >= 0) {
+            return size_t(received);
+        }
+        if (errno == ECONNRESET) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            throw std::runtime_error(errorText("Failed to receive"));
+        }
+    }
+}
+
+bool Socket::receiveAll(void* data, size_t size) const {
+    auto bytes = static_cast<char*>(data);
+    while (size > 0) {
+        size_t received = receive(bytes, size);
+        if (received == 0) {
+            return false;
+        }
+        bytes += received;
+        size -= received;
+    }
+    return true;
+}
+
+void Socket::close() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+    if (!m_unixPath.empty()) {
+        unlink(m_unixPath.c_str());
+    }
+    m_fd = -1;
+    m_unixPath.clear();
+}
+#endif
+
+Socket::~Socket() {
+    close();
+}
+
+Socket::Socket(Socket&& other) noexcept {
+    *this = std::move(other);
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept {
+    if (this != &other) {
+        close();
+        m_fd = std::exchange(other.m_fd, -1);
+        m_unixPath = std::exchange(other.m_unixPath, {});
+    }
+    return *this;
+}
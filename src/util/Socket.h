@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Blocking stream socket, TCP or Unix domain. Addresses are "host:port" or
+// "unix:/path/to/socket". Move-only, closes on destruction, and a listening
+// Unix domain socket removes its file. Sockets are not implemented on
+// Windows yet, connect() and listen() throw there.
+class Socket {
+public:
+    Socket() = default;
+    ~Socket();
+
+    Socket(Socket&& other) noexcept;
+    Socket& operator=(Socket&& other) noexcept;
+    Socket(Socket const&) = delete;
+    Socket& operator=(Socket const&) = delete;
+
+    static Socket connect(std::string const& address);
+    // Port 0 picks a free port, see localAddress()
+    static Socket listen(std::string const& address, int backlog = 64);
+
+    // Waits for the next connection to a listening socket
+    Socket accept() const;
+    // The address a listening socket is bound to, in the form connect() takes
+    std::string localAddress() const;
+
+    // Throws when the peer is gone
+    void sendAll(void const* data, size_t size) const;
+    // Reads what is there, up to size bytes. Returns 0 once the peer closed
+    // the connection and throws on errors.
+    size_t receive(void* data, size_t size) const;
+    // Returns false if the peer closed the connection before size bytes came
+    bool receiveAll(void* data, size_t size) const;
+
+    bool valid() const { return m_fd >= 0; }
+    // For poll()
+    int fd() const { return m_fd; }
+    void close();
+
+private:
+    explicit Socket(int fd) : m_fd(fd) {}
+
+    int m_fd = -1;
+    // Set for listening Unix domain sockets
+    std::string m_unixPath;
+};
@@ -0,0 +1,218 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "Trace.h"
+
+namespace {
+    // Index of the queue owned by the current thread, or -1 outside the pool.
+    thread_local int currentQueue = -1;
+    thread_local ThreadPool const* currentPool = nullptr;
+
+    // The tasks running on the current thread, innermost first. A thread
+    // that helps while it waits runs tasks on top of its own.
+    struct RunningTask {
+        ThreadPool const* pool;
+        RunningTask const* outer;
+    };
+    thread_local RunningTask const* runningTask = nullptr;
+
+    bool runsTaskOf(ThreadPool const* pool) {
+        for (RunningTask const* task = runningTask; task; task = task->outer) {
+            if (task->pool == pool) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+ThreadPool::ThreadPool(unsigned numThreads) {
+    numThreads = std::max(1u, numThreads);
+
+    for (unsigned i = 0; i < numThreads; ++i) {
+        m_queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    for (unsigned i = 0; i < numThreads; ++i) {
+        m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    // Not wait(), errors nobody waited for are dropped
+    helpUntil([this] { return m_pending == 0; });
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_taskAvailable.notify_all();
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    // Tasks spawned from inside a worker stay on its own queue for locality,
+    // everything else is spread round-robin.
+    unsigned queueIndex = currentPool == this
+            ? static_cast<unsigned>(currentQueue)
+            : m_nextQueue++ % m_queues.size();
+
+    ++m_pending;
+    {
+        std::lock_guard lock(m_queues[queueIndex]->mutex);
+        m_queues[queueIndex]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lock(m_mutex);
+        ++m_queued;
+    }
+    m_taskAvailable.notify_one();
+    m_taskFinished.notify_all();
+}
+
+void ThreadPool::wait() {
+    if (runsTaskOf(this)) {
+        throw std::runtime_error("ThreadPool::wait() called from one of its own tasks");
+    }
+    helpUntil([this] { return m_pending == 0; });
+
+    std::exception_ptr error;
+    {
+        std::lock_guard lock(m_mutex);
+        error = std::exchange(m_error, nullptr);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, std::function<void(size_t)> const& body) {
+    struct State {
+        std::atomic<size_t> remaining;
+        std::atomic<bool> failed{false};
+        std::mutex mutex;
+        std::exception_ptr error;
+    };
+    auto state = std::make_shared<State>();
+    state->remaining = count;
+
+    // The tasks reference body, so this has to wait for every one of them
+    // before returning, also when one throws
+    for (size_t i = 0; i < count; ++i) {
+        submit([i, &body, state] {
+            if (!state->failed) {
+                try {
+                    body(i);
+                } catch (...) {
+                    std::lock_guard lock(state->mutex);
+                    if (!state->error) {
+                        state->error = std::current_exception();
+                    }
+                    state->failed = true;
+                }
+            }
+            --state->remaining;
+        });
+    }
+
+    helpUntil([&state] { return state->remaining == 0; });
+
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+bool ThreadPool::popTask(unsigned queueIndex, std::function<void()>& task) {
+    WorkQueue& queue = *m_queues[queueIndex];
+    std::lock_guard lock(queue.mutex);
+
+    if (queue.tasks.empty()) {
+        return false;
+    }
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    --m_queued;
+    return true;
+}
+
+bool ThreadPool::stealTask(unsigned firstQueue, std::function<void()>& task) {
+    for (unsigned i = 0; i < m_queues.size(); ++i) {
+        WorkQueue& queue = *m_queues[(firstQueue + i) % m_queues.size()];
+        std::lock_guard lock(queue.mutex);
+
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --m_queued;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::runTask(std::function<void()>& task) {
+    RunningTask running{this, runningTask};
+    runningTask = &running;
+    std::exception_ptr error;
+    try {
+        task();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    task = nullptr;
+    runningTask = running.outer;
+
+    {
+        std::lock_guard lock(m_mutex);
+        if (error && !m_error) {
+            m_error = std::move(error);
+        }
+        --m_pending;
+    }
+    m_taskFinished.notify_all();
+}
+
+void ThreadPool::helpUntil(std::function<bool()> const& done) {
+    unsigned firstQueue = currentPool == this ? static_cast<unsigned>(currentQueue) : 0;
+
+    while (!done()) {
+        std::function<void()> task;
+        if (stealTask(firstQueue, task)) {
+            runTask(task);
+            continue;
+        }
+
+        std::unique_lock lock(m_mutex);
+        m_taskFinished.wait(lock, [&] { return done() || m_queued > 0; });
+    }
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+    currentQueue = static_cast<int>(index);
+    currentPool = this;
+    setTraceThreadName("worker " + std::to_string(index));
+
+    while (true) {
+        std::function<void()> task;
+        if (popTask(index, task) || stealTask(index + 1, task)) {
+            runTask(task);
+            continue;
+        }
+
+        std::unique_lock lock(m_mutex);
+        m_taskAvailable.wait(lock, [this] { return m_stopping || m_queued > 0; });
+
+        if (m_stopping && m_queued == 0) {
+            return;
+        }
+    }
+}
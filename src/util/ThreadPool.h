@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a deque: it pops its own tasks
+// from the back and steals from the front of the other deques when it runs dry.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned numThreads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    // An exception thrown by task is kept and rethrown by the next wait()
+    void submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished, also those of other
+    // users of the pool. The calling thread helps executing queued tasks while
+    // it waits. Rethrows the first exception a submitted task threw since the
+    // last wait(). A task of this pool would wait for itself, it has to use
+    // parallelFor() instead: wait() throws when called from one.
+    void wait();
+
+    // Runs body(i) for every i in [0, count) and returns once all have finished.
+    // If a body throws, the indices that have not started yet are skipped and
+    // the first exception is rethrown once the others are done.
+    void parallelFor(size_t count, std::function<void(size_t)> const& body);
+
+    unsigned size() const { return static_cast<unsigned>(m_threads.size()); }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool popTask(unsigned queueIndex, std::function<void()>& task);
+    bool stealTask(unsigned firstQueue, std::function<void()>& task);
+    void runTask(std::function<void()>& task);
+    void helpUntil(std::function<bool()> const& done);
+    void workerLoop(unsigned index);
+
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_taskAvailable;
+    std::condition_variable m_taskFinished;
+    std::atomic<size_t> m_queued{0};
+    std::atomic<size_t> m_pending{0};
+    std::atomic<unsigned> m_nextQueue{0};
+    bool m_stopping{false};
+    // First exception of a submitted task, guarded by m_mutex
+    std::exception_ptr m_error;
+};
@@ -0,0 +1,242 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+
+struct TraceTrack {
+    uint32_t id = 0;
+    std::mutex mutex;
+    std::string name;
+    // Ring buffer, allocated on the first event
+    std::vector<TraceEvent> events;
+    // Events ever recorded, the next one goes to events[count % capacity]
+    uint64_t count = 0;
+};
+
+namespace {
+    std::atomic<bool> enabled{false};
+
+    // Tracks are never freed, so events of threads that exited still show
+    // up in the trace and pointers to tracks stay valid
+    struct TraceRegistry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<TraceTrack>> tracks;
+        std::unordered_map<std::string, TraceTrack*> namedTracks;
+        std::unordered_set<std::string> names;
+    };
+
+    TraceRegistry& registry() {
+        static TraceRegistry instance;
+        return instance;
+    }
+
+    thread_local TraceTrack* threadTrack = nullptr;
+    thread_local std::string threadName;
+
+    TraceTrack* addTrack(std::string name) {
+        TraceRegistry& reg = registry();
+        std::lock_guard lock(reg.mutex);
+        auto track = std::make_unique<TraceTrack>();
+        track->id = uint32_t(reg.tracks.size()) + 1;
+        track->name = name.empty() ? "thread " + std::to_string(track->id) : std::move(name);
+        reg.tracks.push_back(std::move(track));
+        return reg.tracks.back().get();
+    }
+
+    std::vector<TraceTrack*> allTracks() {
+        TraceRegistry& reg = registry();
+        std::lock_guard lock(reg.mutex);
+        std::vector<TraceTrack*> tracks;
+        for (auto const& track : reg.tracks) {
+            tracks.push_back(track.get());
+        }
+        return tracks;
+    }
+
+    // The last numEvents events of a track (whose mutex is held), oldest first
+    template<typename F>
+    void forEachRecent(TraceTrack const& track, uint64_t numEvents, F&& f) {
+        numEvents = std::min({numEvents, track.count, uint64_t(track.events.size())});
+        for (uint64_t i = track.count - numEvents; i < track.count; ++i) {
+            f(track.events[i % track.events.size()]);
+        }
+    }
+
+    void writeJsonString(std::ostream& out, std::string_view value) {
+        out << '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (uint8_t(c) >= 0x20) {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+}
+
+bool tracingEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void setTracingEnabled(bool value) {
+    enabled.store(value, std::memory_order_relaxed);
+}
+
+uint64_t traceNowNs() {
+    static auto const epoch = std::chrono::steady_clock::now();
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+}
+
+void setTraceThreadName(std::string name) {
+    threadName = std::move(name);
+    if (threadTrack) {
+        std::lock_guard lock(threadTrack->mutex);
+        threadTrack->name = threadName;
+    }
+}
+
+TraceTrack* traceTrack(std::string const& name) {
+    {
+        TraceRegistry& reg = registry();
+        std::lock_guard lock(reg.mutex);
+        if (auto it = reg.namedTracks.find(name); it != reg.namedTracks.end()) {
+            return it->second;
+        }
+    }
+
+    TraceTrack* track = addTrack(name);
+    TraceRegistry& reg = registry();
+    std::lock_guard lock(reg.mutex);
+    // Lost races leave an unused track behind, which exports as nothing
+    return reg.namedTracks.emplace(name, track).first->second;
+}
+
+void recordTraceEvent(char const* name, uint64_t startNs, uint64_t endNs, TraceTrack* track) {
+    if (!track) {
+        if (!threadTrack) {
+            threadTrack = addTrack(threadName);
+        }
+        track = threadTrack;
+    }
+
+    // Only contended while a trace is exported or the histograms update
+    std::lock_guard lock(track->mutex);
+    if (track->events.empty()) {
+        track->events.resize(traceBufferCapacity);
+    }
+    track->events[track->count % track->events.size()] = {name, startNs, endNs};
+    ++track->count;
+}
+
+char const* internTraceName(std::string_view name) {
+    TraceRegistry& reg = registry();
+    std::lock_guard lock(reg.mutex);
+    return reg.names.emplace(name).first->c_str();
+}
+
+void clearTrace() {
+    for (TraceTrack* track : allTracks()) {
+        std::lock_guard lock(track->mutex);
+        track->events = {};
+        track->count = 0;
+    }
+}
+
+void writeChromeTrace(std::string const& filename) {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open " + filename);
+    }
+
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    auto separator = [&] {
+        out << (first ? "" : ",\n");
+        first = false;
+    };
+
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    for (TraceTrack* track : allTracks()) {
+        std::lock_guard lock(track->mutex);
+        if (track->count == 0) {
+            continue;
+        }
+
+        separator();
+        out << R"({"name": "thread_name", "ph": "M", "pid": 1, "tid": )" << track->id << R"(, "args": {"name": )";
+        writeJsonString(out, track->name);
+        out << "}}";
+
+        // Timestamps in microseconds
+        forEachRecent(*track, track->count, [&](TraceEvent const& event) {
+            separator();
+            out << R"({"name": )";
+            writeJsonString(out, event.name);
+            out << R"(, "ph": "X", "pid": 1, "tid": )" << track->id
+                << R"(, "ts": )" << double(event.startNs) / 1000.0
+                << R"(, "dur": )" << double(event.endNs - event.startNs) / 1000.0 << "}";
+        });
+    }
+    out << "\n]}\n";
+
+    if (!out) {
+        throw std::runtime_error("Failed to write " + filename);
+    }
+}
+
+void TraceHistograms::update() {
+    std::map<std::string_view, double> sums;
+
+    for (TraceTrack* track : allTracks()) {
+        std::lock_guard lock(track->mutex);
+        uint64_t& seen = m_seen[track];
+        // After clearTrace() the count starts over
+        seen = std::min(seen, track->count);
+        forEachRecent(*track, track->count - seen, [&](TraceEvent const& event) {
+            sums[event.name] += double(event.endNs - event.startNs) / 1e6;
+        });
+        seen = track->count;
+    }
+
+    // A new stage took no time in the updates before, so that the histories
+    // of all stages line up
+    size_t historySize = m_stages.empty() ? 0 : m_stages.front().history.size();
+    for (auto const& sum : sums) {
+        std::string_view name = sum.first;
+        auto it = std::lower_bound(m_stages.begin(), m_stages.end(), name,
+                                   [](Stage const& stage, std::string_view key) { return stage.name < key; });
+        if (it == m_stages.end() || it->name != name) {
+            m_stages.insert(it, Stage{std::string(name), std::vector<float>(historySize, 0.0f), 0, 0, 0});
+        }
+    }
+
+    // Stages without events this update, e.g. one that was switched off,
+    // took no time
+    for (Stage& stage : m_stages) {
+        auto it = sums.find(stage.name);
+        double ms = it != sums.end() ? it->second : 0.0;
+        stage.latestMs = float(ms);
+        stage.history.push_back(float(ms));
+        if (stage.history.size() > m_historyLength) {
+            stage.history.erase(stage.history.begin());
+        }
+
+        std::vector<float> sorted = stage.history;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0;
+        for (float value : sorted) {
+            total += value;
+        }
+        stage.meanMs = float(total / double(sorted.size()));
+        stage.p95Ms = sorted[std::min(sorted.size() - 1, sorted.size() * 95 / 100)];
+    }
+}
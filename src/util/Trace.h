@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Scoped timers for finding out where the time of a frame or a headless run
+// goes. Every thread records into its own ring buffer of the most recent
+// events, which writeChromeTrace() exports for chrome://tracing or
+// ui.perfetto.dev. While tracing is disabled a scope costs one relaxed load.
+//
+// Event names are not copied and must outlive the trace: use string literals,
+// or internTraceName() for names built at runtime.
+
+// Events kept per thread before the oldest are overwritten
+constexpr size_t traceBufferCapacity = 1 << 16;
+
+struct TraceEvent {
+    char const* name;
+    uint64_t startNs;
+    uint64_t endNs;
+};
+
+// A timeline in the trace. Threads get one on their first event, other
+// sources of events such as the GPU get a named one from traceTrack().
+struct TraceTrack;
+
+bool tracingEnabled();
+void setTracingEnabled(bool enabled);
+
+// Nanoseconds since the first call, the time base of all events
+uint64_t traceNowNs();
+
+// Names the current thread's timeline in exported traces
+void setTraceThreadName(std::string name);
+
+// The track with the given name, created on first use
+TraceTrack* traceTrack(std::string const& name);
+
+// Records an event measured by other means, e.g. a GPU timer query. The
+// current thread's track is used when track is null.
+void recordTraceEvent(char const* name, uint64_t startNs, uint64_t endNs, TraceTrack* track = nullptr);
+
+// Returns a pointer to a copy of name that lives until the process exits
+char const* internTraceName(std::string_view name);
+
+// Drops all recorded events
+void clearTrace();
+
+// Writes the recorded events as Chrome trace event JSON
+void writeChromeTrace(std::string const& filename);
+
+class ScopedTrace {
+public:
+    explicit ScopedTrace(char const* name) {
+        if (tracingEnabled()) {
+            m_name = name;
+            m_startNs = traceNowNs();
+        }
+    }
+
+    ~ScopedTrace() { end(); }
+
+    // Ends the event before the end of the scope
+    void end() {
+        if (m_name) {
+            recordTraceEvent(m_name, m_startNs, traceNowNs());
+            m_name = nullptr;
+        }
+    }
+
+    ScopedTrace(ScopedTrace const&) = delete;
+    ScopedTrace& operator=(ScopedTrace const&) = delete;
+
+private:
+    char const* m_name = nullptr;
+    uint64_t m_startNs = 0;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+// Times the rest of the enclosing block
+#define TRACE_SCOPE(name) ScopedTrace TRACE_CONCAT(traceScope, __LINE__)(name)
+
+// Rolling history of the time spent per stage (event name), for plotting.
+// Every update() adds one sample per stage: the summed duration of the
+// stage's events recorded since the previous update, so calling it once a
+// frame gives per-frame totals even for stages split over many events. A
+// stage without events in an update gets a 0 sample, the histories of all
+// stages line up.
+class TraceHistograms {
+public:
+    struct Stage {
+        std::string name;
+        // Milliseconds, oldest first
+        std::vector<float> history;
+        float latestMs = 0;
+        float meanMs = 0;
+        float p95Ms = 0;
+    };
+
+    explicit TraceHistograms(size_t historyLength = 240) : m_historyLength(historyLength) {}
+
+    void update();
+
+    // Sorted by name
+    std::vector<Stage> const& stages() const { return m_stages; }
+
+private:
+    size_t m_historyLength;
+    std::vector<Stage> m_stages;
+    // Total number of events of each track already accounted for
+    std::unordered_map<TraceTrack const*, uint64_t> m_seen;
+};